@@ -0,0 +1,275 @@
+/**
+ * @brief Measures how the write throughput scales with the number of threads.
+ * Every thread upserts batches of random keys into the main collection,
+ * either as standalone atomic batches, or wrapped into transactions.
+ * Separately, threads increment counters from a small set of hot keys,
+ * to compare optimistic and pessimistic concurrency control under contention.
+ */
+#include <vector>    //
+#include <thread>    // `std::thread::hardware_concurrency`
+#include <random>    // `std::mt19937_64`
+#include <string>    // `std::string`
+#include <cstring>   // `std::memset`
+#include <algorithm> // `std::sort`
+
+#include <fmt/printf.h> // `fmt::print`
+#include <benchmark/benchmark.h>
+
+#include <argparse/argparse.hpp>
+
+#include <ustore/ustore.hpp>
+
+namespace bm = benchmark;
+using namespace unum::ustore;
+
+struct settings_t {
+    std::size_t threads_count;
+    std::size_t min_seconds;
+    std::size_t batch_size;
+    std::size_t value_size;
+    std::size_t hot_keys;
+    std::string config;
+};
+
+static settings_t settings;
+static database_t db;
+
+void parse_args(int argc, char* argv[], settings_t& settings) {
+    argparse::ArgumentParser program(argv[0]);
+    program.add_argument("-t", "--threads")
+        .default_value(std::to_string(std::thread::hardware_concurrency()))
+        .help("Maximum threads count");
+    program.add_argument("-n", "--min_seconds").default_value("10").help("Minimal seconds");
+    program.add_argument("-b", "--batch_size").default_value("64").help("Batch size");
+    program.add_argument("-v", "--value_size").default_value("100").help("Value size in bytes");
+    program.add_argument("-k", "--hot_keys").default_value("64").help("Number of contended counters");
+    program.add_argument("-c", "--config").default_value("").help("DBMS config in JSON, in-memory if empty");
+
+    program.parse_known_args(argc, argv);
+
+    settings.threads_count = std::stoi(program.get("threads"));
+    settings.min_seconds = std::stoi(program.get("min_seconds"));
+    settings.batch_size = std::stoi(program.get("batch_size"));
+    settings.value_size = std::stoi(program.get("value_size"));
+    settings.hot_keys = std::stoi(program.get("hot_keys"));
+    settings.config = program.get("config");
+
+    if (settings.threads_count == 0) {
+        fmt::print("-threads: Zero threads count specified\n");
+        exit(1);
+    }
+    if (settings.hot_keys == 0) {
+        fmt::print("-hot_keys: Zero counters specified\n");
+        exit(1);
+    }
+}
+
+static void upsert(bm::State& state, bool transactional) {
+
+    status_t status;
+    arena_t arena(db);
+
+    // Threads write into disjoint key ranges, so transactions never conflict
+    std::mt19937_64 generator(state.thread_index());
+    ustore_key_t const thread_prefix = static_cast<ustore_key_t>(state.thread_index()) << 48;
+
+    auto const batch_size = static_cast<ustore_size_t>(state.range(0));
+    std::vector<ustore_key_t> batch_keys(batch_size);
+    std::vector<byte_t> value(settings.value_size);
+    std::memset(value.data(), 'x', value.size());
+    value_view_t value_view {value.data(), value.size()};
+
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.tasks_count = batch_size;
+    write.keys = batch_keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.lengths = value_view.member_length();
+    write.values = value_view.member_ptr();
+
+    ustore_transaction_t transaction = nullptr;
+    ustore_transaction_init_t transaction_init {};
+    transaction_init.db = db;
+    transaction_init.error = status.member_ptr();
+    transaction_init.transaction = &transaction;
+    ustore_transaction_commit_t transaction_commit {};
+    transaction_commit.db = db;
+    transaction_commit.error = status.member_ptr();
+
+    std::size_t entries_success = 0;
+    std::size_t batches_success = 0;
+    for (auto _ : state) {
+        for (auto& key : batch_keys)
+            key = thread_prefix | static_cast<ustore_key_t>(generator() >> 16);
+
+        if (transactional) {
+            ustore_transaction_init(&transaction_init);
+            status.throw_unhandled();
+            write.transaction = transaction;
+        }
+
+        ustore_write(&write);
+        status.throw_unhandled();
+
+        if (transactional) {
+            transaction_commit.transaction = transaction;
+            ustore_transaction_commit(&transaction_commit);
+            if (!status) {
+                status.release_exception();
+                continue;
+            }
+        }
+        entries_success += batch_size;
+        batches_success += 1;
+    }
+
+    ustore_transaction_free(transaction);
+
+    // These will be summed across threads:
+    state.counters["entries/s"] = bm::Counter(entries_success, bm::Counter::kIsRate);
+    state.counters["batches/s"] = bm::Counter(batches_success, bm::Counter::kIsRate);
+    state.counters["bytes/s"] = bm::Counter(entries_success * settings.value_size, bm::Counter::kIsRate);
+}
+
+/**
+ * @brief Every transaction reads a few counters for update, increments and writes them back.
+ * With optimistic concurrency control conflicts surface on commit, with pessimistic one -
+ * as lock timeouts or deadlocks on first access. Either way the transaction is retried.
+ */
+static void contended_increment(bm::State& state) {
+
+    status_t status;
+    arena_t arena(db);
+    std::mt19937_64 generator(state.thread_index());
+
+    // Locking keys in the same order everywhere rules out most deadlocks
+    auto const batch_size = std::min<std::size_t>(state.range(0), settings.hot_keys);
+    std::vector<ustore_key_t> batch_keys(batch_size);
+    std::vector<std::uint64_t> counters(batch_size);
+    std::vector<ustore_length_t> offsets(batch_size);
+    for (std::size_t i = 0; i != batch_size; ++i)
+        offsets[i] = static_cast<ustore_length_t>(i * sizeof(std::uint64_t));
+    ustore_length_t const counter_length = sizeof(std::uint64_t);
+    ustore_bytes_cptr_t counters_begin = reinterpret_cast<ustore_bytes_cptr_t>(counters.data());
+
+    ustore_transaction_t transaction = nullptr;
+    ustore_transaction_init_t transaction_init {};
+    transaction_init.db = db;
+    transaction_init.error = status.member_ptr();
+    transaction_init.transaction = &transaction;
+    ustore_transaction_commit_t transaction_commit {};
+    transaction_commit.db = db;
+    transaction_commit.error = status.member_ptr();
+
+    ustore_length_t* found_offsets = nullptr;
+    ustore_length_t* found_lengths = nullptr;
+    ustore_byte_t* found_values = nullptr;
+    ustore_read_t read {};
+    read.db = db;
+    read.error = status.member_ptr();
+    read.arena = arena.member_ptr();
+    read.keys = batch_keys.data();
+    read.keys_stride = sizeof(ustore_key_t);
+    read.offsets = &found_offsets;
+    read.lengths = &found_lengths;
+    read.values = &found_values;
+
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.keys = batch_keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.offsets = offsets.data();
+    write.offsets_stride = sizeof(ustore_length_t);
+    write.lengths = &counter_length;
+    write.values = &counters_begin;
+
+    std::size_t commits = 0;
+    std::size_t aborts = 0;
+    for (auto _ : state) {
+        for (auto& key : batch_keys)
+            key = static_cast<ustore_key_t>(generator() % settings.hot_keys);
+        std::sort(batch_keys.begin(), batch_keys.end());
+        auto unique_keys = std::unique(batch_keys.begin(), batch_keys.end()) - batch_keys.begin();
+        read.tasks_count = write.tasks_count = static_cast<ustore_size_t>(unique_keys);
+
+        ustore_transaction_init(&transaction_init);
+        status.throw_unhandled();
+        read.transaction = write.transaction = transaction_commit.transaction = transaction;
+
+        ustore_read(&read);
+        if (status) {
+            for (std::ptrdiff_t i = 0; i != unique_keys; ++i) {
+                counters[i] = 0;
+                if (found_lengths[i] == sizeof(std::uint64_t))
+                    std::memcpy(&counters[i], found_values + found_offsets[i], sizeof(std::uint64_t));
+                counters[i] += 1;
+            }
+            ustore_write(&write);
+        }
+        if (status)
+            ustore_transaction_commit(&transaction_commit);
+        if (!status) {
+            status.release_exception();
+            aborts += 1;
+            continue;
+        }
+        commits += 1;
+    }
+
+    ustore_transaction_free(transaction);
+
+    // These will be summed across threads:
+    state.counters["commits/s"] = bm::Counter(commits, bm::Counter::kIsRate);
+    state.counters["aborts/s"] = bm::Counter(aborts, bm::Counter::kIsRate);
+}
+
+static void batch_upsert(bm::State& state) {
+    return upsert(state, false);
+}
+
+static void transactional_upsert(bm::State& state) {
+    return upsert(state, true);
+}
+
+int main(int argc, char** argv) {
+    bm::Initialize(&argc, argv);
+    parse_args(argc, argv, settings);
+
+#if defined(USTORE_DEBUG)
+    settings.threads_count = 1;
+    settings.min_seconds = 1;
+#endif
+
+    db.open(settings.config.c_str()).throw_unhandled();
+
+    bm::RegisterBenchmark("batch_upsert", &batch_upsert) //
+        ->MinTime(settings.min_seconds)
+        ->UseRealTime()
+        ->ThreadRange(1, settings.threads_count)
+        ->Arg(settings.batch_size);
+
+    if (ustore_supports_transactions_k)
+        bm::RegisterBenchmark("transactional_upsert", &transactional_upsert) //
+            ->MinTime(settings.min_seconds)
+            ->UseRealTime()
+            ->ThreadRange(1, settings.threads_count)
+            ->Arg(settings.batch_size);
+
+    if (ustore_supports_transactions_k)
+        bm::RegisterBenchmark("contended_increment", &contended_increment) //
+            ->MinTime(settings.min_seconds)
+            ->UseRealTime()
+            ->ThreadRange(1, settings.threads_count)
+            ->Arg(settings.batch_size);
+
+    bm::RunSpecifiedBenchmarks();
+    bm::Shutdown();
+
+    // Clear DB after benchmark
+    db.clear().throw_unhandled();
+    return 0;
+}
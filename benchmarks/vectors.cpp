@@ -0,0 +1,281 @@
+/**
+ * @brief Measures the construction speed of the vectors index, and the trade-off
+ * between recall and latency of its search for different expansion factors.
+ * Vectors are either random, or rows of a binary matrix of `float`-s in a `--dataset` file.
+ * Ground truth is computed by an exact search over the original vectors.
+ * Batched searches by other metrics measure the throughput of full scans.
+ */
+#include <vector>    //
+#include <random>    // `std::mt19937`
+#include <string>    // `std::string`
+#include <cmath>     // `std::sqrt`
+#include <fstream>   // `std::ifstream`
+#include <algorithm> // `std::partial_sort`
+#include <numeric>   // `std::iota`
+#include <limits>    // `std::numeric_limits`
+
+#include <fmt/printf.h> // `fmt::print`
+#include <benchmark/benchmark.h>
+
+#include <argparse/argparse.hpp>
+
+#include <ustore/ustore.hpp>
+
+namespace bm = benchmark;
+using namespace unum::ustore;
+
+struct settings_t {
+    std::size_t count;
+    std::size_t dimensions;
+    std::size_t queries;
+    std::size_t neighbors;
+    std::size_t batch_size;
+    std::size_t connectivity;
+    std::size_t expansion_add;
+    std::string dataset;
+    std::string config;
+};
+
+static settings_t settings;
+static database_t db;
+static std::vector<float> vectors;
+static std::vector<float> queries;
+static std::vector<ustore_key_t> exact_neighbors;
+
+void parse_args(int argc, char* argv[], settings_t& settings) {
+    argparse::ArgumentParser program(argv[0]);
+    program.add_argument("-n", "--count").default_value("100000").help("Number of random vectors");
+    program.add_argument("-d", "--dimensions").default_value("96").help("Dimensions of every vector");
+    program.add_argument("-q", "--queries").default_value("1000").help("Number of queries");
+    program.add_argument("-k", "--neighbors").default_value("10").help("Number of neighbors to search for");
+    program.add_argument("-b", "--batch_size").default_value("1024").help("Vectors added per write");
+    program.add_argument("-m", "--connectivity").default_value("16").help("Max neighbors per node in the graph");
+    program.add_argument("-e", "--expansion_add").default_value("128").help("Candidates considered on insertion");
+    program.add_argument("-f", "--dataset").default_value("").help("Binary matrix of floats, random if empty");
+    program.add_argument("-c", "--config").default_value("").help("DBMS config in JSON, in-memory if empty");
+
+    program.parse_known_args(argc, argv);
+
+    settings.count = std::stoul(program.get("count"));
+    settings.dimensions = std::stoul(program.get("dimensions"));
+    settings.queries = std::stoul(program.get("queries"));
+    settings.neighbors = std::stoul(program.get("neighbors"));
+    settings.batch_size = std::stoul(program.get("batch_size"));
+    settings.connectivity = std::stoul(program.get("connectivity"));
+    settings.expansion_add = std::stoul(program.get("expansion_add"));
+    settings.dataset = program.get("dataset");
+    settings.config = program.get("config");
+
+    if (settings.dimensions == 0 || settings.batch_size == 0) {
+        fmt::print("-dimensions, -batch_size: Must be positive\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief Scalars are kept within [-1, 1], as they are later quantized into 8-bit integers.
+ */
+void load_vectors() {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    if (settings.dataset.empty()) {
+        vectors.resize(settings.count * settings.dimensions);
+        for (float& scalar : vectors)
+            scalar = distribution(generator);
+    }
+    else {
+        std::ifstream file(settings.dataset, std::ios::binary | std::ios::ate);
+        std::size_t rows = static_cast<std::size_t>(file.tellg()) / (sizeof(float) * settings.dimensions);
+        settings.count = std::min(settings.count, rows);
+        vectors.resize(settings.count * settings.dimensions);
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(vectors.data()), vectors.size() * sizeof(float));
+    }
+
+    // Queries are the perturbed copies of random vectors
+    std::uniform_int_distribution<std::size_t> rows(0, settings.count - 1);
+    queries.resize(settings.queries * settings.dimensions);
+    for (std::size_t query_idx = 0; query_idx != settings.queries; ++query_idx) {
+        float const* row = &vectors[rows(generator) * settings.dimensions];
+        for (std::size_t i = 0; i != settings.dimensions; ++i)
+            queries[query_idx * settings.dimensions + i] = row[i] + distribution(generator) * 0.1f;
+    }
+}
+
+float cos(float const* a, float const* b) {
+    float ab = 0, aa = 0, bb = 0;
+    for (std::size_t i = 0; i != settings.dimensions; ++i)
+        ab += a[i] * b[i], aa += a[i] * a[i], bb += b[i] * b[i];
+    return ab / std::sqrt(aa * bb);
+}
+
+void search_exactly() {
+    std::vector<ustore_key_t> keys(settings.count);
+    std::vector<float> similarities(settings.count);
+    exact_neighbors.resize(settings.queries * settings.neighbors);
+    for (std::size_t query_idx = 0; query_idx != settings.queries; ++query_idx) {
+        float const* query = &queries[query_idx * settings.dimensions];
+        for (std::size_t row = 0; row != settings.count; ++row)
+            similarities[row] = cos(query, &vectors[row * settings.dimensions]);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::partial_sort(keys.begin(), keys.begin() + settings.neighbors, keys.end(), [&](auto a, auto b) {
+            return similarities[a] > similarities[b];
+        });
+        std::copy_n(keys.begin(), settings.neighbors, &exact_neighbors[query_idx * settings.neighbors]);
+    }
+}
+
+static void construct(bm::State& state) {
+
+    status_t status;
+    arena_t arena(db);
+    std::vector<ustore_key_t> keys(settings.batch_size);
+
+    ustore_vectors_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.dimensions = static_cast<ustore_length_t>(settings.dimensions);
+    write.keys = keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.vectors_stride = sizeof(float) * settings.dimensions;
+    write.metric = ustore_vector_metric_cos_k;
+    write.connectivity = static_cast<ustore_length_t>(settings.connectivity);
+    write.expansion_add = static_cast<ustore_length_t>(settings.expansion_add);
+
+    for (auto _ : state) {
+        for (std::size_t batch_begin = 0; batch_begin < settings.count; batch_begin += settings.batch_size) {
+            std::size_t batch_size = std::min(settings.batch_size, settings.count - batch_begin);
+            std::iota(keys.begin(), keys.begin() + batch_size, static_cast<ustore_key_t>(batch_begin));
+            auto batch_begin_ptr = reinterpret_cast<ustore_bytes_cptr_t>(&vectors[batch_begin * settings.dimensions]);
+            write.vectors_starts = &batch_begin_ptr;
+            write.tasks_count = batch_size;
+            ustore_vectors_write(&write);
+            status.throw_unhandled();
+        }
+    }
+
+    state.counters["vectors/s"] = bm::Counter(state.iterations() * settings.count, bm::Counter::kIsRate);
+}
+
+/**
+ * @brief Searches for one query at a time, to measure the latency,
+ * given the expansion factor as the benchmark argument.
+ */
+static void search(bm::State& state) {
+
+    status_t status;
+    arena_t arena(db);
+    ustore_length_t limit = static_cast<ustore_length_t>(settings.neighbors);
+    ustore_length_t* found_counts = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_bytes_cptr_t query_begin = nullptr;
+
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.error = status.member_ptr();
+    search.arena = arena.member_ptr();
+    search.tasks_count = 1;
+    search.dimensions = static_cast<ustore_length_t>(settings.dimensions);
+    search.metric = ustore_vector_metric_cos_k;
+    search.metric_threshold = -1;
+    search.expansion_search = static_cast<ustore_length_t>(state.range(0));
+    search.match_counts_limits = &limit;
+    search.queries_starts = &query_begin;
+    search.match_counts = &found_counts;
+    search.match_keys = &found_keys;
+
+    std::size_t query_idx = 0;
+    std::size_t recalled = 0;
+    for (auto _ : state) {
+        query_begin = reinterpret_cast<ustore_bytes_cptr_t>(&queries[query_idx * settings.dimensions]);
+        ustore_vectors_search(&search);
+        status.throw_unhandled();
+
+        auto exact_begin = exact_neighbors.begin() + query_idx * settings.neighbors;
+        for (std::size_t i = 0; i != found_counts[0]; ++i)
+            recalled += std::count(exact_begin, exact_begin + settings.neighbors, found_keys[i]);
+        query_idx = (query_idx + 1) % settings.queries;
+    }
+
+    state.counters["recall"] = static_cast<double>(recalled) / (state.iterations() * settings.neighbors);
+    state.counters["queries/s"] = bm::Counter(state.iterations(), bm::Counter::kIsRate);
+}
+
+/**
+ * @brief Searches for batches of queries with a metric, that the graph wasn't built for,
+ * given the batch size as the benchmark argument. All the queries of a batch share a
+ * single scan of the collection, so the throughput must grow with the batch size.
+ */
+static void scan(bm::State& state) {
+
+    status_t status;
+    arena_t arena(db);
+    std::size_t batch_size = std::min<std::size_t>(state.range(0), settings.queries);
+    std::vector<ustore_length_t> limits(batch_size, static_cast<ustore_length_t>(settings.neighbors));
+    ustore_length_t* found_counts = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_bytes_cptr_t queries_begin = nullptr;
+
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.error = status.member_ptr();
+    search.arena = arena.member_ptr();
+    search.tasks_count = batch_size;
+    search.dimensions = static_cast<ustore_length_t>(settings.dimensions);
+    search.metric = ustore_vector_metric_dot_k;
+    search.metric_threshold = std::numeric_limits<float>::lowest();
+    search.match_counts_limits = limits.data();
+    search.match_counts_limits_stride = sizeof(ustore_length_t);
+    search.queries_starts = &queries_begin;
+    search.queries_stride = sizeof(float) * settings.dimensions;
+    search.match_counts = &found_counts;
+    search.match_keys = &found_keys;
+
+    std::size_t batch_begin = 0;
+    for (auto _ : state) {
+        queries_begin = reinterpret_cast<ustore_bytes_cptr_t>(&queries[batch_begin * settings.dimensions]);
+        ustore_vectors_search(&search);
+        status.throw_unhandled();
+        batch_begin = (batch_begin + batch_size) % (settings.queries - batch_size + 1);
+    }
+
+    state.counters["queries/s"] = bm::Counter(state.iterations() * batch_size, bm::Counter::kIsRate);
+}
+
+int main(int argc, char** argv) {
+    bm::Initialize(&argc, argv);
+    parse_args(argc, argv, settings);
+
+#if defined(USTORE_DEBUG)
+    settings.count = std::min<std::size_t>(settings.count, 10000);
+    settings.queries = std::min<std::size_t>(settings.queries, 100);
+#endif
+
+    db.open(settings.config.c_str()).throw_unhandled();
+    load_vectors();
+    if (!settings.count || !settings.queries || settings.neighbors > settings.count) {
+        fmt::print("-count, -queries, -neighbors: Nothing to search for\n");
+        exit(1);
+    }
+    search_exactly();
+
+    bm::RegisterBenchmark("construct", &construct)->Iterations(1)->UseRealTime()->Unit(bm::kMillisecond);
+    bm::RegisterBenchmark("search", &search) //
+        ->UseRealTime()
+        ->Unit(bm::kMicrosecond)
+        ->RangeMultiplier(2)
+        ->Range(16, 512);
+    bm::RegisterBenchmark("scan", &scan) //
+        ->UseRealTime()
+        ->Unit(bm::kMillisecond)
+        ->RangeMultiplier(4)
+        ->Range(1, 256);
+
+    bm::RunSpecifiedBenchmarks();
+    bm::Shutdown();
+
+    // Clear DB after benchmark
+    db.clear().throw_unhandled();
+    return 0;
+}
@@ -112,7 +112,8 @@ typedef struct ustore_write_t {
      * @brief Write options.
      *
      * Possible values:
-     * - `::ustore_option_write_flush_k`: Forces to persist non-transactional writes on disk before returning.
+     * - `::ustore_option_write_flush_k`: Forces to persist non-transactional writes on disk before returning,
+     *   or before invoking the `callback`, if one is set.
      * - `::ustore_option_transaction_dont_watch_k`: Disables collision-detection for transactional writes.
      * - `::ustore_option_dont_discard_memory_k`: Won't reset the `arena` before the operation begins.
      */
@@ -225,6 +226,23 @@ typedef struct ustore_write_t {
     ustore_size_t values_stride;
 
     /// @}
+    /// @name Completion
+    /// @{
+
+    /**
+     * @brief Optional function, invoked exactly once, when the write is complete.
+     *
+     * If set, `ustore_write()` may return before a `::ustore_option_write_flush_k` write
+     * is persisted, and the `callback` will be invoked, once it is, possibly from another thread.
+     * The inputs can be reused as soon as `ustore_write()` returns, but the `error`
+     * must stay valid until the `callback`, as it will be set before the `callback` is invoked.
+     * Engines, that don't support asynchronous completion, invoke it before returning.
+     */
+    ustore_callback_t callback;
+    /** @brief The argument, passed to the `callback`. */
+    ustore_callback_payload_t callback_payload;
+
+    /// @}
 
 } ustore_write_t;
 
@@ -398,8 +416,9 @@ void ustore_read(ustore_read_t*);
  *
  * Retrieves the following (upto) `count_limits[i]` keys starting
  * from `start_key[i]` or the smallest following key in each collection.
- * Values are not exported, for that - follow up with a `ustore_read()` or
- * a higher-level interface for Graphs, Docs or other modalities.
+ * Values are only exported on request, via `ustore_scan_t::values`.
+ * For partial reads - follow up with a `ustore_read()` or a higher-level
+ * interface for Graphs, Docs or other modalities.
  *
  * ## Scans vs Iterators
  *
@@ -539,6 +558,29 @@ typedef struct ustore_scan_t {
      * runtime- or library-specific implementations.
      */
     ustore_key_t** keys;
+    /**
+     * @brief Output offsets of values in the `values` tape.
+     *
+     * Will contain a pointer to an array of integer offsets, one for every
+     * exported key in the `keys` tape, plus one more at the end, like in Apache Arrow.
+     * Is @b optional and is only filled, if `values` are requested.
+     */
+    ustore_length_t** values_offsets;
+    /**
+     * @brief Output lengths of values, one for every exported key.
+     * Missing entries are marked with `::ustore_length_missing_k`.
+     * Is @b optional and is only filled, if `values` are requested.
+     */
+    ustore_length_t** values_lengths;
+    /**
+     * @brief Output values tape.
+     *
+     * If not NULL, the values are exported alongside the keys, taken from
+     * the same iterator positions, sparing the follow-up `ustore_read()`.
+     * Engines, that can't do that, leave all of the values outputs untouched.
+     * Is @b optional.
+     */
+    ustore_byte_t** values;
     /// @}
 
 } ustore_scan_t;
@@ -673,6 +715,9 @@ typedef struct ustore_sample_t {
 
 /**
  * @brief Uniformly randomly samples keys from provided collections.
+ * Persistent engines sample approximately, seeking to random keys instead of
+ * iterating through whole collections. Fewer than requested distinct keys are
+ * exported only from collections, that don't have as many.
  * @see `ustore_sample_t`.
  */
 void ustore_sample(ustore_sample_t*);
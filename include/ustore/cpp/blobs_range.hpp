@@ -194,6 +194,8 @@ class pairs_stream_t {
 
         ustore_length_t* found_counts = nullptr;
         ustore_key_t* found_keys = nullptr;
+        ustore_length_t* found_offs = nullptr;
+        ustore_byte_t* found_vals = nullptr;
         status_t status;
         ustore_scan_t scan {};
         scan.db = db_;
@@ -206,6 +208,8 @@ class pairs_stream_t {
         scan.count_limits = &read_ahead_;
         scan.counts = &found_counts;
         scan.keys = &found_keys;
+        scan.values_offsets = &found_offs;
+        scan.values = &found_vals;
 
         ustore_scan(&scan);
         if (!status)
@@ -215,24 +219,25 @@ class pairs_stream_t {
         fetched_offset_ = 0;
         auto count = static_cast<ustore_size_t>(fetched_keys_.size());
 
-        ustore_bytes_ptr_t found_vals {};
-        ustore_length_t* found_offs {};
-        ustore_read_t read {};
-        read.db = db_;
-        read.error = status.member_ptr();
-        read.transaction = txn_;
-        read.arena = arena_.member_ptr();
-        read.options = ustore_option_dont_discard_memory_k;
-        read.tasks_count = count;
-        read.collections = &collection_;
-        read.keys = found_keys;
-        read.keys_stride = sizeof(ustore_key_t);
-        read.offsets = &found_offs;
-        read.values = &found_vals;
-
-        ustore_read(&read);
-        if (!status)
-            return status;
+        // Engines, that can't export values while scanning, are followed up with a read
+        if (!found_offs) {
+            ustore_read_t read {};
+            read.db = db_;
+            read.error = status.member_ptr();
+            read.transaction = txn_;
+            read.arena = arena_.member_ptr();
+            read.options = ustore_option_dont_discard_memory_k;
+            read.tasks_count = count;
+            read.collections = &collection_;
+            read.keys = found_keys;
+            read.keys_stride = sizeof(ustore_key_t);
+            read.offsets = &found_offs;
+            read.values = &found_vals;
+
+            ustore_read(&read);
+            if (!status)
+                return status;
+        }
 
         values_view_ = joined_blobs_t {count, found_offs, found_vals};
         values_iterator_ = values_view_.begin();
@@ -264,7 +264,8 @@ inline void validate_write(ustore_transaction_t const c_txn,
     auto allowed_options =                       //
         ustore_option_transaction_dont_watch_k | //
         ustore_option_dont_discard_memory_k |    //
-        ustore_option_write_flush_k;
+        ustore_option_write_flush_k |            //
+        ustore_option_write_bulk_k;
     return_error_if_m(enum_is_subset(c_options, allowed_options), c_error, args_wrong_k, "Invalid options!");
 
     return_error_if_m(places.keys_begin, c_error, args_wrong_k, "No keys were provided!");
@@ -289,6 +290,25 @@ inline void validate_write(ustore_transaction_t const c_txn,
                           "Current engine does not support transactions!");
 }
 
+/**
+ * @brief Invokes the optional completion `callback` of a `ustore_write_t`
+ * on every path out of the scope, including the early error returns.
+ * Engines, that complete the write asynchronously, must `release()` it.
+ */
+class write_completion_t {
+    ustore_write_t const* write_ = nullptr;
+
+  public:
+    write_completion_t(ustore_write_t const& write) noexcept : write_(write.callback ? &write : nullptr) {}
+    write_completion_t(write_completion_t const&) = delete;
+    write_completion_t& operator=(write_completion_t const&) = delete;
+    ~write_completion_t() noexcept {
+        if (write_)
+            write_->callback(write_->callback_payload);
+    }
+    void release() noexcept { write_ = nullptr; }
+};
+
 inline void validate_read(ustore_transaction_t const c_txn,
                           places_arg_t const& places,
                           ustore_options_t const c_options,
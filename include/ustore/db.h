@@ -181,6 +181,14 @@ typedef enum {
      * detection on separate parts of transactional reads and writes.
      */
     ustore_option_transaction_dont_watch_k = 1 << 2,
+    /**
+     * @brief Marks writes, that are a part of a large import, rather than
+     * online updates. Engines may sort such batches and load them directly
+     * into immutable files, bypassing the write-ahead log and memtables,
+     * to avoid rewriting the same data during compactions.
+     * Ignored inside of transactions.
+     */
+    ustore_option_write_bulk_k = 1 << 3,
     /**
      * @brief On every API call, the arena is cleared for reuse.
      * If the arguments of the function are results of another UStore call,
@@ -199,8 +207,10 @@ typedef enum {
      * and may include irrelevant (deleted & duplicate) keys in order to maximize
      * throughput. The purpose is not accelerating the `ustore_scan()`, but the
      * following `ustore_read()`. Generally used for Machine Learning applications.
+     * Persistent engines treat such scans as one-off passes over the data,
+     * prefetching the following blocks and keeping them out of the cache.
      */
-    ustore_option_scan_bulk_k = 0, // TODO
+    ustore_option_scan_bulk_k = 1 << 6,
 
 } ustore_options_t;
 
@@ -29,9 +29,19 @@ typedef enum {
     ustore_vector_scalar_f16_k = 1,
     ustore_vector_scalar_i8_k = 2,
     ustore_vector_scalar_f64_k = 3,
+    ustore_vector_scalar_bf16_k = 4,
 
 } ustore_vector_scalar_t;
 
+typedef enum {
+
+    /** @brief Hierarchical Navigable Small World graph of quantized copies of vectors. */
+    ustore_vector_index_hnsw_k = 0,
+    /** @brief Inverted lists of Product-Quantized codes, around k-means centroids. */
+    ustore_vector_index_ivfpq_k = 1,
+
+} ustore_vector_index_t;
+
 /**
  * @brief Maps keys to High-Dimensional Vectors.
  * Generalization of @c ustore_write_t to numerical vectors.
@@ -79,6 +89,41 @@ typedef struct ustore_vectors_write_t {
     ustore_length_t const* offsets;
     ustore_size_t offsets_stride;
 
+    /**
+     * @brief Metric, by which the proximity graph is constructed.
+     * Fixed by the first write into a collection.
+     */
+    ustore_vector_metric_t metric;
+    /**
+     * @brief Max number of neighbors of a vector on the upper levels of the graph,
+     * twice as many on the base level. Fixed by the first write into a collection.
+     * Is @b optional, defaults to 16.
+     */
+    ustore_length_t connectivity;
+    /**
+     * @brief Number of candidates considered for linking every new vector,
+     * often called "efConstruction". Higher values improve the quality of the graph.
+     * Is @b optional, defaults to 128.
+     */
+    ustore_length_t expansion_add;
+    /**
+     * @brief Kind of index, built over the vectors. Fixed by the first write into a collection.
+     * Is @b optional, defaults to the proximity graph.
+     */
+    ustore_vector_index_t index;
+    /**
+     * @brief Number of k-means centroids, that split an IVF-PQ collection into inverted lists.
+     * Fixed by the first write into a collection, can't exceed 32768.
+     * Is @b optional, defaults to 1024.
+     */
+    ustore_length_t lists;
+    /**
+     * @brief Number of subspaces, each encoded with a single byte in IVF-PQ collections.
+     * Must divide the `dimensions`. Fixed by the first write into a collection.
+     * Is @b optional, defaults to one subspace per 8, 4, 2 or 1 dimensions, whichever divides them.
+     */
+    ustore_length_t subspaces;
+
     // @}
 
 } ustore_vectors_write_t;
@@ -87,6 +132,29 @@ typedef struct ustore_vectors_write_t {
  * @brief Maps keys to High-Dimensional Vectors.
  * Generalization of @c ustore_write_t to numerical vectors.
  * @see `ustore_vectors_write_t`, `ustore_write_t`, `ustore_write()`.
+ *
+ * Keys must be non-negative. Besides the original vectors, the collection
+ * gets quantized copies of them under negative keys, linked into a Hierarchical
+ * Navigable Small World graph, that is updated incrementally with every write.
+ * Every copy is scaled by the largest absolute component of its vector,
+ * so the original scalars aren't limited to any range.
+ * Dimensions and the scalar type are fixed by the first write into a collection.
+ *
+ * Updating the index reads and rewrites entries, shared by many vectors, like the
+ * header of the graph and the neighbors of new nodes. Concurrent writes into the
+ * same collection are isolated from each other:
+ * - Inside of a `transaction`, the shared entries are watched, so the commit fails
+ *   on concurrent changes of the index, unless `ustore_option_transaction_dont_watch_k` is set.
+ * - Without one, engines with `ustore_supports_transactions_k` use an internal transaction,
+ *   retrying the whole batch a few times, if it conflicts with other writers.
+ * - Other engines serialize the writes into the same collection within the process.
+ *
+ * Collections, created with `ustore_vector_index_ivfpq_k`, get no graph. Instead, the write,
+ * that brings the collection to 39 vectors per list and at least 256 vectors in total, trains
+ * k-means centroids and Product Quantization codebooks on all of them. Until then, the vectors
+ * are only counted and searches compare the query to every one of them. Afterwards, every
+ * vector is assigned to the inverted list of its closest centroid, that stores a compact code
+ * of its residual under a negative key. Keys in such collections must be below 2^47.
  */
 void ustore_vectors_write(ustore_vectors_write_t*);
 
@@ -174,6 +242,18 @@ typedef struct ustore_vectors_search_t {
     ustore_vector_scalar_t scalar_type;
     ustore_vector_metric_t metric;
     ustore_float_t metric_threshold;
+    /**
+     * @brief Number of candidates tracked during the search, often called "ef".
+     * Higher values improve recall at the cost of latency.
+     * Is @b optional, defaults to 64, but is never smaller than the match limit.
+     */
+    ustore_length_t expansion_search;
+    /**
+     * @brief Number of inverted lists, closest to the query, that are scanned in IVF-PQ collections.
+     * Higher values improve recall at the cost of latency.
+     * Is @b optional, defaults to 16.
+     */
+    ustore_length_t probes;
 
     ustore_collection_t const* collections;
     ustore_size_t collections_stride;
@@ -202,6 +282,13 @@ typedef struct ustore_vectors_search_t {
 /**
  * @brief Performs K-Approximate Nearest Neighbors Search.
  * @see `ustore_vectors_search_t`.
+ *
+ * Walks the proximity graph, if it was constructed with the same `metric`,
+ * taking a logarithmic number of steps. IVF-PQ collections, searched by the same
+ * `metric`, compare the query to the codes in a few inverted lists with distance
+ * tables, computed once per list. Otherwise, compares the query against
+ * every vector in the collection. Collections without an index, like the ones written
+ * by older versions, are expected to hold vectors of the queries' `scalar_type`.
  */
 void ustore_vectors_search(ustore_vectors_search_t*);
 
@@ -715,6 +715,7 @@ void ustore_read(ustore_read_t* c_ptr) {
 void ustore_write(ustore_write_t* c_ptr) {
 
     ustore_write_t& c = *c_ptr;
+    write_completion_t completion {c};
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
     if (!c.tasks_count)
         return;
@@ -3,10 +3,28 @@
  * @author Ashot Vardanian
  *
  * @brief Embedded Persistent Key-Value Store on top of @b LevelDB.
- * Has no support for collections, transactions or any non-CRUD jobs.
+ * Has no support for non-CRUD jobs, but emulates named collections and transactions.
+ *
+ * ## Collections
+ * Entries of named collections are prefixed with the collection ID, ordered first by
+ * the comparator. The main collection keeps the shorter unprefixed keys, so databases,
+ * created before named collections were supported, are opened as is.
+ * The names of collections are stored in a reserved collection.
+ *
+ * ## Transactions
+ * Transactions are optimistic. The changes are staged in memory and applied with a
+ * single `WriteBatch`. Every observed key is hashed into a table of version counters,
+ * incremented on every write. A commit fails, if any of the versions, remembered
+ * by the transaction, has changed. Hash collisions may cause false conflicts,
+ * but never hide the real ones. Scans watch every key they export, but not the gaps
+ * between them, so new keys, inserted into a scanned range, don't cause conflicts.
  */
+#include <map>
 #include <mutex>
+#include <atomic>
 #include <fstream>
+#include <optional>
+#include <shared_mutex>
 
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
@@ -17,7 +35,8 @@
 #include "ustore/db.h"
 #include "ustore/cpp/ranges_args.hpp"   // `places_arg_t`
 #include "helpers/linked_array.hpp"  // `uninitialized_array_gt`
-#include "helpers/full_scan.hpp"     // `reservoir_sample_iterator`
+#include "helpers/full_scan.hpp"     // `random_seek_sample_iterator`, `forward_scanner_gt`
+#include "helpers/key_encoding.hpp"  // `native_key_encoding_t`
 #include "helpers/config_loader.hpp" // `config_loader_t`
 
 using namespace unum::ustore;
@@ -33,8 +52,8 @@ using json_t = nlohmann::json;
 ustore_collection_t const ustore_collection_main_k = 0;
 ustore_length_t const ustore_length_missing_k = std::numeric_limits<ustore_length_t>::max();
 ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max();
-bool const ustore_supports_transactions_k = false;
-bool const ustore_supports_named_collections_k = false;
+bool const ustore_supports_transactions_k = true;
+bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = true;
 
 using level_native_t = leveldb::DB;
@@ -42,11 +61,49 @@ using level_status_t = leveldb::Status;
 using level_options_t = leveldb::Options;
 using level_iter_uptr_t = std::unique_ptr<leveldb::Iterator>;
 
+/**
+ * @brief Reserved collection, mapping the IDs of named collections to their names.
+ */
+static constexpr ustore_collection_t level_registry_k = std::numeric_limits<ustore_collection_t>::max();
+
+/**
+ * @brief The keys, observed by transactions, are hashed into this many version counters.
+ */
+static constexpr std::size_t watch_buckets_log2_k = 16;
+static constexpr std::size_t watch_buckets_k = 1ul << watch_buckets_log2_k;
+
+/**
+ * @brief Full key of an entry. Is stored as is, unless it belongs to the main collection,
+ * where only the `key` is stored.
+ */
+struct level_key_t {
+    ustore_collection_t collection = ustore_collection_main_k;
+    ustore_key_t key = 0;
+
+    static level_key_t parse(leveldb::Slice const& slice) noexcept {
+        level_key_t result;
+        if (slice.size() == sizeof(ustore_key_t))
+            std::memcpy(&result.key, slice.data(), sizeof(ustore_key_t));
+        else
+            std::memcpy(&result, slice.data(), sizeof(level_key_t));
+        return result;
+    }
+
+    bool operator<(level_key_t const& other) const noexcept {
+        return collection != other.collection ? collection < other.collection : key < other.key;
+    }
+    bool operator==(level_key_t const& other) const noexcept {
+        return collection == other.collection && key == other.key;
+    }
+};
+
+static_assert(sizeof(level_key_t) == sizeof(ustore_collection_t) + sizeof(ustore_key_t));
+
 struct key_comparator_t final : public leveldb::Comparator {
 
     inline int Compare(leveldb::Slice const& a, leveldb::Slice const& b) const override {
-        auto ai = *reinterpret_cast<ustore_key_t const*>(a.data());
-        auto bi = *reinterpret_cast<ustore_key_t const*>(b.data());
+        auto ai = level_key_t::parse(a);
+        auto bi = level_key_t::parse(b);
         if (ai == bi)
             return 0;
         return ai < bi ? -1 : 1;
@@ -57,8 +114,11 @@ struct key_comparator_t final : public leveldb::Comparator {
     void FindShortestSeparator(std::string*, leveldb::Slice const&) const override {}
 
     void FindShortSuccessor(std::string* key) const override {
+        if (key->size() != sizeof(ustore_key_t))
+            return;
         auto& int_key = *reinterpret_cast<ustore_key_t*>(key->data());
-        ++int_key;
+        if (int_key != std::numeric_limits<ustore_key_t>::max())
+            ++int_key;
     }
 };
 
@@ -68,9 +128,28 @@ struct level_snapshot_t {
     leveldb::Snapshot const* snapshot = nullptr;
 };
 
+/**
+ * @brief Optimistic transaction. Stages its changes in memory and remembers
+ * the versions of the keys it has observed, to be validated on commit.
+ */
+struct level_txn_t {
+    /// Pending changes, where removals are represented with `std::nullopt`
+    std::map<level_key_t, std::optional<std::string>> changes;
+    /// Versions of the watched buckets, at the time of the first observation
+    std::unordered_map<std::size_t, std::uint64_t> watches;
+};
+
 struct level_db_t {
     std::unordered_map<ustore_size_t, level_snapshot_t*> snapshots;
+    /// Names of named collections, persisted in the `level_registry_k` collection
+    std::map<ustore_collection_t, std::string> collections;
+    ustore_collection_t next_collection = 1;
     std::unique_ptr<level_native_t> native;
+    /// Version counters of hashed keys, incremented after every change
+    std::unique_ptr<std::atomic<std::uint64_t>[]> versions;
+    std::atomic<ustore_sequence_number_t> sequence_number {0};
+    /// Shared by plain writes, exclusively locked by transactions, validating and applying changes
+    std::shared_mutex commit_mutex;
     std::mutex mutex;
 };
 
@@ -78,8 +157,10 @@ struct level_db_t {
 /*****************	 C++ Implementation	  ****************/
 /*********************************************************/
 
-inline leveldb::Slice to_slice(ustore_key_t const& key) noexcept {
-    return {reinterpret_cast<char const*>(&key), sizeof(ustore_key_t)};
+inline leveldb::Slice to_slice(level_key_t const& key) noexcept {
+    return key.collection == ustore_collection_main_k
+               ? leveldb::Slice {reinterpret_cast<char const*>(&key.key), sizeof(ustore_key_t)}
+               : leveldb::Slice {reinterpret_cast<char const*>(&key), sizeof(level_key_t)};
 }
 
 inline leveldb::Slice to_slice(value_view_t value) noexcept {
@@ -112,6 +193,127 @@ bool export_error(level_status_t const& status, ustore_error_t* c_error) {
     return true;
 }
 
+inline std::size_t watch_bucket(level_key_t const& key) noexcept {
+    std::uint64_t hash = static_cast<std::uint64_t>(key.key) * 0x9E3779B97F4A7C15ull;
+    hash ^= static_cast<std::uint64_t>(key.collection) * 0xC2B2AE3D27D4EB4Full;
+    return static_cast<std::size_t>(hash >> (64 - watch_buckets_log2_k));
+}
+
+/**
+ * @brief Remembers the version of the key, unless it was already observed by this transaction.
+ * Must be called before the key is read, so that concurrent changes are never missed.
+ */
+inline void watch_key(level_db_t& db, level_txn_t& txn, level_key_t const& key) noexcept(false) {
+    std::size_t bucket = watch_bucket(key);
+    txn.watches.try_emplace(bucket, db.versions[bucket].load(std::memory_order_acquire));
+}
+
+/**
+ * @brief Invalidates the observations of the key by pending transactions.
+ * Must be called after the change is applied.
+ */
+inline void mark_changed(level_db_t& db, level_key_t const& key) noexcept {
+    db.versions[watch_bucket(key)].fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief Confines a LevelDB iterator to a single collection, exposing unprefixed keys,
+ * so that it can be passed to `forward_scanner_gt` or `random_seek_sample_iterator`.
+ */
+class level_collection_iterator_t {
+    leveldb::Iterator& native_;
+    ustore_collection_t collection_;
+
+  public:
+    level_collection_iterator_t(leveldb::Iterator& native, ustore_collection_t collection) noexcept
+        : native_(native), collection_(collection) {}
+
+    bool Valid() const { return native_.Valid() && level_key_t::parse(native_.key()).collection == collection_; }
+    void Seek(leveldb::Slice const& key) {
+        native_.Seek(to_slice(level_key_t {collection_, native_key_encoding_t::decode(key.data())}));
+    }
+    void SeekToFirst() {
+        native_.Seek(to_slice(level_key_t {collection_, std::numeric_limits<ustore_key_t>::min()}));
+    }
+    void SeekToLast() {
+        // Position on the first entry of the following collection and step back
+        if (collection_ != level_registry_k)
+            native_.Seek(to_slice(level_key_t {collection_ + 1, std::numeric_limits<ustore_key_t>::min()}));
+        if (collection_ != level_registry_k && native_.Valid())
+            native_.Prev();
+        else if (native_.status().ok())
+            native_.SeekToLast();
+    }
+    void Next() { native_.Next(); }
+    leveldb::Slice key() const {
+        leveldb::Slice key = native_.key();
+        return {key.data() + key.size() - sizeof(ustore_key_t), sizeof(ustore_key_t)};
+    }
+    leveldb::Slice value() const { return native_.value(); }
+    level_status_t status() const { return native_.status(); }
+};
+
+/**
+ * @brief Merges the pending changes of a transaction into the entries of a collection,
+ * hiding the removed ones. Only moves forward, as needed by `forward_scanner_gt`.
+ */
+class level_txn_iterator_t {
+    using changes_t = std::map<level_key_t, std::optional<std::string>>;
+
+    level_collection_iterator_t committed_;
+    changes_t const* changes_;
+    changes_t::const_iterator change_;
+    ustore_collection_t collection_;
+    bool from_change_ = false;
+
+    bool change_valid() const noexcept {
+        return changes_ && change_ != changes_->end() && change_->first.collection == collection_;
+    }
+
+    /// Skips the removed keys and the committed entries, shadowed by changes
+    void settle() {
+        for (; change_valid(); ++change_) {
+            if (committed_.Valid()) {
+                ustore_key_t committed_key = native_key_encoding_t::decode(committed_.key().data());
+                if (committed_key < change_->first.key)
+                    break;
+                if (committed_key == change_->first.key)
+                    committed_.Next();
+            }
+            if (change_->second) {
+                from_change_ = true;
+                return;
+            }
+        }
+        from_change_ = false;
+    }
+
+  public:
+    level_txn_iterator_t(leveldb::Iterator& native, ustore_collection_t collection, level_txn_t const* txn) noexcept
+        : committed_(native, collection), changes_(txn ? &txn->changes : nullptr), collection_(collection) {}
+
+    bool Valid() const { return from_change_ || committed_.Valid(); }
+    void Seek(leveldb::Slice const& key) {
+        committed_.Seek(key);
+        if (changes_)
+            change_ = changes_->lower_bound(level_key_t {collection_, native_key_encoding_t::decode(key.data())});
+        settle();
+    }
+    void Next() {
+        if (from_change_)
+            ++change_;
+        else
+            committed_.Next();
+        settle();
+    }
+    leveldb::Slice key() const {
+        return from_change_ ? leveldb::Slice {reinterpret_cast<char const*>(&change_->first.key), sizeof(ustore_key_t)}
+                            : committed_.key();
+    }
+    leveldb::Slice value() const { return from_change_ ? leveldb::Slice {*change_->second} : committed_.value(); }
+    level_status_t status() const { return committed_.status(); }
+};
+
 void ustore_database_init(ustore_database_init_t* c_ptr) {
 
     ustore_database_init_t& c = *c_ptr;
@@ -172,7 +374,7 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
         if (!config.engine.config.empty())
             fill_options(config.engine.config, options);
 
-        level_db_t* db_ptr = new level_db_t;
+        auto db_ptr = std::make_unique<level_db_t>();
         level_native_t* native_db = nullptr;
         level_status_t status = leveldb::DB::Open(options, root, &native_db);
         if (!status.ok()) {
@@ -180,7 +382,20 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
             return;
         }
         db_ptr->native = std::unique_ptr<level_native_t>(native_db);
-        *c.db = db_ptr;
+        db_ptr->versions = std::make_unique<std::atomic<std::uint64_t>[]>(watch_buckets_k);
+
+        // Recover the names of collections
+        level_iter_uptr_t it {native_db->NewIterator(leveldb::ReadOptions())};
+        level_collection_iterator_t registry {*it, level_registry_k};
+        for (registry.SeekToFirst(); registry.Valid(); registry.Next()) {
+            auto id = static_cast<ustore_collection_t>(native_key_encoding_t::decode(registry.key().data()));
+            db_ptr->collections.emplace(id, registry.value().ToString());
+            db_ptr->next_collection = std::max(db_ptr->next_collection, id + 1);
+        }
+        if (export_error(registry.status(), c.error))
+            return;
+        it.reset();
+        *c.db = db_ptr.release();
     }
     catch (json_t::type_error const&) {
         *c.error = "Unsupported type in LevelDB configuration key";
@@ -265,10 +480,12 @@ void write_one( //
 
     auto place = places[0];
     auto content = contents[0];
-    auto key = to_slice(place.key);
+    level_key_t key_bytes {place.collection, place.key};
+    auto key = to_slice(key_bytes);
     level_status_t status =
         !content ? db.native->Delete(options, key) : db.native->Put(options, key, to_slice(content));
-    export_error(status, c_error);
+    if (!export_error(status, c_error))
+        mark_changed(db, key_bytes);
 }
 
 void write_many( //
@@ -283,7 +500,8 @@ void write_many( //
         auto place = places[i];
         auto content = contents[i];
 
-        auto key = to_slice(place.key);
+        level_key_t key_bytes {place.collection, place.key};
+        auto key = to_slice(key_bytes);
         if (!content)
             batch.Delete(key);
         else
@@ -291,15 +509,46 @@ void write_many( //
     }
 
     level_status_t status = db.native->Write(options, &batch);
-    export_error(status, c_error);
+    if (export_error(status, c_error))
+        return;
+    for (std::size_t i = 0; i != places.size(); ++i)
+        mark_changed(db, level_key_t {places[i].collection, places[i].key});
+}
+
+/**
+ * @brief Stages the changes in a transaction, overwriting the previous changes of the same keys.
+ */
+void write_staged( //
+    level_db_t& db,
+    level_txn_t& txn,
+    places_arg_t const& places,
+    contents_arg_t const& contents,
+    ustore_options_t const c_options) {
+
+    bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
+    for (std::size_t i = 0; i != places.size(); ++i) {
+        auto place = places[i];
+        auto content = contents[i];
+
+        level_key_t key {place.collection, place.key};
+        if (watch)
+            watch_key(db, txn, key);
+        auto& change = txn.changes[key];
+        if (content)
+            change.emplace(reinterpret_cast<char const*>(content.begin()), content.size());
+        else
+            change.reset();
+    }
 }
 
 void ustore_write(ustore_write_t* c_ptr) {
 
     ustore_write_t& c = *c_ptr;
+    write_completion_t completion {c};
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
     strided_iterator_gt<ustore_bytes_cptr_t const> vals {c.values, c.values_stride};
@@ -313,13 +562,24 @@ void ustore_write(ustore_write_t* c_ptr) {
     validate_write(c.transaction, places, contents, c.options, c.error);
     return_if_error_m(c.error);
 
+    if (txn_ptr) {
+        safe_section("Staging LevelDB changes", c.error, [&] {
+            write_staged(db, *txn_ptr, places, contents, c.options);
+        });
+        return;
+    }
+
     leveldb::WriteOptions options;
     if (c.options & ustore_option_write_flush_k)
         options.sync = true;
 
     try {
+        // Changes can't be applied, while a transaction validates its observations
+        std::shared_lock<std::shared_mutex> commit_lock(db.commit_mutex);
         auto func = c.tasks_count == 1 ? &write_one : &write_many;
         func(db, places, contents, options, c.error);
+        if (!*c.error)
+            ++db.sequence_number;
     }
     catch (...) {
         *c.error = "Write Failure";
@@ -329,15 +589,31 @@ void ustore_write(ustore_write_t* c_ptr) {
 template <typename value_enumerator_at>
 void read_enumerate( //
     level_db_t& db,
+    level_txn_t* txn_ptr,
     places_arg_t tasks,
     leveldb::ReadOptions const& options,
+    ustore_options_t const c_options,
     std::string& value,
     value_enumerator_at enumerator,
     ustore_error_t* c_error) {
 
+    bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
     for (std::size_t i = 0; i != tasks.size(); ++i) {
         place_t place = tasks[i];
-        level_status_t status = db.native->Get(options, to_slice(place.key), &value);
+        level_key_t key {place.collection, place.key};
+
+        // Transactions see their own changes first
+        if (txn_ptr) {
+            if (watch)
+                watch_key(db, *txn_ptr, key);
+            auto change = txn_ptr->changes.find(key);
+            if (change != txn_ptr->changes.end()) {
+                enumerator(i, change->second ? value_view_t {*change->second} : value_view_t {});
+                continue;
+            }
+        }
+
+        level_status_t status = db.native->Get(options, to_slice(key), &value);
         if (!status.IsNotFound()) {
             if (export_error(status, c_error))
                 return;
@@ -359,9 +635,11 @@ void ustore_read(ustore_read_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
-    places_arg_t places {{}, keys, {}, c.tasks_count};
+    places_arg_t places {collections, keys, {}, c.tasks_count};
 
     validate_read(c.transaction, places, c.options, c.error);
     return_if_error_m(c.error);
@@ -395,7 +673,7 @@ void ustore_read(ustore_read_t* c_ptr) {
             if (needs_export)
                 contents.insert(contents.size(), value.begin(), value.end(), c.error);
         };
-        read_enumerate(db, places, options, value_buffer, data_enumerator, c.error);
+        read_enumerate(db, txn_ptr, places, options, c.options, value_buffer, data_enumerator, c.error);
         offs[places.count] = contents.size();
         if (needs_export)
             *c.values = reinterpret_cast<ustore_bytes_ptr_t>(contents.begin());
@@ -414,11 +692,14 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> limits {c.count_limits, c.count_limits_stride};
-    scans_arg_t scans {{}, start_keys, limits, c.tasks_count};
+    scans_arg_t scans {collections, start_keys, limits, c.tasks_count};
 
+    validate_scan(c.transaction, scans, c.options, c.error);
     return_if_error_m(c.error);
 
     // 1. Allocate a tape for all the values to be fetched
@@ -440,6 +721,13 @@ void ustore_scan(ustore_scan_t* c_ptr) {
         options.snapshot = snap.snapshot;
     }
 
+    // Exported keys can only be watched after they are read. Until then, no changes
+    // may be applied, or the transaction would remember their versions, missing them.
+    bool const watch = txn_ptr && !(c.options & ustore_option_transaction_dont_watch_k);
+    std::unique_lock<std::shared_mutex> commit_lock(db.commit_mutex, std::defer_lock);
+    if (watch)
+        commit_lock.lock();
+
     level_iter_uptr_t it;
     try {
         it = level_iter_uptr_t(db.native->NewIterator(options));
@@ -448,23 +736,75 @@ void ustore_scan(ustore_scan_t* c_ptr) {
         *c.error = "Fail To Create Iterator";
         return;
     }
-    for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
-        scan_t task = scans[i];
-        it->Seek(to_slice(task.min_key));
-        offsets[i] = keys_output - *c.keys;
-
-        ustore_size_t j = 0;
-        while (it->Valid() && j != task.limit) {
-            std::memcpy(keys_output, it->key().data(), sizeof(ustore_key_t));
-            ++keys_output;
-            ++j;
-            it->Next();
+
+    // Serve the tasks in the order of start keys, so the iterator mostly moves forward.
+    // Every task fills its own slice, sized by its limit, and those are compacted later.
+    auto order = order_scan_tasks(scans, arena, c.error);
+    return_if_error_m(c.error);
+    auto slice_offsets = arena.alloc<std::size_t>(scans.count, c.error);
+    return_if_error_m(c.error);
+    auto slice_counts = arena.alloc<ustore_length_t>(scans.count, c.error);
+    return_if_error_m(c.error);
+    for (std::size_t task_idx = 0, slice_offset = 0; task_idx != scans.count; ++task_idx) {
+        slice_offsets[task_idx] = slice_offset;
+        slice_offset += scans.limits[task_idx];
+    }
+
+    // Values are pulled from the same iterator positions, if requested
+    bool const needs_values = c.values != nullptr;
+    scanned_values_t values(arena);
+    if (needs_values)
+        values.reserve(arena, total_keys, c.error);
+    return_if_error_m(c.error);
+
+    // The native iterator is shared, but every collection gets a separate view of it
+    std::optional<level_txn_iterator_t> collection_it;
+    std::optional<forward_scanner_gt<level_txn_iterator_t>> scanner;
+    ustore_collection_t scanned_collection = ustore_collection_main_k;
+    for (std::size_t task_idx : order) {
+        scan_t task = scans[task_idx];
+        if (!scanner || task.collection != scanned_collection) {
+            scanned_collection = task.collection;
+            collection_it.emplace(*it, task.collection, txn_ptr);
+            scanner.emplace(*collection_it);
         }
+        scanner->seek(task.min_key);
+        std::size_t slice_offset = slice_offsets[task_idx];
+        slice_counts[task_idx] = scanner->read(task.limit, keys_output + slice_offset, [&](std::size_t key_idx) {
+            if (needs_values)
+                values.push(slice_offset + key_idx, scanner->value(), c.error);
+        });
+        return_if_error_m(c.error);
+    }
+    return_error_if_m(it->status().ok(), c.error, error_unknown_k, "Scan Failure");
+
+    if (watch) {
+        safe_section("Watching scanned keys", c.error, [&] {
+            for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
+                ustore_collection_t collection = scans[task_idx].collection;
+                ustore_key_t const* slice = keys_output + slice_offsets[task_idx];
+                for (std::size_t key_idx = 0; key_idx != slice_counts[task_idx]; ++key_idx)
+                    watch_key(db, *txn_ptr, level_key_t {collection, slice[key_idx]});
+            }
+        });
+        return_if_error_m(c.error);
+        commit_lock.unlock();
+    }
 
-        counts[i] = j;
+    // Slices only move towards the beginning, so they can be compacted in order
+    for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
+        offsets[task_idx] = keys_output - *c.keys;
+        counts[task_idx] = slice_counts[task_idx];
+        if (slice_counts[task_idx])
+            std::memmove(keys_output, *c.keys + slice_offsets[task_idx], slice_counts[task_idx] * sizeof(ustore_key_t));
+        if (needs_values)
+            values.move(slice_offsets[task_idx], keys_output - *c.keys, slice_counts[task_idx]);
+        keys_output += slice_counts[task_idx];
     }
+    offsets[scans.count] = keys_output - *c.keys;
 
-    offsets[scans.size()] = keys_output - *c.keys;
+    if (needs_values)
+        values.export_to(arena, keys_output - *c.keys, c.values_offsets, c.values_lengths, c.values, c.error);
 }
 
 void ustore_sample(ustore_sample_t* c_ptr) {
@@ -479,8 +819,9 @@ void ustore_sample(ustore_sample_t* c_ptr) {
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_length_t const> lens {c.count_limits, c.count_limits_stride};
-    sample_args_t samples {{}, lens, c.tasks_count};
+    sample_args_t samples {collections, lens, c.tasks_count};
 
     // 1. Allocate a tape for all the values to be fetched
     auto offsets = arena.alloc_or_dummy(samples.count + 1, c.error, c.offsets);
@@ -511,11 +852,28 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         });
         return_if_error_m(c.error);
 
+        // Parts of the key range are weighed by the approximate size of their files
+        auto weigh = [&](ustore_key_t const* bounds, std::uint64_t* weights) {
+            level_key_t bounds_keys[sample_ranges_k + 1];
+            leveldb::Range ranges[sample_ranges_k];
+            for (std::size_t part = 0; part != sample_ranges_k + 1; ++part)
+                bounds_keys[part] = level_key_t {task.collection, bounds[part]};
+            for (std::size_t part = 0; part != sample_ranges_k; ++part)
+                ranges[part] = leveldb::Range(to_slice(bounds_keys[part]), to_slice(bounds_keys[part + 1]));
+            db.native->GetApproximateSizes(ranges, sample_ranges_k, weights);
+        };
+
+        // Pending changes of transactions aren't sampled
+        level_collection_iterator_t collection_it {*it, task.collection};
         ptr_range_gt<ustore_key_t> sampled_keys(keys_output, task.limit);
-        reservoir_sample_iterator(it, sampled_keys, c.error);
+        std::size_t count = 0;
+        safe_section("Sampling LevelDB", c.error, [&] {
+            random_seek_sample_iterator(&collection_it, sampled_keys, weigh, count, c.error);
+        });
+        return_if_error_m(c.error);
 
-        counts[task_idx] = task.limit;
-        keys_output += task.limit;
+        counts[task_idx] = static_cast<ustore_length_t>(count);
+        keys_output += count;
     }
     offsets[samples.count] = keys_output - *c.keys;
 }
@@ -537,6 +895,7 @@ void ustore_measure(ustore_measure_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
     uint64_t approximate_size = 0;
@@ -549,8 +908,9 @@ void ustore_measure(ustore_measure_t* c_ptr) {
         min_value_bytes[i] = static_cast<ustore_size_t>(0);
         max_value_bytes[i] = static_cast<ustore_size_t>(0);
 
-        ustore_key_t const min_key = start_keys[i];
-        ustore_key_t const max_key = end_keys[i];
+        ustore_collection_t const collection = collections ? collections[i] : ustore_collection_main_k;
+        level_key_t const min_key {collection, start_keys[i]};
+        level_key_t const max_key {collection, end_keys[i]};
         leveldb::Range range(to_slice(min_key), to_slice(max_key));
         try {
             db.native->GetApproximateSizes(&range, 1, &approximate_size);
@@ -574,7 +934,26 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
 
     ustore_collection_create_t& c = *c_ptr;
     auto name_len = c.name ? std::strlen(c.name) : 0;
-    return_error_if_m(name_len, c.error, args_wrong_k, "Collections not supported by LevelDB!");
+    return_error_if_m(name_len, c.error, args_wrong_k, "Default collection is always present");
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::lock_guard<std::mutex> locker(db.mutex);
+    for (auto const& [id, name] : db.collections)
+        return_error_if_m(name != c.name, c.error, args_wrong_k, "Such collection already exists!");
+
+    ustore_collection_t id = db.next_collection;
+    level_key_t registry_key {level_registry_k, static_cast<ustore_key_t>(id)};
+    leveldb::WriteOptions options;
+    options.sync = true;
+    level_status_t status = db.native->Put(options, to_slice(registry_key), leveldb::Slice(c.name, name_len));
+    if (export_error(status, c.error))
+        return;
+
+    safe_section("Registering a collection", c.error, [&] { db.collections.emplace(id, c.name); });
+    return_if_error_m(c.error);
+    ++db.next_collection;
+    *c.id = id;
 }
 
 void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
@@ -582,42 +961,95 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
     ustore_collection_drop_t& c = *c_ptr;
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
     bool invalidate = c.mode == ustore_drop_keys_vals_handle_k;
-    return_error_if_m(c.id == ustore_collection_main_k && !invalidate,
+    return_error_if_m(c.id != ustore_collection_main_k || !invalidate,
                       c.error,
                       args_combo_k,
-                      "Collections not supported by LevelDB!");
+                      "Default collection can't be invalidated.");
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::lock_guard<std::mutex> locker(db.mutex);
+    if (c.id != ustore_collection_main_k)
+        return_error_if_m(db.collections.count(c.id), c.error, args_wrong_k, "Collection doesn't exist!");
 
-    leveldb::WriteBatch batch;
-    auto it = std::unique_ptr<leveldb::Iterator>(db.native->NewIterator(leveldb::ReadOptions()));
+    // The iterator keeps seeing the dropped entries, to mark them changed after the write
+    std::shared_lock<std::shared_mutex> commit_lock(db.commit_mutex);
+    level_iter_uptr_t it;
+    safe_section("Creating a LevelDB iterator", c.error, [&] {
+        it = level_iter_uptr_t(db.native->NewIterator(leveldb::ReadOptions()));
+    });
+    return_if_error_m(c.error);
+    level_collection_iterator_t entries {*it, c.id};
 
-    if (c.mode == ustore_drop_keys_vals_k) {
-        for (it->SeekToFirst(); it->Valid(); it->Next())
-            batch.Delete(it->key());
-    }
+    leveldb::WriteBatch batch;
+    safe_section("Collecting entries to drop", c.error, [&] {
+        for (entries.SeekToFirst(); entries.Valid(); entries.Next()) {
+            level_key_t key {c.id, native_key_encoding_t::decode(entries.key().data())};
+            if (c.mode == ustore_drop_vals_k)
+                batch.Put(to_slice(key), leveldb::Slice());
+            else
+                batch.Delete(to_slice(key));
+        }
+    });
+    return_if_error_m(c.error);
+    if (export_error(entries.status(), c.error))
+        return;
 
-    else if (c.mode == ustore_drop_vals_k) {
-        for (it->SeekToFirst(); it->Valid(); it->Next())
-            batch.Put(it->key(), leveldb::Slice());
-    }
+    level_key_t registry_key {level_registry_k, static_cast<ustore_key_t>(c.id)};
+    if (invalidate)
+        batch.Delete(to_slice(registry_key));
 
     leveldb::WriteOptions options;
     options.sync = true;
     level_status_t status = db.native->Write(options, &batch);
-    export_error(status, c.error);
+    if (export_error(status, c.error))
+        return;
+
+    for (entries.SeekToFirst(); entries.Valid(); entries.Next())
+        mark_changed(db, level_key_t {c.id, native_key_encoding_t::decode(entries.key().data())});
+    ++db.sequence_number;
+    if (invalidate)
+        db.collections.erase(c.id);
 }
 
 void ustore_collection_list(ustore_collection_list_t* c_ptr) {
 
     ustore_collection_list_t& c = *c_ptr;
-    *c.count = 0;
-    if (c.ids)
-        *c.ids = nullptr;
-    if (c.offsets)
-        *c.offsets = nullptr;
-    if (c.names)
-        *c.names = nullptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.count && c.names, c.error, args_combo_k, "Need names and outputs!");
+
+    linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::lock_guard<std::mutex> locker(db.mutex);
+    std::size_t collections_count = db.collections.size();
+    *c.count = static_cast<ustore_size_t>(collections_count);
+
+    // Every string will be null-terminated
+    std::size_t strings_length = 0;
+    for (auto const& [id, name] : db.collections)
+        strings_length += name.size() + 1;
+
+    auto names = arena.alloc<char>(strings_length, c.error).begin();
+    *c.names = names;
+    return_if_error_m(c.error);
+
+    // For every collection we also need to export IDs and offsets
+    auto ids = arena.alloc_or_dummy(collections_count, c.error, c.ids);
+    return_if_error_m(c.error);
+    auto offs = arena.alloc_or_dummy(collections_count + 1, c.error, c.offsets);
+    return_if_error_m(c.error);
+
+    std::size_t i = 0;
+    for (auto const& [id, name] : db.collections) {
+        std::memcpy(names, name.data(), name.size());
+        names[name.size()] = '\0';
+        ids[i] = id;
+        offs[i] = static_cast<ustore_length_t>(names - *c.names);
+        names += name.size() + 1;
+        ++i;
+    }
+    offs[i] = static_cast<ustore_length_t>(names - *c.names);
 }
 
 void ustore_database_control(ustore_database_control_t* c_ptr) {
@@ -639,13 +1071,65 @@ void ustore_database_control(ustore_database_control_t* c_ptr) {
 void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
 
     ustore_transaction_init_t& c = *c_ptr;
-    *c.error = "Transactions not supported by LevelDB!";
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    validate_transaction_begin(c.transaction, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(*c.transaction);
+    if (!txn_ptr) {
+        safe_section("Allocating transaction state", c.error, [&] { txn_ptr = new level_txn_t(); });
+        return_if_error_m(c.error);
+        *c.transaction = txn_ptr;
+    }
+    txn_ptr->changes.clear();
+    txn_ptr->watches.clear();
 }
 
 void ustore_transaction_commit(ustore_transaction_commit_t* c_ptr) {
 
     ustore_transaction_commit_t& c = *c_ptr;
-    *c.error = "Transactions not supported by LevelDB!";
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    validate_transaction_commit(c.transaction, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t& txn = *reinterpret_cast<level_txn_t*>(c.transaction);
+
+    leveldb::WriteBatch batch;
+    safe_section("Batching transaction changes", c.error, [&] {
+        for (auto const& [key, value] : txn.changes)
+            if (value)
+                batch.Put(to_slice(key), leveldb::Slice(*value));
+            else
+                batch.Delete(to_slice(key));
+    });
+    return_if_error_m(c.error);
+
+    leveldb::WriteOptions options;
+    options.sync = c.options & ustore_option_write_flush_k;
+
+    // No other changes can be applied between the validation and the write
+    std::unique_lock<std::shared_mutex> commit_lock(db.commit_mutex);
+    for (auto const& [bucket, version] : txn.watches)
+        return_error_if_m(db.versions[bucket].load(std::memory_order_acquire) == version,
+                          c.error,
+                          consistency_k,
+                          "Failure: Transaction Conflict");
+
+    if (!txn.changes.empty()) {
+        level_status_t status = db.native->Write(options, &batch);
+        if (export_error(status, c.error))
+            return;
+        for (auto const& [key, value] : txn.changes)
+            mark_changed(db, key);
+    }
+    ustore_sequence_number_t sequence_number = ++db.sequence_number;
+    commit_lock.unlock();
+
+    txn.changes.clear();
+    txn.watches.clear();
+    if (c.sequence_number)
+        *c.sequence_number = sequence_number;
 }
 
 /*********************************************************/
@@ -656,7 +1140,10 @@ void ustore_arena_free(ustore_arena_t c_arena) {
     clear_linked_memory(c_arena);
 }
 
-void ustore_transaction_free(ustore_transaction_t) {
+void ustore_transaction_free(ustore_transaction_t c_transaction) {
+    if (!c_transaction)
+        return;
+    delete reinterpret_cast<level_txn_t*>(c_transaction);
 }
 
 void ustore_database_free(ustore_database_t c_db) {
@@ -15,22 +15,39 @@
  * Moreover, not being the default variant, its significantly less optimized,
  * so after numerous tests we decided to stick to `BlockBasedTable`.
  * https://github.com/facebook/rocksdb/wiki/PlainTable-Format
+ *
+ * ## Key Encoding
+ * Keys are stored big-endian with the sign bit flipped, ordered by the default bytewise
+ * comparator. Unlike a custom comparator, it has fast-paths inside of RocksDB and
+ * allows fixed-length prefix extractors with prefix Bloom filters in memtables and SSTs.
  */
 
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
 #include <fstream>
 #include <filesystem>
 
+#include <unistd.h> // `getpid`
+
 #include <rocksdb/db.h>
+#include <rocksdb/table.h>         // `BlockBasedTableOptions`
+#include <rocksdb/cache.h>         // `NewLRUCache`, `HyperClockCacheOptions`
+#include <rocksdb/filter_policy.h> // `NewBloomFilterPolicy`
+#include <rocksdb/sst_file_writer.h> // `SstFileWriter`
 #include <rocksdb/utilities/options_util.h>
 #include <rocksdb/utilities/transaction.h>
 #include <rocksdb/utilities/optimistic_transaction_db.h>
+#include <rocksdb/utilities/transaction_db.h>
 
 #include "ustore/db.h"
 #include "ustore/cpp/ranges_args.hpp" // `places_arg_t`
 #include "helpers/linked_array.hpp"   // `uninitialized_array_gt`
-#include "helpers/full_scan.hpp"      // `reservoir_sample_iterator`
+#include "helpers/full_scan.hpp"      // `random_seek_sample_iterator`, `forward_scanner_gt`
+#include "helpers/key_encoding.hpp"   // `ordered_key_encoding_t`
 #include "helpers/config_loader.hpp"  // `config_loader_t`
+#include "helpers/group_commit.hpp"   // `group_commit_gt`
 
 namespace stdfs = std::filesystem;
 using namespace unum::ustore;
@@ -47,32 +64,33 @@ bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = true;
 
-using rocks_native_t = rocksdb::OptimisticTransactionDB;
+using rocks_native_t = rocksdb::StackableDB;
 using rocks_status_t = rocksdb::Status;
 using rocks_value_t = rocksdb::PinnableSlice;
 using rocks_txn_t = rocksdb::Transaction;
 using rocks_collection_t = rocksdb::ColumnFamilyHandle;
 
-struct key_comparator_t final : public rocksdb::Comparator {
-    inline int Compare(rocksdb::Slice const& a, rocksdb::Slice const& b) const override {
-        auto ai = *reinterpret_cast<ustore_key_t const*>(a.data());
-        auto bi = *reinterpret_cast<ustore_key_t const*>(b.data());
-        if (ai == bi)
-            return 0;
-        return ai < bi ? -1 : 1;
-    }
-    const char* Name() const override { return "i64"; }
-    void FindShortestSeparator(std::string*, rocksdb::Slice const&) const override {}
-    void FindShortSuccessor(std::string*) const override {}
-    bool CanKeysWithDifferentByteContentsBeEqual() const override { return false; }
-    bool IsSameLengthImmediateSuccessor(rocksdb::Slice const& s, rocksdb::Slice const& t) const override {
-        auto si = *reinterpret_cast<ustore_key_t const*>(s.data());
-        auto ti = *reinterpret_cast<ustore_key_t const*>(t.data());
-        return si + 1 == ti;
-    }
-};
+/**
+ * @brief Keys are stored big-endian with the sign bit flipped, so the default bytewise
+ * comparator orders them numerically, and leading bytes can feed prefix Bloom filters.
+ * Databases, created with the older native-endian "i64" comparator, must be migrated
+ * with `ustore_rocksdb_migrate`.
+ */
+using rocks_key_t = encoded_key_gt<ordered_key_encoding_t>;
 
-static key_comparator_t key_comparator_k = {};
+/**
+ * @brief Scans expected to export at least this many keys from
+ * a single collection, or marked with `ustore_option_scan_bulk_k`,
+ * prefetch the following blocks with `readahead_size`.
+ */
+static constexpr std::size_t long_scan_keys_k = 4096;
+static constexpr std::size_t long_scan_readahead_k = 2ul * 1024ul * 1024ul;
+
+/**
+ * @brief Smaller batches, marked with `ustore_option_write_bulk_k`, still go through
+ * the memtable, as creating and ingesting a file costs more than writing them.
+ */
+static constexpr std::size_t bulk_write_min_tasks_k = 1024;
 
 struct rocks_snapshot_t {
     rocksdb::Snapshot const* snapshot = nullptr;
@@ -82,17 +100,46 @@ struct rocks_db_t {
     std::vector<rocks_collection_t*> columns;
     std::unordered_map<ustore_size_t, rocks_snapshot_t*> snapshots;
     std::unique_ptr<rocks_native_t> native;
+    /// Exactly one of these points to `native`, depending on the "concurrency_control" setting
+    rocksdb::OptimisticTransactionDB* optimistic = nullptr;
+    rocksdb::TransactionDB* pessimistic = nullptr;
+    /// Deadlock detection and lock timeouts of pessimistic transactions
+    rocksdb::TransactionOptions pessimistic_options;
+    /// Defaults for the iterators of `ustore_scan`, overridable from the config
+    rocksdb::ReadOptions scan_options;
+    /// Nested engine config, consulted again, when new collections are created
+    json_t engine_config;
+    /// Block caches, shared by the whole DB under an empty name, or owned by collection profiles
+    std::unordered_map<std::string, std::shared_ptr<rocksdb::Cache>> block_caches;
+    /// Stages the SST files of bulk writes, until they are moved into the DB by ingestion
+    stdfs::path bulk_directory;
+    /// Unique for every process and every opening of the DB, to never reuse the names of leftovers
+    std::string bulk_files_prefix;
+    /// Names the temporary SST files of concurrent bulk writes
+    std::atomic<std::size_t> bulk_files_count {0};
+    /// Shares WAL syncs between concurrent writes with `ustore_option_write_flush_k`
+    group_commit_gt<rocks_status_t> group_commit;
     std::mutex mutex;
 };
 
-inline rocksdb::Slice to_slice(ustore_key_t const& key) noexcept {
-    return {reinterpret_cast<char const*>(&key), sizeof(ustore_key_t)};
+inline rocksdb::Slice to_slice(rocks_key_t const& key) noexcept {
+    return {key.bytes, sizeof(key.bytes)};
 }
 
 inline rocksdb::Slice to_slice(value_view_t value) noexcept {
     return {reinterpret_cast<const char*>(value.begin()), value.size()};
 }
 
+/**
+ * @brief Iterators, that walk a whole collection, must cross the boundaries
+ * of prefixes, if the collection was configured with a "prefix_extractor_length".
+ */
+inline rocksdb::ReadOptions total_order_options() noexcept {
+    rocksdb::ReadOptions options;
+    options.total_order_seek = true;
+    return options;
+}
+
 inline std::unique_ptr<rocks_value_t> make_value(ustore_error_t* c_error) noexcept {
     std::unique_ptr<rocks_value_t> value_uptr;
     safe_section("Allocating RocksDB-compatible value buffer", c_error, [&] {
@@ -101,6 +148,31 @@ inline std::unique_ptr<rocks_value_t> make_value(ustore_error_t* c_error) noexce
     return value_uptr;
 }
 
+/**
+ * @brief Arena-resident array of RocksDB objects, like `PinnableSlice`-s and `Status`-es,
+ * which, unlike our own outputs, must be constructed and destroyed.
+ */
+template <typename object_at>
+class arena_objects_gt {
+    object_at* begin_ = nullptr;
+    std::size_t count_ = 0;
+
+  public:
+    arena_objects_gt(std::size_t count, linked_memory_lock_t& arena, ustore_error_t* c_error) noexcept(false) {
+        auto tape = arena.alloc<object_at>(count, c_error, alignof(object_at));
+        return_if_error_m(c_error);
+        std::uninitialized_default_construct(tape.begin(), tape.end());
+        begin_ = tape.begin();
+        count_ = count;
+    }
+    arena_objects_gt(arena_objects_gt const&) = delete;
+    arena_objects_gt& operator=(arena_objects_gt const&) = delete;
+    ~arena_objects_gt() noexcept { std::destroy_n(begin_, count_); }
+
+    object_at* begin() const noexcept { return begin_; }
+    object_at& operator[](std::size_t i) const noexcept { return begin_[i]; }
+};
+
 bool export_error(rocks_status_t const& status, ustore_error_t* c_error) {
     if (status.ok())
         return false;
@@ -111,6 +183,8 @@ bool export_error(rocks_status_t const& status, ustore_error_t* c_error) {
         *c_error = "Failure: IO  Error";
     else if (status.IsInvalidArgument())
         *c_error = "Failure: Invalid Argument";
+    else if (status.IsBusy() || status.IsTimedOut() || status.IsTryAgain())
+        *c_error = "Failure: Transaction Conflict";
     else
         *c_error = "Failure";
     return true;
@@ -121,6 +195,160 @@ rocks_collection_t* rocks_collection(rocks_db_t& db, ustore_collection_t collect
                                                   : reinterpret_cast<rocks_collection_t*>(collection);
 }
 
+/*********************************************************/
+/*****************     Configuration      ****************/
+/*********************************************************/
+
+/**
+ * @brief Overrides the Column Family options, present in a "CFOptions" JSON object.
+ */
+void parse_column_options(json_t const& j_cf, rocksdb::ColumnFamilyOptions& cf_options) {
+    if (j_cf.contains("max_write_buffer_number"))
+        cf_options.max_write_buffer_number = j_cf["max_write_buffer_number"];
+    if (j_cf.contains("write_buffer_size"))
+        cf_options.write_buffer_size = j_cf["write_buffer_size"];
+    if (j_cf.contains("target_file_size_base"))
+        cf_options.target_file_size_base = j_cf["target_file_size_base"];
+    if (j_cf.contains("max_compaction_bytes"))
+        cf_options.max_compaction_bytes = j_cf["max_compaction_bytes"];
+    if (j_cf.contains("level_compaction_dynamic_level_bytes"))
+        cf_options.level_compaction_dynamic_level_bytes = j_cf["level_compaction_dynamic_level_bytes"];
+    if (j_cf.contains("level0_stop_writes_trigger"))
+        cf_options.level0_stop_writes_trigger = j_cf["level0_stop_writes_trigger"];
+    if (j_cf.contains("target_file_size_multiplier"))
+        cf_options.target_file_size_multiplier = j_cf["target_file_size_multiplier"];
+    if (j_cf.contains("max_bytes_for_level_multiplier"))
+        cf_options.max_bytes_for_level_multiplier = j_cf["max_bytes_for_level_multiplier"];
+    if (j_cf.contains("memtable_whole_key_filtering"))
+        cf_options.memtable_whole_key_filtering = j_cf["memtable_whole_key_filtering"];
+    if (j_cf.contains("memtable_prefix_bloom_size_ratio"))
+        cf_options.memtable_prefix_bloom_size_ratio = j_cf["memtable_prefix_bloom_size_ratio"];
+    // Prefixes are the most significant bytes of big-endian keys, so they group adjacent key ranges
+    if (j_cf.contains("prefix_extractor_length")) {
+        std::size_t prefix_length = j_cf["prefix_extractor_length"];
+        prefix_length = std::min(std::max(prefix_length, 1ul), sizeof(ustore_key_t));
+        cf_options.prefix_extractor.reset(rocksdb::NewFixedPrefixTransform(prefix_length));
+    }
+    if (j_cf.contains("optimize_filters_for_hits"))
+        cf_options.optimize_filters_for_hits = j_cf["optimize_filters_for_hits"];
+    if (j_cf.contains("compression"))
+        if (j_cf["compression"] != "kNoCompression")
+            log_warning_m(
+                "We discourage general-purpose compression in favour "
+                "of modality-aware compression in UStore\n");
+}
+
+/**
+ * @brief Overrides the `BlockBasedTable` options, present in a "BlockBasedTableOptions" JSON object.
+ * The @p block_cache is created on first request, if "block_cache_size" is specified.
+ */
+void parse_table_options(json_t const& j_table,
+                         std::shared_ptr<rocksdb::Cache>& block_cache,
+                         rocksdb::BlockBasedTableOptions& table_options,
+                         ustore_error_t* c_error) {
+
+    if (j_table.contains("block_size"))
+        table_options.block_size = j_table["block_size"];
+
+    std::size_t cache_size = 0;
+    return_error_if_m(config_loader_t::parse_volume(j_table, "block_cache_size", cache_size),
+                      c_error,
+                      args_wrong_k,
+                      "Invalid block cache size");
+    if (cache_size && !block_cache) {
+        std::string cache_kind = j_table.value("block_cache", "LRUCache");
+        if (cache_kind == "HyperClockCache") {
+            std::size_t entry_charge = j_table.value("block_cache_entry_charge", table_options.block_size);
+            block_cache = rocksdb::HyperClockCacheOptions(cache_size, entry_charge).MakeSharedCache();
+        }
+        else {
+            return_error_if_m(cache_kind == "LRUCache", c_error, args_wrong_k, "Unknown block cache kind");
+            block_cache = rocksdb::NewLRUCache(cache_size);
+        }
+    }
+    if (block_cache)
+        table_options.block_cache = block_cache;
+
+    if (j_table.contains("bloom_bits_per_key"))
+        table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(j_table["bloom_bits_per_key"].get<double>()));
+    if (j_table.contains("whole_key_filtering"))
+        table_options.whole_key_filtering = j_table["whole_key_filtering"];
+    if (j_table.contains("optimize_filters_for_memory"))
+        table_options.optimize_filters_for_memory = j_table["optimize_filters_for_memory"];
+    if (j_table.contains("cache_index_and_filter_blocks"))
+        table_options.cache_index_and_filter_blocks = j_table["cache_index_and_filter_blocks"];
+    if (j_table.contains("pin_l0_filter_and_index_blocks_in_cache"))
+        table_options.pin_l0_filter_and_index_blocks_in_cache = j_table["pin_l0_filter_and_index_blocks_in_cache"];
+    if (j_table.contains("data_block_hash_index"))
+        table_options.data_block_index_type =
+            j_table["data_block_hash_index"].get<bool>()
+                ? rocksdb::BlockBasedTableOptions::DataBlockIndexType::kDataBlockBinaryAndHash
+                : rocksdb::BlockBasedTableOptions::DataBlockIndexType::kDataBlockBinarySearch;
+
+    // Partitioned filters only work with partitioned indexes
+    if (j_table.contains("partition_filters")) {
+        table_options.partition_filters = j_table["partition_filters"];
+        if (table_options.partition_filters)
+            table_options.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+    }
+    if (j_table.contains("index_type")) {
+        std::string index_type = j_table["index_type"];
+        if (index_type == "kBinarySearch")
+            table_options.index_type = rocksdb::BlockBasedTableOptions::kBinarySearch;
+        else if (index_type == "kHashSearch")
+            table_options.index_type = rocksdb::BlockBasedTableOptions::kHashSearch;
+        else if (index_type == "kTwoLevelIndexSearch")
+            table_options.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+        else if (index_type == "kBinarySearchWithFirstKey")
+            table_options.index_type = rocksdb::BlockBasedTableOptions::kBinarySearchWithFirstKey;
+        else
+            return_error_m(c_error, "Unknown index type");
+    }
+}
+
+/**
+ * @brief Prepares the options of a collection, named @p name, from the nested engine config.
+ * Top-level "CFOptions" and "BlockBasedTableOptions" apply to every collection, and can be
+ * overridden per collection under "Collections", to tune hot and cold data differently.
+ * Profiles without their own "block_cache_size" share the block cache of the whole DB.
+ */
+void configure_collection(rocks_db_t& db,
+                          std::string const& name,
+                          rocksdb::ColumnFamilyOptions& cf_options,
+                          ustore_error_t* c_error) {
+
+    cf_options.comparator = rocksdb::BytewiseComparator();
+    json_t const& js = db.engine_config;
+    if (!js.is_object())
+        return;
+
+    json_t const* j_profile = nullptr;
+    if (js.contains("Collections") && js["Collections"].contains(name))
+        j_profile = &js["Collections"][name];
+
+    if (js.contains("CFOptions"))
+        parse_column_options(js["CFOptions"], cf_options);
+    if (j_profile && j_profile->contains("CFOptions"))
+        parse_column_options((*j_profile)["CFOptions"], cf_options);
+
+    bool has_table = js.contains("BlockBasedTableOptions");
+    bool has_own_table = j_profile && j_profile->contains("BlockBasedTableOptions");
+    if (!has_table && !has_own_table)
+        return;
+
+    rocksdb::BlockBasedTableOptions table_options;
+    if (has_table)
+        parse_table_options(js["BlockBasedTableOptions"], db.block_caches[""], table_options, c_error);
+    return_if_error_m(c_error);
+    if (has_own_table) {
+        json_t const& j_table = (*j_profile)["BlockBasedTableOptions"];
+        bool const owns_cache = j_table.contains("block_cache_size");
+        parse_table_options(j_table, db.block_caches[owns_cache ? name : std::string()], table_options, c_error);
+        return_if_error_m(c_error);
+    }
+    cf_options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+}
+
 /*********************************************************/
 /*****************	    C Interface 	  ****************/
 /*********************************************************/
@@ -152,6 +380,7 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
         // https://github.com/facebook/rocksdb/wiki/RocksDB-Options-File
         rocksdb::Options options;
         options.compression = rocksdb::kNoCompression;
+        db_ptr->scan_options.fill_cache = false;
         auto cf_options = rocksdb::ColumnFamilyOptions();
         std::vector<rocksdb::ColumnFamilyDescriptor> column_descriptors;
         return_error_if_m(config.engine.config_url.empty(), c.error, args_wrong_k, "Doesn't support URL configs");
@@ -182,57 +411,113 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
                     options.max_file_opening_threads = j_db["max_file_opening_threads"];
             }
 
-            if (js.contains("CFOptions")) {
-                auto j_cf = js["CFOptions"];
-                if (j_cf.contains("max_write_buffer_number"))
-                    cf_options.max_write_buffer_number = j_cf["max_write_buffer_number"];
-                if (j_cf.contains("write_buffer_size"))
-                    cf_options.write_buffer_size = j_cf["write_buffer_size"];
-                if (j_cf.contains("target_file_size_base"))
-                    cf_options.target_file_size_base = j_cf["target_file_size_base"];
-                if (j_cf.contains("max_compaction_bytes"))
-                    cf_options.max_compaction_bytes = j_cf["max_compaction_bytes"];
-                if (j_cf.contains("level_compaction_dynamic_level_bytes"))
-                    cf_options.level_compaction_dynamic_level_bytes = j_cf["level_compaction_dynamic_level_bytes"];
-                if (j_cf.contains("level0_stop_writes_trigger"))
-                    cf_options.level0_stop_writes_trigger = j_cf["level0_stop_writes_trigger"];
-                if (j_cf.contains("target_file_size_multiplier"))
-                    cf_options.target_file_size_multiplier = j_cf["target_file_size_multiplier"];
-                if (j_cf.contains("max_bytes_for_level_multiplier"))
-                    cf_options.max_bytes_for_level_multiplier = j_cf["max_bytes_for_level_multiplier"];
-                if (j_cf.contains("compression"))
-                    if (j_cf["compression"] != "kNoCompression")
-                        log_warning_m(
-                            "We discourage general-purpose compression in favour "
-                            "of modality-aware compression in UStore\n");
+            if (js.contains("ReadOptions")) {
+                auto j_read = js["ReadOptions"];
+                if (j_read.contains("readahead_size"))
+                    db_ptr->scan_options.readahead_size = j_read["readahead_size"];
+                if (j_read.contains("adaptive_readahead"))
+                    db_ptr->scan_options.adaptive_readahead = j_read["adaptive_readahead"];
+                if (j_read.contains("auto_prefix_mode"))
+                    db_ptr->scan_options.auto_prefix_mode = j_read["auto_prefix_mode"];
+                if (j_read.contains("async_io"))
+                    db_ptr->scan_options.async_io = j_read["async_io"];
+                if (j_read.contains("fill_cache"))
+                    db_ptr->scan_options.fill_cache = j_read["fill_cache"];
             }
         }
+        // Transactions are optimistic by default, validating conflicts on commit.
+        // Under high contention, locking the keys on first access avoids abort storms.
+        bool pessimistic = false;
+        rocksdb::TransactionDBOptions txn_db_options;
+        db_ptr->pessimistic_options.deadlock_detect = true;
+        if (config.engine.config.contains("TransactionDBOptions")) {
+            auto j_txn = config.engine.config["TransactionDBOptions"];
+            std::string concurrency_control = j_txn.value("concurrency_control", "optimistic");
+            return_error_if_m(concurrency_control == "optimistic" || concurrency_control == "pessimistic",
+                              c.error,
+                              args_wrong_k,
+                              "Unknown concurrency control");
+            pessimistic = concurrency_control == "pessimistic";
+            if (j_txn.contains("max_num_locks"))
+                txn_db_options.max_num_locks = j_txn["max_num_locks"];
+            if (j_txn.contains("num_stripes"))
+                txn_db_options.num_stripes = j_txn["num_stripes"];
+            if (j_txn.contains("transaction_lock_timeout"))
+                txn_db_options.transaction_lock_timeout = j_txn["transaction_lock_timeout"];
+            if (j_txn.contains("default_lock_timeout"))
+                txn_db_options.default_lock_timeout = j_txn["default_lock_timeout"];
+            if (j_txn.contains("deadlock_detect"))
+                db_ptr->pessimistic_options.deadlock_detect = j_txn["deadlock_detect"];
+            if (j_txn.contains("deadlock_detect_depth"))
+                db_ptr->pessimistic_options.deadlock_detect_depth = j_txn["deadlock_detect_depth"];
+        }
+
+        // Scans start at arbitrary keys and cross prefixes, unless RocksDB decides per `Seek()`
+        db_ptr->scan_options.total_order_seek = !db_ptr->scan_options.auto_prefix_mode;
 
         rocksdb::ConfigOptions config_options;
         status = rocksdb::LoadLatestOptions(config_options, root, &options, &column_descriptors);
         return_error_if_m(status.ok() || status.IsNotFound(), c.error, error_unknown_k, "Recovering RocksDB state");
 
-        cf_options.comparator = &key_comparator_k;
+        // Collections are tuned from the nested config, on top of their persisted options
+        db_ptr->engine_config = config.engine.config;
         if (column_descriptors.empty())
             column_descriptors.push_back({rocksdb::kDefaultColumnFamilyName, std::move(cf_options)});
-        else {
-            for (auto& column_descriptor : column_descriptors)
-                column_descriptor.options.comparator = &key_comparator_k;
+        for (auto& column_descriptor : column_descriptors) {
+            configure_collection(*db_ptr, column_descriptor.name, column_descriptor.options, c.error);
+            return_if_error_m(c.error);
         }
 
         options.create_if_missing = true;
-        options.comparator = &key_comparator_k;
+        options.comparator = rocksdb::BytewiseComparator();
 
         // Storage paths
         for (auto const& disk : config.data_directories)
             options.db_paths.push_back({disk.path, disk.max_size});
 
         rocks_native_t* native_db = nullptr;
-        rocksdb::OptimisticTransactionDBOptions txn_options;
-        status = rocks_native_t::Open(options, txn_options, root, column_descriptors, &db_ptr->columns, &native_db);
+        if (pessimistic) {
+            status = rocksdb::TransactionDB::Open( //
+                options,
+                txn_db_options,
+                root,
+                column_descriptors,
+                &db_ptr->columns,
+                &db_ptr->pessimistic);
+            native_db = db_ptr->pessimistic;
+        }
+        else {
+            rocksdb::OptimisticTransactionDBOptions txn_options;
+            status = rocksdb::OptimisticTransactionDB::Open( //
+                options,
+                txn_options,
+                root,
+                column_descriptors,
+                &db_ptr->columns,
+                &db_ptr->optimistic);
+            native_db = db_ptr->optimistic;
+        }
+        return_error_if_m(!status.IsInvalidArgument() || status.ToString().find("comparator") == std::string::npos,
+                          c.error,
+                          args_wrong_k,
+                          "Legacy key encoding, migrate with `ustore_rocksdb_migrate`");
         return_error_if_m(status.ok(), c.error, error_unknown_k, "Opening RocksDB with options");
 
         db_ptr->native = std::unique_ptr<rocks_native_t>(native_db);
+
+        // Files of interrupted bulk writes were never ingested. The DB is locked by now,
+        // so no other process can be staging new files in the same directory.
+        std::error_code fs_error;
+        db_ptr->bulk_directory = root / "bulk";
+        stdfs::remove_all(db_ptr->bulk_directory, fs_error);
+        stdfs::create_directories(db_ptr->bulk_directory, fs_error);
+        if (fs_error) {
+            ustore_database_free(db_ptr);
+            return_error_m(c.error, "Couldn't prepare the directory for bulk writes");
+        }
+        auto opened_at = std::chrono::system_clock::now().time_since_epoch();
+        db_ptr->bulk_files_prefix = std::to_string(::getpid()) + "_" +
+                                    std::to_string(std::chrono::nanoseconds(opened_at).count()) + "_";
         *c.db = db_ptr;
     });
 }
@@ -317,14 +602,15 @@ void write_one( //
     bool const safe = c_options & ustore_option_write_flush_k;
     bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
 
+    // Durable writes only reach the WAL here and are synced by `sync_wal`
     rocksdb::WriteOptions options;
-    options.sync = safe;
     options.disableWAL = !safe;
 
     auto place = places[0];
     auto content = contents[0];
     auto collection = rocks_collection(db, place.collection);
-    auto key = to_slice(place.key);
+    rocks_key_t key_bytes {place.key};
+    auto key = to_slice(key_bytes);
     rocks_status_t status;
 
     if (txn_ptr)
@@ -357,7 +643,6 @@ void write_many( //
     bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
 
     rocksdb::WriteOptions options;
-    options.sync = safe;
     options.disableWAL = !safe;
 
     if (txn_ptr) {
@@ -365,7 +650,8 @@ void write_many( //
             auto place = places[i];
             auto content = contents[i];
             auto collection = rocks_collection(db, place.collection);
-            auto key = to_slice(place.key);
+            rocks_key_t key_bytes {place.key};
+            auto key = to_slice(key_bytes);
             auto status =   //
                 !content    //
                     ? watch //
@@ -384,7 +670,8 @@ void write_many( //
             auto place = places[i];
             auto content = contents[i];
             auto collection = rocks_collection(db, place.collection);
-            auto key = to_slice(place.key);
+            rocks_key_t key_bytes {place.key};
+            auto key = to_slice(key_bytes);
             auto status = !content //
                               ? batch.Delete(collection, key)
                               : batch.Put(collection, key, to_slice(content));
@@ -396,9 +683,102 @@ void write_many( //
     }
 }
 
+/**
+ * @brief Sorts a large batch by collection and key, writes the entries of every collection
+ * into a separate SST file and atomically ingests all of them with `IngestExternalFiles`,
+ * bypassing the WAL, the memtable and the first levels of compaction.
+ * Of duplicate keys the last entry wins, just like in a `WriteBatch`.
+ */
+void write_bulk( //
+    rocks_db_t& db,
+    places_arg_t const& places,
+    contents_arg_t const& contents,
+    linked_memory_lock_t& arena,
+    ustore_error_t* c_error) noexcept(false) {
+
+    auto order = arena.alloc<std::size_t>(places.size(), c_error);
+    return_if_error_m(c_error);
+    auto less = [&](std::size_t lhs_idx, std::size_t rhs_idx) noexcept {
+        place_t lhs = places[lhs_idx], rhs = places[rhs_idx];
+        return lhs.collection != rhs.collection ? lhs.collection < rhs.collection : lhs.key < rhs.key;
+    };
+    std::iota(order.begin(), order.end(), 0ul);
+    std::stable_sort(order.begin(), order.end(), less);
+
+    std::vector<rocksdb::IngestExternalFileArg> files;
+    auto remove_files = [&] {
+        std::error_code ignored_error;
+        for (auto const& file : files)
+            stdfs::remove(file.external_files.front(), ignored_error);
+    };
+
+    rocks_status_t status;
+    for (std::size_t group_begin = 0; group_begin != order.size();) {
+        ustore_collection_t collection_id = places[order[group_begin]].collection;
+        std::size_t group_end = group_begin;
+        while (group_end != order.size() && places[order[group_end]].collection == collection_id)
+            ++group_end;
+
+        // The file is built with the options of the collection, to share its filters and block size
+        auto collection = rocks_collection(db, collection_id);
+        rocksdb::IngestExternalFileArg file;
+        file.column_family = collection;
+        file.options.move_files = true;
+        auto file_name = db.bulk_files_prefix + std::to_string(db.bulk_files_count++) + ".sst";
+        file.external_files.push_back((db.bulk_directory / file_name).string());
+        files.push_back(file);
+
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), db.native->GetOptions(collection), collection);
+        status = writer.Open(file.external_files.front());
+        for (std::size_t order_idx = group_begin; order_idx != group_end && status.ok(); ++order_idx) {
+            place_t place = places[order[order_idx]];
+            bool overwritten = order_idx + 1 != group_end && places[order[order_idx + 1]].key == place.key;
+            if (overwritten)
+                continue;
+            auto content = contents[order[order_idx]];
+            rocks_key_t key_bytes {place.key};
+            status = content ? writer.Put(to_slice(key_bytes), to_slice(content)) : writer.Delete(to_slice(key_bytes));
+        }
+        if (status.ok())
+            status = writer.Finish();
+        if (export_error(status, c_error))
+            return remove_files();
+        group_begin = group_end;
+    }
+
+    // Moved files are owned by RocksDB, but a failed ingestion leaves them behind
+    status = db.native->IngestExternalFiles(files);
+    if (export_error(status, c_error))
+        remove_files();
+}
+
+/**
+ * @brief Persists the WAL past the preceding write of the calling thread.
+ * Instead of a separate `fsync` for every write with `sync = true`, concurrent
+ * writers share syncs through a group commit. With a @p callback, the thread
+ * doesn't wait for a sync, unless it has to run one itself.
+ */
+void sync_wal( //
+    rocks_db_t& db,
+    ustore_callback_t callback,
+    ustore_callback_payload_t callback_payload,
+    ustore_error_t* c_error) noexcept(false) {
+
+    auto sync = [&] { return db.native->FlushWAL(true); };
+    if (!callback) {
+        export_error(db.group_commit.wait(sync), c_error);
+        return;
+    }
+    db.group_commit.notify(sync, [=](rocks_status_t const& status) {
+        export_error(status, c_error);
+        callback(callback_payload);
+    });
+}
+
 void ustore_write(ustore_write_t* c_ptr) {
 
     ustore_write_t& c = *c_ptr;
+    write_completion_t completion {c};
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
     if (!c.tasks_count)
         return;
@@ -418,9 +798,23 @@ void ustore_write(ustore_write_t* c_ptr) {
     validate_write(c.transaction, places, contents, c.options, c.error);
     return_if_error_m(c.error);
 
+    bool const bulk = (c.options & ustore_option_write_bulk_k) && !c.transaction;
+    if (bulk && c.tasks_count >= bulk_write_min_tasks_k) {
+        linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
+        return_if_error_m(c.error);
+        safe_section("Bulk-loading into RocksDB", c.error, [&] { write_bulk(db, places, contents, arena, c.error); });
+        return;
+    }
+
     safe_section("Writing into RocksDB", c.error, [&] {
         auto func = c.tasks_count == 1 ? &write_one : &write_many;
         func(db, &txn, places, contents, c.options, c.error);
+        return_if_error_m(c.error);
+        if (!(c.options & ustore_option_write_flush_k) || c.transaction)
+            return;
+        if (c.callback)
+            completion.release();
+        sync_wal(db, c.callback, c.callback_payload, c.error);
     });
 }
 
@@ -445,7 +839,8 @@ void read_one( //
 
     place_t place = places[0];
     auto col = rocks_collection(db, place.collection);
-    auto key = to_slice(place.key);
+    rocks_key_t key_bytes {place.key};
+    auto key = to_slice(key_bytes);
     auto value_uptr = make_value(c_error);
     return_if_error_m(c_error);
 
@@ -467,14 +862,22 @@ void read_one( //
         enumerator(0, value_view_t {});
 }
 
-template <typename value_enumerator_at>
+/**
+ * @brief Reads a batch with the `PinnableSlice` overloads of `MultiGet`, so the values
+ * stay pinned in the block cache or the memtable, instead of being copied into strings.
+ * Before the values are enumerated, the @p reserve callback gets their total length,
+ * so that the output tape can be allocated at once.
+ */
+template <typename value_enumerator_at, typename tape_reserver_at>
 void read_many( //
     rocks_db_t& db,
     rocks_txn_t* txn_ptr,
     rocks_snapshot_t* snap_ptr,
     places_arg_t places,
     ustore_options_t const c_options,
+    linked_memory_lock_t& arena,
     value_enumerator_at enumerator,
+    tape_reserver_at reserve,
     ustore_error_t* c_error) noexcept(false) {
 
     rocksdb::ReadOptions options;
@@ -485,25 +888,58 @@ void read_many( //
     }
 
     bool watch = !(c_options & ustore_option_transaction_dont_watch_k);
-    std::vector<rocks_collection_t*> cols(places.count);
-    std::vector<rocksdb::Slice> keys(places.count);
-    std::vector<std::string> vals(places.count);
+    auto cols = arena.alloc<rocks_collection_t*>(places.count, c_error);
+    return_if_error_m(c_error);
+    auto keys = arena.alloc<rocksdb::Slice>(places.count, c_error, alignof(rocksdb::Slice));
+    return_if_error_m(c_error);
+    auto keys_bytes = arena.alloc<rocks_key_t>(places.count, c_error);
+    return_if_error_m(c_error);
+    arena_objects_gt<rocks_value_t> vals(places.count, arena, c_error);
+    return_if_error_m(c_error);
+    arena_objects_gt<rocks_status_t> statuses(places.count, arena, c_error);
+    return_if_error_m(c_error);
+
+    // RocksDB sorts the keys by column family ID and key, unless they already are
+    bool same_column = true;
+    bool sorted = true;
     for (std::size_t i = 0; i != places.size(); ++i) {
         place_t place = places[i];
         cols[i] = rocks_collection(db, place.collection);
-        keys[i] = to_slice(place.key);
+        keys_bytes[i] = rocks_key_t {place.key};
+        keys[i] = to_slice(keys_bytes[i]);
+        if (!i)
+            continue;
+        same_column &= cols[i] == cols[i - 1];
+        auto previous_id = cols[i - 1]->GetID();
+        auto id = cols[i]->GetID();
+        sorted &= previous_id < id || (previous_id == id && places[i - 1].key <= place.key);
     }
 
-    std::vector<rocks_status_t> statuses = //
-        txn_ptr                            //
-            ? watch                        //
-                  ? txn_ptr->MultiGetForUpdate(options, cols, keys, &vals)
-                  : txn_ptr->MultiGet(options, cols, keys, &vals)
-            : db.native->MultiGet(options, cols, keys, &vals);
+    // Transactions only batch lookups within one column family,
+    // and lookups for update are never batched
+    if (!txn_ptr)
+        db.native->MultiGet(options, places.count, cols.begin(), keys.begin(), vals.begin(), statuses.begin(), sorted);
+    else if (!watch && same_column)
+        txn_ptr->MultiGet(options, cols[0], places.count, keys.begin(), vals.begin(), statuses.begin(), sorted);
+    else
+        for (std::size_t i = 0; i != places.size(); ++i)
+            statuses[i] = watch //
+                              ? txn_ptr->GetForUpdate(options, cols[i], keys[i], &vals[i])
+                              : txn_ptr->Get(options, cols[i], keys[i], &vals[i]);
+
+    std::size_t total_length = 0;
+    for (std::size_t i = 0; i != places.size(); ++i) {
+        if (statuses[i].IsNotFound())
+            continue;
+        if (export_error(statuses[i], c_error))
+            return;
+        total_length += vals[i].size();
+    }
+    reserve(total_length);
+    return_if_error_m(c_error);
+
     for (std::size_t i = 0; i != places.size(); ++i) {
         if (!statuses[i].IsNotFound()) {
-            if (export_error(statuses[i], c_error))
-                return;
             auto begin = reinterpret_cast<ustore_bytes_cptr_t>(vals[i].data());
             auto length = static_cast<ustore_length_t>(vals[i].size());
             enumerator(i, value_view_t {begin, length});
@@ -554,10 +990,16 @@ void ustore_read(ustore_read_t* c_ptr) {
         }
     };
 
+    // Every value is copied just once, straight from the pinned slices
+    auto tape_reserver = [&](std::size_t total_length) {
+        if (needs_export)
+            contents.reserve(total_length, c.error);
+    };
+
     safe_section("Reading from RocksDB", c.error, [&] {
         c.tasks_count == 1 //
             ? read_one(db, &txn, &snap, places, c.options, data_enumerator, c.error)
-            : read_many(db, &txn, &snap, places, c.options, data_enumerator, c.error);
+            : read_many(db, &txn, &snap, places, c.options, arena, data_enumerator, tape_reserver, c.error);
         offs[places.count] = contents.size();
 
         if (needs_export)
@@ -594,17 +1036,46 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
-    // 2. Fetch the data
-    rocksdb::ReadOptions options;
-    options.fill_cache = false;
+    // 2. Fetch the data, serving all the tasks of one collection with a single iterator,
+    // moving in the order of start keys. Every task fills its own slice, sized by its limit.
+    auto order = order_scan_tasks(tasks, arena, c.error);
+    return_if_error_m(c.error);
+    auto slice_offsets = arena.alloc<std::size_t>(tasks.count, c.error);
+    return_if_error_m(c.error);
+    auto slice_counts = arena.alloc<ustore_length_t>(tasks.count, c.error);
+    return_if_error_m(c.error);
+    for (std::size_t task_idx = 0, slice_offset = 0; task_idx != tasks.count; ++task_idx) {
+        slice_offsets[task_idx] = slice_offset;
+        slice_offset += tasks.limits[task_idx];
+    }
 
-    if (c.snapshot)
-        options.snapshot = snap.snapshot;
+    // Values are pulled from the same iterator positions, if requested
+    bool const needs_values = c.values != nullptr;
+    scanned_values_t values(arena);
+    if (needs_values)
+        values.reserve(arena, total_keys, c.error);
+    return_if_error_m(c.error);
 
-    for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
-        scan_t task = tasks[i];
-        auto collection = rocks_collection(db, task.collection);
+    for (std::size_t order_idx = 0; order_idx != tasks.count;) {
+        ustore_collection_t collection_id = tasks[order[order_idx]].collection;
+        std::size_t group_end = order_idx;
+        std::size_t group_keys = 0;
+        for (; group_end != tasks.count && tasks[order[group_end]].collection == collection_id; ++group_end)
+            group_keys += tasks[order[group_end]].limit;
+
+        rocksdb::ReadOptions options = db.scan_options;
+        if (c.snapshot)
+            options.snapshot = snap.snapshot;
+        bool const bulk = c.options & ustore_option_scan_bulk_k;
+        if ((bulk || group_keys >= long_scan_keys_k) && !options.readahead_size) {
+            options.readahead_size = long_scan_readahead_k;
+            options.adaptive_readahead = true;
+        }
+        // One-off passes shouldn't evict the blocks used by online lookups
+        if (bulk)
+            options.fill_cache = false;
 
+        auto collection = rocks_collection(db, collection_id);
         std::unique_ptr<rocksdb::Iterator> it;
         safe_section("Creating a RocksDB iterator", c.error, [&] {
             it = c.transaction //
@@ -613,21 +1084,35 @@ void ustore_scan(ustore_scan_t* c_ptr) {
         });
         return_if_error_m(c.error);
 
-        offsets[i] = keys_output - *c.keys;
-
-        ustore_size_t j = 0;
-        it->Seek(to_slice(task.min_key));
-        while (it->Valid() && j != task.limit) {
-            std::memcpy(keys_output, it->key().data(), sizeof(ustore_key_t));
-            ++keys_output;
-            ++j;
-            it->Next();
+        forward_scanner_gt<rocksdb::Iterator, ordered_key_encoding_t> scanner {*it};
+        for (; order_idx != group_end; ++order_idx) {
+            std::size_t task_idx = order[order_idx];
+            scan_t task = tasks[task_idx];
+            scanner.seek(task.min_key);
+            std::size_t slice_offset = slice_offsets[task_idx];
+            slice_counts[task_idx] = scanner.read(task.limit, keys_output + slice_offset, [&](std::size_t key_idx) {
+                if (needs_values)
+                    values.push(slice_offset + key_idx, scanner.value(), c.error);
+            });
+            return_if_error_m(c.error);
         }
+        return_error_if_m(it->status().ok(), c.error, error_unknown_k, "Scan Failure");
+    }
 
-        counts[i] = j;
+    // Slices only move towards the beginning, so they can be compacted in order
+    for (std::size_t task_idx = 0; task_idx != tasks.count; ++task_idx) {
+        offsets[task_idx] = keys_output - *c.keys;
+        counts[task_idx] = slice_counts[task_idx];
+        if (slice_counts[task_idx])
+            std::memmove(keys_output, *c.keys + slice_offsets[task_idx], slice_counts[task_idx] * sizeof(ustore_key_t));
+        if (needs_values)
+            values.move(slice_offsets[task_idx], keys_output - *c.keys, slice_counts[task_idx]);
+        keys_output += slice_counts[task_idx];
     }
+    offsets[tasks.count] = keys_output - *c.keys;
 
-    offsets[tasks.size()] = keys_output - *c.keys;
+    if (needs_values)
+        values.export_to(arena, keys_output - *c.keys, c.values_offsets, c.values_lengths, c.values, c.error);
 }
 
 void ustore_sample(ustore_sample_t* c_ptr) {
@@ -658,7 +1143,7 @@ void ustore_sample(ustore_sample_t* c_ptr) {
     return_if_error_m(c.error);
 
     // 2. Fetch the data
-    rocksdb::ReadOptions options;
+    rocksdb::ReadOptions options = total_order_options();
     options.fill_cache = false;
 
     if (c.snapshot)
@@ -677,11 +1162,29 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         });
         return_if_error_m(c.error);
 
+        // Parts of the key range are weighed by the approximate size of their files and memtables
+        auto weigh = [&](ustore_key_t const* bounds, std::uint64_t* weights) {
+            rocks_key_t bounds_bytes[sample_ranges_k + 1];
+            rocksdb::Range ranges[sample_ranges_k];
+            for (std::size_t part = 0; part != sample_ranges_k + 1; ++part)
+                bounds_bytes[part] = rocks_key_t {bounds[part]};
+            for (std::size_t part = 0; part != sample_ranges_k; ++part)
+                ranges[part] = rocksdb::Range(to_slice(bounds_bytes[part]), to_slice(bounds_bytes[part + 1]));
+            rocksdb::SizeApproximationOptions size_options;
+            size_options.include_memtables = true;
+            size_options.files_size_error_margin = 0.1;
+            db.native->GetApproximateSizes(size_options, collection, ranges, sample_ranges_k, weights);
+        };
+
         ptr_range_gt<ustore_key_t> sampled_keys(keys_output, task.limit);
-        reservoir_sample_iterator(it, sampled_keys, c.error);
+        std::size_t count = 0;
+        safe_section("Sampling RocksDB", c.error, [&] {
+            random_seek_sample_iterator<ordered_key_encoding_t>(it, sampled_keys, weigh, count, c.error);
+        });
+        return_if_error_m(c.error);
 
-        counts[task_idx] = task.limit;
-        keys_output += task.limit;
+        counts[task_idx] = static_cast<ustore_length_t>(count);
+        keys_output += count;
     }
     offsets[samples.count] = keys_output - *c.keys;
 }
@@ -718,7 +1221,8 @@ void ustore_measure(ustore_measure_t* c_ptr) {
         auto collection = rocks_collection(db, collections[i]);
         ustore_key_t const min_key = start_keys[i];
         ustore_key_t const max_key = end_keys[i];
-        range = rocksdb::Range(to_slice(min_key), to_slice(max_key));
+        rocks_key_t min_key_bytes {min_key}, max_key_bytes {max_key};
+        range = rocksdb::Range(to_slice(min_key_bytes), to_slice(max_key_bytes));
         safe_section("Retrieving properties from RocksDB", c.error, [&] {
             status = db.native->GetApproximateSizes(options, collection, &range, 1, &approximate_size);
             if (export_error(status, c.error))
@@ -753,7 +1257,11 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
 
     rocks_collection_t* collection = nullptr;
     auto cf_options = rocksdb::ColumnFamilyOptions();
-    cf_options.comparator = &key_comparator_k;
+    {
+        std::lock_guard<std::mutex> locker(db.mutex);
+        configure_collection(db, c.name, cf_options, c.error);
+    }
+    return_if_error_m(c.error);
     rocks_status_t status = db.native->CreateColumnFamily(std::move(cf_options), c.name, &collection);
     if (!export_error(status, c.error)) {
         db.columns.push_back(collection);
@@ -804,7 +1312,7 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
     else if (c.mode == ustore_drop_keys_vals_k) {
         rocksdb::WriteBatch batch;
         auto it =
-            std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(rocksdb::ReadOptions(), collection_ptr_to_clear));
+            std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(total_order_options(), collection_ptr_to_clear));
         for (it->SeekToFirst(); it->Valid(); it->Next())
             batch.Delete(collection_ptr_to_clear, it->key());
         rocks_status_t status = db.native->Write(options, &batch);
@@ -815,7 +1323,7 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
     else if (c.mode == ustore_drop_vals_k) {
         rocksdb::WriteBatch batch;
         auto it =
-            std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(rocksdb::ReadOptions(), collection_ptr_to_clear));
+            std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(total_order_options(), collection_ptr_to_clear));
         for (it->SeekToFirst(); it->Valid(); it->Next())
             batch.Put(collection_ptr_to_clear, it->key(), rocksdb::Slice());
         rocks_status_t status = db.native->Write(options, &batch);
@@ -882,15 +1390,20 @@ void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
     validate_transaction_begin(c.transaction, c.options, c.error);
     return_if_error_m(c.error);
 
+    // Durable transactions are synced on commit by `sync_wal`
     bool const safe = c.options & ustore_option_write_flush_k;
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
     rocks_txn_t& txn = **reinterpret_cast<rocks_txn_t**>(c.transaction);
-    rocksdb::OptimisticTransactionOptions txn_options;
-    txn_options.set_snapshot = false;
     rocksdb::WriteOptions options;
-    options.sync = safe;
     options.disableWAL = !safe;
-    auto new_txn = db.native->BeginTransaction(options, txn_options, &txn);
+    rocks_txn_t* new_txn = nullptr;
+    if (db.pessimistic)
+        new_txn = db.pessimistic->BeginTransaction(options, db.pessimistic_options, &txn);
+    else {
+        rocksdb::OptimisticTransactionOptions txn_options;
+        txn_options.set_snapshot = false;
+        new_txn = db.optimistic->BeginTransaction(options, txn_options, &txn);
+    }
     if (!new_txn)
         *c.error = "Couldn't start a transaction!";
     else
@@ -917,6 +1430,11 @@ void ustore_transaction_commit(ustore_transaction_commit_t* c_ptr) {
             *c.sequence_number = db.native->GetLatestSequenceNumber();
         db.mutex.unlock();
     }
+    return_if_error_m(c.error);
+
+    bool const safe = !txn.GetWriteOptions()->disableWAL;
+    if (safe)
+        safe_section("Syncing RocksDB WAL", c.error, [&] { sync_wal(db, nullptr, nullptr, c.error); });
 }
 
 void ustore_arena_free(ustore_arena_t c_arena) {
@@ -5,39 +5,49 @@
  * @brief Embedded In-Memory Key-Value Store built on @b AVL trees or STL.
  * This implementation uses straightforward approach to implement concurrency.
  * It keeps all the pairs sorted and is pretty fast for a BST-based container.
+ * Persistence relies on a Write-Ahead Log, periodically checkpointed into Parquet.
  */
 
-#include <stdio.h> // Saving/reading from disk
+#include <stdio.h>  // Saving/reading from disk
+#include <unistd.h> // `fdatasync`
 
 #include <map>
+#include <deque>
 #include <vector>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <shared_mutex>
+#include <thread>
+#include <condition_variable>
 #include <mutex>      // `std::unique_lock`
 #include <numeric>    // `std::accumulate`
+#include <algorithm>  // `std::find`
 #include <atomic>     // Thread-safe generation counters
 #include <filesystem> // Enumerating the directory
 #include <fstream>    // Passing file contents to JSON parser
 
-// TODO: These alternative containers need further testing:
-// #include <ucset/consistent_avl.hpp> // `ucset::consistent_avl_gt`
-// #include <ucset/partitioned.hpp>    // `ucset::partitioned_gt`
 #include <ucset/consistent_set.hpp> // `ucset::consistent_set_gt`
-#include <ucset/locked.hpp>         // `ucset::locked_gt`
 
 #include <nlohmann/json.hpp>       // `nlohmann::json`
 #include <arrow/io/file.h>         // `arrow::io::ReadableFile`
-#include <parquet/stream_reader.h> // `parquet::StreamReader`
-#include <parquet/stream_writer.h> // `parquet::StreamWriter`
+#include <parquet/file_reader.h>   // `parquet::ParquetFileReader`
+#include <parquet/file_writer.h>   // `parquet::ParquetFileWriter`
+#include <parquet/column_reader.h> // `parquet::Int64Reader`
+#include <parquet/column_writer.h> // `parquet::Int64Writer`
 
 #include "ustore/db.h"
 #include "helpers/file.hpp"
 #include "helpers/linked_memory.hpp" // `linked_memory_t`
 #include "helpers/linked_array.hpp"  // `unintialized_vector_gt`
 #include "helpers/config_loader.hpp" // `config_loader_t`
+#include "helpers/thread_pool.hpp"   // `thread_pool_t`
+#include "helpers/slab_allocator.hpp" // `slab_allocator_t`
+#include "helpers/partitioned_set.hpp" // `partitioned_set_gt`
+#include "helpers/full_scan.hpp"       // `scanned_values_t`
+#include "helpers/group_commit.hpp"    // `group_commit_gt`
 #include "ustore/cpp/ranges_args.hpp"   // `places_arg_t`
 
 /*********************************************************/
@@ -49,7 +59,7 @@ ustore_length_t const ustore_length_missing_k = std::numeric_limits<ustore_lengt
 ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max();
 bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
-bool const ustore_supports_snapshots_k = false;
+bool const ustore_supports_snapshots_k = true;
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
@@ -62,53 +72,163 @@ using namespace unum;
 namespace stdfs = std::filesystem;
 using json_t = nlohmann::json;
 
-using blob_allocator_t = std::allocator<byte_t>;
-
 struct ucset_options_t {
     bool encryption = false;
     bool compression = false;
+    /**
+     * @brief Once values approach this much RAM, the least recently used ones are
+     * moved into a memory-mapped file in the DB directory. Zero means no limit.
+     */
     size_t memory_limit = 0;
+    /**
+     * @brief Once the Write-Ahead Log grows beyond this size, the DB
+     * is checkpointed into Parquet files in the background.
+     */
+    size_t checkpoint_size = 64ul * 1024ul * 1024ul;
+    /**
+     * @brief Number of threads, used to load and checkpoint collections.
+     * Zero means "as many as there are hardware threads".
+     */
+    size_t threads = 0;
+    /**
+     * @brief Batched reads and scans of at least this many tasks are split
+     * between the `threads`. Zero keeps all of them on the calling thread.
+     */
+    size_t parallel_batch_size = 0;
+    /**
+     * @brief Number of independently locked parts of the container, from 1 to 64.
+     * A single partition means a single global lock.
+     */
+    size_t partitions = 16;
 };
 
-struct pair_t {
-    collection_key_t collection_key;
-    value_view_t range;
+/**
+ * @brief Owning storage for a single value, of the same size as `value_view_t`.
+ * Short values are kept inline, longer ones are placed into a `slab_allocator_t`,
+ * which may spill them into a memory-mapped file, if the `memory_limit` is reached.
+ * Values, that get cold, are moved there later with `evict`.
+ * Missing values have a `ustore_length_missing_k` length, like in `value_view_t`.
+ */
+class value_storage_t {
+  public:
+    static constexpr std::size_t inline_capacity_k = 12;
+
+  private:
+    /// Either the contents of a short value, or the address of a long one,
+    /// followed by a flag, marking values spilled into the overflow file.
+    byte_t bytes_[inline_capacity_k];
+    ustore_length_t length_ = ustore_length_missing_k;
+
+    bool is_inline() const noexcept { return length_ <= inline_capacity_k; }
+    bool is_allocated() const noexcept { return length_ != ustore_length_missing_k && !is_inline(); }
+    bool is_spilled() const noexcept { return bytes_[sizeof(byte_t*)] != byte_t(0); }
+    byte_t* address() const noexcept {
+        byte_t* begin;
+        std::memcpy(&begin, bytes_, sizeof(begin));
+        return begin;
+    }
 
-    pair_t() = default;
-    pair_t(pair_t const&) = delete;
-    pair_t& operator=(pair_t const&) = delete;
+  public:
+    value_storage_t() noexcept = default;
+    value_storage_t(value_storage_t const&) = delete;
+    value_storage_t& operator=(value_storage_t const&) = delete;
 
-    pair_t(collection_key_t collection_key) noexcept : collection_key(collection_key) {}
+    value_storage_t(value_view_t other, slab_allocator_t& allocator, ustore_error_t* c_error) noexcept {
+        if (!other)
+            return;
 
-    pair_t(collection_key_t collection_key, value_view_t other, ustore_error_t* c_error) noexcept
-        : collection_key(collection_key) {
-        if (other.size()) {
-            auto begin = blob_allocator_t {}.allocate(other.size());
+        byte_t* begin = bytes_;
+        if (other.size() > inline_capacity_k) {
+            bool spilled = false;
+            begin = allocator.allocate(other.size(), spilled);
             return_error_if_m(begin != nullptr, c_error, out_of_memory_k, "Failed to copy a blob");
-            range = {begin, other.size()};
-            std::memcpy(begin, other.begin(), other.size());
+            std::memcpy(bytes_, &begin, sizeof(begin));
+            bytes_[sizeof(begin)] = static_cast<byte_t>(spilled);
         }
-        else
-            range = other;
+        std::memcpy(begin, other.begin(), other.size());
+        length_ = static_cast<ustore_length_t>(other.size());
     }
 
-    ~pair_t() noexcept {
-        if (range.size())
-            blob_allocator_t {}.deallocate((byte_t*)range.data(), range.size());
-        range = {};
+    ~value_storage_t() noexcept {
+        if (is_allocated())
+            slab_allocator_t::deallocate(address(), length_, is_spilled());
+        length_ = ustore_length_missing_k;
     }
 
-    pair_t(pair_t&& other) noexcept
-        : collection_key(other.collection_key), range(std::exchange(other.range, value_view_t {})) {}
+    value_storage_t(value_storage_t&& other) noexcept : length_(other.length_) {
+        std::memcpy(bytes_, other.bytes_, inline_capacity_k);
+        other.length_ = ustore_length_missing_k;
+    }
 
-    pair_t& operator=(pair_t&& other) noexcept {
-        std::swap(collection_key, other.collection_key);
-        std::swap(range, other.range);
+    value_storage_t& operator=(value_storage_t&& other) noexcept {
+        byte_t bytes[inline_capacity_k];
+        std::memcpy(bytes, bytes_, inline_capacity_k);
+        std::memcpy(bytes_, other.bytes_, inline_capacity_k);
+        std::memcpy(other.bytes_, bytes, inline_capacity_k);
+        std::swap(length_, other.length_);
         return *this;
     }
 
+    value_view_t view() const noexcept {
+        if (length_ == ustore_length_missing_k)
+            return {};
+        return {is_inline() ? bytes_ : address(), length_};
+    }
+
+    /**
+     * @brief Marks a value in RAM as recently read, so it isn't evicted.
+     */
+    void touch() const noexcept {
+        if (is_allocated() && !is_spilled())
+            slab_allocator_t::touch(address(), length_);
+    }
+
+    /**
+     * @brief Moves a value in RAM into the overflow file, if its memory was selected
+     * by `slab_allocator_t::select_cold`. The caller must make sure, that no one
+     * holds a view of the value, as its address changes.
+     * @return `false`, if the value had to be moved, but couldn't.
+     */
+    bool evict(slab_allocator_t& allocator) noexcept {
+        if (!is_allocated() || is_spilled() || !slab_allocator_t::is_selected(address(), length_))
+            return true;
+
+        byte_t* begin = allocator.allocate_spilled(length_);
+        if (!begin)
+            return false;
+        std::memcpy(begin, address(), length_);
+        slab_allocator_t::deallocate(address(), length_, false);
+        std::memcpy(bytes_, &begin, sizeof(begin));
+        bytes_[sizeof(begin)] = static_cast<byte_t>(true);
+        return true;
+    }
+};
+
+static_assert(sizeof(value_storage_t) == sizeof(value_view_t));
+
+struct pair_t {
+    collection_key_t collection_key;
+    value_storage_t value;
+
+    pair_t() = default;
+    pair_t(pair_t const&) = delete;
+    pair_t& operator=(pair_t const&) = delete;
+    pair_t(pair_t&&) noexcept = default;
+    pair_t& operator=(pair_t&&) noexcept = default;
+
+    pair_t(collection_key_t collection_key) noexcept : collection_key(collection_key) {}
+
+    pair_t(collection_key_t collection_key,
+           value_view_t other,
+           slab_allocator_t& allocator,
+           ustore_error_t* c_error) noexcept
+        : collection_key(collection_key), value(other, allocator, c_error) {}
+
+    /// Views are only valid until the pair is moved, as short values live inside of it.
+    value_view_t range() const noexcept { return value.view(); }
+
     operator collection_key_t() const noexcept { return collection_key; }
-    explicit operator bool() const noexcept { return range; }
+    explicit operator bool() const noexcept { return range(); }
 };
 
 struct pair_compare_t {
@@ -122,14 +242,52 @@ struct pair_compare_t {
 /*****************  Using Consistent Sets ****************/
 /*********************************************************/
 
-// using ucset_t = ucset_gt<pair_t, pair_compare_t>;
-// using ucset_t = consistent_avl_gt<pair_t, pair_compare_t>;
-// using ucset_t = partitioned_gt< //
-//     ucset_gt<pair_t, pair_compare_t>,
-//     std::hash<collection_key_t>,
-//     std::shared_mutex,
-//     64>;
-using ucset_t = locked_gt<consistent_set_gt<pair_t, pair_compare_t>, std::shared_mutex>;
+struct collection_stats_t {
+    std::size_t cardinality = 0;
+    std::size_t value_bytes = 0;
+};
+
+/**
+ * @brief Running totals of present entries and their sizes in every collection
+ * of a single partition, so that `ustore_measure` doesn't have to walk the tree.
+ * If the totals can't be updated, they are marked inexact until the next `clear`.
+ */
+struct collections_stats_t {
+    std::unordered_map<ustore_collection_t, collection_stats_t> collections;
+    bool exact = true;
+
+    void update(pair_t const* previous, pair_t const* next) noexcept {
+        value_view_t previous_value = previous ? previous->range() : value_view_t {};
+        value_view_t next_value = next ? next->range() : value_view_t {};
+        if (!previous_value && !next_value)
+            return;
+
+        ustore_collection_t collection = previous ? previous->collection_key.collection : next->collection_key.collection;
+        try {
+            collection_stats_t& stats = collections[collection];
+            if (previous_value)
+                stats.cardinality--, stats.value_bytes -= previous_value.size();
+            if (next_value)
+                stats.cardinality++, stats.value_bytes += next_value.size();
+            if (!stats.cardinality)
+                collections.erase(collection);
+        }
+        catch (...) {
+            exact = false;
+        }
+    }
+
+    void clear() noexcept {
+        collections.clear();
+        exact = true;
+    }
+};
+
+/**
+ * @brief Writes into different partitions don't contend for the same lock.
+ * The number of partitions is configured with `ucset_options_t::partitions`.
+ */
+using ucset_t = partitioned_set_gt<consistent_set_gt<pair_t, pair_compare_t>, collection_key_hash_t, collections_stats_t>;
 using transaction_t = typename ucset_t::transaction_t;
 using generation_t = typename ucset_t::generation_t;
 
@@ -148,11 +306,69 @@ ucset::status_t find_and_watch(set_or_transaction_at& set_or_transaction,
 
     auto find_status = set_or_transaction.find(
         collection_key,
-        [&](pair_t const& pair) noexcept { callback(pair.range); },
+        [&](pair_t const& pair) noexcept {
+            pair.value.touch();
+            callback(pair.range());
+        },
         [&]() noexcept { callback(value_view_t {}); });
     return find_status;
 }
 
+/**
+ * @brief Scans are split into runs of this many entries, releasing
+ * the locks in between, so that long scans don't starve the writers.
+ */
+constexpr std::size_t scan_run_length_k = 4096;
+
+/**
+ * @brief Default wrapper of every run of `scan_in_runs`, that just executes it.
+ */
+struct unwrapped_run_t {
+    template <typename run_at>
+    ucset::status_t operator()(run_at&& run) const noexcept {
+        return run();
+    }
+};
+
+/**
+ * @brief Visits the pairs in sorted order, starting from @p start, in runs of `scan_run_length_k`,
+ * until the @p callback returns `false`. Every run holds the locks just once and continues
+ * from where the previous one stopped, instead of searching for every next key from the root.
+ *
+ * @param wrap_run Executes every run, passed as a callable, possibly taking extra locks around it.
+ */
+template <typename set_or_transaction_at, typename callback_at, typename wrap_run_at = unwrapped_run_t>
+ucset::status_t scan_in_runs(set_or_transaction_at& set_or_transaction,
+                             collection_key_t start,
+                             callback_at&& callback,
+                             wrap_run_at&& wrap_run = {}) noexcept {
+
+    collection_key_t previous = start;
+    bool resumed = false;
+    bool stopped = false;
+    std::size_t run_length = 0;
+    auto callback_pair = [&](pair_t const& pair) noexcept {
+        // The last pair of the previous run is visited again
+        if (resumed && pair.collection_key == previous)
+            return true;
+        if (!callback(pair)) {
+            stopped = true;
+            return false;
+        }
+        previous = pair.collection_key;
+        return ++run_length != scan_run_length_k;
+    };
+
+    do {
+        run_length = 0;
+        auto status = wrap_run([&]() noexcept { return set_or_transaction.scan(previous, callback_pair); });
+        if (!status)
+            return status;
+        resumed = true;
+    } while (!stopped && run_length == scan_run_length_k);
+    return {};
+}
+
 template <typename set_or_transaction_at, typename callback_at>
 ucset::status_t scan_and_watch(set_or_transaction_at& set_or_transaction,
                                collection_key_t start,
@@ -160,71 +376,262 @@ ucset::status_t scan_and_watch(set_or_transaction_at& set_or_transaction,
                                ustore_options_t options,
                                callback_at&& callback) noexcept {
 
+    if (!range_limit)
+        return {};
+
     std::size_t match_idx = 0;
-    collection_key_t previous = start;
-    bool reached_end = false;
     auto watch_status = ucset::status_t();
-    auto callback_pair = [&](pair_t const& pair) noexcept {
-        reached_end = pair.collection_key.collection != previous.collection;
-        if (reached_end)
-            return;
+    auto status = scan_in_runs(set_or_transaction, start, [&](pair_t const& pair) noexcept {
+        if (pair.collection_key.collection != start.collection)
+            return false;
 
         if constexpr (!std::is_same<set_or_transaction_at, ucset_t>()) {
             bool dont_watch = options & ustore_option_transaction_dont_watch_k;
             if (!dont_watch)
                 if (watch_status = set_or_transaction.watch(pair); !watch_status)
-                    return;
+                    return false;
         }
 
         callback(pair);
-        previous.key = pair.collection_key.key;
-        ++match_idx;
-    };
-
-    auto find_status = set_or_transaction.find(start, callback_pair, {});
-    if (!find_status)
-        return find_status;
-    if (!watch_status)
-        return watch_status;
-
-    while (match_idx != range_limit && !reached_end) {
-        find_status = set_or_transaction.upper_bound(previous, callback_pair, [&]() noexcept { reached_end = true; });
-        if (!find_status)
-            return find_status;
-        if (!watch_status)
-            return watch_status;
-    }
-
-    return {};
+        return ++match_idx != range_limit;
+    });
+    if (!status)
+        return status;
+    return watch_status;
 }
 
 template <typename set_or_transaction_at, typename callback_at>
 ucset::status_t scan_full(set_or_transaction_at& set_or_transaction, callback_at&& callback) noexcept {
 
-    collection_key_t previous {
+    collection_key_t first {
         std::numeric_limits<ustore_collection_t>::min(),
         std::numeric_limits<ustore_key_t>::min(),
     };
-    while (true) {
-        auto callback_pair = [&](pair_t const& pair) noexcept {
-            callback(pair);
-            previous = pair.collection_key;
-        };
+    return scan_in_runs(set_or_transaction, first, [&](pair_t const& pair) noexcept {
+        callback(pair);
+        return true;
+    });
+}
+
+/*********************************************************/
+/*****************    Write-Ahead Log     ****************/
+/*********************************************************/
+
+/**
+ * @brief Kinds of records in the Write-Ahead Log.
+ * Every record is framed as: `[u32 length][u32 checksum][u8 kind][body]`.
+ */
+enum class wal_entry_t : std::uint8_t {
+    batch_k = 1,      ///< Atomic group of upserts and deletions, @see `wal_batch_t`.
+    collection_k = 2, ///< Binds a collection ID to a name: `[i64 id][name]`.
+    drop_k = 3,       ///< Drops a collection or its contents: `[i64 id][u8 mode]`.
+};
+
+template <typename at>
+void wal_append(std::string& body, at const& value) noexcept(false) {
+    body.append(reinterpret_cast<char const*>(&value), sizeof(at));
+}
+
+template <typename at>
+bool wal_extract(std::string_view& body, at& value) noexcept {
+    if (body.size() < sizeof(at))
+        return false;
+    std::memcpy(&value, body.data(), sizeof(at));
+    body.remove_prefix(sizeof(at));
+    return true;
+}
+
+inline std::uint32_t wal_checksum(wal_entry_t kind, std::string_view body) noexcept {
+    // FNV-1a is plenty to detect a torn tail of the log.
+    std::uint32_t hash = 2166136261u;
+    auto mix = [&](char c) noexcept {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 16777619u;
+    };
+    mix(static_cast<char>(kind));
+    for (char c : body)
+        mix(c);
+    return hash;
+}
+
+/**
+ * @brief Serialized group of changes, that must be applied atomically.
+ * Layout: `[u32 count]` followed by `count` entries of
+ * `[i64 collection][i64 key][u32 length][bytes]`, where a missing
+ * length marks a deletion.
+ */
+struct wal_batch_t {
+    std::string body = std::string(sizeof(std::uint32_t), '\0');
+    std::uint32_t count = 0;
+
+    void push(collection_key_t collection_key, value_view_t value) noexcept(false) {
+        ustore_length_t length = value ? static_cast<ustore_length_t>(value.size()) : ustore_length_missing_k;
+        wal_append(body, collection_key.collection);
+        wal_append(body, collection_key.key);
+        wal_append(body, length);
+        body.append(value.c_str(), value.size());
+        ++count;
+        std::memcpy(body.data(), &count, sizeof(count));
+    }
+
+    void clear() noexcept {
+        body.resize(sizeof(count));
+        count = 0;
+        std::memset(body.data(), 0, sizeof(count));
+    }
+
+    explicit operator bool() const noexcept { return count; }
+};
+
+/**
+ * @brief Result of a log sync, passed between the writers of a group commit.
+ */
+struct wal_status_t {
+    char const* error = nullptr;
+    bool ok() const noexcept { return !error; }
+};
+
+/**
+ * @brief Append-only log of committed changes, split into numbered segments.
+ * Makes durable commits proportional to the size of the change, rather than
+ * the size of the whole DB. Once the active segment grows beyond the
+ * `ucset_options_t::checkpoint_size`, a background thread dumps the state
+ * into Parquet files and deletes the older segments.
+ *
+ * Every segment starts with the names of collections, present at the time
+ * it was opened, so it can be replayed even if the IDs change between runs.
+ *
+ * Records are appended under the `mutex`, but synced outside of it, so that
+ * concurrent durable writers share a single `fdatasync` through `group_commit`.
+ */
+struct wal_t {
+    static constexpr std::string_view segment_prefix_k = ".wal.";
+
+    /**
+     * @brief Orders the changes in memory and in the log.
+     * Protects all of the following members.
+     */
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread checkpointer;
+    bool stopping = false;
+
+    file_handle_t file;
+    std::string directory;
+    std::size_t segment = 0;
+    std::size_t bytes = 0;
+    std::size_t checkpoint_size = 0;
+
+    /**
+     * @brief Set, once a change was applied in memory, but failed to reach the log.
+     * Memory is then ahead of the log, so all later writes are refused, instead of
+     * logging changes, that depend on a lost one. Reopening the DB restores the last
+     * logged state, as the torn tail of the log is ignored on replay.
+     */
+    bool broken = false;
+
+    /**
+     * @brief Coalesces the syncs of concurrent durable writes.
+     * Lives outside of the `mutex`, which only orders the appends.
+     */
+    group_commit_gt<wal_status_t> group_commit;
+
+    bool enabled() const noexcept { return !directory.empty(); }
+
+    static std::string segment_path(std::string const& directory, std::size_t segment) noexcept(false) {
+        return stdfs::path(directory) / (std::string(segment_prefix_k) + std::to_string(segment));
+    }
+
+    /**
+     * @brief Writes a record into the OS buffers, without syncing it to disk.
+     * Must be called under the `mutex`. Check `broken` before applying the change.
+     */
+    void append(wal_entry_t kind, std::string_view body, ustore_error_t* c_error) noexcept {
+        std::uint32_t length = static_cast<std::uint32_t>(body.size());
+        std::uint32_t checksum = wal_checksum(kind, body);
+        bool written = std::fwrite(&length, sizeof(length), 1, file) == 1 &&
+                       std::fwrite(&checksum, sizeof(checksum), 1, file) == 1 &&
+                       std::fwrite(&kind, sizeof(kind), 1, file) == 1 &&
+                       std::fwrite(body.data(), 1, body.size(), file) == body.size();
+        written = written && std::fflush(file) == 0;
+        broken |= !written;
+        return_error_if_m(written, c_error, error_unknown_k, "Failed to append to the log");
+
+        bytes += sizeof(length) + sizeof(checksum) + sizeof(kind) + body.size();
+        if (bytes >= checkpoint_size)
+            wakeup.notify_one();
+    }
 
-        auto reached_end = false;
-        auto callback_nothing = [&]() noexcept {
-            reached_end = true;
+    /**
+     * @brief Blocks until every record, appended by the calling thread, is synced to disk.
+     * Must be called outside of the `mutex`. Concurrent callers share syncs.
+     */
+    void sync(ustore_error_t* c_error) noexcept {
+        auto sync_once = [&]() noexcept {
+            // Duplicate the descriptor, so that a concurrent rotation can't close it under us.
+            // Rotations sync the segments they close, so syncing the newest one is enough.
+            int descriptor = -1;
+            {
+                std::unique_lock _ {mutex};
+                if (!file)
+                    return wal_status_t {};
+                descriptor = ::dup(::fileno(file));
+            }
+            if (descriptor < 0)
+                return wal_status_t {"Failed to sync the log"};
+            bool synced = ::fdatasync(descriptor) == 0;
+            ::close(descriptor);
+            if (synced)
+                return wal_status_t {};
+
+            // Pages, that failed to sync, may be dropped by the OS
+            std::unique_lock _ {mutex};
+            broken = true;
+            return wal_status_t {"Failed to sync the log"};
         };
+        wal_status_t status;
+        safe_section("Syncing the log", c_error, [&] { status = group_commit.wait(sync_once); });
+        return_if_error_m(c_error);
+        return_error_if_m(status.ok(), c_error, error_unknown_k, status.error);
+    }
 
-        auto status = set_or_transaction.upper_bound(previous, callback_pair, callback_nothing);
-        if (reached_end)
-            break;
-        if (!status)
-            return status;
+    template <typename names_at>
+    void append_names(names_at const& names, ustore_error_t* c_error) noexcept(false) {
+        for (auto const& [name, id] : names) {
+            std::string body;
+            wal_append(body, id);
+            body.append(name);
+            append(wal_entry_t::collection_k, body, c_error);
+            return_if_error_m(c_error);
+        }
     }
 
-    return {};
-}
+    /**
+     * @brief Syncs and closes the active segment, opening the next one.
+     * @param names Collections to be listed in the head of the new segment.
+     */
+    template <typename names_at>
+    void rotate(names_at const& names, ustore_error_t* c_error) noexcept(false) {
+        close(c_error);
+        return_if_error_m(c_error);
+
+        auto path = segment_path(directory, segment + 1);
+        auto status = file.open(path.c_str(), "ab");
+        return_error_if_m(status, c_error, error_unknown_k, "Failed to open a log segment");
+        ++segment;
+        bytes = 0;
+        append_names(names, c_error);
+    }
+
+    void close(ustore_error_t* c_error) noexcept {
+        if (!file)
+            return;
+        return_error_if_m(std::fflush(file) == 0, c_error, error_unknown_k, "Failed to flush the log");
+        return_error_if_m(::fdatasync(::fileno(file)) == 0, c_error, error_unknown_k, "Failed to sync the log");
+        auto status = file.close();
+        return_error_if_m(status, c_error, error_unknown_k, "Failed to close the log");
+    }
+};
 
 /*********************************************************/
 /***************** Collections Management ****************/
@@ -247,6 +654,67 @@ struct string_less_t : public std::less<std::string_view> {
     using is_transparent = void;
 };
 
+/**
+ * @brief Point-in-time view of the DB, built from "before-images".
+ * The container keeps just one version of every entry, so before a writer
+ * changes a key for the first time since the snapshot was taken, it copies
+ * the previous state of that key here. All other keys are read from HEAD.
+ */
+struct snapshot_t {
+    /**
+     * @brief Writers take it exclusively to add before-images, readers - shared.
+     * Readers only hold it for a single lookup or a single run of a scan,
+     * so that long scans don't block the writers.
+     */
+    mutable std::shared_mutex mutex;
+
+    /**
+     * @brief Empty optionals mark keys, that were missing when the snapshot was taken.
+     */
+    std::map<collection_key_t, std::optional<value_storage_t>> before;
+};
+
+/**
+ * @brief Erases the entries of dropped collections in the background.
+ * Dropping a collection handle just detaches it, so the caller doesn't wait
+ * for millions of entries to be erased. Until the erasure is done, the ID
+ * of the collection can't be given to a new one.
+ */
+struct reclaimer_t {
+    /**
+     * @brief Protects all of the following members.
+     */
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread thread;
+    bool stopping = false;
+
+    /**
+     * @brief Detached collections, the first of which is being erased.
+     */
+    std::deque<ustore_collection_t> pending;
+
+    bool is_pending(ustore_collection_t id) noexcept {
+        std::unique_lock _ {mutex};
+        return std::find(pending.begin(), pending.end(), id) != pending.end();
+    }
+};
+
+/**
+ * @brief Moves the values, that weren't read or written recently, from RAM
+ * into the overflow file in the background, once the `memory_limit` is near.
+ * Writers only wake it up, so they never wait for the eviction.
+ */
+struct evictor_t {
+    /**
+     * @brief Protects all of the following members.
+     */
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread thread;
+    bool stopping = false;
+};
+
 struct database_t {
     /**
      * @brief Rarely-used mutex for global reorganizations, like:
@@ -255,11 +723,25 @@ struct database_t {
      */
     std::shared_mutex restructuring_mutex;
 
+    /**
+     * @brief Memory for the values, that don't fit into `pair_t`.
+     * Must outlive the `pairs`, so it's declared before them.
+     */
+    slab_allocator_t values;
+
     /**
      * @brief Primary database state.
      */
     ucset_t pairs;
 
+    /**
+     * @brief Live snapshots, addressed by their pointers, like in other engines.
+     * Writers hold the mutex shared, while preserving before-images and applying
+     * the changes. Creating and dropping snapshots takes it exclusively.
+     */
+    std::shared_mutex snapshots_mutex;
+    std::map<ustore_snapshot_t, std::unique_ptr<snapshot_t>> snapshots;
+
     /**
      * @brief A variable-size set of named collections.
      * It's cleaner to implement it with heterogenous lookups as
@@ -273,11 +755,34 @@ struct database_t {
      */
     std::string persisted_directory;
 
+    /**
+     * @brief Log of changes since the last checkpoint.
+     * Only active, if the `persisted_directory` is set.
+     */
+    wal_t wal;
+
+    /**
+     * @brief Threads used to load and save collections in parallel,
+     * and to split large batches of reads and scans.
+     */
+    thread_pool_t pool;
+    std::size_t parallel_batch_size = 0;
+
+    reclaimer_t reclaimer;
+    evictor_t evictor;
+
     database_t(ucset_t&& set) noexcept(false) : pairs(std::move(set)) {}
+};
 
-    database_t(database_t&& other) noexcept
-        : pairs(std::move(other.pairs)), names(std::move(other.names)),
-          persisted_directory(std::move(other.persisted_directory)) {}
+/**
+ * @brief Transaction state, extended with the serialized list of changes,
+ * that will be appended to the Write-Ahead Log on commit.
+ */
+struct txn_t {
+    transaction_t raw;
+    wal_batch_t changes;
+    /// Keys, which before-images must be preserved in live snapshots on commit.
+    std::vector<collection_key_t> updated_keys;
 };
 
 ustore_collection_t new_collection(database_t& db) noexcept {
@@ -290,133 +795,1154 @@ ustore_collection_t new_collection(database_t& db) noexcept {
         is_new = new_handle != ustore_collection_main_k;
         for (auto const& [name, existing_handle] : db.names)
             is_new &= new_handle != existing_handle;
+        is_new &= !db.reclaimer.is_pending(new_handle);
+    }
+    return new_handle;
+}
+
+void export_error_code(ucset::status_t code, ustore_error_t* c_error) noexcept {
+    if (!code)
+        *c_error = "Faced error!";
+}
+
+/**
+ * @brief Applies a change in memory and, if persistence is enabled, logs it.
+ * Holding the log mutex through both steps keeps the order of records
+ * in the log identical to the order of changes in memory. Durable writes
+ * are synced after the mutex is released, sharing syncs with other writers.
+ */
+template <typename apply_at>
+void apply_logged(database_t& db,
+                  wal_entry_t kind,
+                  std::string_view body,
+                  bool flush,
+                  ustore_error_t* c_error,
+                  apply_at&& apply) noexcept {
+
+    if (!db.wal.enabled() || body.empty())
+        return export_error_code(apply(), c_error);
+
+    {
+        std::unique_lock _ {db.wal.mutex};
+        return_error_if_m(!db.wal.broken, c_error, error_unknown_k, "The log is broken, reopen the DB");
+        ucset::status_t status = apply();
+        if (!status)
+            return export_error_code(status, c_error);
+        db.wal.append(kind, body, c_error);
+        return_if_error_m(c_error);
+    }
+    if (flush)
+        db.wal.sync(c_error);
+}
+
+/**
+ * @brief Collections are erased in runs of this many entries, releasing
+ * the locks in between, so that dropping a large one doesn't block the DB.
+ */
+constexpr std::size_t erase_run_length_k = 4096;
+
+ucset::status_t erase_collection(database_t& db, ustore_collection_t id) noexcept {
+
+    collection_key_t lower(id, std::numeric_limits<ustore_key_t>::min());
+    while (true) {
+        // Find where the next run ends, to erase it all at once
+        std::size_t run_length = 0;
+        std::optional<collection_key_t> upper;
+        auto status = db.pairs.scan(lower, [&](pair_t const& pair) noexcept {
+            if (pair.collection_key.collection != id)
+                return false;
+            if (run_length == erase_run_length_k) {
+                upper = pair.collection_key;
+                return false;
+            }
+            ++run_length;
+            return true;
+        });
+        if (!status || !run_length)
+            return status;
+
+        if (!upper)
+            return db.pairs.erase_range(lower, id + 1, no_op_t {});
+        status = db.pairs.erase_range(lower, *upper, no_op_t {});
+        if (!status)
+            return status;
+        lower = *upper;
+    }
+}
+
+void forget_collection_name(database_t& db, ustore_collection_t id) noexcept {
+    for (auto it = db.names.begin(); it != db.names.end(); ++it) {
+        if (id != it->second)
+            continue;
+        db.names.erase(it);
+        break;
+    }
+}
+
+ucset::status_t drop_collection(database_t& db, ustore_collection_t id, ustore_drop_mode_t mode) noexcept {
+
+    if (mode == ustore_drop_keys_vals_handle_k) {
+        auto status = erase_collection(db, id);
+        if (status)
+            forget_collection_name(db, id);
+        return status;
+    }
+
+    else if (mode == ustore_drop_keys_vals_k)
+        return erase_collection(db, id);
+
+    // Values are replaced through upserts, rather than in place,
+    // so that the partitions' statistics stay up to date
+    else if (mode == ustore_drop_vals_k) {
+        std::vector<pair_t> emptied;
+        ucset::status_t copy_status;
+        auto status = db.pairs.range(id, id + 1, [&](pair_t const& pair) noexcept {
+            if (!pair || !copy_status)
+                return;
+            try {
+                emptied.emplace_back(pair.collection_key, value_view_t::make_empty(), db.values, nullptr);
+            }
+            catch (...) {
+                copy_status = ucset::errc_t::out_of_memory_heap_k;
+            }
+        });
+        if (!status || !copy_status)
+            return !status ? status : copy_status;
+        return db.pairs.upsert(std::make_move_iterator(emptied.begin()), std::make_move_iterator(emptied.end()));
+    }
+
+    return {};
+}
+
+/*********************************************************/
+/*****************	      Snapshots	      ****************/
+/*********************************************************/
+
+/**
+ * @brief Keeps a snapshot alive, while it's being read. Its before-images
+ * are locked separately for every lookup. Holds nothing, if the reads are directed to HEAD.
+ */
+struct snapshot_lock_t {
+    std::shared_lock<std::shared_mutex> registry;
+    snapshot_t* snapshot = nullptr;
+
+    explicit operator bool() const noexcept { return snapshot; }
+    snapshot_t const& operator*() const noexcept { return *snapshot; }
+};
+
+/**
+ * @brief Looks up and locks a live snapshot, reporting an error,
+ * if it was never created or was already dropped.
+ */
+snapshot_lock_t lock_snapshot(database_t& db, ustore_snapshot_t id, ustore_error_t* c_error) noexcept {
+    snapshot_lock_t lock;
+    if (!id)
+        return lock;
+
+    lock.registry = std::shared_lock {db.snapshots_mutex};
+    auto it = db.snapshots.find(id);
+    if (it == db.snapshots.end()) {
+        log_error_m(c_error, args_wrong_k, "The snapshot doesn't exist!");
+        return lock;
+    }
+    lock.snapshot = it->second.get();
+    return lock;
+}
+
+/**
+ * @brief Copies the current state of a key into every live snapshot, that doesn't have it yet.
+ * Must be called with the `database_t::snapshots_mutex` held shared, before the key is changed.
+ */
+void preserve_before_image(database_t& db, collection_key_t key, ustore_error_t* c_error) noexcept(false) {
+
+    std::optional<value_storage_t> head;
+    bool fetched = false;
+    for (auto& id_and_snapshot : db.snapshots) {
+        snapshot_t& snap = *id_and_snapshot.second;
+        std::unique_lock _ {snap.mutex};
+        if (snap.before.count(key))
+            continue;
+
+        if (!fetched) {
+            auto status = db.pairs.find(
+                key,
+                [&](pair_t const& pair) noexcept { head.emplace(pair.range(), db.values, c_error); },
+                [&]() noexcept {});
+            export_error_code(status, c_error);
+            return_if_error_m(c_error);
+            fetched = true;
+        }
+
+        std::optional<value_storage_t> before;
+        if (head)
+            before.emplace(head->view(), db.values, c_error);
+        return_if_error_m(c_error);
+        snap.before.emplace(key, std::move(before));
+    }
+}
+
+/**
+ * @brief Preserves the before-images of all the keys in a collection, that is about to be dropped.
+ */
+void preserve_before_images(database_t& db, ustore_collection_t collection, ustore_error_t* c_error) noexcept(false) {
+
+    if (db.snapshots.empty())
+        return;
+
+    // Copying the values right from the callback would nest the locks in the wrong order
+    std::vector<collection_key_t> keys;
+    auto status = db.pairs.range(collection, collection + 1, [&](pair_t& pair) noexcept {
+        safe_section("Collecting keys", c_error, [&] { keys.push_back(pair.collection_key); });
+    });
+    export_error_code(status, c_error);
+    return_if_error_m(c_error);
+
+    for (collection_key_t key : keys) {
+        preserve_before_image(db, key, c_error);
+        return_if_error_m(c_error);
+    }
+}
+
+/**
+ * @brief Reads a key as of the time the snapshot was taken.
+ * Holds the snapshot's mutex shared through both lookups, so that no writer
+ * can change HEAD between them without leaving a before-image.
+ */
+template <typename callback_at>
+ucset::status_t find_in_snapshot(database_t& db,
+                                 snapshot_t const& snap,
+                                 collection_key_t collection_key,
+                                 callback_at&& callback) noexcept {
+
+    std::shared_lock _ {snap.mutex};
+    auto before_it = snap.before.find(collection_key);
+    if (before_it == snap.before.end())
+        return find_and_watch(db.pairs, collection_key, ustore_options_default_k, callback);
+
+    callback(before_it->second ? before_it->second->view() : value_view_t {});
+    return {};
+}
+
+/**
+ * @brief Scans a collection as of the time the snapshot was taken, merging the keys
+ * from HEAD with the before-images: hiding the ones added after the snapshot was taken,
+ * and restoring the removed ones.
+ *
+ * The snapshot's mutex is held shared for one run of the scan at a time, letting the
+ * writers in between. As they may add before-images for the keys, we haven't reached yet,
+ * the position in the before-images is looked up again at the start of every run.
+ */
+template <typename callback_at>
+ucset::status_t scan_snapshot(database_t& db,
+                              snapshot_t const& snap,
+                              collection_key_t start,
+                              std::size_t range_limit,
+                              callback_at&& callback) noexcept {
+
+    if (!range_limit)
+        return {};
+
+    std::size_t match_idx = 0;
+    std::optional<collection_key_t> passed;
+    auto before_it = snap.before.end();
+    auto seek_before = [&]() noexcept {
+        before_it = passed ? snap.before.upper_bound(*passed) : snap.before.lower_bound(start);
+    };
+    auto before_valid = [&]() noexcept {
+        return before_it != snap.before.end() && before_it->first.collection == start.collection;
+    };
+    // Restores the keys, removed since the snapshot was taken, up to the given one
+    auto restore_removed = [&](collection_key_t const* bound) noexcept {
+        for (; before_valid() && (!bound || before_it->first < *bound); ++before_it)
+            if (before_it->second) {
+                callback(before_it->first.key, before_it->second->view());
+                if (++match_idx == range_limit)
+                    return false;
+            }
+        return true;
+    };
+
+    auto in_locked_run = [&](auto&& run) noexcept {
+        std::shared_lock _ {snap.mutex};
+        seek_before();
+        return run();
+    };
+    auto status = scan_in_runs(
+        db.pairs,
+        start,
+        [&](pair_t const& pair) noexcept {
+            if (pair.collection_key.collection != start.collection)
+                return false;
+            if (!restore_removed(&pair.collection_key))
+                return false;
+
+            // Hide the keys, added since the snapshot was taken, and restore the changed values
+            passed = pair.collection_key;
+            value_view_t value = pair.range();
+            if (before_valid() && before_it->first == pair.collection_key) {
+                auto const& before = before_it->second;
+                ++before_it;
+                if (!before)
+                    return true;
+                value = before->view();
+            }
+            callback(pair.collection_key.key, value);
+            return ++match_idx != range_limit;
+        },
+        in_locked_run);
+    if (!status)
+        return status;
+
+    if (match_idx != range_limit)
+        in_locked_run([&]() noexcept {
+            restore_removed(nullptr);
+            return ucset::status_t {};
+        });
+    return {};
+}
+
+/*********************************************************/
+/*****************	 Writing to Disk	  ****************/
+/*********************************************************/
+
+/**
+ * @brief Every collection is saved into one or more Parquet files, each
+ * holding a disjoint range of keys. The files are written in parallel,
+ * and later read in parallel, one row group at a time.
+ */
+constexpr std::size_t parquet_file_rows_k = 1024ul * 1024ul;
+constexpr std::size_t parquet_row_group_rows_k = 64ul * 1024ul;
+constexpr std::string_view parquet_extension_k = ".parquet";
+
+struct key_from_pair_t {
+    ustore_key_t* key_ptr;
+    key_from_pair_t(ustore_key_t* key) : key_ptr(key) {}
+    key_from_pair_t& operator=(pair_t const& pair) {
+        *key_ptr = pair.collection_key.key;
+        return *this;
+    };
+};
+
+struct key_iterator_t {
+    using value_type = ustore_key_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::random_access_iterator_tag;
+
+    ustore_key_t* begin_;
+    key_iterator_t(ustore_key_t* key) : begin_(key) {}
+    key_from_pair_t operator[](std::size_t idx) { return &begin_[idx]; };
+};
+
+bool ends_with(std::string_view str, std::string_view suffix) noexcept {
+    return str.size() >= suffix.size() &&
+           0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix.data(), suffix.size());
+}
+
+/**
+ * @brief The first part of a collection is saved as "<name>.parquet",
+ * the following ones as "<name>.parquet.<part>".
+ */
+std::string collection_file_name(std::string_view collection_name, std::size_t part) noexcept(false) {
+    std::string file_name {collection_name};
+    file_name += parquet_extension_k;
+    if (part)
+        file_name += "." + std::to_string(part);
+    return file_name;
+}
+
+bool parse_collection_file_name(std::string_view file_name, std::string& collection_name) noexcept(false) {
+    if (ends_with(file_name, parquet_extension_k)) {
+        collection_name = file_name.substr(0, file_name.size() - parquet_extension_k.size());
+        return true;
+    }
+
+    auto part_offset = file_name.rfind('.');
+    if (part_offset == std::string_view::npos || part_offset + 1 == file_name.size())
+        return false;
+    auto part = file_name.substr(part_offset + 1);
+    auto stem = file_name.substr(0, part_offset);
+    if (!std::all_of(part.begin(), part.end(), [](char c) { return std::isdigit(c); }) ||
+        !ends_with(stem, parquet_extension_k))
+        return false;
+    collection_name = stem.substr(0, stem.size() - parquet_extension_k.size());
+    return true;
+}
+
+/**
+ * @brief Splits a collection into ranges of roughly `parquet_file_rows_k` entries each,
+ * picking the boundaries from a random sample of keys.
+ * @return Sorted boundaries, where the first and the last span the whole collection.
+ */
+std::vector<collection_key_t> split_collection(database_t& db,
+                                               ustore_collection_t collection_id,
+                                               ustore_error_t* c_error) noexcept(false) {
+
+    collection_key_t min(collection_id, std::numeric_limits<ustore_key_t>::min());
+    collection_key_t max(collection_id + 1, std::numeric_limits<ustore_key_t>::min());
+    std::vector<collection_key_t> boundaries {min};
+
+    std::size_t const samples_limit = db.pool.size() * 64;
+    std::vector<ustore_key_t> samples(samples_limit);
+    std::random_device random_device;
+    std::mt19937 random_generator(random_device());
+    std::size_t seen = 0;
+    key_iterator_t iter(samples.data());
+    auto status = db.pairs.sample_range(min, max, random_generator, seen, samples_limit, iter);
+    export_error_code(status, c_error);
+    if (*c_error)
+        return {};
+
+    std::size_t parts = divide_round_up(seen, parquet_file_rows_k);
+    samples.resize(std::min(seen, samples_limit));
+    std::sort(samples.begin(), samples.end());
+    for (std::size_t part = 1; part < parts; ++part) {
+        ustore_key_t boundary = samples[part * samples.size() / parts];
+        if (boundary != boundaries.back().key)
+            boundaries.emplace_back(collection_id, boundary);
+    }
+    boundaries.push_back(max);
+    return boundaries;
+}
+
+/**
+ * @brief Saves all the pairs in `[min, max)` into a single Parquet file.
+ * The pairs are visited in runs, that copy the keys and values into an intermediate buffer,
+ * as they may be freed by concurrent writers once the run releases the locks.
+ * Full row groups are encoded and written between the runs, so writers never wait for the disk.
+ */
+void write_collection( //
+    database_t& db,
+    collection_key_t min,
+    collection_key_t max,
+    std::string const& collection_path,
+    ustore_error_t* c_error) noexcept(false) {
+
+    std::shared_ptr<arrow::io::FileOutputStream> out_file;
+    PARQUET_ASSIGN_OR_THROW(out_file, arrow::io::FileOutputStream::Open(collection_path));
+
+    parquet::schema::NodeVector columns {};
+    columns.push_back(parquet::schema::PrimitiveNode::Make( //
+        "key",
+        parquet::Repetition::REQUIRED,
+        parquet::Type::INT64,
+        parquet::ConvertedType::INT_64));
+    columns.push_back(parquet::schema::PrimitiveNode::Make( //
+        "value",
+        parquet::Repetition::OPTIONAL,
+        parquet::Type::BYTE_ARRAY,
+        parquet::ConvertedType::UTF8));
+    auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
+        parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, columns));
+    parquet::WriterProperties::Builder builder;
+    auto file_writer = parquet::ParquetFileWriter::Open(out_file, schema, builder.build());
+
+    std::vector<ustore_key_t> keys;
+    std::vector<ustore_length_t> lengths;
+    std::vector<std::int16_t> definitions(parquet_row_group_rows_k, 1);
+    std::vector<parquet::ByteArray> values(parquet_row_group_rows_k);
+    std::string contents;
+    keys.reserve(parquet_row_group_rows_k);
+    lengths.reserve(parquet_row_group_rows_k);
+
+    auto write_row_group = [&] {
+        if (keys.empty())
+            return;
+        // Runs may overshoot the size of a row group by a few pairs
+        definitions.resize(keys.size(), 1);
+        values.resize(keys.size());
+        auto begin = reinterpret_cast<std::uint8_t const*>(contents.data());
+        for (std::size_t i = 0, offset = 0; i != keys.size(); offset += lengths[i], ++i)
+            values[i] = parquet::ByteArray(lengths[i], begin + offset);
+
+        auto count = static_cast<std::int64_t>(keys.size());
+        parquet::RowGroupWriter* row_group = file_writer->AppendRowGroup();
+        static_cast<parquet::Int64Writer*>(row_group->NextColumn())->WriteBatch(count, nullptr, nullptr, keys.data());
+        static_cast<parquet::ByteArrayWriter*>(row_group->NextColumn())
+            ->WriteBatch(count, definitions.data(), nullptr, values.data());
+        row_group->Close();
+
+        keys.clear();
+        lengths.clear();
+        contents.clear();
+    };
+
+    auto copy_pair = [&](pair_t const& pair) noexcept {
+        if (*c_error || !(pair.collection_key < max))
+            return false;
+        // Deletions are kept in memory as pairs with missing values
+        if (!pair)
+            return true;
+        safe_section("Serializing pairs", c_error, [&] {
+            keys.push_back(pair.collection_key.key);
+            lengths.push_back(static_cast<ustore_length_t>(pair.range().size()));
+            contents.append(pair.range().c_str(), pair.range().size());
+        });
+        return !*c_error;
+    };
+    auto run_and_write = [&](auto&& run) noexcept {
+        ucset::status_t status = run();
+        if (status && !*c_error && keys.size() >= parquet_row_group_rows_k)
+            safe_section("Writing a row group", c_error, write_row_group);
+        return status;
+    };
+    auto status = scan_in_runs(db.pairs, min, copy_pair, run_and_write);
+    export_error_code(status, c_error);
+    return_if_error_m(c_error);
+
+    write_row_group();
+    file_writer->Close();
+}
+
+void write(database_t& db, std::string const& dir_path, ustore_error_t* c_error) noexcept(false) {
+
+    // Check if the source directory even exists
+    if (!std::filesystem::is_directory(dir_path))
+        return;
+
+    // Split collections into parts of similar size
+    struct part_t {
+        collection_key_t min;
+        collection_key_t max;
+        std::string file_name;
+        ustore_error_t error = nullptr;
+    };
+    std::vector<part_t> parts;
+    auto split = [&](ustore_collection_t collection_id, std::string_view collection_name) {
+        auto boundaries = split_collection(db, collection_id, c_error);
+        return_if_error_m(c_error);
+        for (std::size_t i = 0; i + 1 < boundaries.size(); ++i)
+            parts.push_back({boundaries[i], boundaries[i + 1], collection_file_name(collection_name, i)});
+    };
+
+    split(ustore_collection_main_k, {});
+    return_if_error_m(c_error);
+    for (auto const& collection : db.names) {
+        split(collection.second, collection.first);
+        return_if_error_m(c_error);
+    }
+
+    // Every file is first written under a temporary name, so that a failure
+    // half-way wouldn't corrupt the previous checkpoint.
+    db.pool.for_each(parts.size(), [&](std::size_t part_idx) noexcept {
+        part_t& part = parts[part_idx];
+        auto const temporary_path = stdfs::path(dir_path) / (part.file_name + ".tmp");
+        safe_section("Saving a collection", &part.error, [&] {
+            write_collection(db, part.min, part.max, temporary_path, &part.error);
+        });
+    });
+    for (part_t const& part : parts)
+        return_error_if_m(!part.error, c_error, error_unknown_k, part.error);
+
+    std::unordered_set<std::string> collection_files;
+    for (part_t const& part : parts) {
+        stdfs::rename(stdfs::path(dir_path) / (part.file_name + ".tmp"), stdfs::path(dir_path) / part.file_name);
+        collection_files.insert(part.file_name);
+    }
+
+    // Remove the files of collections, dropped since the last checkpoint,
+    // as well as the parts, that are no longer needed.
+    std::string collection_name;
+    for (auto const& dir_entry : std::filesystem::directory_iterator {dir_path}) {
+        std::string file_name = dir_entry.path().filename();
+        if (parse_collection_file_name(file_name, collection_name) && !collection_files.count(file_name))
+            stdfs::remove(dir_entry.path());
+    }
+}
+
+std::unique_ptr<parquet::ParquetFileReader> open_collection_file(std::string const& collection_path) noexcept(false) {
+    std::shared_ptr<arrow::io::ReadableFile> in_file;
+    PARQUET_ASSIGN_OR_THROW(in_file, arrow::io::ReadableFile::Open(collection_path));
+    return parquet::ParquetFileReader::Open(in_file);
+}
+
+/**
+ * @brief Loads a single row group of an opened Parquet file, inserting all of its rows at once.
+ */
+void read_row_group(database_t& db,
+                    ustore_collection_t collection_id,
+                    parquet::ParquetFileReader& file_reader,
+                    int row_group_idx,
+                    ustore_error_t* c_error) noexcept(false) {
+
+    auto row_group = file_reader.RowGroup(row_group_idx);
+    auto rows = static_cast<std::size_t>(row_group->metadata()->num_rows());
+    auto keys_reader = std::static_pointer_cast<parquet::Int64Reader>(row_group->Column(0));
+    auto values_reader = std::static_pointer_cast<parquet::ByteArrayReader>(row_group->Column(1));
+
+    std::vector<ustore_key_t> keys(rows);
+    for (std::size_t row = 0; row < rows && keys_reader->HasNext();) {
+        std::int64_t keys_read = 0;
+        keys_reader->ReadBatch(rows - row, nullptr, nullptr, keys.data() + row, &keys_read);
+        row += keys_read;
+    }
+
+    // Values are only valid until the next batch is read, so we copy them right away
+    std::size_t const batch_size = std::min(rows, parquet_row_group_rows_k);
+    std::vector<std::int16_t> definitions(batch_size);
+    std::vector<parquet::ByteArray> values(batch_size);
+    std::vector<pair_t> pairs;
+    pairs.reserve(rows);
+    for (std::size_t row = 0; row < rows && values_reader->HasNext();) {
+        std::int64_t values_read = 0;
+        auto levels_read = values_reader->ReadBatch( //
+            std::min(batch_size, rows - row),
+            definitions.data(),
+            nullptr,
+            values.data(),
+            &values_read);
+
+        for (std::int64_t level_idx = 0, value_idx = 0; level_idx != levels_read; ++level_idx, ++row) {
+            value_view_t value = value_view_t::make_empty();
+            if (definitions[level_idx]) {
+                parquet::ByteArray const& bytes = values[value_idx++];
+                value = value_view_t {bytes.ptr, bytes.len};
+            }
+            pairs.emplace_back(collection_key_t {collection_id, keys[row]}, value, db.values, c_error);
+            return_if_error_m(c_error);
+        }
+    }
+
+    auto status = db.pairs.upsert(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+    export_error_code(status, c_error);
+}
+
+void read(database_t& db, std::string const& path, ustore_error_t* c_error) noexcept(false) {
+
+    // Clear the DB, before refilling it
+    db.names.clear();
+    auto status = db.pairs.clear();
+    export_error_code(status, c_error);
+    return_if_error_m(c_error);
+
+    // Check if the source directory even exists
+    if (!std::filesystem::is_directory(path))
+        return;
+
+    // Collect all the persisted parts of all the collections
+    struct file_t {
+        ustore_collection_t collection_id;
+        std::string path;
+        std::unique_ptr<parquet::ParquetFileReader> reader;
+        int row_groups = 0;
+        ustore_error_t error = nullptr;
+    };
+    std::vector<file_t> files;
+    std::string collection_name;
+    for (auto const& dir_entry : std::filesystem::directory_iterator {path}) {
+        auto const& collection_path = dir_entry.path();
+        if (!parse_collection_file_name(collection_path.filename().native(), collection_name))
+            continue;
+
+        ustore_collection_t collection_id = ustore_collection_main_k;
+        if (!collection_name.empty()) {
+            auto name_it = db.names.find(collection_name);
+            if (name_it == db.names.end())
+                name_it = db.names.emplace(collection_name, new_collection(db)).first;
+            collection_id = name_it->second;
+        }
+        files.push_back({collection_id, collection_path});
+    }
+
+    // Open the files in parallel, keeping the readers for the first runs of row groups
+    db.pool.for_each(files.size(), [&](std::size_t file_idx) noexcept {
+        file_t& file = files[file_idx];
+        safe_section("Opening a collection", &file.error, [&] {
+            file.reader = open_collection_file(file.path);
+            file.row_groups = file.reader->metadata()->num_row_groups();
+        });
+    });
+
+    // Every task loads a contiguous run of row groups of a single file, reading them
+    // through one reader. Files are only split into several runs, if there are fewer
+    // of them than threads, so most files are opened just once.
+    struct run_t {
+        std::size_t file_idx;
+        int first_row_group;
+        int end_row_group;
+        ustore_error_t error = nullptr;
+    };
+    std::vector<run_t> runs;
+    std::size_t const threads = std::max<std::size_t>(db.pool.size(), 1);
+    std::size_t const runs_per_file = files.empty() ? 1 : divide_round_up(threads, files.size());
+    for (std::size_t file_idx = 0; file_idx != files.size(); ++file_idx) {
+        return_error_if_m(!files[file_idx].error, c_error, error_unknown_k, files[file_idx].error);
+        int const row_groups = files[file_idx].row_groups;
+        int const run_length = static_cast<int>(divide_round_up<std::size_t>(row_groups, runs_per_file));
+        for (int first = 0; first < row_groups; first += run_length)
+            runs.push_back({file_idx, first, std::min(first + run_length, row_groups)});
+    }
+
+    db.pool.for_each(runs.size(), [&](std::size_t run_idx) noexcept {
+        run_t& run = runs[run_idx];
+        file_t& file = files[run.file_idx];
+        safe_section("Loading a collection", &run.error, [&] {
+            // Only the first run of every file reuses the reader, that was opened above
+            std::unique_ptr<parquet::ParquetFileReader> reader;
+            if (run.first_row_group == 0)
+                reader = std::move(file.reader);
+            else
+                reader = open_collection_file(file.path);
+            for (int row_group_idx = run.first_row_group; row_group_idx != run.end_row_group; ++row_group_idx) {
+                read_row_group(db, file.collection_id, *reader, row_group_idx, &run.error);
+                return_if_error_m(&run.error);
+            }
+        });
+    });
+    for (run_t const& run : runs)
+        return_error_if_m(!run.error, c_error, error_unknown_k, run.error);
+}
+
+std::vector<std::size_t> list_segments(std::string const& dir_path) noexcept(false) {
+
+    std::vector<std::size_t> segments;
+    for (auto const& dir_entry : std::filesystem::directory_iterator {dir_path}) {
+        std::string file_name = dir_entry.path().filename();
+        if (file_name.size() <= wal_t::segment_prefix_k.size() || file_name.find(wal_t::segment_prefix_k) != 0)
+            continue;
+        auto suffix = std::string_view(file_name).substr(wal_t::segment_prefix_k.size());
+        if (std::all_of(suffix.begin(), suffix.end(), [](char c) { return std::isdigit(c); }))
+            segments.push_back(std::stoull(std::string(suffix)));
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+using collection_ids_t = std::unordered_map<ustore_collection_t, ustore_collection_t>;
+
+void replay_batch(database_t& db,
+                  std::string_view body,
+                  collection_ids_t const& ids,
+                  ustore_error_t* c_error) noexcept(false) {
+
+    std::uint32_t count = 0;
+    return_error_if_m(wal_extract(body, count), c_error, error_unknown_k, "Corrupted log batch");
+
+    std::vector<pair_t> pairs;
+    pairs.reserve(count);
+    for (std::uint32_t i = 0; i != count; ++i) {
+        collection_key_t collection_key;
+        ustore_length_t length = 0;
+        bool parsed = wal_extract(body, collection_key.collection) && //
+                      wal_extract(body, collection_key.key) &&
+                      wal_extract(body, length);
+        auto value = value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(body.data()), length};
+        parsed &= body.size() >= value.size();
+        return_error_if_m(parsed, c_error, error_unknown_k, "Corrupted log batch");
+        body.remove_prefix(value.size());
+
+        // The collection may have been dropped later in the same segment
+        auto id_it = ids.find(collection_key.collection);
+        if (id_it == ids.end())
+            continue;
+
+        collection_key.collection = id_it->second;
+        pairs.emplace_back(collection_key, value, db.values, c_error);
+        return_if_error_m(c_error);
+    }
+
+    auto status = db.pairs.upsert(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+    export_error_code(status, c_error);
+}
+
+/**
+ * @brief Replays a single segment of the log on top of the current state.
+ * Replay stops at the first incomplete or corrupted record, which is
+ * expected at the tail of the log, if the process has crashed mid-append.
+ */
+void replay_segment(database_t& db, std::string const& segment_path, ustore_error_t* c_error) noexcept(false) {
+
+    std::ifstream file(segment_path, std::ios::binary);
+    return_error_if_m(file, c_error, error_unknown_k, "Failed to open a log segment");
+    std::string content {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::string_view remaining = content;
+
+    // Collection IDs differ between runs, so we match them by names
+    collection_ids_t ids;
+    ids.emplace(ustore_collection_main_k, ustore_collection_main_k);
+
+    std::uint32_t length = 0;
+    std::uint32_t checksum = 0;
+    wal_entry_t kind {};
+    while (wal_extract(remaining, length) && wal_extract(remaining, checksum) && wal_extract(remaining, kind)) {
+        if (remaining.size() < length)
+            break;
+        std::string_view body = remaining.substr(0, length);
+        remaining.remove_prefix(length);
+        if (wal_checksum(kind, body) != checksum)
+            break;
+
+        switch (kind) {
+        case wal_entry_t::batch_k: replay_batch(db, body, ids, c_error); break;
+        case wal_entry_t::collection_k: {
+            ustore_collection_t logged_id = ustore_collection_main_k;
+            return_error_if_m(wal_extract(body, logged_id), c_error, error_unknown_k, "Corrupted log record");
+            auto name_it = db.names.find(body);
+            if (name_it == db.names.end())
+                name_it = db.names.emplace(std::string(body), new_collection(db)).first;
+            ids[logged_id] = name_it->second;
+            break;
+        }
+        case wal_entry_t::drop_k: {
+            ustore_collection_t logged_id = ustore_collection_main_k;
+            std::uint8_t mode = 0;
+            bool parsed = wal_extract(body, logged_id) && wal_extract(body, mode);
+            return_error_if_m(parsed, c_error, error_unknown_k, "Corrupted log record");
+            auto id_it = ids.find(logged_id);
+            if (id_it == ids.end())
+                break;
+            auto status = drop_collection(db, id_it->second, static_cast<ustore_drop_mode_t>(mode));
+            export_error_code(status, c_error);
+            if (mode == ustore_drop_keys_vals_handle_k)
+                ids.erase(id_it);
+            break;
+        }
+        default: return_error_m(c_error, "Unknown record in the log");
+        }
+        return_if_error_m(c_error);
+    }
+}
+
+/**
+ * @brief Replays all the log segments left since the last checkpoint.
+ * @return The total size of replayed segments in bytes.
+ */
+std::size_t replay(database_t& db, std::string const& dir_path, ustore_error_t* c_error) noexcept(false) {
+
+    std::size_t replayed_bytes = 0;
+    for (std::size_t segment : list_segments(dir_path)) {
+        auto segment_path = wal_t::segment_path(dir_path, segment);
+        replay_segment(db, segment_path, c_error);
+        if (*c_error)
+            return replayed_bytes;
+        replayed_bytes += stdfs::file_size(segment_path);
+        db.wal.segment = segment;
+    }
+    return replayed_bytes;
+}
+
+/**
+ * @brief Dumps the current state into Parquet files and removes the log segments it covers.
+ * Writes may continue concurrently and land in the newly opened segment. Some of them
+ * may also get into the checkpoint, but as the log is replayed in order, the result is
+ * the same.
+ *
+ * @param closing If set, no new log segment is opened.
+ */
+void checkpoint(database_t& db, bool closing, ustore_error_t* c_error) noexcept(false) {
+
+    std::shared_lock _ {db.restructuring_mutex};
+    std::size_t last_covered_segment = 0;
+    {
+        std::unique_lock log_lock {db.wal.mutex};
+        last_covered_segment = db.wal.segment;
+        if (closing)
+            db.wal.close(c_error);
+        else
+            db.wal.rotate(db.names, c_error);
+    }
+    return_if_error_m(c_error);
+
+    write(db, db.persisted_directory, c_error);
+    return_if_error_m(c_error);
+
+    for (std::size_t segment : list_segments(db.persisted_directory))
+        if (segment <= last_covered_segment)
+            stdfs::remove(wal_t::segment_path(db.persisted_directory, segment));
+}
+
+void checkpoint_in_background(database_t& db) noexcept {
+
+    std::unique_lock lock {db.wal.mutex};
+    while (!db.wal.stopping) {
+        if (db.wal.bytes < db.wal.checkpoint_size) {
+            db.wal.wakeup.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        ustore_error_t c_error = nullptr;
+        safe_section("Checkpointing", &c_error, [&] { checkpoint(db, false, &c_error); });
+        lock.lock();
+
+        // Don't spin, if the disk keeps failing
+        if (c_error)
+            db.wal.wakeup.wait_for(lock, std::chrono::seconds(1));
+    }
+}
+
+/*********************************************************/
+/*****************	 Collections Reclamation	****************/
+/*********************************************************/
+
+void reclaim_in_background(database_t& db) noexcept {
+
+    std::unique_lock lock {db.reclaimer.mutex};
+    while (!db.reclaimer.stopping) {
+        if (db.reclaimer.pending.empty()) {
+            db.reclaimer.wakeup.wait(lock);
+            continue;
+        }
+
+        // The ID stays reserved, until all of its entries are gone
+        ustore_collection_t id = db.reclaimer.pending.front();
+        lock.unlock();
+        auto status = erase_collection(db, id);
+        lock.lock();
+
+        if (status)
+            db.reclaimer.pending.pop_front();
+        else
+            db.reclaimer.wakeup.wait_for(lock, std::chrono::seconds(1));
+    }
+}
+
+/**
+ * @brief Drops a collection handle in constant time, leaving its entries
+ * to the background thread. The caller must hold the `restructuring_mutex`.
+ */
+ucset::status_t detach_collection(database_t& db, ustore_collection_t id) noexcept {
+    try {
+        std::unique_lock _ {db.reclaimer.mutex};
+        db.reclaimer.pending.push_back(id);
+        if (!db.reclaimer.thread.joinable())
+            db.reclaimer.thread = std::thread(reclaim_in_background, std::ref(db));
     }
-    return new_handle;
+    catch (...) {
+        return ucset::errc_t::out_of_memory_heap_k;
+    }
+    db.reclaimer.wakeup.notify_one();
+    forget_collection_name(db, id);
+    return {};
 }
 
-void export_error_code(ucset::status_t code, ustore_error_t* c_error) noexcept {
-    if (!code)
-        *c_error = "Faced error!";
+void stop_reclamation(database_t& db) noexcept {
+    if (!db.reclaimer.thread.joinable())
+        return;
+    {
+        std::unique_lock _ {db.reclaimer.mutex};
+        db.reclaimer.stopping = true;
+    }
+    db.reclaimer.wakeup.notify_all();
+    db.reclaimer.thread.join();
+}
+
+void stop_checkpoints(database_t& db) noexcept {
+    if (!db.wal.checkpointer.joinable())
+        return;
+    {
+        std::unique_lock _ {db.wal.mutex};
+        db.wal.stopping = true;
+    }
+    db.wal.wakeup.notify_all();
+    db.wal.checkpointer.join();
 }
 
 /*********************************************************/
-/*****************	 Writing to Disk	  ****************/
+/*****************	   Values Eviction	   ****************/
 /*********************************************************/
 
-void write_collection( //
-    database_t const& db,
-    ustore_collection_t collection_id,
-    std::string const& collection_path,
-    ustore_error_t* c_error) noexcept(false) {
+/**
+ * @brief Selects the cold memory in the `slab_allocator_t` and moves the values
+ * out of it, repointing their storage. Every part of the DB is exclusively
+ * locked during its sweep, as readers may hold views of the values.
+ * Before-images of the snapshots are swept under their own mutexes.
+ * @return `true`, if some RAM was released.
+ */
+bool evict_cold_values(database_t& db) noexcept {
 
-    std::shared_ptr<arrow::io::FileOutputStream> out_file;
-    PARQUET_ASSIGN_OR_THROW(out_file, arrow::io::FileOutputStream::Open(collection_path));
+    std::size_t excess = db.values.excess_resident_bytes();
+    if (!excess || !db.values.select_cold(excess))
+        return false;
 
-    parquet::schema::NodeVector columns {};
-    columns.push_back(parquet::schema::PrimitiveNode::Make( //
-        "key",
-        parquet::Repetition::REQUIRED,
-        parquet::Type::INT64,
-        parquet::ConvertedType::INT_64));
-    columns.push_back(parquet::schema::PrimitiveNode::Make( //
-        "value",
-        parquet::Repetition::OPTIONAL,
-        parquet::Type::BYTE_ARRAY,
-        parquet::ConvertedType::UTF8));
-    auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
-        parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, columns));
-    parquet::WriterProperties::Builder builder;
-    parquet::StreamWriter os {parquet::ParquetFileWriter::Open(out_file, schema, builder.build())};
+    std::size_t resident = db.values.resident_bytes();
+    collection_key_t min {
+        std::numeric_limits<ustore_collection_t>::min(),
+        std::numeric_limits<ustore_key_t>::min(),
+    };
+    collection_key_t max {
+        std::numeric_limits<ustore_collection_t>::max(),
+        std::numeric_limits<ustore_key_t>::max(),
+    };
+    db.pairs.update_range(min, max, [&](pair_t& pair) noexcept { pair.value.evict(db.values); });
+    {
+        std::shared_lock _ {db.snapshots_mutex};
+        for (auto& [id, snap] : db.snapshots) {
+            std::unique_lock snap_lock {snap->mutex};
+            for (auto& [key, before] : snap->before)
+                if (before)
+                    before->evict(db.values);
+        }
+    }
 
-    collection_key_t min(collection_id, std::numeric_limits<ustore_key_t>::min());
-    collection_key_t max(collection_id, std::numeric_limits<ustore_key_t>::max());
-    auto status = db.pairs.range(min, max, [&](pair_t& pair) noexcept {
-        std::optional<std::string_view> value;
-        if (pair.range.size())
-            value = std::string_view(pair.range);
-        os << pair.collection_key.key << value << parquet::EndRow;
-    });
-    export_error_code(status, c_error);
-    return_if_error_m(c_error);
+    // Values, that were in flight during the sweep, will be moved by the next one
+    db.values.release_selected();
+    return db.values.resident_bytes() < resident;
 }
 
-void write(database_t const& db, std::string const& dir_path, ustore_error_t* c_error) noexcept(false) {
+void evict_in_background(database_t& db) noexcept {
 
-    // Check if the source directory even exists
-    if (!std::filesystem::is_directory(dir_path))
-        return;
+    std::unique_lock lock {db.evictor.mutex};
+    while (!db.evictor.stopping) {
+        if (!db.values.excess_resident_bytes()) {
+            db.evictor.wakeup.wait(lock);
+            continue;
+        }
 
-    auto main_path = stdfs::path(dir_path) / ".parquet";
-    write_collection(db, ustore_collection_main_k, main_path, c_error);
-    return_if_error_m(c_error);
+        lock.unlock();
+        bool evicted = evict_cold_values(db);
+        lock.lock();
 
-    for (auto const& collection : db.names) {
-        auto const& collection_name = collection.first;
-        auto const collection_path = stdfs::path(dir_path) / (collection_name + ".parquet");
-        write_collection(db, collection.second, collection_path, c_error);
-        return_if_error_m(c_error);
+        // Don't spin, if the values can't be moved right now
+        if (!evicted)
+            db.evictor.wakeup.wait_for(lock, std::chrono::seconds(1));
     }
 }
 
-bool ends_with(std::string_view str, std::string_view suffix) noexcept {
-    return str.size() >= suffix.size() &&
-           0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix.data(), suffix.size());
+/**
+ * @brief Wakes up the eviction thread, if the values approach the `memory_limit`.
+ * Is called after every write, so it only takes a lock, if the limit is near.
+ */
+void request_eviction(database_t& db) noexcept {
+    if (!db.values.excess_resident_bytes())
+        return;
+    try {
+        std::unique_lock _ {db.evictor.mutex};
+        if (!db.evictor.thread.joinable())
+            db.evictor.thread = std::thread(evict_in_background, std::ref(db));
+    }
+    catch (...) {
+        // Without the thread, new values will just keep spilling
+        return;
+    }
+    db.evictor.wakeup.notify_one();
 }
 
-void read(database_t& db, std::string const& path, ustore_error_t* c_error) noexcept(false) {
+void stop_eviction(database_t& db) noexcept {
+    if (!db.evictor.thread.joinable())
+        return;
+    {
+        std::unique_lock _ {db.evictor.mutex};
+        db.evictor.stopping = true;
+    }
+    db.evictor.wakeup.notify_all();
+    db.evictor.thread.join();
+}
 
-    // Clear the DB, before refilling it
-    db.names.clear();
-    auto status = db.pairs.clear();
-    export_error_code(status, c_error);
-    return_if_error_m(c_error);
+/*********************************************************/
+/*****************	  Parallel Batches	  ****************/
+/*********************************************************/
 
-    // Check if the source directory even exists
-    if (!std::filesystem::is_directory(path))
-        return;
+/**
+ * @brief Contiguous range of tasks in a batch, processed by one thread.
+ */
+struct batch_shard_t {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    ustore_error_t error = nullptr;
+};
 
-    // Loop over all persisted collections, reading them one by one
-    std::string_view extension {".parquet"};
-    for (auto const& dir_entry : std::filesystem::directory_iterator {path}) {
-        auto const& collection_path = dir_entry.path();
-        std::string collection_name = collection_path.filename();
-        if (!ends_with(collection_name, extension))
-            continue;
+/**
+ * @brief Values, copied by a single shard of a batched read.
+ */
+struct read_shard_t : public batch_shard_t {
+    std::string contents;
+};
 
-        collection_name.resize(collection_name.size() - extension.size());
-        ustore_collection_t collection_id = collection_name.empty() ? ustore_collection_main_k : new_collection(db);
-        if (!collection_name.empty())
-            db.names.emplace(collection_name, collection_id);
-
-        std::shared_ptr<arrow::io::ReadableFile> in_file;
-        PARQUET_ASSIGN_OR_THROW(in_file, arrow::io::ReadableFile::Open(collection_path));
-        parquet::StreamReader os {parquet::ParquetFileReader::Open(in_file)};
-
-        ustore_key_t key;
-        std::optional<std::string> value;
-        while (!os.eof()) {
-            os >> key >> value >> parquet::EndRow;
-
-            pair_t pair;
-            pair.collection_key.collection = collection_id;
-            pair.collection_key.key = key;
-
-            // Converting to our internal representation would require a copy
-            if (value) {
-                auto buf_len = value->size();
-                auto buf_ptr = blob_allocator_t {}.allocate(buf_len);
-                return_error_if_m(buf_ptr != nullptr, c_error, out_of_memory_k, "Failed to allocate a blob");
-                pair.range = value_view_t {buf_ptr, buf_len};
-                std::memcpy(buf_ptr, value->data(), value->size());
-            }
-            else
-                pair.range = value_view_t::make_empty();
+/**
+ * @brief Checks if a batch is large enough to be split between the threads.
+ * Transactions track the keys they read, so their batches are never split.
+ */
+bool should_parallelize(database_t const& db, ustore_transaction_t transaction, std::size_t tasks_count) noexcept {
+    return !transaction && db.parallel_batch_size && tasks_count >= db.parallel_batch_size && db.pool.size() > 1;
+}
 
-            auto status = db.pairs.upsert(std::move(pair));
-            export_error_code(status, c_error);
-            return_if_error_m(c_error);
+/**
+ * @brief Splits a batch into several shards per thread,
+ * so that the work is balanced, even if some tasks are heavier.
+ */
+template <typename shard_at>
+std::vector<shard_at> split_batch(database_t const& db, std::size_t tasks_count) noexcept(false) {
+    std::size_t shards_count = std::min(tasks_count, db.pool.size() * 4);
+    std::vector<shard_at> shards(shards_count);
+    for (std::size_t shard_idx = 0; shard_idx != shards_count; ++shard_idx) {
+        shards[shard_idx].begin = tasks_count * shard_idx / shards_count;
+        shards[shard_idx].end = tasks_count * (shard_idx + 1) / shards_count;
+    }
+    return shards;
+}
+
+/**
+ * @brief Splits a batched read between the threads, producing the same tape, as a serial one.
+ * Every shard copies the values into its private buffer, and once the offsets
+ * are known, the buffers are concatenated in the arena.
+ */
+void read_in_parallel(database_t& db,
+                      snapshot_lock_t const& snap,
+                      places_arg_t const& places,
+                      linked_memory_lock_t& arena,
+                      ustore_read_t& c) noexcept {
+
+    std::size_t const tasks_count = places.size();
+    auto presences = arena.alloc<ustore_octet_t>(divide_round_up(tasks_count, bits_in_byte_k), c.error);
+    return_if_error_m(c.error);
+    auto offsets = arena.alloc<ustore_length_t>(tasks_count + 1, c.error);
+    return_if_error_m(c.error);
+    auto lengths = arena.alloc<ustore_length_t>(tasks_count, c.error);
+    return_if_error_m(c.error);
+
+    std::vector<read_shard_t> shards;
+    safe_section("Splitting the batch", c.error, [&] { shards = split_batch<read_shard_t>(db, tasks_count); });
+    return_if_error_m(c.error);
+
+    // 1. Pull the data into private buffers
+    db.pool.for_each(shards.size(), [&](std::size_t shard_idx) noexcept {
+        read_shard_t& shard = shards[shard_idx];
+        for (std::size_t task_idx = shard.begin; task_idx != shard.end && !shard.error; ++task_idx) {
+            auto back_inserter = [&](value_view_t value) noexcept {
+                lengths[task_idx] = value ? static_cast<ustore_length_t>(value.size()) : ustore_length_missing_k;
+                safe_section("Copying a value", &shard.error, [&] {
+                    shard.contents.append(value.c_str(), value.size());
+                });
+            };
+            collection_key_t key = places[task_idx].collection_key();
+            auto status = snap //
+                              ? find_in_snapshot(db, *snap, key, back_inserter)
+                              : find_and_watch(db.pairs, key, c.options, back_inserter);
+            export_error_code(status, &shard.error);
         }
+    });
+    for (read_shard_t const& shard : shards)
+        return_error_if_m(!shard.error, c.error, error_unknown_k, shard.error);
+
+    // 2. Concatenate the buffers
+    bits_span_t presences_bits {presences.begin()};
+    ustore_length_t offset = 0;
+    for (std::size_t task_idx = 0; task_idx != tasks_count; ++task_idx) {
+        presences_bits[task_idx] = lengths[task_idx] != ustore_length_missing_k;
+        offsets[task_idx] = offset;
+        offset += lengths[task_idx] != ustore_length_missing_k ? lengths[task_idx] : 0;
     }
+    offsets[tasks_count] = offset;
+
+    auto contents = arena.alloc<byte_t>(offset, c.error);
+    return_if_error_m(c.error);
+    db.pool.for_each(shards.size(), [&](std::size_t shard_idx) noexcept {
+        read_shard_t const& shard = shards[shard_idx];
+        if (!shard.contents.empty())
+            std::memcpy(contents.begin() + offsets[shard.begin], shard.contents.data(), shard.contents.size());
+    });
+
+    // 3. Export the results
+    if (c.presences)
+        *c.presences = presences.begin();
+    if (c.offsets)
+        *c.offsets = offsets.begin();
+    if (c.lengths)
+        *c.lengths = lengths.begin();
+    if (c.values)
+        *c.values = reinterpret_cast<ustore_bytes_ptr_t>(contents.begin());
 }
 
 /*********************************************************/
@@ -427,10 +1953,9 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
 
     ustore_database_init_t& c = *c_ptr;
     safe_section("Initializing DBMS", c.error, [&] {
-        auto maybe_pairs = ucset_t::make();
+        auto maybe_pairs = ucset_t::make(ucset_options_t {}.partitions);
         return_error_if_m(maybe_pairs, c.error, error_unknown_k, "Couldn't build consistent set");
-        auto db = database_t(std::move(maybe_pairs).value());
-        auto db_ptr = std::make_unique<database_t>(std::move(db)).release();
+        auto db_ptr = std::make_unique<database_t>(std::move(maybe_pairs).value()).release();
 
         if (c.config && std::strlen(c.config) > 0) {
             // Load config
@@ -451,15 +1976,20 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
 
             // Engine config
             return_error_if_m(config.engine.config_url.empty(), c.error, args_wrong_k, "Doesn't support URL configs");
-            return_error_if_m(config.engine.config.empty(), c.error, args_wrong_k, "Doesn't support nested configs");
 
             auto fill_options = [](json_t const& js, ucset_options_t& options) {
                 if (js.contains("encryption"))
                     options.encryption = js["encryption"];
                 if (js.contains("compression"))
                     options.compression = js["compression"];
-                if (js.contains("memory_limit"))
-                    options.memory_limit = js["memory_limit"];
+                if (js.contains("threads"))
+                    options.threads = js["threads"];
+                if (js.contains("partitions"))
+                    options.partitions = js["partitions"];
+                if (js.contains("parallel_batch_size"))
+                    options.parallel_batch_size = js["parallel_batch_size"];
+                return config_loader_t::parse_volume(js, "memory_limit", options.memory_limit) &&
+                       config_loader_t::parse_volume(js, "checkpoint_size", options.checkpoint_size);
             };
 
             // Load from file
@@ -468,32 +1998,105 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
                 std::ifstream ifs(config.engine.config_file_path);
                 return_error_if_m(ifs, c.error, args_wrong_k, "Config file not found");
                 auto js = json_t::parse(ifs);
-                fill_options(js, options);
+                return_error_if_m(fill_options(js, options), c.error, args_wrong_k, "Invalid engine config");
             }
             // Override with nested
             if (!config.engine.config.empty())
-                fill_options(config.engine.config, options);
+                return_error_if_m(fill_options(config.engine.config, options),
+                                  c.error,
+                                  args_wrong_k,
+                                  "Invalid engine config");
+
+            // The container is still empty, so it's cheap to rebuild
+            if (options.partitions != db_ptr->pairs.parts_count()) {
+                auto maybe_pairs = ucset_t::make(options.partitions);
+                return_error_if_m(maybe_pairs, c.error, args_wrong_k, "Invalid number of partitions");
+                db_ptr->pairs = std::move(maybe_pairs).value();
+            }
+
+            // The calling thread takes part in all the jobs, so we spawn one less
+            auto threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+            db_ptr->pool.start(threads > 1 ? threads - 1 : 0);
+            db_ptr->parallel_batch_size = options.parallel_batch_size;
 
             db_ptr->persisted_directory = root;
+            status = db_ptr->values.limit_memory(options.memory_limit, db_ptr->persisted_directory);
+            return_error_if_m(status, c.error, error_unknown_k, status.message());
             read(*db_ptr, db_ptr->persisted_directory, c.error);
+            return_if_error_m(c.error);
+            auto replayed_bytes = replay(*db_ptr, db_ptr->persisted_directory, c.error);
+            return_if_error_m(c.error);
+
+            // Start a new log segment, counting the replayed ones towards the next checkpoint
+            db_ptr->wal.directory = db_ptr->persisted_directory;
+            db_ptr->wal.checkpoint_size = options.checkpoint_size;
+            db_ptr->wal.rotate(db_ptr->names, c.error);
+            return_if_error_m(c.error);
+            db_ptr->wal.bytes += replayed_bytes;
+            db_ptr->wal.checkpointer = std::thread(checkpoint_in_background, std::ref(*db_ptr));
         }
         *c.db = db_ptr;
     });
 }
 
 void ustore_snapshot_list(ustore_snapshot_list_t* c_ptr) {
+
     ustore_snapshot_list_t& c = *c_ptr;
-    *c.count = 0;
-    if (c.ids)
-        *c.ids = nullptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.count && c.ids, c.error, args_combo_k, "Need outputs!");
+
+    linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
+    return_if_error_m(c.error);
+
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::shared_lock _ {db.snapshots_mutex};
+    std::size_t snapshots_count = db.snapshots.size();
+    *c.count = static_cast<ustore_size_t>(snapshots_count);
+
+    auto ids = arena.alloc_or_dummy(snapshots_count, c.error, c.ids);
+    return_if_error_m(c.error);
+
+    std::size_t i = 0;
+    for (auto const& id_and_snapshot : db.snapshots)
+        ids[i++] = id_and_snapshot.first;
 }
 
-void ustore_snapshot_create(ustore_snapshot_create_t*) {
-    // TODO
+void ustore_snapshot_create(ustore_snapshot_create_t* c_ptr) {
+
+    ustore_snapshot_create_t& c = *c_ptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+
+    // Waits for the in-flight writes, so none of them is half-way preserved
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::unique_lock _ {db.snapshots_mutex};
+    safe_section("Allocating snapshot handle", c.error, [&] {
+        auto snap = std::make_unique<snapshot_t>();
+        auto id = reinterpret_cast<ustore_snapshot_t>(snap.get());
+        db.snapshots.emplace(id, std::move(snap));
+        *c.id = id;
+    });
 }
 
-void ustore_snapshot_drop(ustore_snapshot_drop_t*) {
-    // TODO
+void ustore_snapshot_drop(ustore_snapshot_drop_t* c_ptr) {
+
+    if (!c_ptr)
+        return;
+
+    ustore_snapshot_drop_t& c = *c_ptr;
+    if (!c.id || !c.db)
+        return;
+
+    // Before-images are freed outside of the lock
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::unique_ptr<snapshot_t> snap;
+    {
+        std::unique_lock _ {db.snapshots_mutex};
+        auto it = db.snapshots.find(c.id);
+        if (it == db.snapshots.end())
+            return;
+        snap = std::move(it->second);
+        db.snapshots.erase(it);
+    }
 }
 
 void ustore_read(ustore_read_t* c_ptr) {
@@ -507,13 +2110,20 @@ void ustore_read(ustore_read_t* c_ptr) {
     return_if_error_m(c.error);
 
     database_t& db = *reinterpret_cast<database_t*>(c.db);
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
+    txn_t& txn = *reinterpret_cast<txn_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
     places_arg_t places {collections, keys, {}, c.tasks_count};
     validate_read(c.transaction, places, c.options, c.error);
     return_if_error_m(c.error);
 
+    // Reads from snapshots bypass the transaction state
+    snapshot_lock_t snap = lock_snapshot(db, c.snapshot, c.error);
+    return_if_error_m(c.error);
+
+    if (should_parallelize(db, c.transaction, places.size()))
+        return read_in_parallel(db, snap, places, arena, c);
+
     // 1. Allocate a tape for all the values to be pulled
     growing_tape_t tape(arena);
     tape.reserve(places.size(), c.error);
@@ -526,9 +2136,11 @@ void ustore_read(ustore_read_t* c_ptr) {
     for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx) {
         place_t place = places[task_idx];
         collection_key_t key = place.collection_key();
-        auto status = c.transaction //
-                          ? find_and_watch(txn, key, c.options, back_inserter)
-                          : find_and_watch(db.pairs, key, c.options, back_inserter);
+        auto status = snap              //
+                          ? find_in_snapshot(db, *snap, key, back_inserter)
+                          : c.transaction //
+                                ? find_and_watch(txn.raw, key, c.options, back_inserter)
+                                : find_and_watch(db.pairs, key, c.options, back_inserter);
         if (!status)
             return export_error_code(status, c.error);
     }
@@ -547,6 +2159,7 @@ void ustore_read(ustore_read_t* c_ptr) {
 void ustore_write(ustore_write_t* c_ptr) {
 
     ustore_write_t& c = *c_ptr;
+    write_completion_t completion {c};
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
     if (!c.tasks_count)
         return;
@@ -555,7 +2168,7 @@ void ustore_write(ustore_write_t* c_ptr) {
     return_if_error_m(c.error);
 
     database_t& db = *reinterpret_cast<database_t*>(c.db);
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
+    txn_t& txn = *reinterpret_cast<txn_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
     strided_iterator_gt<ustore_bytes_cptr_t const> vals {c.values, c.values_stride};
@@ -573,6 +2186,9 @@ void ustore_write(ustore_write_t* c_ptr) {
     // in terms of transactional and batch operations.
     // The latter will also differ depending on the number
     // pairs you are working with - one or more.
+    // Changes will also be logged, if persistence is enabled.
+    bool logged = db.wal.enabled();
+    bool flush = c.options & ustore_option_write_flush_k;
     if (c.transaction) {
         bool dont_watch = c.options & ustore_option_transaction_dont_watch_k;
         for (std::size_t i = 0; i != places.size(); ++i) {
@@ -580,43 +2196,63 @@ void ustore_write(ustore_write_t* c_ptr) {
             value_view_t content = contents[i];
             collection_key_t key = place.collection_key();
             if (!dont_watch)
-                if (auto watch_status = txn.watch(key); !watch_status)
+                if (auto watch_status = txn.raw.watch(key); !watch_status)
                     return export_error_code(watch_status, c.error);
 
             ucset::status_t status;
             if (content) {
-                pair_t pair {key, content, c.error};
+                pair_t pair {key, content, db.values, c.error};
                 return_if_error_m(c.error);
-                status = txn.upsert(std::move(pair));
+                status = txn.raw.upsert(std::move(pair));
             }
             else
-                status = txn.erase(key);
+                status = txn.raw.erase(key);
 
             if (!status)
                 return export_error_code(status, c.error);
+            safe_section("Logging a change", c.error, [&] {
+                txn.updated_keys.push_back(key);
+                if (logged)
+                    txn.changes.push(key, content);
+            });
+            return_if_error_m(c.error);
         }
-        return;
+        return request_eviction(db);
+    }
+
+    // Snapshots must get the previous values before any of them changes
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    for (std::size_t i = 0; i != places.size() && !db.snapshots.empty(); ++i) {
+        safe_section("Preserving before-images", c.error, [&] {
+            preserve_before_image(db, places[i].collection_key(), c.error);
+        });
+        return_if_error_m(c.error);
     }
 
     // Non-transactional but atomic batch-write operation.
     // It requires producing a copy of input data.
-    else if (c.tasks_count > 1) {
+    if (c.tasks_count > 1) {
         uninitialized_array_gt<pair_t> copies(places.count, arena, c.error);
         return_if_error_m(c.error);
         initialized_range_gt<pair_t> copies_constructed(copies);
+        wal_batch_t batch;
 
         for (std::size_t i = 0; i != places.size(); ++i) {
             place_t place = places[i];
             value_view_t content = contents[i];
             collection_key_t key = place.collection_key();
 
-            pair_t pair {key, content, c.error};
+            pair_t pair {key, content, db.values, c.error};
             return_if_error_m(c.error);
             copies[i] = std::move(pair);
+            if (logged)
+                safe_section("Logging a change", c.error, [&] { batch.push(key, content); });
+            return_if_error_m(c.error);
         }
 
-        auto status = db.pairs.upsert(std::make_move_iterator(copies.begin()), std::make_move_iterator(copies.end()));
-        return export_error_code(status, c.error);
+        apply_logged(db, wal_entry_t::batch_k, batch.body, flush, c.error, [&]() noexcept {
+            return db.pairs.upsert(std::make_move_iterator(copies.begin()), std::make_move_iterator(copies.end()));
+        });
     }
 
     // Just a single non-batch write
@@ -625,11 +2261,18 @@ void ustore_write(ustore_write_t* c_ptr) {
         value_view_t content = contents[0];
         collection_key_t key = place.collection_key();
 
-        pair_t pair {key, content, c.error};
+        pair_t pair {key, content, db.values, c.error};
+        return_if_error_m(c.error);
+        wal_batch_t batch;
+        if (logged)
+            safe_section("Logging a change", c.error, [&] { batch.push(key, content); });
         return_if_error_m(c.error);
-        auto status = db.pairs.upsert(std::move(pair));
-        return export_error_code(status, c.error);
+
+        apply_logged(db, wal_entry_t::batch_k, batch.body, flush, c.error, [&]() noexcept {
+            return db.pairs.upsert(std::move(pair));
+        });
     }
+    request_eviction(db);
 }
 
 void ustore_scan(ustore_scan_t* c_ptr) {
@@ -643,7 +2286,7 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     return_if_error_m(c.error);
 
     database_t& db = *reinterpret_cast<database_t*>(c.db);
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
+    txn_t& txn = *reinterpret_cast<txn_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> lens {c.count_limits, c.count_limits_stride};
@@ -652,6 +2295,10 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     validate_scan(c.transaction, scans, c.options, c.error);
     return_if_error_m(c.error);
 
+    // Scans of snapshots bypass the transaction state
+    snapshot_lock_t snap = lock_snapshot(db, c.snapshot, c.error);
+    return_if_error_m(c.error);
+
     // 1. Allocate a tape for all the values to be fetched
     auto offsets = arena.alloc_or_dummy(scans.count + 1, c.error, c.offsets);
     return_if_error_m(c.error);
@@ -662,50 +2309,88 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
+    // Values are copied while the pairs are still locked, if requested
+    bool const needs_values = c.values != nullptr;
+    scanned_values_t values(arena);
+    if (needs_values)
+        values.reserve(arena, total_keys, c.error);
+    return_if_error_m(c.error);
+
     // 2. Fetch the data
-    for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
+    auto scan_one = [&](std::size_t task_idx, ustore_key_t* output, ustore_length_t& matched_pairs_count) noexcept {
         scan_t scan = scans[task_idx];
-        offsets[task_idx] = keys_output - *c.keys;
-
-        ustore_length_t matched_pairs_count = 0;
-        auto found_pair = [&](pair_t const& pair) noexcept {
-            *keys_output = pair.collection_key.key;
-            ++keys_output;
+        auto found_key = [&](ustore_key_t key, value_view_t value) noexcept {
+            if (needs_values)
+                values.push(output - *c.keys + matched_pairs_count, value, c.error);
+            output[matched_pairs_count] = key;
             ++matched_pairs_count;
         };
+        auto found_pair = [&](pair_t const& pair) noexcept {
+            found_key(pair.collection_key.key, pair.range());
+        };
 
         auto previous_key = collection_key_t {scan.collection, scan.min_key};
-        auto status = c.transaction //
-                          ? scan_and_watch(txn, previous_key, scan.limit, c.options, found_pair)
-                          : scan_and_watch(db.pairs, previous_key, scan.limit, c.options, found_pair);
-        if (!status)
-            return export_error_code(status, c.error);
+        return snap              //
+                   ? scan_snapshot(db, *snap, previous_key, scan.limit, found_key)
+                   : c.transaction //
+                         ? scan_and_watch(txn.raw, previous_key, scan.limit, c.options, found_pair)
+                         : scan_and_watch(db.pairs, previous_key, scan.limit, c.options, found_pair);
+    };
+
+    // Values share a single tape, so they are only exported serially
+    if (needs_values || !should_parallelize(db, c.transaction, scans.count)) {
+        for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
+            offsets[task_idx] = keys_output - *c.keys;
+            ustore_length_t matched_pairs_count = 0;
+            auto status = scan_one(task_idx, keys_output, matched_pairs_count);
+            if (!status)
+                return export_error_code(status, c.error);
+            return_if_error_m(c.error);
 
-        counts[task_idx] = matched_pairs_count;
+            counts[task_idx] = matched_pairs_count;
+            keys_output += matched_pairs_count;
+        }
+        offsets[scans.count] = keys_output - *c.keys;
+        if (needs_values)
+            values.export_to(arena, keys_output - *c.keys, c.values_offsets, c.values_lengths, c.values, c.error);
+        return;
     }
-    offsets[scans.count] = keys_output - *c.keys;
-}
 
-struct key_from_pair_t {
-    ustore_key_t* key_ptr;
-    key_from_pair_t(ustore_key_t* key) : key_ptr(key) {}
-    key_from_pair_t& operator=(pair_t const& pair) {
-        *key_ptr = pair.collection_key.key;
-        return *this;
-    };
-};
+    // Large batches are split between threads. Every task fills
+    // its own slice, sized by its limit, and those are compacted later.
+    auto slice_offsets = arena.alloc<std::size_t>(scans.count, c.error);
+    return_if_error_m(c.error);
+    auto slice_counts = arena.alloc<ustore_length_t>(scans.count, c.error);
+    return_if_error_m(c.error);
+    for (std::size_t task_idx = 0, slice_offset = 0; task_idx != scans.count; ++task_idx) {
+        slice_offsets[task_idx] = slice_offset;
+        slice_offset += scans.limits[task_idx];
+    }
 
-struct key_iterator_t {
-    using value_type = ustore_key_t;
-    using pointer = value_type*;
-    using reference = value_type&;
-    using difference_type = std::ptrdiff_t;
-    using iterator_category = std::random_access_iterator_tag;
+    std::vector<batch_shard_t> shards;
+    safe_section("Splitting the batch", c.error, [&] { shards = split_batch<batch_shard_t>(db, scans.count); });
+    return_if_error_m(c.error);
+    db.pool.for_each(shards.size(), [&](std::size_t shard_idx) noexcept {
+        batch_shard_t& shard = shards[shard_idx];
+        for (std::size_t task_idx = shard.begin; task_idx != shard.end && !shard.error; ++task_idx) {
+            slice_counts[task_idx] = 0;
+            auto status = scan_one(task_idx, keys_output + slice_offsets[task_idx], slice_counts[task_idx]);
+            export_error_code(status, &shard.error);
+        }
+    });
+    for (batch_shard_t const& shard : shards)
+        return_error_if_m(!shard.error, c.error, error_unknown_k, shard.error);
 
-    ustore_key_t* begin_;
-    key_iterator_t(ustore_key_t* key) : begin_(key) {}
-    key_from_pair_t operator[](std::size_t idx) { return &begin_[idx]; };
-};
+    // Slices only move towards the beginning, so they can be compacted in order
+    for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
+        offsets[task_idx] = keys_output - *c.keys;
+        counts[task_idx] = slice_counts[task_idx];
+        if (slice_counts[task_idx])
+            std::memmove(keys_output, *c.keys + slice_offsets[task_idx], slice_counts[task_idx] * sizeof(ustore_key_t));
+        keys_output += slice_counts[task_idx];
+    }
+    offsets[scans.count] = keys_output - *c.keys;
+}
 
 void ustore_sample(ustore_sample_t* c_ptr) {
 
@@ -732,6 +2417,9 @@ void ustore_sample(ustore_sample_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
+    snapshot_lock_t snap = lock_snapshot(db, c.snapshot, c.error);
+    return_if_error_m(c.error);
+
     for (std::size_t task_idx = 0; task_idx != samples.count; ++task_idx) {
         sample_arg_t task = samples[task_idx];
         offsets[task_idx] = keys_output - *c.keys;
@@ -743,11 +2431,29 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         collection_key_t min(task.collection, std::numeric_limits<ustore_key_t>::min());
         collection_key_t max(task.collection, std::numeric_limits<ustore_key_t>::max());
 
+        // Snapshots are sampled from the merged view of HEAD and the before-images
+        if (snap) {
+            auto max_count = std::numeric_limits<std::size_t>::max();
+            auto status = scan_snapshot(db, *snap, min, max_count, [&](ustore_key_t key, value_view_t) {
+                if (seen < task.limit)
+                    keys_output[seen] = key;
+                else if (auto idx = std::uniform_int_distribution<std::size_t>(0, seen)(random_generator);
+                         idx < task.limit)
+                    keys_output[idx] = key;
+                ++seen;
+            });
+            export_error_code(status, c.error);
+            return_if_error_m(c.error);
+            counts[task_idx] = static_cast<ustore_length_t>(std::min<std::size_t>(seen, task.limit));
+            keys_output += task.limit;
+            continue;
+        }
+
         auto status = db.pairs.sample_range(min, max, random_generator, seen, task.limit, iter);
         export_error_code(status, c.error);
         return_if_error_m(c.error);
 
-        counts[task_idx] = task.limit;
+        counts[task_idx] = static_cast<ustore_length_t>(std::min<std::size_t>(seen, task.limit));
         keys_output += task.limit;
     }
     offsets[samples.count] = keys_output - *c.keys;
@@ -772,7 +2478,6 @@ void ustore_measure(ustore_measure_t* c_ptr) {
     return_if_error_m(c.error);
 
     database_t& db = *reinterpret_cast<database_t*>(c.db);
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
@@ -785,22 +2490,39 @@ void ustore_measure(ustore_measure_t* c_ptr) {
         collection_key_t min(collection, min_key);
         collection_key_t max(collection, max_key);
 
-        std::size_t cardinality = 0;
-        std::size_t value_bytes = 0;
-        std::size_t space_usage = 0;
-        auto status = db.pairs.range(min, max, [&](pair_t& pair) noexcept {
-            ++cardinality;
-            value_bytes += pair.range.size();
-            space_usage += pair.range.size() + sizeof(pair_t);
-        });
-        export_error_code(status, c.error);
-        return_if_error_m(c.error);
+        // Whole collections are measured from the partitions' running totals,
+        // while arbitrary ranges still have to be walked.
+        bool whole_collection = min_key == std::numeric_limits<ustore_key_t>::min() &&
+                                max_key == std::numeric_limits<ustore_key_t>::max();
+        bool exact = true;
+        collection_stats_t stats;
+        if (whole_collection)
+            db.pairs.for_each_summary([&](collections_stats_t const& part) noexcept {
+                exact &= part.exact;
+                auto it = part.collections.find(collection);
+                if (it == part.collections.end())
+                    return;
+                stats.cardinality += it->second.cardinality;
+                stats.value_bytes += it->second.value_bytes;
+            });
+
+        if (!whole_collection || !exact) {
+            stats = {};
+            auto status = db.pairs.range(min, max, [&](pair_t const& pair) noexcept {
+                if (!pair)
+                    return;
+                ++stats.cardinality;
+                stats.value_bytes += pair.range().size();
+            });
+            export_error_code(status, c.error);
+            return_if_error_m(c.error);
+        }
 
-        min_cardinalities[i] = static_cast<ustore_size_t>(cardinality);
-        max_cardinalities[i] = std::numeric_limits<ustore_size_t>::max();
-        min_value_bytes[i] = value_bytes;
-        max_value_bytes[i] = std::numeric_limits<ustore_size_t>::max();
-        min_space_usages[i] = space_usage;
+        min_cardinalities[i] = static_cast<ustore_size_t>(stats.cardinality);
+        max_cardinalities[i] = static_cast<ustore_size_t>(stats.cardinality);
+        min_value_bytes[i] = static_cast<ustore_size_t>(stats.value_bytes);
+        max_value_bytes[i] = static_cast<ustore_size_t>(stats.value_bytes);
+        min_space_usages[i] = static_cast<ustore_size_t>(stats.value_bytes + stats.cardinality * sizeof(pair_t));
         max_space_usages[i] = std::numeric_limits<ustore_size_t>::max();
     }
 }
@@ -824,6 +2546,21 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
 
     auto new_collection_id = new_collection(db);
     safe_section("Inserting new collection", c.error, [&] { db.names.emplace(collection_name, new_collection_id); });
+    return_if_error_m(c.error);
+
+    if (db.wal.enabled())
+        safe_section("Logging new collection", c.error, [&] {
+            std::string body;
+            wal_append(body, new_collection_id);
+            body.append(collection_name);
+            {
+                std::unique_lock log_lock {db.wal.mutex};
+                return_error_if_m(!db.wal.broken, c.error, error_unknown_k, "The log is broken, reopen the DB");
+                db.wal.append(wal_entry_t::collection_k, body, c.error);
+                return_if_error_m(c.error);
+            }
+            db.wal.sync(c.error);
+        });
     *c.id = new_collection_id;
 }
 
@@ -840,31 +2577,21 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
 
     database_t& db = *reinterpret_cast<database_t*>(c.db);
     std::unique_lock _ {db.restructuring_mutex};
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    safe_section("Preserving before-images", c.error, [&] { preserve_before_images(db, c.id, c.error); });
+    return_if_error_m(c.error);
 
-    if (c.mode == ustore_drop_keys_vals_handle_k) {
-        auto status = db.pairs.erase_range(c.id, c.id + 1, no_op_t {});
-        if (!status)
-            return export_error_code(status, c.error);
-
-        for (auto it = db.names.begin(); it != db.names.end(); ++it) {
-            if (c.id != it->second)
-                continue;
-            db.names.erase(it);
-            break;
-        }
-    }
-
-    else if (c.mode == ustore_drop_keys_vals_k) {
-        auto status = db.pairs.erase_range(c.id, c.id + 1, no_op_t {});
-        return export_error_code(status, c.error);
-    }
-
-    else if (c.mode == ustore_drop_vals_k) {
-        auto status = db.pairs.range(c.id, c.id + 1, [&](pair_t& pair) noexcept {
-            pair = pair_t {pair.collection_key, value_view_t::make_empty(), nullptr};
+    std::string body;
+    if (db.wal.enabled())
+        safe_section("Logging collection removal", c.error, [&] {
+            wal_append(body, c.id);
+            wal_append(body, static_cast<std::uint8_t>(c.mode));
         });
-        return export_error_code(status, c.error);
-    }
+    return_if_error_m(c.error);
+
+    apply_logged(db, wal_entry_t::drop_k, body, true, c.error, [&]() noexcept {
+        return invalidate ? detach_collection(db, c.id) : drop_collection(db, c.id, c.mode);
+    });
 }
 
 void ustore_collection_list(ustore_collection_list_t* c_ptr) {
@@ -936,12 +2663,14 @@ void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
 
         auto maybe_txn = db.pairs.transaction();
         return_error_if_m(maybe_txn, c.error, error_unknown_k, "Couldn't start a transaction");
-        *c.transaction = std::make_unique<transaction_t>(std::move(maybe_txn).value()).release();
+        *c.transaction = std::make_unique<txn_t>(txn_t {std::move(maybe_txn).value(), {}}).release();
     });
     return_if_error_m(c.error);
 
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(*c.transaction);
-    auto status = txn.reset();
+    txn_t& txn = *reinterpret_cast<txn_t*>(*c.transaction);
+    txn.changes.clear();
+    txn.updated_keys.clear();
+    auto status = txn.raw.reset();
     return export_error_code(status, c.error);
 }
 
@@ -953,20 +2682,33 @@ void ustore_transaction_commit(ustore_transaction_commit_t* c_ptr) {
 
     validate_transaction_commit(c.transaction, c.options, c.error);
     return_if_error_m(c.error);
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
-    auto status = txn.stage();
-    if (!status)
-        return export_error_code(status, c.error);
-    status = txn.commit();
-    if (!status)
-        return export_error_code(status, c.error);
+    txn_t& txn = *reinterpret_cast<txn_t*>(c.transaction);
 
-    if (c.sequence_number)
-        *c.sequence_number = txn.generation();
+    // Live snapshots may still need the values, this transaction overwrites
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    for (std::size_t i = 0; i != txn.updated_keys.size() && !db.snapshots.empty(); ++i) {
+        safe_section("Preserving before-images", c.error, [&] {
+            preserve_before_image(db, txn.updated_keys[i], c.error);
+        });
+        return_if_error_m(c.error);
+    }
+
+    // Only the changes are logged, the checkpoints are made in the background
+    bool flush = c.options & ustore_option_write_flush_k;
+    std::string_view changes = txn.changes ? std::string_view(txn.changes.body) : std::string_view();
+    apply_logged(db, wal_entry_t::batch_k, changes, flush, c.error, [&]() noexcept {
+        auto status = txn.raw.stage();
+        if (!status)
+            return status;
+        return txn.raw.commit();
+    });
+    return_if_error_m(c.error);
+    txn.changes.clear();
+    txn.updated_keys.clear();
 
-    // TODO: Degrade the lock to "shared" state before starting expensive IO
-    if (c.options & ustore_option_write_flush_k)
-        safe_section("Saving to disk", c.error, [&] { write(db, db.persisted_directory, c.error); });
+    if (c.sequence_number)
+        *c.sequence_number = txn.raw.generation();
+    request_eviction(db);
 }
 
 /*********************************************************/
@@ -980,7 +2722,7 @@ void ustore_arena_free(ustore_arena_t c_arena) {
 void ustore_transaction_free(ustore_transaction_t const c_transaction) {
     if (!c_transaction)
         return;
-    transaction_t& txn = *reinterpret_cast<transaction_t*>(c_transaction);
+    txn_t& txn = *reinterpret_cast<txn_t*>(c_transaction);
     delete &txn;
 }
 
@@ -989,9 +2731,12 @@ void ustore_database_free(ustore_database_t c_db) {
         return;
 
     database_t& db = *reinterpret_cast<database_t*>(c_db);
+    stop_eviction(db);
+    stop_reclamation(db);
     if (!db.persisted_directory.empty()) {
+        stop_checkpoints(db);
         ustore_error_t c_error = nullptr;
-        safe_section("Saving to disk", &c_error, [&] { write(db, db.persisted_directory, &c_error); });
+        safe_section("Saving to disk", &c_error, [&] { checkpoint(db, true, &c_error); });
     }
 
     delete &db;
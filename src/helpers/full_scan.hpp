@@ -5,14 +5,25 @@
  * @brief Callback-based full-scan over BLOB collection.
  */
 #pragma once
+#include <map>
 #include <random>
+#include <numeric>   // `std::iota`
+#include <algorithm> // `std::sort`
 
 #include "ustore/blobs.h"
+#include "ustore/cpp/ranges_args.hpp" // `scans_arg_t`
+#include "linked_array.hpp"           // `uninitialized_array_gt`
+#include "key_encoding.hpp"           // `native_key_encoding_t`
 
 namespace unum::ustore {
 
+/**
+ * @brief Passes whole batches of up to @p read_ahead entries to the callback,
+ * so that it can process many of them at once. Keys and values of a batch
+ * are only valid until the callback returns.
+ */
 template <typename callback_should_continue_at>
-void full_scan_collection( //
+void full_scan_collection_batches( //
     ustore_database_t db,
     ustore_transaction_t transaction,
     ustore_collection_t collection,
@@ -27,6 +38,8 @@ void full_scan_collection( //
     while (!*error) {
         ustore_length_t* found_blobs_count {};
         ustore_key_t* found_blobs_keys {};
+        ustore_length_t* found_blobs_offsets {};
+        ustore_byte_t* found_blobs_data {};
         ustore_scan_t scan {};
         scan.db = db;
         scan.error = error;
@@ -39,71 +52,385 @@ void full_scan_collection( //
         scan.count_limits = &read_ahead;
         scan.counts = &found_blobs_count;
         scan.keys = &found_blobs_keys;
+        scan.values_offsets = &found_blobs_offsets;
+        scan.values = &found_blobs_data;
 
         ustore_scan(&scan);
         if (*error)
             break;
 
-        if (found_blobs_count[0] <= 1)
+        ustore_length_t const count_blobs = found_blobs_count[0];
+        if (!count_blobs)
             // We have reached the end of collection
             break;
 
-        ustore_length_t* found_blobs_offsets {};
-        ustore_byte_t* found_blobs_data {};
-        ustore_read_t read {};
-        read.db = db;
-        read.error = error;
-        read.transaction = transaction;
-        read.arena = arena;
-        read.options = ustore_options_t(options | ustore_option_dont_discard_memory_k);
-        read.tasks_count = found_blobs_count[0];
-        read.collections = &collection;
-        read.collections_stride = 0;
-        read.keys = found_blobs_keys;
-        read.keys_stride = sizeof(ustore_key_t);
-        read.offsets = &found_blobs_offsets;
-        read.values = &found_blobs_data;
-
-        ustore_read(&read);
-        if (*error)
-            break;
+        // Engines, that can't export values while scanning, are followed up with a read
+        if (!found_blobs_offsets) {
+            ustore_read_t read {};
+            read.db = db;
+            read.error = error;
+            read.transaction = transaction;
+            read.arena = arena;
+            read.options = ustore_options_t(options | ustore_option_dont_discard_memory_k);
+            read.tasks_count = count_blobs;
+            read.collections = &collection;
+            read.collections_stride = 0;
+            read.keys = found_blobs_keys;
+            read.keys_stride = sizeof(ustore_key_t);
+            read.offsets = &found_blobs_offsets;
+            read.values = &found_blobs_data;
 
-        ustore_length_t const count_blobs = found_blobs_count[0];
-        joined_blobs_iterator_t found_blobs {found_blobs_offsets, found_blobs_data};
-        for (std::size_t i = 0; i != count_blobs; ++i, ++found_blobs) {
-            value_view_t bucket = *found_blobs;
-            if (!callback_should_continue(found_blobs_keys[i], bucket))
-                return;
+            ustore_read(&read);
+            if (*error)
+                break;
         }
 
+        joined_blobs_iterator_t found_blobs {found_blobs_offsets, found_blobs_data};
+        if (!callback_should_continue(found_blobs_keys, found_blobs, count_blobs))
+            return;
+
+        if (count_blobs < read_ahead)
+            break;
         start_key = found_blobs_keys[count_blobs - 1] + 1;
     }
 }
 
+template <typename callback_should_continue_at>
+void full_scan_collection( //
+    ustore_database_t db,
+    ustore_transaction_t transaction,
+    ustore_collection_t collection,
+    ustore_options_t options,
+    ustore_key_t start_key,
+    ustore_length_t read_ahead,
+    linked_memory_lock_t& arena,
+    ustore_error_t* error,
+    callback_should_continue_at&& callback_should_continue) noexcept {
+
+    auto for_each = [&](ustore_key_t const* keys, joined_blobs_iterator_t found_blobs, std::size_t count) {
+        for (std::size_t i = 0; i != count; ++i, ++found_blobs) {
+            value_view_t bucket = *found_blobs;
+            if (!callback_should_continue(keys[i], bucket))
+                return false;
+        }
+        return true;
+    };
+    full_scan_collection_batches(db, transaction, collection, options, start_key, read_ahead, arena, error, for_each);
+}
+
+/**
+ * @brief Orders the tasks of a batched scan by collection and start key,
+ * so that a single iterator per collection can serve all of them, moving forward.
+ * Already ordered batches keep the identity order and skip sorting.
+ */
+inline ptr_range_gt<std::size_t> order_scan_tasks(scans_arg_t const& scans,
+                                                  linked_memory_lock_t& arena,
+                                                  ustore_error_t* c_error) noexcept {
+
+    auto order = arena.alloc<std::size_t>(scans.count, c_error);
+    if (*c_error)
+        return order;
+
+    auto less = [&](std::size_t lhs_idx, std::size_t rhs_idx) noexcept {
+        scan_t lhs = scans[lhs_idx], rhs = scans[rhs_idx];
+        return lhs.collection != rhs.collection ? lhs.collection < rhs.collection : lhs.min_key < rhs.min_key;
+    };
+    std::iota(order.begin(), order.end(), 0ul);
+    if (!std::is_sorted(order.begin(), order.end(), less))
+        std::sort(order.begin(), order.end(), less);
+    return order;
+}
+
+/**
+ * @brief Wraps a RocksDB or LevelDB iterator, reused across the ordered tasks of one batched scan.
+ * Remembers the smallest key the iterator may currently point to, so that nearby
+ * ascending targets are reached with a few `Next()` calls instead of a full `Seek()`.
+ * Keys are translated with @p key_encoding_at, matching the comparator of the store.
+ */
+template <typename level_or_rocks_iterator_at, typename key_encoding_at = native_key_encoding_t>
+class forward_scanner_gt {
+    using iterator_key_t = decltype(std::declval<level_or_rocks_iterator_at&>().key());
+    using slice_t = std::remove_cv_t<std::remove_reference_t<iterator_key_t>>;
+
+    level_or_rocks_iterator_at& iterator_;
+    ustore_key_t position_ {};
+    bool positioned_ {false};
+
+  public:
+    static constexpr std::size_t steps_before_seek_k = 8;
+
+    forward_scanner_gt(level_or_rocks_iterator_at& iterator) noexcept : iterator_(iterator) {}
+
+    void seek(ustore_key_t key) {
+        if (positioned_ && position_ <= key) {
+            for (std::size_t step = 0; step != steps_before_seek_k; ++step, iterator_.Next()) {
+                if (!iterator_.Valid()) {
+                    if (!iterator_.status().ok())
+                        break;
+                    position_ = key;
+                    return;
+                }
+                if (key_encoding_at::decode(iterator_.key().data()) >= key) {
+                    position_ = key;
+                    return;
+                }
+            }
+        }
+
+        encoded_key_gt<key_encoding_at> target {key};
+        iterator_.Seek(slice_t(target.bytes, sizeof(ustore_key_t)));
+        position_ = key;
+        positioned_ = true;
+    }
+
+    /**
+     * @brief Exports up to @p limit keys, calling @p callback with the index of every one,
+     * while the iterator still points to it, so that the value can be pulled too.
+     */
+    template <typename callback_at>
+    ustore_length_t read(ustore_length_t limit, ustore_key_t* keys, callback_at&& callback) {
+        ustore_length_t count = 0;
+        for (; count != limit && iterator_.Valid(); ++count, iterator_.Next()) {
+            keys[count] = key_encoding_at::decode(iterator_.key().data());
+            callback(count);
+        }
+
+        // The iterator now points past the last exported key
+        if (count) {
+            ustore_key_t last = keys[count - 1];
+            if (last == std::numeric_limits<ustore_key_t>::max())
+                positioned_ = false;
+            else
+                position_ = last + 1;
+        }
+        return count;
+    }
+
+    ustore_length_t read(ustore_length_t limit, ustore_key_t* keys) {
+        return read(limit, keys, [](std::size_t) noexcept {});
+    }
+
+    value_view_t value() const noexcept {
+        auto value = iterator_.value();
+        return {reinterpret_cast<byte_t const*>(value.data()), value.size()};
+    }
+};
+
 /**
- * @brief Implements reservoir sampling for RocksDB or LevelDB collections.
+ * @brief Values exported by a batched scan alongside the keys, from the same iterator positions.
+ * The tasks may be served out of order, so every exported key owns a slot for the offset
+ * and the length of its value, and the tape is rearranged in the order of keys before export.
+ */
+class scanned_values_t {
+    uninitialized_array_gt<byte_t> tape_;
+    ptr_range_gt<ustore_length_t> offsets_;
+    ptr_range_gt<ustore_length_t> lengths_;
+
+  public:
+    scanned_values_t(linked_memory_lock_t& arena) noexcept : tape_(arena) {}
+
+    /**
+     * @brief Allocates slots for the given number of keys. Must be called before `push()`.
+     */
+    void reserve(linked_memory_lock_t& arena, std::size_t slots, ustore_error_t* c_error) noexcept {
+        offsets_ = arena.alloc<ustore_length_t>(slots + 1, c_error);
+        return_if_error_m(c_error);
+        lengths_ = arena.alloc<ustore_length_t>(slots, c_error);
+    }
+
+    void push(std::size_t slot, value_view_t value, ustore_error_t* c_error) noexcept {
+        offsets_[slot] = static_cast<ustore_length_t>(tape_.size());
+        lengths_[slot] = value ? static_cast<ustore_length_t>(value.size()) : ustore_length_missing_k;
+        if (!value.size())
+            return;
+        tape_.reserve(tape_.size() + value.size(), c_error);
+        return_if_error_m(c_error);
+        tape_.insert(tape_.size(), value.begin(), value.end(), c_error);
+    }
+
+    /**
+     * @brief Mirrors the compaction of the keys tape: moves a slice of slots towards the beginning.
+     */
+    void move(std::size_t source, std::size_t target, std::size_t count) noexcept {
+        if (!count)
+            return;
+        std::memmove(offsets_.begin() + target, offsets_.begin() + source, count * sizeof(ustore_length_t));
+        std::memmove(lengths_.begin() + target, lengths_.begin() + source, count * sizeof(ustore_length_t));
+    }
+
+    void export_to(linked_memory_lock_t& arena,
+                   std::size_t count,
+                   ustore_length_t** offsets,
+                   ustore_length_t** lengths,
+                   ustore_byte_t** values,
+                   ustore_error_t* c_error) noexcept {
+
+        auto length_at = [&](std::size_t slot) noexcept -> std::size_t {
+            return lengths_[slot] != ustore_length_missing_k ? lengths_[slot] : 0;
+        };
+        bool in_order = true;
+        for (std::size_t slot = 0, expected = 0; slot != count && in_order; expected += length_at(slot), ++slot)
+            in_order = offsets_[slot] == expected;
+
+        // Values of tasks, served out of order, are copied into a new tape
+        if (!in_order) {
+            auto ordered = arena.alloc<byte_t>(tape_.size(), c_error);
+            return_if_error_m(c_error);
+            std::size_t ordered_length = 0;
+            for (std::size_t slot = 0; slot != count; ++slot) {
+                std::size_t length = length_at(slot);
+                if (length)
+                    std::memcpy(ordered.begin() + ordered_length, tape_.begin() + offsets_[slot], length);
+                offsets_[slot] = static_cast<ustore_length_t>(ordered_length);
+                ordered_length += length;
+            }
+            *values = reinterpret_cast<ustore_byte_t*>(ordered.begin());
+        }
+        else
+            *values = reinterpret_cast<ustore_byte_t*>(tape_.begin());
+
+        offsets_[count] = static_cast<ustore_length_t>(tape_.size());
+        if (offsets)
+            *offsets = offsets_.begin();
+        if (lengths)
+            *lengths = lengths_.begin();
+    }
+};
+
+/**
+ * @brief Number of equal parts, every key range is split into by `random_seek_sample_iterator`.
+ */
+static constexpr std::size_t sample_ranges_k = 64;
+
+/**
+ * @brief Maximum depth of nested splits in `random_seek_sample_iterator`.
+ */
+static constexpr std::size_t sample_depth_k = 8;
+
+/**
+ * @brief A key range, split into `sample_ranges_k` equal parts with approximate weights.
+ */
+struct sample_split_t {
+    ustore_key_t bounds[sample_ranges_k + 1];
+    std::uint64_t weights[sample_ranges_k];
+    std::uint64_t total_weight = 0;
+};
+
+/**
+ * @brief Approximately uniform sampling for RocksDB or LevelDB collections, which doesn't
+ * iterate through all the entries, taking O(k log N) time instead of O(N).
+ *
+ * The span between the first and the last key is split into `sample_ranges_k` equal parts,
+ * which @p weigh estimates with the approximate on-disk sizes of their entries. Every draw
+ * picks a part proportionally to its weight, and while that part is expected to receive more
+ * than a few of the k draws, splits it further in the same way. Then it seeks to a random key within
+ * the chosen part, so keys following large gaps inside of a part are somewhat more likely.
+ * Splits are cached between draws. Collections, too small to warrant seeking, are sampled
+ * exactly with reservoir sampling.
  * @see https://en.wikipedia.org/wiki/Reservoir_sampling
+ *
+ * @param weigh Callback receiving `sample_ranges_k + 1` bounds and filling `sample_ranges_k` weights.
+ * @param count Number of sampled distinct keys, only smaller than requested in tiny collections.
  */
-template <typename level_or_rocks_iterator_at>
-void reservoir_sample_iterator(level_or_rocks_iterator_at&& iterator,
-                               ptr_range_gt<ustore_key_t> sampled_keys,
-                               ustore_error_t* c_error) noexcept {
+template <typename key_encoding_at = native_key_encoding_t, typename level_or_rocks_iterator_at, typename weigh_at>
+void random_seek_sample_iterator(level_or_rocks_iterator_at&& iterator,
+                                 ptr_range_gt<ustore_key_t> sampled_keys,
+                                 weigh_at&& weigh,
+                                 std::size_t& count,
+                                 ustore_error_t* c_error) noexcept(false) {
+
+    using slice_t = std::remove_cv_t<std::remove_reference_t<decltype(iterator->key())>>;
+    std::size_t const limit = sampled_keys.size();
+    count = 0;
+    if (!limit)
+        return;
 
     std::random_device random_device;
-    std::mt19937 random_generator(random_device());
-    std::uniform_int_distribution<ustore_key_t> dist(std::numeric_limits<ustore_key_t>::min());
+    std::mt19937_64 random_generator(random_device());
 
+    // Reservoir-sample a short prefix of the collection, which may turn out to be all of it
+    std::size_t const prefix_limit = limit * 4;
     std::size_t i = 0;
-    for (iterator->SeekToFirst(); i < sampled_keys.size(); ++i, iterator->Next()) {
-        return_error_if_m(iterator->Valid(), c_error, 0, "Sample Failure!");
-        std::memcpy(&sampled_keys[i], iterator->key().data(), sizeof(ustore_key_t));
+    ustore_key_t min_key = 0;
+    for (iterator->SeekToFirst(); iterator->Valid() && i != prefix_limit; ++i, iterator->Next()) {
+        ustore_key_t key = key_encoding_at::decode(iterator->key().data());
+        if (!i)
+            min_key = key;
+        std::size_t j = i < limit ? i : std::uniform_int_distribution<std::size_t>(0, i)(random_generator);
+        if (j < limit)
+            sampled_keys[j] = key;
+    }
+    return_error_if_m(iterator->status().ok(), c_error, 0, "Sample Failure!");
+    if (!iterator->Valid()) {
+        count = std::min(i, limit);
+        return;
     }
 
-    for (std::size_t j = 0; iterator->Valid(); ++i, iterator->Next()) {
-        j = dist(random_generator) % (i + 1);
-        if (j < sampled_keys.size())
-            std::memcpy(&sampled_keys[j], iterator->key().data(), sizeof(ustore_key_t));
+    iterator->SeekToLast();
+    return_error_if_m(iterator->Valid(), c_error, 0, "Sample Failure!");
+    ustore_key_t const max_key = key_encoding_at::decode(iterator->key().data());
+
+    // Parts without a measurable size still get a chance to be sampled
+    auto span_of = [](ustore_key_t min, ustore_key_t max) noexcept {
+        return static_cast<std::uint64_t>(max) - static_cast<std::uint64_t>(min);
+    };
+    std::map<std::pair<ustore_key_t, ustore_key_t>, sample_split_t> splits;
+    auto split = [&](ustore_key_t min, ustore_key_t max) -> sample_split_t const& {
+        auto it = splits.find({min, max});
+        if (it != splits.end())
+            return it->second;
+
+        sample_split_t& result = splits[{min, max}];
+        std::uint64_t const span = span_of(min, max);
+        std::uint64_t const step = std::max<std::uint64_t>(span / sample_ranges_k, 1);
+        for (std::size_t part = 0; part != sample_ranges_k; ++part) {
+            std::uint64_t offset = std::min(step * part, span);
+            result.bounds[part] = static_cast<ustore_key_t>(static_cast<std::uint64_t>(min) + offset);
+        }
+        result.bounds[sample_ranges_k] = max;
+        std::fill_n(result.weights, sample_ranges_k, 0);
+        weigh(result.bounds, result.weights);
+        for (auto& weight : result.weights)
+            result.total_weight += (weight += 1);
+        return result;
+    };
+    // Parts, expected to receive only a few draws, aren't split any further
+    std::uint64_t const fine_weight = split(min_key, max_key).total_weight / limit * 4;
+
+    // Draw until enough distinct keys are found, giving up after a few rounds
+    for (std::size_t round = 0; round != 4 && count != limit; ++round) {
+        for (std::size_t draw = count; draw != limit; ++draw) {
+            ustore_key_t part_min = min_key, part_max = max_key;
+            for (std::size_t depth = 0; depth != sample_depth_k; ++depth) {
+                sample_split_t const& parts = split(part_min, part_max);
+                std::uniform_int_distribution<std::uint64_t> weight_dist(0, parts.total_weight - 1);
+                std::uint64_t weight_offset = weight_dist(random_generator);
+                std::size_t part = 0;
+                while (weight_offset >= parts.weights[part])
+                    weight_offset -= parts.weights[part++];
+
+                part_min = parts.bounds[part];
+                part_max = parts.bounds[part + 1];
+                if (parts.weights[part] <= fine_weight || span_of(part_min, part_max) < sample_ranges_k)
+                    break;
+            }
+
+            std::uint64_t key_offset =
+                std::uniform_int_distribution<std::uint64_t>(0, span_of(part_min, part_max))(random_generator);
+            encoded_key_gt<key_encoding_at> target {
+                static_cast<ustore_key_t>(static_cast<std::uint64_t>(part_min) + key_offset)};
+            iterator->Seek(slice_t(target.bytes, sizeof(ustore_key_t)));
+            if (!iterator->Valid()) {
+                return_error_if_m(iterator->status().ok(), c_error, 0, "Sample Failure!");
+                iterator->SeekToFirst();
+            }
+            sampled_keys[draw] = key_encoding_at::decode(iterator->key().data());
+        }
+        std::sort(sampled_keys.begin(), sampled_keys.end());
+        count = std::unique(sampled_keys.begin(), sampled_keys.end()) - sampled_keys.begin();
     }
+
+    std::shuffle(sampled_keys.begin(), sampled_keys.begin() + count, random_generator);
 }
 
 } // namespace unum::ustore
@@ -0,0 +1,126 @@
+/**
+ * @file group_commit.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Coalesces the durability requests of concurrent writers into shared log syncs.
+ */
+#pragma once
+#include <mutex>              // `std::unique_lock`
+#include <condition_variable> // `std::condition_variable`
+#include <functional>         // `std::function`
+#include <cstdint>            // `std::uint64_t`
+#include <deque>              // `std::deque`
+#include <utility>            // `std::pair`
+#include <vector>             // `std::vector`
+
+namespace unum::ustore {
+
+/**
+ * @brief Group commit of writes, that were already appended to a Write-Ahead Log without syncing it.
+ *
+ * Every finished write takes a ticket. The first writer, that finds no sync in progress,
+ * becomes the leader and syncs the log once for all the tickets issued so far.
+ * Others either block until a sync covers their ticket, or leave a completion
+ * callback, which the leader invokes after the next sync, possibly running
+ * a few more syncs, until no callbacks are queued.
+ *
+ * If a sync fails, every ticket it covered reports the failure. Failed ranges are merged,
+ * so a durable write between two failed syncs may also be reported as failed, but never vice versa.
+ *
+ * @tparam status_at Result of a sync, default-constructible into a success and having an `ok()` member.
+ */
+template <typename status_at>
+class group_commit_gt {
+  public:
+    using status_t = status_at;
+    using callback_t = std::function<void(status_t const&)>;
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable synced_cond_;
+    std::uint64_t issued_ = 0;
+    std::uint64_t synced_ = 0;
+    bool syncing_ = false;
+    std::uint64_t failed_from_ = 0;
+    std::uint64_t failed_upto_ = 0;
+    status_t failure_;
+    std::deque<std::pair<std::uint64_t, callback_t>> callbacks_;
+
+    status_t status_of(std::uint64_t ticket) const {
+        return ticket >= failed_from_ && ticket <= failed_upto_ ? failure_ : status_t {};
+    }
+
+    template <typename sync_at>
+    void lead(std::unique_lock<std::mutex>& lock, sync_at&& sync) {
+        syncing_ = true;
+        std::vector<std::pair<std::uint64_t, callback_t>> ready;
+        do {
+            std::uint64_t const from = synced_ + 1;
+            std::uint64_t const upto = issued_;
+            lock.unlock();
+            status_t status = sync();
+            lock.lock();
+
+            if (!status.ok()) {
+                if (!failed_upto_)
+                    failed_from_ = from;
+                failed_upto_ = upto;
+                failure_ = status;
+            }
+            synced_ = upto;
+            synced_cond_.notify_all();
+
+            // Tickets are issued and queued under the same lock, so the queue is sorted
+            while (!callbacks_.empty() && callbacks_.front().first <= upto) {
+                ready.push_back(std::move(callbacks_.front()));
+                callbacks_.pop_front();
+            }
+            lock.unlock();
+            for (auto& ticket_and_callback : ready)
+                ticket_and_callback.second(status_of(ticket_and_callback.first));
+            ready.clear();
+            lock.lock();
+        } while (!callbacks_.empty());
+        syncing_ = false;
+
+        // Wake the writers, whose tickets came too late, to elect the next leader
+        synced_cond_.notify_all();
+    }
+
+  public:
+    group_commit_gt() = default;
+    group_commit_gt(group_commit_gt const&) = delete;
+    group_commit_gt& operator=(group_commit_gt const&) = delete;
+
+    /**
+     * @brief Blocks until the log is synced past the preceding write of the calling thread.
+     * @param sync Syncs the log, returning a `status_t`. Called outside of the lock.
+     */
+    template <typename sync_at>
+    status_t wait(sync_at&& sync) noexcept(false) {
+        std::unique_lock lock {mutex_};
+        std::uint64_t const ticket = ++issued_;
+        while (synced_ < ticket) {
+            if (!syncing_)
+                lead(lock, sync);
+            else
+                synced_cond_.wait(lock);
+        }
+        return status_of(ticket);
+    }
+
+    /**
+     * @brief Schedules the @p callback after the log is synced past the preceding write
+     * of the calling thread. Blocks only if no other thread is syncing, to lead the sync.
+     */
+    template <typename sync_at>
+    void notify(sync_at&& sync, callback_t callback) noexcept(false) {
+        std::unique_lock lock {mutex_};
+        std::uint64_t const ticket = ++issued_;
+        callbacks_.emplace_back(ticket, std::move(callback));
+        if (!syncing_)
+            lead(lock, sync);
+    }
+};
+
+} // namespace unum::ustore
@@ -0,0 +1,62 @@
+/**
+ * @file helpers/key_encoding.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Binary representations of integer keys inside of persistent Key-Value stores.
+ */
+#pragma once
+#include <cstdint> // `std::uint64_t`
+#include <cstring> // `std::memcpy`
+
+#include "ustore/db.h" // `ustore_key_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief Keys are stored in their native in-memory representation,
+ * which must be ordered with a custom integer comparator.
+ */
+struct native_key_encoding_t {
+    static void encode(ustore_key_t key, char* bytes) noexcept { std::memcpy(bytes, &key, sizeof(ustore_key_t)); }
+    static ustore_key_t decode(char const* bytes) noexcept {
+        ustore_key_t key;
+        std::memcpy(&key, bytes, sizeof(ustore_key_t));
+        return key;
+    }
+};
+
+/**
+ * @brief Keys are stored big-endian with the sign bit flipped, so that plain
+ * lexicographic comparison of bytes orders them like signed integers.
+ * Any leading bytes of such key can serve as a prefix for Bloom filters.
+ */
+struct ordered_key_encoding_t {
+    static constexpr std::uint64_t sign_bit_k = std::uint64_t(1) << 63;
+
+    static void encode(ustore_key_t key, char* bytes) noexcept {
+        auto bits = static_cast<std::uint64_t>(key) ^ sign_bit_k;
+        for (std::size_t i = 0; i != sizeof(ustore_key_t); ++i)
+            bytes[i] = static_cast<char>(bits >> (56 - 8 * i));
+    }
+    static ustore_key_t decode(char const* bytes) noexcept {
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i != sizeof(ustore_key_t); ++i)
+            bits = (bits << 8) | static_cast<std::uint8_t>(bytes[i]);
+        return static_cast<ustore_key_t>(bits ^ sign_bit_k);
+    }
+};
+
+/**
+ * @brief Fixed-size buffer with one encoded key, which outlives the
+ * LevelDB or RocksDB slices pointing to it.
+ */
+template <typename key_encoding_at>
+struct encoded_key_gt {
+    char bytes[sizeof(ustore_key_t)];
+
+    encoded_key_gt() = default;
+    encoded_key_gt(ustore_key_t key) noexcept { key_encoding_at::encode(key, bytes); }
+    ustore_key_t decode() const noexcept { return key_encoding_at::decode(bytes); }
+};
+
+} // namespace unum::ustore
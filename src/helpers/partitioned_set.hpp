@@ -0,0 +1,574 @@
+/**
+ * @file partitioned_set.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Concurrent ordered set, hash-partitioned into independently locked parts.
+ */
+#pragma once
+#include <array>        // `std::array`
+#include <memory>       // `std::unique_ptr`
+#include <vector>       // `std::vector`
+#include <optional>     // `std::optional`
+#include <atomic>       // `std::atomic`
+#include <mutex>        // `std::unique_lock`
+#include <shared_mutex> // `std::shared_mutex`
+#include <utility>      // `std::declval`
+#include <algorithm>    // `std::sort`
+#include <type_traits>  // `std::is_same_v`
+
+#include <ucset/consistent_set.hpp> // `ucset::no_op_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief Default summary of a part, that tracks nothing.
+ * A custom one is notified about every change of every entry, getting the
+ * previous and the new version of it, any of which may be `nullptr`.
+ */
+struct no_summary_t {
+    template <typename element_at>
+    void update(element_at const*, element_at const*) noexcept {}
+    void clear() noexcept {}
+};
+
+/**
+ * @brief Wraps several single-threaded `ucset` containers, each guarded by its own
+ * mutex, so that writes into different parts never wait for each other.
+ * Entries are assigned to parts by the hash of their identifier.
+ *
+ * Point operations touch just one part. Ordered lookups, like `upper_bound`,
+ * hold all the parts' shared locks and merge the results. Batch upserts and
+ * transactions are atomic across parts: they lock all the parts they touch in
+ * a fixed order, so different batches can't deadlock. Transactions are committed
+ * in two phases: first, every touched part is staged, and if any of them fails
+ * validation, all are rolled back; only then the changes are committed.
+ *
+ * Every part can also maintain a @p summary_at of its contents, like the number
+ * of entries, updated under the same lock as the entries themselves.
+ *
+ * With a single part, it behaves like `ucset::locked_gt`.
+ */
+template <typename set_at, typename hash_at, typename summary_at = no_summary_t, typename mutex_at = std::shared_mutex>
+class partitioned_set_gt {
+  public:
+    using set_t = set_at;
+    using hash_t = hash_at;
+    using summary_t = summary_at;
+    using mutex_t = mutex_at;
+    using element_t = typename set_t::element_t;
+    using identifier_t = typename set_t::identifier_t;
+    using generation_t = typename set_t::generation_t;
+    using status_t = decltype(std::declval<set_t&>().clear());
+
+    /// Sets of touched parts are tracked with 64-bit masks.
+    static constexpr std::size_t max_parts_k = 64;
+    static constexpr bool summarized_k = !std::is_same_v<summary_t, no_summary_t>;
+
+  private:
+    struct part_t {
+        mutable mutex_t mutex;
+        set_t set;
+        summary_t summary;
+        part_t(set_t&& set) noexcept : set(std::move(set)) {}
+
+        /// Upserts an entry, notifying the summary. The caller must hold the unique lock.
+        status_t upsert(element_t&& element) noexcept {
+            if constexpr (summarized_k) {
+                element_t const* previous = nullptr;
+                auto status = set.find(identifier_t(element), [&](element_t const& existing) noexcept { previous = &existing; });
+                if (!status)
+                    return status;
+                summary.update(previous, &element);
+            }
+            return set.upsert(std::move(element));
+        }
+    };
+
+    using part_mask_t = std::uint64_t;
+
+    std::vector<std::unique_ptr<part_t>> parts_;
+    std::unique_ptr<std::atomic<generation_t>> generation_;
+
+    std::size_t part_of(identifier_t const& id) const noexcept { return hash_t {}(id) % parts_.size(); }
+    static part_mask_t bit(std::size_t part_idx) noexcept { return part_mask_t(1) << part_idx; }
+
+    template <typename callback_at>
+    void for_each_part(part_mask_t mask, callback_at&& callback) const noexcept {
+        for (std::size_t part_idx = 0; mask; ++part_idx, mask >>= 1)
+            if (mask & 1)
+                callback(*parts_[part_idx], part_idx);
+    }
+
+    part_mask_t all_parts() const noexcept {
+        return parts_.size() == max_parts_k ? ~part_mask_t(0) : bit(parts_.size()) - 1;
+    }
+
+    void lock(part_mask_t mask) const noexcept {
+        for_each_part(mask, [](part_t& part, std::size_t) { part.mutex.lock(); });
+    }
+    void unlock(part_mask_t mask) const noexcept {
+        for_each_part(mask, [](part_t& part, std::size_t) { part.mutex.unlock(); });
+    }
+    void lock_shared(part_mask_t mask) const noexcept {
+        for_each_part(mask, [](part_t& part, std::size_t) { part.mutex.lock_shared(); });
+    }
+    void unlock_shared(part_mask_t mask) const noexcept {
+        for_each_part(mask, [](part_t& part, std::size_t) { part.mutex.unlock_shared(); });
+    }
+
+    /**
+     * @brief Finds the smallest entry across all parts, following the given one.
+     * The caller must hold the shared locks of all the parts.
+     */
+    template <typename upper_bound_at, typename found_at, typename missing_at>
+    status_t merge_upper_bounds(upper_bound_at&& upper_bound, found_at&& found, missing_at&& missing) const noexcept {
+        element_t const* smallest = nullptr;
+        status_t status;
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx)
+            status = upper_bound(part_idx, [&](element_t const& element) noexcept {
+                if (!smallest || identifier_t(element) < identifier_t(*smallest))
+                    smallest = &element;
+            });
+        if (!status)
+            return status;
+        if (smallest)
+            found(*smallest);
+        else
+            missing();
+        return status;
+    }
+
+    /**
+     * @brief Visits the entries, starting from the given one, in sorted order across all parts,
+     * until the @p callback returns `false` or the entries end. Every part keeps a cursor
+     * at its next entry, so moving on costs a single lookup in just one part.
+     * The caller must hold the shared locks of all the parts.
+     */
+    template <typename find_at, typename upper_bound_at, typename callback_at>
+    status_t merge_ranges(identifier_t const& lower,
+                          find_at&& find,
+                          upper_bound_at&& upper_bound,
+                          callback_at&& callback) const noexcept {
+        std::array<element_t const*, max_parts_k> cursors {};
+        status_t status;
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            auto found = [&](element_t const& element) noexcept {
+                cursors[part_idx] = &element;
+            };
+            status = find(part_idx, lower, found);
+            if (status && !cursors[part_idx])
+                status = upper_bound(part_idx, lower, found);
+        }
+
+        while (status) {
+            std::size_t smallest_idx = parts_.size();
+            for (std::size_t part_idx = 0; part_idx != parts_.size(); ++part_idx)
+                if (cursors[part_idx] &&
+                    (smallest_idx == parts_.size() ||
+                     identifier_t(*cursors[part_idx]) < identifier_t(*cursors[smallest_idx])))
+                    smallest_idx = part_idx;
+            if (smallest_idx == parts_.size())
+                break;
+
+            identifier_t smallest = *cursors[smallest_idx];
+            if (!callback(*cursors[smallest_idx]))
+                break;
+
+            cursors[smallest_idx] = nullptr;
+            status = upper_bound(smallest_idx, smallest, [&](element_t const& element) noexcept {
+                cursors[smallest_idx] = &element;
+            });
+        }
+        return status;
+    }
+
+    partitioned_set_gt() noexcept = default;
+
+  public:
+    class transaction_t {
+        friend class partitioned_set_gt;
+
+        partitioned_set_gt* store_ = nullptr;
+        std::vector<typename set_t::transaction_t> parts_;
+        std::vector<identifier_t> changed_;
+        part_mask_t touched_ = 0;
+        part_mask_t staged_ = 0;
+        generation_t generation_ = 0;
+
+        typename set_t::transaction_t& part_of(identifier_t const& id) noexcept {
+            auto part_idx = store_->part_of(id);
+            touched_ |= bit(part_idx);
+            return parts_[part_idx];
+        }
+
+        mutex_t& mutex_of(identifier_t const& id) const noexcept { return store_->parts_[store_->part_of(id)]->mutex; }
+
+        /// Remembers the changed entries, to update the summaries on commit.
+        status_t remember(identifier_t const& id) noexcept {
+            if constexpr (summarized_k) {
+                try {
+                    changed_.push_back(id);
+                }
+                catch (...) {
+                    return ucset::errc_t::out_of_memory_heap_k;
+                }
+            }
+            return {};
+        }
+
+        /// Passes the previous and the staged versions of every changed entry to the
+        /// summaries of their parts. The caller must hold the unique locks of those parts.
+        void summarize() noexcept {
+            std::sort(changed_.begin(), changed_.end());
+            changed_.erase(std::unique(changed_.begin(), changed_.end()), changed_.end());
+            for (identifier_t const& id : changed_) {
+                auto part_idx = store_->part_of(id);
+                if (!(staged_ & bit(part_idx)))
+                    continue;
+                part_t& part = *store_->parts_[part_idx];
+                element_t const* previous = nullptr;
+                element_t const* next = nullptr;
+                part.set.find(id, [&](element_t const& element) noexcept { previous = &element; });
+                parts_[part_idx].find(id, [&](element_t const& element) noexcept { next = &element; });
+                part.summary.update(previous, next);
+            }
+            changed_.clear();
+        }
+
+      public:
+        status_t watch(identifier_t const& id) noexcept {
+            std::shared_lock _ {mutex_of(id)};
+            return part_of(id).watch(id);
+        }
+        status_t watch(element_t const& element) noexcept { return part_of(element).watch(element); }
+        status_t upsert(element_t&& element) noexcept {
+            identifier_t id = element;
+            auto status = remember(id);
+            return status ? part_of(id).upsert(std::move(element)) : status;
+        }
+        status_t erase(identifier_t const& id) noexcept {
+            auto status = remember(id);
+            return status ? part_of(id).erase(id) : status;
+        }
+
+        template <typename found_at, typename missing_at = ucset::no_op_t>
+        status_t find(identifier_t const& id, found_at&& found, missing_at&& missing = {}) noexcept {
+            std::shared_lock _ {mutex_of(id)};
+            return parts_[store_->part_of(id)].find(id, found, missing);
+        }
+
+        template <typename found_at, typename missing_at = ucset::no_op_t>
+        status_t upper_bound(identifier_t const& id, found_at&& found, missing_at&& missing = {}) noexcept {
+            auto all = store_->all_parts();
+            store_->lock_shared(all);
+            auto status = store_->merge_upper_bounds(
+                [&](std::size_t part_idx, auto&& callback) noexcept {
+                    return parts_[part_idx].upper_bound(id, callback);
+                },
+                found,
+                missing);
+            store_->unlock_shared(all);
+            return status;
+        }
+
+        /**
+         * @brief Visits the entries, starting from @p lower, in sorted order, including
+         * the changes made in this transaction, until the @p callback returns `false`.
+         * All the parts stay locked for the whole run, so keep the runs short.
+         */
+        template <typename callback_at>
+        status_t scan(identifier_t const& lower, callback_at&& callback) noexcept {
+            auto all = store_->all_parts();
+            store_->lock_shared(all);
+            auto status = store_->merge_ranges(
+                lower,
+                [&](std::size_t part_idx, identifier_t const& id, auto&& found) noexcept {
+                    return parts_[part_idx].find(id, found);
+                },
+                [&](std::size_t part_idx, identifier_t const& id, auto&& found) noexcept {
+                    return parts_[part_idx].upper_bound(id, found);
+                },
+                callback);
+            store_->unlock_shared(all);
+            return status;
+        }
+
+        status_t reset() noexcept {
+            status_t status;
+            for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx)
+                status = parts_[part_idx].reset();
+            changed_.clear();
+            touched_ = staged_ = 0;
+            generation_ = 0;
+            return status;
+        }
+
+        status_t rollback() noexcept {
+            status_t status;
+            store_->lock(staged_);
+            store_->for_each_part(staged_, [&](part_t&, std::size_t part_idx) {
+                if (auto part_status = parts_[part_idx].rollback(); !part_status)
+                    status = part_status;
+            });
+            store_->unlock(staged_);
+            staged_ = 0;
+            return status;
+        }
+
+        /**
+         * @brief First phase of the commit. Validates all the watched entries
+         * in every touched part, and only succeeds, if all the parts do.
+         */
+        status_t stage() noexcept {
+            status_t status;
+            store_->lock(touched_);
+            store_->for_each_part(touched_, [&](part_t&, std::size_t part_idx) {
+                if (!status)
+                    return;
+                status = parts_[part_idx].stage();
+                if (status)
+                    staged_ |= bit(part_idx);
+            });
+            store_->unlock(touched_);
+            if (!status)
+                rollback();
+            return status;
+        }
+
+        /**
+         * @brief Second phase of the commit. Makes the staged changes
+         * visible in all the parts at once.
+         */
+        status_t commit() noexcept {
+            status_t status;
+            store_->lock(staged_);
+            if constexpr (summarized_k)
+                summarize();
+            store_->for_each_part(staged_, [&](part_t&, std::size_t part_idx) {
+                if (auto part_status = parts_[part_idx].commit(); !part_status)
+                    status = part_status;
+            });
+            generation_ = ++*store_->generation_;
+            store_->unlock(staged_);
+            touched_ = staged_ = 0;
+            return status;
+        }
+
+        generation_t generation() const noexcept { return generation_; }
+    };
+
+    partitioned_set_gt(partitioned_set_gt&&) noexcept = default;
+    partitioned_set_gt& operator=(partitioned_set_gt&&) noexcept = default;
+
+    static std::optional<partitioned_set_gt> make(std::size_t parts_count = 1) noexcept {
+        if (!parts_count || parts_count > max_parts_k)
+            return std::nullopt;
+        try {
+            partitioned_set_gt result;
+            result.generation_ = std::make_unique<std::atomic<generation_t>>(0);
+            result.parts_.reserve(parts_count);
+            for (std::size_t part_idx = 0; part_idx != parts_count; ++part_idx) {
+                auto maybe_set = set_t::make();
+                if (!maybe_set)
+                    return std::nullopt;
+                result.parts_.push_back(std::make_unique<part_t>(std::move(maybe_set).value()));
+            }
+            return result;
+        }
+        catch (...) {
+            return std::nullopt;
+        }
+    }
+
+    std::size_t parts_count() const noexcept { return parts_.size(); }
+
+    status_t upsert(element_t&& element) noexcept {
+        part_t& part = *parts_[part_of(element)];
+        std::unique_lock _ {part.mutex};
+        return part.upsert(std::move(element));
+    }
+
+    /**
+     * @brief Atomically upserts a batch of entries, locking only the parts it touches.
+     * The iterators must be multi-pass, as the batch is traversed twice.
+     */
+    template <typename begin_at, typename end_at = begin_at>
+    status_t upsert(begin_at begin, end_at end) noexcept {
+        part_mask_t touched = 0;
+        for (auto it = begin; it != end; ++it)
+            touched |= bit(part_of(static_cast<element_t const&>(*it)));
+
+        status_t status;
+        lock(touched);
+        for (auto it = begin; it != end && status; ++it) {
+            element_t&& element = std::move(*it);
+            status = parts_[part_of(element)]->upsert(std::move(element));
+        }
+        unlock(touched);
+        return status;
+    }
+
+    template <typename found_at, typename missing_at = ucset::no_op_t>
+    status_t find(identifier_t const& id, found_at&& found, missing_at&& missing = {}) const noexcept {
+        part_t const& part = *parts_[part_of(id)];
+        std::shared_lock _ {part.mutex};
+        return part.set.find(id, found, missing);
+    }
+
+    template <typename found_at, typename missing_at = ucset::no_op_t>
+    status_t upper_bound(identifier_t const& id, found_at&& found, missing_at&& missing = {}) const noexcept {
+        auto all = all_parts();
+        lock_shared(all);
+        auto status = merge_upper_bounds(
+            [&](std::size_t part_idx, auto&& callback) noexcept {
+                return parts_[part_idx]->set.upper_bound(id, callback);
+            },
+            found,
+            missing);
+        unlock_shared(all);
+        return status;
+    }
+
+    /**
+     * @brief Visits the entries, starting from @p lower, in sorted order across all parts,
+     * until the @p callback returns `false`. Unlike repeated `upper_bound` calls, the locks
+     * are taken once per run. All the parts stay locked for the whole run, so keep it short.
+     */
+    template <typename callback_at>
+    status_t scan(identifier_t const& lower, callback_at&& callback) const noexcept {
+        auto all = all_parts();
+        lock_shared(all);
+        auto status = merge_ranges(
+            lower,
+            [&](std::size_t part_idx, identifier_t const& id, auto&& found) noexcept {
+                return parts_[part_idx]->set.find(id, found);
+            },
+            [&](std::size_t part_idx, identifier_t const& id, auto&& found) noexcept {
+                return parts_[part_idx]->set.upper_bound(id, found);
+            },
+            callback);
+        unlock_shared(all);
+        return status;
+    }
+
+    /**
+     * @brief Visits all the entries in the range, part by part.
+     * Within a part the entries are ordered, but not across them.
+     */
+    template <typename lower_at, typename upper_at, typename callback_at>
+    status_t range(lower_at const& lower, upper_at const& upper, callback_at&& callback) const noexcept {
+        status_t status;
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            part_t const& part = *parts_[part_idx];
+            std::shared_lock _ {part.mutex};
+            status = part.set.range(lower, upper, callback);
+        }
+        return status;
+    }
+
+    /**
+     * @brief Visits all the entries in the range, part by part, holding each part's unique lock,
+     * so that the @p callback may change the entries in place, as long as their identifiers
+     * and summaries stay the same.
+     */
+    template <typename lower_at, typename upper_at, typename callback_at>
+    status_t update_range(lower_at const& lower, upper_at const& upper, callback_at&& callback) noexcept {
+        status_t status;
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            part_t& part = *parts_[part_idx];
+            std::unique_lock _ {part.mutex};
+            status = part.set.range(lower, upper, callback);
+        }
+        return status;
+    }
+
+    template <typename lower_at, typename upper_at, typename callback_at = ucset::no_op_t>
+    status_t erase_range(lower_at const& lower, upper_at const& upper, callback_at&& callback = {}) noexcept {
+        status_t status;
+        auto all = all_parts();
+        lock(all);
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            part_t& part = *parts_[part_idx];
+            status = part.set.erase_range(lower, upper, [&](auto& element) noexcept {
+                part.summary.update(&element, static_cast<element_t const*>(nullptr));
+                callback(element);
+            });
+        }
+        unlock(all);
+        return status;
+    }
+
+    /**
+     * @brief Reservoir-samples the range. As @p seen is carried from part to part,
+     * every entry has the same chance of being selected.
+     */
+    template <typename generator_at, typename output_at>
+    status_t sample_range(identifier_t const& lower,
+                          identifier_t const& upper,
+                          generator_at&& generator,
+                          std::size_t& seen,
+                          std::size_t capacity,
+                          output_at&& output) noexcept {
+        status_t status;
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            part_t& part = *parts_[part_idx];
+            std::shared_lock _ {part.mutex};
+            status = part.set.sample_range(lower, upper, generator, seen, capacity, output);
+        }
+        return status;
+    }
+
+    status_t clear() noexcept {
+        status_t status;
+        auto all = all_parts();
+        lock(all);
+        for (std::size_t part_idx = 0; part_idx != parts_.size() && status; ++part_idx) {
+            status = parts_[part_idx]->set.clear();
+            parts_[part_idx]->summary.clear();
+        }
+        unlock(all);
+        return status;
+    }
+
+    /**
+     * @brief Visits the summaries of all the parts. They are locked together,
+     * so the visited summaries reflect the same moment in time.
+     */
+    template <typename callback_at>
+    void for_each_summary(callback_at&& callback) const noexcept {
+        auto all = all_parts();
+        lock_shared(all);
+        for (auto const& part : parts_)
+            callback(static_cast<summary_t const&>(part->summary));
+        unlock_shared(all);
+    }
+
+    std::size_t size() const noexcept {
+        std::size_t result = 0;
+        for (auto const& part : parts_) {
+            std::shared_lock _ {part->mutex};
+            result += part->set.size();
+        }
+        return result;
+    }
+
+    std::optional<transaction_t> transaction() noexcept {
+        try {
+            transaction_t txn;
+            txn.store_ = this;
+            txn.parts_.reserve(parts_.size());
+            for (auto& part : parts_) {
+                auto maybe_txn = part->set.transaction();
+                if (!maybe_txn)
+                    return std::nullopt;
+                txn.parts_.push_back(std::move(maybe_txn).value());
+            }
+            return txn;
+        }
+        catch (...) {
+            return std::nullopt;
+        }
+    }
+};
+
+} // namespace unum::ustore
@@ -0,0 +1,536 @@
+/**
+ * @file simd.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Vectorized kernels for similarity metrics, picked at runtime for the current CPU.
+ *
+ * Every kernel returns sums of pairwise products, from which the metrics are derived:
+ * - `dot`: just the inner product,
+ * - `cos`: the inner product and both squared norms,
+ * - `l2sq`: the squared Euclidean distance.
+ *
+ * Three kinds of inputs are supported: pairs of 8-bit integers, pairs of `float`-s,
+ * and IEEE 754 half-precision numbers compared with single-precision ones.
+ * On x86 the AVX2 and AVX-512 VNNI variants are compiled with function attributes,
+ * so the binary runs on older CPUs. On Arm the NEON variants are picked at compile time.
+ */
+#pragma once
+#include <cstdint>   // `std::int8_t`
+#include <cstddef>   // `std::size_t`
+#include <cstring>   // `std::memcpy`
+#include <algorithm> // `std::min`
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USTORE_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define USTORE_SIMD_X86 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define USTORE_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define USTORE_SIMD_NEON 0
+#endif
+
+namespace unum::ustore {
+
+using f16_t = std::uint16_t;
+
+struct products_i8_t {
+    std::int64_t ab = 0;
+    std::int64_t aa = 0;
+    std::int64_t bb = 0;
+};
+
+struct products_f32_t {
+    float ab = 0;
+    float aa = 0;
+    float bb = 0;
+};
+
+inline float f16_to_f32(f16_t half) noexcept {
+    std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000u) << 16;
+    std::uint32_t exponent = (half >> 10) & 0x1Fu;
+    std::uint32_t mantissa = half & 0x3FFu;
+    std::uint32_t bits = sign;
+    if (exponent == 0x1F)
+        bits |= 0x7F800000u | (mantissa << 13);
+    else if (exponent)
+        bits |= ((exponent + 112u) << 23) | (mantissa << 13);
+    else if (mantissa) {
+        // Sub-normal halves become normal floats: `mantissa * 2^-24`
+        float magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+        return sign ? -magnitude : magnitude;
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * @brief Brain floats are just truncated single-precision ones.
+ */
+inline float bf16_to_f32(std::uint16_t brain) noexcept {
+    std::uint32_t bits = static_cast<std::uint32_t>(brain) << 16;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+inline float to_f32(float scalar) noexcept {
+    return scalar;
+}
+inline float to_f32(f16_t scalar) noexcept {
+    return f16_to_f32(scalar);
+}
+
+/*********************************************************/
+/*****************	    Serial Kernels	  ****************/
+/*********************************************************/
+
+inline std::int64_t dot_i8_serial(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    std::int64_t ab = 0;
+    for (std::size_t i = 0; i != n; ++i)
+        ab += std::int16_t(a[i]) * std::int16_t(b[i]);
+    return ab;
+}
+
+inline products_i8_t cos_i8_serial(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    products_i8_t result;
+    for (std::size_t i = 0; i != n; ++i) {
+        std::int16_t ai = a[i], bi = b[i];
+        result.ab += ai * bi, result.aa += ai * ai, result.bb += bi * bi;
+    }
+    return result;
+}
+
+template <typename scalar_at>
+float dot_serial(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    float ab = 0;
+    for (std::size_t i = 0; i != n; ++i)
+        ab += to_f32(a[i]) * b[i];
+    return ab;
+}
+
+template <typename scalar_at>
+products_f32_t cos_serial(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    products_f32_t result;
+    for (std::size_t i = 0; i != n; ++i) {
+        float ai = to_f32(a[i]), bi = b[i];
+        result.ab += ai * bi, result.aa += ai * ai, result.bb += bi * bi;
+    }
+    return result;
+}
+
+template <typename scalar_at>
+float l2sq_serial(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    float sum = 0;
+    for (std::size_t i = 0; i != n; ++i) {
+        float diff = to_f32(a[i]) - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/*********************************************************/
+/*****************	     x86 Kernels	  ****************/
+/*********************************************************/
+
+#if USTORE_SIMD_X86
+
+#define USTORE_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define USTORE_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni")))
+
+USTORE_TARGET_AVX2 inline std::int32_t reduce_i32_avx2(__m256i x) noexcept {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+USTORE_TARGET_AVX2 inline float reduce_f32_avx2(__m256 x) noexcept {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+USTORE_TARGET_AVX2 inline __m256 load_f32_avx2(float const* x) noexcept {
+    return _mm256_loadu_ps(x);
+}
+USTORE_TARGET_AVX2 inline __m256 load_f32_avx2(f16_t const* x) noexcept {
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(x)));
+}
+
+/**
+ * @brief Sign-extends 16 bytes into 16-bit integers, so that `_mm256_madd_epi16`
+ * could multiply them without the saturation of `_mm256_maddubs_epi16`.
+ */
+USTORE_TARGET_AVX2 inline __m256i load_i16_avx2(std::int8_t const* x) noexcept {
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(x)));
+}
+
+USTORE_TARGET_AVX2 inline std::int64_t dot_i8_avx2(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    __m256i ab = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        ab = _mm256_add_epi32(ab, _mm256_madd_epi16(load_i16_avx2(a + i), load_i16_avx2(b + i)));
+    return reduce_i32_avx2(ab) + dot_i8_serial(a + i, b + i, n - i);
+}
+
+USTORE_TARGET_AVX2 inline products_i8_t cos_i8_avx2(std::int8_t const* a,
+                                                    std::int8_t const* b,
+                                                    std::size_t n) noexcept {
+    __m256i ab = _mm256_setzero_si256(), aa = _mm256_setzero_si256(), bb = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i ai = load_i16_avx2(a + i), bi = load_i16_avx2(b + i);
+        ab = _mm256_add_epi32(ab, _mm256_madd_epi16(ai, bi));
+        aa = _mm256_add_epi32(aa, _mm256_madd_epi16(ai, ai));
+        bb = _mm256_add_epi32(bb, _mm256_madd_epi16(bi, bi));
+    }
+    products_i8_t result = cos_i8_serial(a + i, b + i, n - i);
+    result.ab += reduce_i32_avx2(ab), result.aa += reduce_i32_avx2(aa), result.bb += reduce_i32_avx2(bb);
+    return result;
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX2 float dot_avx2(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m256 ab = _mm256_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        ab = _mm256_fmadd_ps(load_f32_avx2(a + i), _mm256_loadu_ps(b + i), ab);
+    return reduce_f32_avx2(ab) + dot_serial(a + i, b + i, n - i);
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX2 products_f32_t cos_avx2(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m256 ab = _mm256_setzero_ps(), aa = _mm256_setzero_ps(), bb = _mm256_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 ai = load_f32_avx2(a + i), bi = _mm256_loadu_ps(b + i);
+        ab = _mm256_fmadd_ps(ai, bi, ab);
+        aa = _mm256_fmadd_ps(ai, ai, aa);
+        bb = _mm256_fmadd_ps(bi, bi, bb);
+    }
+    products_f32_t result = cos_serial(a + i, b + i, n - i);
+    result.ab += reduce_f32_avx2(ab), result.aa += reduce_f32_avx2(aa), result.bb += reduce_f32_avx2(bb);
+    return result;
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX2 float l2sq_avx2(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m256 sum = _mm256_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 diff = _mm256_sub_ps(load_f32_avx2(a + i), _mm256_loadu_ps(b + i));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    return reduce_f32_avx2(sum) + l2sq_serial(a + i, b + i, n - i);
+}
+
+/**
+ * @brief The tails are handled with masked loads, that don't touch the memory past the end.
+ */
+USTORE_TARGET_AVX512 inline __m512i load_i16_avx512(std::int8_t const* x, __mmask32 mask) noexcept {
+    return _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(mask, x));
+}
+
+USTORE_TARGET_AVX512 inline __m512 load_f32_avx512(float const* x, __mmask16 mask) noexcept {
+    return _mm512_maskz_loadu_ps(mask, x);
+}
+USTORE_TARGET_AVX512 inline __m512 load_f32_avx512(f16_t const* x, __mmask16 mask) noexcept {
+    return _mm512_maskz_cvtph_ps(mask, _mm256_maskz_loadu_epi16(mask, x));
+}
+
+/**
+ * @brief Unlike `_mm512_reduce_add_*` and casts, the zero-masked extracts don't trip
+ * the uninitialized-variable warnings of GCC.
+ */
+USTORE_TARGET_AVX512 inline std::int32_t reduce_i32_avx512(__m512i x) noexcept {
+    __m256i low = _mm512_maskz_extracti64x4_epi64(0xFF, x, 0);
+    __m256i high = _mm512_maskz_extracti64x4_epi64(0xFF, x, 1);
+    return reduce_i32_avx2(_mm256_add_epi32(low, high));
+}
+
+USTORE_TARGET_AVX512 inline float reduce_f32_avx512(__m512 x) noexcept {
+    __m256 low = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, _mm512_castps_pd(x), 0));
+    __m256 high = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, _mm512_castps_pd(x), 1));
+    return reduce_f32_avx2(_mm256_add_ps(low, high));
+}
+
+inline __mmask32 tail_mask32(std::size_t n) noexcept {
+    return n >= 32 ? __mmask32(0xFFFFFFFFu) : __mmask32((1u << n) - 1u);
+}
+inline __mmask16 tail_mask16(std::size_t n) noexcept {
+    return n >= 16 ? __mmask16(0xFFFFu) : __mmask16((1u << n) - 1u);
+}
+
+USTORE_TARGET_AVX512 inline std::int64_t dot_i8_avx512(std::int8_t const* a,
+                                                       std::int8_t const* b,
+                                                       std::size_t n) noexcept {
+    __m512i ab = _mm512_setzero_si512();
+    for (std::size_t i = 0; i < n; i += 32) {
+        __mmask32 mask = tail_mask32(n - i);
+        ab = _mm512_dpwssd_epi32(ab, load_i16_avx512(a + i, mask), load_i16_avx512(b + i, mask));
+    }
+    return reduce_i32_avx512(ab);
+}
+
+USTORE_TARGET_AVX512 inline products_i8_t cos_i8_avx512(std::int8_t const* a,
+                                                       std::int8_t const* b,
+                                                       std::size_t n) noexcept {
+    __m512i ab = _mm512_setzero_si512(), aa = _mm512_setzero_si512(), bb = _mm512_setzero_si512();
+    for (std::size_t i = 0; i < n; i += 32) {
+        __mmask32 mask = tail_mask32(n - i);
+        __m512i ai = load_i16_avx512(a + i, mask), bi = load_i16_avx512(b + i, mask);
+        ab = _mm512_dpwssd_epi32(ab, ai, bi);
+        aa = _mm512_dpwssd_epi32(aa, ai, ai);
+        bb = _mm512_dpwssd_epi32(bb, bi, bi);
+    }
+    products_i8_t result;
+    result.ab = reduce_i32_avx512(ab), result.aa = reduce_i32_avx512(aa);
+    result.bb = reduce_i32_avx512(bb);
+    return result;
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX512 float dot_avx512(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m512 ab = _mm512_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 16) {
+        __mmask16 mask = tail_mask16(n - i);
+        ab = _mm512_fmadd_ps(load_f32_avx512(a + i, mask), load_f32_avx512(b + i, mask), ab);
+    }
+    return reduce_f32_avx512(ab);
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX512 products_f32_t cos_avx512(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m512 ab = _mm512_setzero_ps(), aa = _mm512_setzero_ps(), bb = _mm512_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 16) {
+        __mmask16 mask = tail_mask16(n - i);
+        __m512 ai = load_f32_avx512(a + i, mask), bi = load_f32_avx512(b + i, mask);
+        ab = _mm512_fmadd_ps(ai, bi, ab);
+        aa = _mm512_fmadd_ps(ai, ai, aa);
+        bb = _mm512_fmadd_ps(bi, bi, bb);
+    }
+    products_f32_t result;
+    result.ab = reduce_f32_avx512(ab), result.aa = reduce_f32_avx512(aa), result.bb = reduce_f32_avx512(bb);
+    return result;
+}
+
+template <typename scalar_at>
+USTORE_TARGET_AVX512 float l2sq_avx512(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    __m512 sum = _mm512_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 16) {
+        __mmask16 mask = tail_mask16(n - i);
+        __m512 diff = _mm512_sub_ps(load_f32_avx512(a + i, mask), load_f32_avx512(b + i, mask));
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+    return reduce_f32_avx512(sum);
+}
+
+#endif
+
+/*********************************************************/
+/*****************	     Arm Kernels	  ****************/
+/*********************************************************/
+
+#if USTORE_SIMD_NEON
+
+inline float32x4_t load_f32_neon(float const* x) noexcept {
+    return vld1q_f32(x);
+}
+inline float32x4_t load_f32_neon(f16_t const* x) noexcept {
+    return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(x)));
+}
+
+/**
+ * @brief Accumulates the products of 16 pairs of bytes into 4 lanes, with a
+ * single `SDOT` instruction on CPUs supporting the Armv8.2 dot-product extension.
+ */
+inline int32x4_t dot_i8x16_neon(int32x4_t sum, int8x16_t a, int8x16_t b) noexcept {
+#if defined(__ARM_FEATURE_DOTPROD)
+    return vdotq_s32(sum, a, b);
+#else
+    sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(a), vget_low_s8(b)));
+    return vpadalq_s16(sum, vmull_high_s8(a, b));
+#endif
+}
+
+inline std::int64_t dot_i8_neon(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    int32x4_t ab = vdupq_n_s32(0);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        ab = dot_i8x16_neon(ab, vld1q_s8(a + i), vld1q_s8(b + i));
+    return vaddvq_s32(ab) + dot_i8_serial(a + i, b + i, n - i);
+}
+
+inline products_i8_t cos_i8_neon(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    int32x4_t ab = vdupq_n_s32(0), aa = vdupq_n_s32(0), bb = vdupq_n_s32(0);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int8x16_t ai = vld1q_s8(a + i), bi = vld1q_s8(b + i);
+        ab = dot_i8x16_neon(ab, ai, bi);
+        aa = dot_i8x16_neon(aa, ai, ai);
+        bb = dot_i8x16_neon(bb, bi, bi);
+    }
+    products_i8_t result = cos_i8_serial(a + i, b + i, n - i);
+    result.ab += vaddvq_s32(ab), result.aa += vaddvq_s32(aa), result.bb += vaddvq_s32(bb);
+    return result;
+}
+
+template <typename scalar_at>
+float dot_neon(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    float32x4_t ab = vdupq_n_f32(0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        ab = vfmaq_f32(ab, load_f32_neon(a + i), vld1q_f32(b + i));
+    return vaddvq_f32(ab) + dot_serial(a + i, b + i, n - i);
+}
+
+template <typename scalar_at>
+products_f32_t cos_neon(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    float32x4_t ab = vdupq_n_f32(0), aa = vdupq_n_f32(0), bb = vdupq_n_f32(0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t ai = load_f32_neon(a + i), bi = vld1q_f32(b + i);
+        ab = vfmaq_f32(ab, ai, bi);
+        aa = vfmaq_f32(aa, ai, ai);
+        bb = vfmaq_f32(bb, bi, bi);
+    }
+    products_f32_t result = cos_serial(a + i, b + i, n - i);
+    result.ab += vaddvq_f32(ab), result.aa += vaddvq_f32(aa), result.bb += vaddvq_f32(bb);
+    return result;
+}
+
+template <typename scalar_at>
+float l2sq_neon(scalar_at const* a, float const* b, std::size_t n) noexcept {
+    float32x4_t sum = vdupq_n_f32(0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t diff = vsubq_f32(load_f32_neon(a + i), vld1q_f32(b + i));
+        sum = vfmaq_f32(sum, diff, diff);
+    }
+    return vaddvq_f32(sum) + l2sq_serial(a + i, b + i, n - i);
+}
+
+#endif
+
+/*********************************************************/
+/*****************	       Dispatch	      ****************/
+/*********************************************************/
+
+/**
+ * @brief Table of kernels for the current CPU.
+ * The integer ones accumulate in 32-bit lanes, so they must be called on at most
+ * `i8_block_k` dimensions at once, which the wrappers below take care of.
+ */
+struct simd_kernels_t {
+    static constexpr std::size_t i8_block_k = 1u << 14;
+
+    std::int64_t (*dot_i8)(std::int8_t const*, std::int8_t const*, std::size_t) noexcept = &dot_i8_serial;
+    products_i8_t (*cos_i8)(std::int8_t const*, std::int8_t const*, std::size_t) noexcept = &cos_i8_serial;
+
+    float (*dot_f32)(float const*, float const*, std::size_t) noexcept = &dot_serial<float>;
+    products_f32_t (*cos_f32)(float const*, float const*, std::size_t) noexcept = &cos_serial<float>;
+    float (*l2sq_f32)(float const*, float const*, std::size_t) noexcept = &l2sq_serial<float>;
+
+    float (*dot_f16)(f16_t const*, float const*, std::size_t) noexcept = &dot_serial<f16_t>;
+    products_f32_t (*cos_f16)(f16_t const*, float const*, std::size_t) noexcept = &cos_serial<f16_t>;
+    float (*l2sq_f16)(f16_t const*, float const*, std::size_t) noexcept = &l2sq_serial<f16_t>;
+};
+
+/**
+ * @brief Instruction sets, for which the kernels are compiled.
+ * Every one, supported by the current CPU, can be picked explicitly, for testing.
+ */
+enum class simd_isa_t {
+    serial_k,
+    avx2_k,
+    avx512_k,
+    neon_k,
+};
+
+inline bool simd_isa_supported(simd_isa_t isa) noexcept {
+    switch (isa) {
+    case simd_isa_t::serial_k: return true;
+#if USTORE_SIMD_X86
+    case simd_isa_t::avx2_k:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    case simd_isa_t::avx512_k:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vnni");
+#elif USTORE_SIMD_NEON
+    case simd_isa_t::neon_k: return true;
+#endif
+    default: return false;
+    }
+}
+
+/**
+ * @brief Fills the table with the kernels of the @p isa, which must be supported.
+ */
+inline simd_kernels_t simd_kernels_for(simd_isa_t isa) noexcept {
+    simd_kernels_t kernels;
+    switch (isa) {
+#if USTORE_SIMD_X86
+    case simd_isa_t::avx512_k:
+        kernels.dot_i8 = &dot_i8_avx512, kernels.cos_i8 = &cos_i8_avx512;
+        kernels.dot_f32 = &dot_avx512<float>, kernels.cos_f32 = &cos_avx512<float>;
+        kernels.l2sq_f32 = &l2sq_avx512<float>;
+        kernels.dot_f16 = &dot_avx512<f16_t>, kernels.cos_f16 = &cos_avx512<f16_t>;
+        kernels.l2sq_f16 = &l2sq_avx512<f16_t>;
+        break;
+    case simd_isa_t::avx2_k:
+        kernels.dot_i8 = &dot_i8_avx2, kernels.cos_i8 = &cos_i8_avx2;
+        kernels.dot_f32 = &dot_avx2<float>, kernels.cos_f32 = &cos_avx2<float>, kernels.l2sq_f32 = &l2sq_avx2<float>;
+        kernels.dot_f16 = &dot_avx2<f16_t>, kernels.cos_f16 = &cos_avx2<f16_t>, kernels.l2sq_f16 = &l2sq_avx2<f16_t>;
+        break;
+#elif USTORE_SIMD_NEON
+    case simd_isa_t::neon_k:
+        kernels.dot_i8 = &dot_i8_neon, kernels.cos_i8 = &cos_i8_neon;
+        kernels.dot_f32 = &dot_neon<float>, kernels.cos_f32 = &cos_neon<float>, kernels.l2sq_f32 = &l2sq_neon<float>;
+        kernels.dot_f16 = &dot_neon<f16_t>, kernels.cos_f16 = &cos_neon<f16_t>, kernels.l2sq_f16 = &l2sq_neon<f16_t>;
+        break;
+#endif
+    default: break;
+    }
+    return kernels;
+}
+
+inline simd_kernels_t detect_simd_kernels() noexcept {
+    for (simd_isa_t isa : {simd_isa_t::avx512_k, simd_isa_t::avx2_k, simd_isa_t::neon_k})
+        if (simd_isa_supported(isa))
+            return simd_kernels_for(isa);
+    return {};
+}
+
+inline simd_kernels_t const& simd_kernels() noexcept {
+    static simd_kernels_t const kernels = detect_simd_kernels();
+    return kernels;
+}
+
+inline std::int64_t dot_i8(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    auto kernel = simd_kernels().dot_i8;
+    std::int64_t result = 0;
+    for (std::size_t i = 0; i < n; i += simd_kernels_t::i8_block_k)
+        result += kernel(a + i, b + i, std::min(n - i, simd_kernels_t::i8_block_k));
+    return result;
+}
+
+inline products_i8_t cos_i8(std::int8_t const* a, std::int8_t const* b, std::size_t n) noexcept {
+    auto kernel = simd_kernels().cos_i8;
+    products_i8_t result;
+    for (std::size_t i = 0; i < n; i += simd_kernels_t::i8_block_k) {
+        products_i8_t block = kernel(a + i, b + i, std::min(n - i, simd_kernels_t::i8_block_k));
+        result.ab += block.ab, result.aa += block.aa, result.bb += block.bb;
+    }
+    return result;
+}
+
+} // namespace unum::ustore
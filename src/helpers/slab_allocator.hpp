@@ -0,0 +1,646 @@
+/**
+ * @file slab_allocator.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Size-class allocator for large numbers of small blobs.
+ */
+#pragma once
+#include <sys/mman.h> // `mmap`
+#include <fcntl.h>    // `open`
+#include <unistd.h>   // `ftruncate`
+#include <cstdlib>    // `std::aligned_alloc`
+#include <memory>     // `std::allocator`
+#include <new>        // placement `new`
+#include <mutex>      // `std::unique_lock`
+#include <atomic>     // `std::atomic`
+#include <map>        // `std::multimap`
+#include <string>     // `std::string`
+#include <filesystem> // `std::filesystem::path`
+
+#include "ustore/cpp/types.hpp"  // `byte_t`
+#include "ustore/cpp/status.hpp" // `status_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief Unlinked temporary file, mapped into memory in big chunks.
+ * Hands out page-aligned runs of memory, that the OS can write back
+ * and evict from RAM, when it is short of it. The contents are lost
+ * once the file is closed.
+ *
+ * Released runs are reused by later requests of the same or smaller
+ * size, but neighboring runs are never merged.
+ */
+class overflow_file_t {
+  public:
+    static constexpr std::size_t chunk_size_k = 256ul * 1024ul * 1024ul;
+    static constexpr std::size_t page_size_k = 4096ul;
+
+  private:
+    struct mapping_t {
+        mapping_t* next = nullptr;
+        void* reserved = nullptr;
+        std::size_t reserved_length = 0;
+    };
+
+    int descriptor_ = -1;
+    std::size_t file_size_ = 0;
+    mapping_t* mappings_ = nullptr;
+    byte_t* tail_ = nullptr;
+    byte_t* tail_end_ = nullptr;
+    std::multimap<std::size_t, byte_t*> free_runs_;
+    std::mutex mutex_;
+
+    void release_run(byte_t* begin, std::size_t length) noexcept {
+        if (!length)
+            return;
+        try {
+            free_runs_.emplace(length, begin);
+        }
+        catch (...) {
+            // Losing track of a run only wastes disk space.
+        }
+    }
+
+    bool grow(std::size_t alignment) noexcept {
+        auto mapping = new (std::nothrow) mapping_t;
+        if (!mapping)
+            return false;
+
+        // Reserve a bit more address space, than we need, to align the mapping.
+        mapping->reserved_length = chunk_size_k + alignment;
+        mapping->reserved = mmap(nullptr, mapping->reserved_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping->reserved == MAP_FAILED) {
+            delete mapping;
+            return false;
+        }
+
+        auto aligned = next_multiple<std::uintptr_t>(std::uintptr_t(mapping->reserved), alignment);
+        if (ftruncate(descriptor_, static_cast<off_t>(file_size_ + chunk_size_k)) != 0 ||
+            mmap((void*)aligned,
+                 chunk_size_k,
+                 PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED,
+                 descriptor_,
+                 static_cast<off_t>(file_size_)) == MAP_FAILED) {
+            munmap(mapping->reserved, mapping->reserved_length);
+            delete mapping;
+            return false;
+        }
+
+        release_run(tail_, tail_end_ - tail_);
+        file_size_ += chunk_size_k;
+        mapping->next = mappings_;
+        mappings_ = mapping;
+        tail_ = reinterpret_cast<byte_t*>(aligned);
+        tail_end_ = tail_ + chunk_size_k;
+        return true;
+    }
+
+  public:
+    overflow_file_t() noexcept = default;
+    overflow_file_t(overflow_file_t const&) = delete;
+    overflow_file_t& operator=(overflow_file_t const&) = delete;
+    ~overflow_file_t() noexcept { close(); }
+
+    status_t open(std::string const& directory) noexcept {
+        if (descriptor_ >= 0)
+            return "Overflow file is already open";
+
+        std::string path;
+        try {
+            path = std::filesystem::path(directory) / ".overflow.XXXXXX";
+        }
+        catch (...) {
+            return "Failed to compose the overflow file path";
+        }
+        descriptor_ = mkstemp(path.data());
+        if (descriptor_ < 0)
+            return "Failed to create the overflow file";
+        unlink(path.c_str());
+        return {};
+    }
+
+    void close() noexcept {
+        while (mappings_) {
+            auto mapping = std::exchange(mappings_, mappings_->next);
+            munmap(mapping->reserved, mapping->reserved_length);
+            delete mapping;
+        }
+        if (descriptor_ >= 0)
+            ::close(std::exchange(descriptor_, -1));
+        free_runs_.clear();
+        tail_ = tail_end_ = nullptr;
+        file_size_ = 0;
+    }
+
+    bool is_open() const noexcept { return descriptor_ >= 0; }
+
+    /**
+     * @param length Multiple of `page_size_k`, not larger than `chunk_size_k`.
+     * @param alignment Power of two, not smaller than `page_size_k`.
+     */
+    byte_t* allocate(std::size_t length, std::size_t alignment = page_size_k) noexcept {
+        std::unique_lock lock {mutex_};
+        for (auto it = free_runs_.lower_bound(length); it != free_runs_.end(); ++it) {
+            auto begin = it->second;
+            if (std::uintptr_t(begin) % alignment)
+                continue;
+            auto remaining = it->first - length;
+            free_runs_.erase(it);
+            release_run(begin + length, remaining);
+            return begin;
+        }
+
+        auto begin = reinterpret_cast<byte_t*>(next_multiple<std::uintptr_t>(std::uintptr_t(tail_), alignment));
+        if (!tail_ || begin + length > tail_end_) {
+            if (!grow(alignment))
+                return nullptr;
+            begin = tail_;
+        }
+        release_run(tail_, begin - tail_);
+        tail_ = begin + length;
+        return begin;
+    }
+
+    void deallocate(byte_t* begin, std::size_t length) noexcept {
+        std::unique_lock lock {mutex_};
+        release_run(begin, length);
+    }
+};
+
+/**
+ * @brief Carves fixed-size slots out of big aligned slabs, instead of asking
+ * the system allocator for every blob. Every slot size has its own free-list,
+ * so a released slot is reused by the next blob of a similar length, and the
+ * memory never fragments beyond the rounding to the nearest size class.
+ *
+ * To reduce contention between writers, the classes are replicated in several
+ * shards, picked by the calling thread. Every slab starts with a header, pointing
+ * to its owning class, so deallocation only needs the pointer and the length,
+ * not the allocator instance. Blobs longer than `max_slot_size_k` are forwarded
+ * to the system allocator, prefixed with a small header.
+ *
+ * If a memory limit is set, the slabs and blobs, that don't fit into it,
+ * are placed into an `overflow_file_t`. Such allocations are marked as "spilled".
+ *
+ * To keep the hot values in RAM, the slabs and blobs have reference bits, set on
+ * allocation and by `touch()`. Once the RAM usage approaches the limit, a clock hand
+ * sweeps over them with `select_cold()`, clearing the bits, and selects the ones,
+ * that weren't referenced since the previous sweep. The owner of the values must
+ * then move them out with `allocate_spilled()`, and `release_selected()` returns
+ * the emptied slabs to the system. Other slabs are only returned to the system,
+ * when the allocator is destroyed.
+ */
+class slab_allocator_t {
+  public:
+    static constexpr std::size_t slab_size_k = 64ul * 1024ul;
+    static constexpr std::size_t min_slot_size_k = 16ul;
+    static constexpr std::size_t max_slot_size_k = 2048ul;
+    static constexpr std::size_t shards_count_k = 4ul;
+
+  private:
+    /// Powers of two and the midpoints between them: 16, 24, 32, 48, ..., 1536, 2048.
+    static constexpr std::size_t classes_count_k = 15ul;
+    /// Slabs in RAM and in the overflow file are kept in separate classes.
+    static constexpr std::size_t tiers_count_k = 2ul;
+
+    struct size_class_t;
+    struct slab_header_t {
+        slab_header_t* next = nullptr;
+        size_class_t* owner = nullptr;
+        /// Number of allocated slots, guarded by the owner's mutex.
+        std::size_t used = 0;
+        std::atomic<bool> referenced {true};
+        /// Selected slabs are no longer allocated from and are released, once empty.
+        std::atomic<bool> selected {false};
+    };
+    static constexpr std::size_t slab_header_size_k = 64ul;
+    static_assert(sizeof(slab_header_t) <= slab_header_size_k);
+
+    struct large_header_t {
+        slab_allocator_t* allocator = nullptr;
+        /// Neighbors in the list of blobs in RAM, guarded by the `large_mutex_`.
+        large_header_t* prev = nullptr;
+        large_header_t* next = nullptr;
+        std::size_t length = 0;
+        std::atomic<bool> referenced {true};
+        std::atomic<bool> selected {false};
+    };
+    static constexpr std::size_t large_header_size_k = 48ul;
+    static_assert(sizeof(large_header_t) <= large_header_size_k);
+
+    struct free_slot_t {
+        free_slot_t* next = nullptr;
+    };
+
+    struct size_class_t {
+        std::mutex mutex;
+        free_slot_t* free = nullptr;
+        slab_header_t* slabs = nullptr;
+        byte_t* tail = nullptr;
+        byte_t* tail_end = nullptr;
+        std::size_t slot_size = 0;
+    };
+
+    size_class_t classes_[tiers_count_k][shards_count_k][classes_count_k];
+    std::atomic<std::size_t> resident_bytes_ {0};
+    std::atomic<std::size_t> spilled_bytes_ {0};
+    std::size_t memory_limit_ = 0;
+    overflow_file_t overflow_;
+
+    std::mutex large_mutex_;
+    large_header_t* large_blobs_ = nullptr;
+    large_header_t* large_hand_ = nullptr;
+
+    /// The clock visits every size class in RAM and then the large blobs.
+    static constexpr std::size_t clock_positions_k = shards_count_k * classes_count_k + 1ul;
+    std::mutex clock_mutex_;
+    std::size_t clock_position_ = 0;
+    slab_header_t* slab_hand_ = nullptr;
+
+    static std::size_t class_index(std::size_t length) noexcept {
+        if (length <= min_slot_size_k)
+            return 0;
+        std::size_t bit_width = sizeof(std::size_t) * bits_in_byte_k - __builtin_clzll(length - 1);
+        std::size_t half = 1ul << (bit_width - 1);
+        return 2 * (bit_width - 5) + 1 + (length > half + half / 2);
+    }
+
+    static std::size_t class_slot_size(std::size_t index) noexcept {
+        if (index == 0)
+            return min_slot_size_k;
+        std::size_t power = 1ul << (index / 2 + 4);
+        return index % 2 ? power + power / 2 : power;
+    }
+
+    static std::size_t shard_index() noexcept {
+        static std::atomic<std::size_t> threads_count {0};
+        thread_local std::size_t shard = threads_count++ % shards_count_k;
+        return shard;
+    }
+
+    static slab_header_t* slab_of(byte_t const* slot) noexcept {
+        return reinterpret_cast<slab_header_t*>(std::uintptr_t(slot) & ~std::uintptr_t(slab_size_k - 1));
+    }
+
+    static std::size_t spilled_run_length(std::size_t length) noexcept {
+        return next_multiple(length + large_header_size_k, overflow_file_t::page_size_k);
+    }
+
+    /**
+     * @brief Checks if @p length more bytes fit into the memory limit and
+     * reserves them, if so. The limit is soft, concurrent calls may overshoot it.
+     */
+    bool reserve_resident(std::size_t length) noexcept {
+        if (memory_limit_ && overflow_.is_open() && resident_bytes_ + length > memory_limit_)
+            return false;
+        resident_bytes_ += length;
+        return true;
+    }
+
+    static large_header_t* large_header_of(byte_t const* begin) noexcept {
+        return reinterpret_cast<large_header_t*>(const_cast<byte_t*>(begin) - large_header_size_k);
+    }
+
+    void link_large(large_header_t* header) noexcept {
+        std::unique_lock lock {large_mutex_};
+        header->next = large_blobs_;
+        if (large_blobs_)
+            large_blobs_->prev = header;
+        large_blobs_ = header;
+    }
+
+    void unlink_large(large_header_t* header) noexcept {
+        std::unique_lock lock {large_mutex_};
+        if (large_hand_ == header)
+            large_hand_ = header->next;
+        (header->prev ? header->prev->next : large_blobs_) = header->next;
+        if (header->next)
+            header->next->prev = header->prev;
+    }
+
+    /**
+     * @param spilled If set, the memory is taken from the overflow file right away.
+     * Otherwise, will be set, if the memory limit is reached.
+     */
+    byte_t* allocate_large(std::size_t length, bool& spilled) noexcept {
+        byte_t* begin = nullptr;
+        spilled = spilled || !reserve_resident(length + large_header_size_k);
+        if (!spilled) {
+            try {
+                begin = std::allocator<byte_t> {}.allocate(length + large_header_size_k);
+            }
+            catch (...) {
+                resident_bytes_ -= length + large_header_size_k;
+                return nullptr;
+            }
+        }
+        else if (spilled_run_length(length) <= overflow_file_t::chunk_size_k) {
+            begin = overflow_.allocate(spilled_run_length(length));
+            if (!begin)
+                return nullptr;
+            spilled_bytes_ += spilled_run_length(length);
+        }
+        else
+            return nullptr;
+
+        auto header = new (begin) large_header_t {};
+        header->allocator = this;
+        header->length = length + large_header_size_k;
+        if (!spilled)
+            link_large(header);
+        return begin + large_header_size_k;
+    }
+
+    /**
+     * @brief Drops the free slots of the selected slabs from the head of the free-list.
+     * The caller must hold the mutex of the @p size_class.
+     */
+    static void skip_selected_slots(size_class_t& size_class) noexcept {
+        while (size_class.free && slab_of(reinterpret_cast<byte_t*>(size_class.free))->selected)
+            size_class.free = size_class.free->next;
+    }
+
+    /**
+     * @param spilled If set, the memory is taken from the overflow file right away.
+     * Otherwise, will be set, if the memory limit is reached.
+     */
+    byte_t* allocate_slot(std::size_t length, bool& spilled) noexcept {
+        auto shard = shard_index();
+        auto index = class_index(length);
+
+        // Prefer reusing slots in RAM, even beyond the memory limit.
+        size_class_t* size_class = &classes_[spilled][shard][index];
+        std::unique_lock lock {size_class->mutex};
+        skip_selected_slots(*size_class);
+        if (!spilled && !size_class->free && size_class->tail + size_class->slot_size > size_class->tail_end &&
+            !reserve_resident(slab_size_k)) {
+            lock.unlock();
+            size_class = &classes_[1][shard][index];
+            lock = std::unique_lock {size_class->mutex};
+            spilled = true;
+        }
+
+        byte_t* slot = nullptr;
+        if (size_class->free)
+            slot = reinterpret_cast<byte_t*>(std::exchange(size_class->free, size_class->free->next));
+        else {
+            if (size_class->tail + size_class->slot_size > size_class->tail_end) {
+                byte_t* memory = nullptr;
+                if (spilled) {
+                    memory = overflow_.allocate(slab_size_k, slab_size_k);
+                    spilled_bytes_ += memory ? slab_size_k : 0;
+                }
+                else {
+                    memory = static_cast<byte_t*>(std::aligned_alloc(slab_size_k, slab_size_k));
+                    resident_bytes_ -= memory ? 0 : slab_size_k;
+                }
+                if (!memory)
+                    return nullptr;
+                auto slab = new (memory) slab_header_t {};
+                slab->next = size_class->slabs;
+                slab->owner = size_class;
+                size_class->slabs = slab;
+                size_class->tail = memory + slab_header_size_k;
+                size_class->tail_end = memory + slab_size_k;
+            }
+            slot = std::exchange(size_class->tail, size_class->tail + size_class->slot_size);
+        }
+
+        slab_header_t* slab = slab_of(slot);
+        ++slab->used;
+        slab->referenced.store(true, std::memory_order_relaxed);
+        return slot;
+    }
+
+    /**
+     * @brief Advances the clock hand through the slabs of one size class, selecting
+     * the ones, that weren't referenced since the last visit, until @p selected
+     * reaches @p bytes. The caller must hold the `clock_mutex_`.
+     * @return `true`, if the hand reached the end of the class.
+     */
+    bool select_slabs(size_class_t& size_class, std::size_t bytes, std::size_t& selected) noexcept {
+        std::unique_lock lock {size_class.mutex};
+        slab_header_t* slab = slab_hand_ ? slab_hand_ : size_class.slabs;
+        for (; slab && selected < bytes; slab = slab->next) {
+            if (slab->selected || slab->referenced.exchange(false, std::memory_order_relaxed))
+                continue;
+
+            // Stop carving the remaining slots out of the tail
+            slab->selected = true;
+            if (slab_of(size_class.tail) == slab)
+                size_class.tail = size_class.tail_end = nullptr;
+            selected += slab_size_k;
+        }
+        slab_hand_ = slab;
+        return !slab;
+    }
+
+    /**
+     * @brief Same as `select_slabs`, but for the large blobs in RAM.
+     */
+    bool select_large(std::size_t bytes, std::size_t& selected) noexcept {
+        std::unique_lock lock {large_mutex_};
+        large_header_t* header = large_hand_ ? large_hand_ : large_blobs_;
+        for (; header && selected < bytes; header = header->next) {
+            if (header->selected || header->referenced.exchange(false, std::memory_order_relaxed))
+                continue;
+            header->selected = true;
+            selected += header->length;
+        }
+        large_hand_ = header;
+        return !header;
+    }
+
+  public:
+    slab_allocator_t() noexcept {
+        for (auto& tier : classes_)
+            for (auto& shard : tier)
+                for (std::size_t i = 0; i != classes_count_k; ++i)
+                    shard[i].slot_size = class_slot_size(i);
+    }
+    slab_allocator_t(slab_allocator_t const&) = delete;
+    slab_allocator_t& operator=(slab_allocator_t const&) = delete;
+
+    ~slab_allocator_t() noexcept {
+        // The spilled slabs are unmapped together with the overflow file.
+        for (auto& shard : classes_[0])
+            for (auto& size_class : shard)
+                while (size_class.slabs)
+                    std::free(std::exchange(size_class.slabs, size_class.slabs->next));
+    }
+
+    /**
+     * @brief Limits the amount of RAM used for blobs, spilling the rest into
+     * an unlinked file in the @p directory. Zero @p memory_limit means no limit.
+     */
+    status_t limit_memory(std::size_t memory_limit, std::string const& directory) noexcept {
+        if (!memory_limit)
+            return {};
+        if (auto status = overflow_.open(directory); !status)
+            return status;
+        memory_limit_ = memory_limit;
+        return {};
+    }
+
+    /**
+     * @return Uninitialized memory of at least @p length bytes, or `nullptr`.
+     * @param spilled Will be set, if the memory comes from the overflow file.
+     */
+    byte_t* allocate(std::size_t length, bool& spilled) noexcept {
+        spilled = false;
+        return length > max_slot_size_k ? allocate_large(length, spilled) : allocate_slot(length, spilled);
+    }
+
+    /**
+     * @return Uninitialized memory of at least @p length bytes in the overflow file, or `nullptr`.
+     * Must be released with the "spilled" flag set.
+     */
+    byte_t* allocate_spilled(std::size_t length) noexcept {
+        bool spilled = true;
+        return length > max_slot_size_k ? allocate_large(length, spilled) : allocate_slot(length, spilled);
+    }
+
+    /**
+     * @brief Releases memory, previously returned by `allocate()` with the same @p length.
+     * Is static, as the owning size-class is found through the slab header.
+     */
+    static void deallocate(byte_t* begin, std::size_t length, bool spilled) noexcept {
+        if (length <= max_slot_size_k) {
+            slab_header_t& slab = *slab_of(begin);
+            size_class_t& size_class = *slab.owner;
+            auto slot = reinterpret_cast<free_slot_t*>(begin);
+            std::unique_lock lock {size_class.mutex};
+            --slab.used;
+            if (slab.selected)
+                return;
+            slot->next = size_class.free;
+            size_class.free = slot;
+            return;
+        }
+
+        begin -= large_header_size_k;
+        slab_allocator_t& allocator = *reinterpret_cast<large_header_t*>(begin)->allocator;
+        if (spilled) {
+            allocator.overflow_.deallocate(begin, spilled_run_length(length));
+            allocator.spilled_bytes_ -= spilled_run_length(length);
+        }
+        else {
+            allocator.unlink_large(reinterpret_cast<large_header_t*>(begin));
+            std::allocator<byte_t> {}.deallocate(begin, length + large_header_size_k);
+            allocator.resident_bytes_ -= length + large_header_size_k;
+        }
+    }
+
+    /**
+     * @brief Marks the memory of a value in RAM as recently used,
+     * protecting it from the next `select_cold()` sweep.
+     */
+    static void touch(byte_t const* begin, std::size_t length) noexcept {
+        std::atomic<bool>& referenced =
+            length <= max_slot_size_k ? slab_of(begin)->referenced : large_header_of(begin)->referenced;
+        if (!referenced.load(std::memory_order_relaxed))
+            referenced.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Checks if a value in RAM was selected by `select_cold()`
+     * and should be moved into the overflow file.
+     */
+    static bool is_selected(byte_t const* begin, std::size_t length) noexcept {
+        return length <= max_slot_size_k ? slab_of(begin)->selected.load() : large_header_of(begin)->selected.load();
+    }
+
+    /**
+     * @brief The number of bytes, that should be evicted from RAM, or zero.
+     * Eviction starts above 7/8 of the memory limit and continues down to 3/4 of it,
+     * so that the new values have room in RAM and the sweeps are rare.
+     */
+    std::size_t excess_resident_bytes() const noexcept {
+        if (!memory_limit_ || !overflow_.is_open())
+            return 0;
+        std::size_t resident = resident_bytes_;
+        if (resident <= memory_limit_ - memory_limit_ / 8)
+            return 0;
+        return resident - (memory_limit_ - memory_limit_ / 4);
+    }
+
+    /**
+     * @brief Sweeps the clock hand over the slabs and blobs in RAM, selecting
+     * at least @p bytes of the ones, that weren't touched since the previous
+     * sweep, or as many as there are. No new values are placed into them.
+     * @return The number of selected bytes.
+     */
+    std::size_t select_cold(std::size_t bytes) noexcept {
+        std::unique_lock lock {clock_mutex_};
+        std::size_t selected = 0;
+        // Two full turns, as the first one may only clear the reference bits
+        for (std::size_t step = 0; step != 2 * clock_positions_k + 1 && selected < bytes; ++step) {
+            bool turned = false;
+            if (clock_position_ + 1 == clock_positions_k)
+                turned = select_large(bytes, selected);
+            else {
+                auto shard = clock_position_ / classes_count_k;
+                auto index = clock_position_ % classes_count_k;
+                turned = select_slabs(classes_[0][shard][index], bytes, selected);
+            }
+            if (!turned)
+                break;
+            clock_position_ = (clock_position_ + 1) % clock_positions_k;
+        }
+        return selected;
+    }
+
+    /**
+     * @brief Returns the selected slabs, that have no values left in them, to the system.
+     * Should be called after the owner has moved the values out of the selected memory.
+     */
+    void release_selected() noexcept {
+        std::unique_lock clock_lock {clock_mutex_};
+        for (auto& shard : classes_[0]) {
+            for (auto& size_class : shard) {
+                slab_header_t* released = nullptr;
+                {
+                    std::unique_lock lock {size_class.mutex};
+
+                    // Selected slabs are never allocated from, so their free slots can be forgotten
+                    for (free_slot_t** slot = &size_class.free; *slot;)
+                        if (slab_of(reinterpret_cast<byte_t*>(*slot))->selected)
+                            *slot = (*slot)->next;
+                        else
+                            slot = &(*slot)->next;
+
+                    for (slab_header_t** slab = &size_class.slabs; *slab;) {
+                        slab_header_t* current = *slab;
+                        if (!current->selected || current->used) {
+                            slab = &current->next;
+                            continue;
+                        }
+                        if (slab_hand_ == current)
+                            slab_hand_ = current->next;
+                        *slab = current->next;
+                        current->next = released;
+                        released = current;
+                    }
+                }
+                while (released) {
+                    std::free(std::exchange(released, released->next));
+                    resident_bytes_ -= slab_size_k;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief The number of bytes held in RAM, including the free slots.
+     */
+    std::size_t resident_bytes() const noexcept { return resident_bytes_; }
+
+    /**
+     * @brief The number of bytes held in the overflow file, including the free slots.
+     */
+    std::size_t spilled_bytes() const noexcept { return spilled_bytes_; }
+};
+
+} // namespace unum::ustore
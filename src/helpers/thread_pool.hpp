@@ -0,0 +1,148 @@
+/**
+ * @file thread_pool.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief A minimalistic fixed-size pool of threads for fork-join style parallelism.
+ */
+#pragma once
+#include <thread>             // `std::thread`
+#include <mutex>              // `std::unique_lock`
+#include <condition_variable> // `std::condition_variable`
+#include <functional>         // `std::function`
+#include <memory>             // `std::shared_ptr`
+#include <atomic>             // `std::atomic`
+#include <queue>              // `std::queue`
+#include <vector>             // `std::vector`
+
+namespace unum::ustore {
+
+/**
+ * @brief Fixed-size pool of threads, shared by all the operations on a DB.
+ *
+ * The calling thread always participates in the work it submits and never
+ * waits for helpers, that haven't started yet. So it's safe to nest calls
+ * from within tasks running on the same pool, or to use a pool without threads.
+ */
+class thread_pool_t {
+    std::vector<std::thread> threads_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_ = false;
+
+    void loop() noexcept {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock {mutex_};
+                wakeup_.wait(lock, [&] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+  public:
+    thread_pool_t() = default;
+    thread_pool_t(thread_pool_t const&) = delete;
+    thread_pool_t& operator=(thread_pool_t const&) = delete;
+    ~thread_pool_t() noexcept { stop(); }
+
+    /**
+     * @brief Spawns the background threads.
+     * @param threads_count The number of threads besides the calling one.
+     */
+    void start(std::size_t threads_count) noexcept(false) {
+        stop();
+        stopping_ = false;
+        threads_.reserve(threads_count);
+        for (std::size_t i = 0; i != threads_count; ++i)
+            threads_.emplace_back(&thread_pool_t::loop, this);
+    }
+
+    void stop() noexcept {
+        {
+            std::unique_lock lock {mutex_};
+            stopping_ = true;
+        }
+        wakeup_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+        threads_.clear();
+    }
+
+    /**
+     * @brief The number of threads, that can simultaneously execute submitted tasks.
+     */
+    std::size_t size() const noexcept { return threads_.size() + 1; }
+
+    /**
+     * @brief Calls `callback(i)` for every `i` in `[0, count)`, balancing
+     * the work dynamically between the calling thread and the pool.
+     * Returns only once all the calls have finished.
+     * The @p callback must not throw.
+     */
+    template <typename callback_at>
+    void for_each(std::size_t count, callback_at&& callback) noexcept {
+
+        // Helpers may start after this function has returned,
+        // so the shared state must outlive the stack frame.
+        struct state_t {
+            std::atomic<std::size_t> next {0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::size_t running = 0;
+            bool closed = false;
+        };
+        std::shared_ptr<state_t> state;
+        if (count > 1 && !threads_.empty())
+            try {
+                state = std::make_shared<state_t>();
+            }
+            catch (...) {
+            }
+
+        if (!state) {
+            for (std::size_t i = 0; i != count; ++i)
+                callback(i);
+            return;
+        }
+
+        auto work = [count, &callback](state_t& state) noexcept {
+            for (std::size_t i = state.next++; i < count; i = state.next++)
+                callback(i);
+        };
+
+        // If we fail to submit some of the helpers, the calling thread will do more work.
+        std::size_t helpers_count = std::min(threads_.size(), count - 1);
+        try {
+            std::unique_lock lock {mutex_};
+            for (std::size_t i = 0; i != helpers_count; ++i)
+                tasks_.push([state, work] {
+                    {
+                        std::unique_lock lock {state->mutex};
+                        if (state->closed)
+                            return;
+                        ++state->running;
+                    }
+                    work(*state);
+                    std::unique_lock lock {state->mutex};
+                    --state->running;
+                    state->finished.notify_all();
+                });
+        }
+        catch (...) {
+        }
+        wakeup_.notify_all();
+
+        work(*state);
+        std::unique_lock lock {state->mutex};
+        state->closed = true;
+        state->finished.wait(lock, [&] { return state->running == 0; });
+    }
+};
+
+} // namespace unum::ustore
@@ -1534,7 +1534,9 @@ void read_modify_write( //
     };
 
     places_arg_t unique_places;
-    auto opts = c_txn ? ustore_options_t(c_options & ~ustore_option_transaction_dont_watch_k) : c_options;
+    // Reads reject the options, that only apply to writes
+    auto opts = ustore_options_t(c_options & ~(ustore_option_write_flush_k | ustore_option_write_bulk_k));
+    opts = c_txn ? ustore_options_t(opts & ~ustore_option_transaction_dont_watch_k) : opts;
     read_modify_docs(c_db, c_txn, places, opts, c_modification, arena, unique_places, c_error, safe_callback);
     return_if_error_m(c_error);
 
@@ -6,19 +6,52 @@
  * Sits on top of any @see "ustore.h"-compatible system.
  *
  * Internally quantizes often f32/f16 vectors into i8 representations,
- * later constructing a Navigable Small World Graph on those vectors.
- * During search relies on an algorithm resembling A*, adding a
- * stochastic component.
+ * scaling each by its largest absolute component,
+ * later constructing a Hierarchical Navigable Small World Graph on those vectors.
+ * During search relies on a greedy best-first walk over that graph,
+ * descending from its sparse upper levels to the dense base level.
+ * Searches by other metrics scan the original vectors without quantizing them,
+ * passing over every collection once for all the queries of a batch.
+ *
+ * ## Layout
+ *
+ * Every collection stores three kinds of entries:
+ * - The original vector under its non-negative key `k`.
+ * - The node of the graph under the negative key `-1 - k`: the quantized vector and its scale,
+ *   followed by the neighbors on every level of the node, with distances to them.
+ * - The header of the graph under the smallest key: dimensions, scalar type of originals,
+ *   metric, connectivity and the entry point.
+ *
+ * Nodes are read in batches, once per expanded candidate, and are cached for the duration of a call.
+ * All the nodes, modified by a write, are submitted with the original vectors in a single batch.
+ *
+ * Collections, indexed with IVF-PQ, have a zero connectivity in their headers and no graph nodes.
+ * Instead, the negative key `-1 - (l << 47 | k)` holds the Product-Quantized code of the vector `k`
+ * in the inverted list `l`, while the key right after the header holds the coarse centroids and
+ * the codebooks. Every list is a contiguous range of keys, and only the probed ones are scanned
+ * during search, so the memory usage is dominated by the centroids.
  */
-#include <cmath> // `std::sqrt`
+#include <algorithm>     // `std::stable_sort`
+#include <chrono>        // `std::chrono::microseconds`
+#include <cmath>         // `std::sqrt`
+#include <cstring>       // `std::memcpy`
+#include <deque>         // `std::deque`
+#include <map>           // `std::map`
+#include <queue>         // `std::priority_queue`
+#include <memory>        // `std::unique_ptr`
+#include <mutex>         // `std::mutex`
+#include <thread>        // `std::this_thread::sleep_for`
+#include <vector>        // `std::vector`
+#include <unordered_map> // `std::unordered_map`
+#include <unordered_set> // `std::unordered_set`
 
 #include "ustore/vectors.h"
 #include "ustore/cpp/ranges_args.hpp" // `places_arg_t`
 
-#include "helpers/linked_memory.hpp"          // `linked_memory_lock_t`
-#include "helpers/algorithm.hpp"              // `transform_n`
-#include "helpers/full_scan.hpp"              // `full_scan_collection`
-#include "helpers/limited_priority_queue.hpp" // `limited_priority_queue_gt`
+#include "helpers/linked_memory.hpp" // `linked_memory_lock_t`
+#include "helpers/algorithm.hpp"     // `transform_n`
+#include "helpers/full_scan.hpp"     // `full_scan_collection_batches`
+#include "helpers/simd.hpp"          // `simd_kernels`
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
@@ -29,70 +62,68 @@ using namespace unum;
 
 using real_t = float;
 using quant_t = std::int8_t;
-using quant_product_t = std::int16_t;
 
-struct match_t {
-    ustore_key_t key;
-    ustore_float_t metric;
-};
+static constexpr real_t quant_max_k = std::numeric_limits<quant_t>::max();
 
-struct lower_similarity_t {
-    bool operator()(match_t const& a, match_t const& b) const noexcept { return a.metric < b.metric; }
+/**
+ * @brief Vector, quantized with its own scale, so that `original[i] ≈ scalars[i] * scale`.
+ */
+struct quantized_t {
+    quant_t const* scalars;
+    real_t scale;
 };
 
-using pq_t = limited_priority_queue_gt<match_t, lower_similarity_t>;
-
-static constexpr quant_t float_scaling_k = 100;
-static constexpr quant_product_t product_scaling_k = float_scaling_k * float_scaling_k;
-
-template <typename number_at>
-number_at square(number_at n) noexcept {
-    return n * n;
-}
-
+/**
+ * Metrics are computed either on quantized copies of vectors, or on originals
+ * compared to single-precision queries. Both paths use the kernels from "simd.hpp".
+ */
 struct metric_dot_t {
-    real_t operator()(quant_t const* a, quant_t const* b, std::size_t dims) const noexcept {
-        std::int64_t sum = 0;
-        for (std::size_t i = 0; i != dims; ++i) {
-            quant_product_t ai = a[i];
-            quant_product_t bi = b[i];
-            sum += ai * bi;
-        }
-        return real_t(sum) / product_scaling_k;
+    real_t operator()(quantized_t a, quantized_t b, std::size_t dims) const noexcept {
+        return real_t(dot_i8(a.scalars, b.scalars, dims)) * a.scale * b.scale;
+    }
+    real_t operator()(real_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return simd_kernels().dot_f32(a, b, dims);
+    }
+    real_t operator()(f16_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return simd_kernels().dot_f16(a, b, dims);
     }
 };
 
+/**
+ * @brief Is invariant to scaling, so the quantized copies are compared without their scales.
+ */
 struct metric_cos_t {
-    real_t operator()(quant_t const* a, quant_t const* b, std::size_t dims) const noexcept {
-        std::int64_t sum = 0, a_norm = 0, b_norm = 0;
-        for (std::size_t i = 0; i != dims; ++i) {
-            quant_product_t ai = a[i];
-            quant_product_t bi = b[i];
-            sum += ai * bi;
-            a_norm += square(ai);
-            b_norm += square(bi);
-        }
-        auto nominator = real_t(sum) / product_scaling_k;
-        auto denominator = std::sqrt(real_t(a_norm) / product_scaling_k) * //
-                           std::sqrt(real_t(b_norm) / product_scaling_k);
-        return nominator / denominator;
+    template <typename products_at>
+    static real_t normalize(products_at products) noexcept {
+        return real_t(products.ab) / (std::sqrt(real_t(products.aa)) * std::sqrt(real_t(products.bb)));
+    }
+    real_t operator()(quantized_t a, quantized_t b, std::size_t dims) const noexcept {
+        return normalize(cos_i8(a.scalars, b.scalars, dims));
+    }
+    real_t operator()(real_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return normalize(simd_kernels().cos_f32(a, b, dims));
+    }
+    real_t operator()(f16_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return normalize(simd_kernels().cos_f16(a, b, dims));
     }
 };
 
+/**
+ * @brief Copies with different scales can't be subtracted directly, so the distance is expanded
+ * into `|a|^2 + |b|^2 - 2ab`, where the integer products are exact, and only scaled in the end.
+ */
 struct metric_l2_t {
-
-    real_t operator()(quant_t const* a, std::size_t dims) const noexcept {
-        std::int64_t sum = 0;
-        for (std::size_t i = 0; i != dims; ++i)
-            sum += square<quant_product_t>(a[i]);
-        return std::sqrt(real_t(sum) / product_scaling_k);
+    real_t operator()(quantized_t a, quantized_t b, std::size_t dims) const noexcept {
+        products_i8_t products = cos_i8(a.scalars, b.scalars, dims);
+        double sa = a.scale, sb = b.scale;
+        double squared = sa * sa * products.aa + sb * sb * products.bb - 2 * sa * sb * products.ab;
+        return static_cast<real_t>(std::sqrt(std::max(squared, 0.0)));
     }
-
-    real_t operator()(quant_t const* a, quant_t const* b, std::size_t dims) const noexcept {
-        std::int64_t sum = 0;
-        for (std::size_t i = 0; i != dims; ++i)
-            sum += square<quant_product_t>(a[i] - b[i]);
-        return std::sqrt(real_t(sum) / product_scaling_k);
+    real_t operator()(real_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return std::sqrt(simd_kernels().l2sq_f32(a, b, dims));
+    }
+    real_t operator()(f16_t const* a, real_t const* b, std::size_t dims) const noexcept {
+        return std::sqrt(simd_kernels().l2sq_f16(a, b, dims));
     }
 };
 
@@ -101,22 +132,45 @@ struct entry_t {
     value_view_t value;
 };
 
-template <typename float_at = real_t>
-void quantize(float_at const* originals, std::size_t dims, quant_t* quants) noexcept {
+template <typename scalar_at>
+void upcast(scalar_at const* originals, std::size_t dims, real_t* floats) noexcept {
     for (std::size_t i = 0; i != dims; ++i)
-        quants[i] = static_cast<quant_t>(originals[i] * float_scaling_k);
+        floats[i] = static_cast<real_t>(originals[i]);
 }
 
-void quantize(byte_t const* bytes, ustore_vector_scalar_t scalar_type, std::size_t dims, quant_t* quants) noexcept {
+void upcast(byte_t const* bytes, ustore_vector_scalar_t scalar_type, std::size_t dims, real_t* floats) noexcept {
     switch (scalar_type) {
-    case ustore_vector_scalar_f32_k: return quantize((real_t const*)bytes, dims, quants);
-    case ustore_vector_scalar_f64_k: return quantize((double const*)bytes, dims, quants);
-    case ustore_vector_scalar_f16_k: return quantize((std::int16_t const*)bytes, dims, quants);
-    case ustore_vector_scalar_i8_k: return quantize((quant_t const*)bytes, dims, quants);
+    case ustore_vector_scalar_f32_k: return upcast((real_t const*)bytes, dims, floats);
+    case ustore_vector_scalar_f64_k: return upcast((double const*)bytes, dims, floats);
+    case ustore_vector_scalar_f16_k: return transform_n((f16_t const*)bytes, dims, floats, &f16_to_f32);
+    case ustore_vector_scalar_bf16_k: return transform_n((std::uint16_t const*)bytes, dims, floats, &bf16_to_f32);
+    case ustore_vector_scalar_i8_k: return upcast((quant_t const*)bytes, dims, floats);
     }
 }
 
-real_t metric(quant_t const* a, quant_t const* b, std::size_t dims, ustore_vector_metric_t kind) noexcept {
+/**
+ * @brief Symmetrically maps the largest absolute component of a vector to the edge of the `quant_t` range.
+ * Unlike an asymmetric min/max mapping, keeps zero at zero, so integer products stay proportional to the
+ * original ones. Vectors with infinite or missing components are zeroed.
+ * @return The scale, that multiplies the quantized scalars back into the original range.
+ */
+real_t quantize(real_t const* floats, std::size_t dims, quant_t* quants) noexcept {
+    real_t max_abs = 0;
+    bool finite = true;
+    for (std::size_t i = 0; i != dims; ++i)
+        max_abs = std::max(max_abs, std::fabs(floats[i])), finite &= std::isfinite(floats[i]);
+    if (!finite || max_abs == 0) {
+        std::fill_n(quants, dims, quant_t(0));
+        return 0;
+    }
+    real_t factor = quant_max_k / max_abs;
+    for (std::size_t i = 0; i != dims; ++i)
+        quants[i] = static_cast<quant_t>(std::lround(floats[i] * factor));
+    return max_abs / quant_max_k;
+}
+
+template <typename first_at, typename second_at>
+real_t metric(first_at a, second_at b, std::size_t dims, ustore_vector_metric_t kind) noexcept {
     switch (kind) {
     case ustore_vector_metric_dot_k: return metric_dot_t {}(a, b, dims);
     case ustore_vector_metric_cos_k: return metric_cos_t {}(a, b, dims);
@@ -129,7 +183,8 @@ ustore_length_t size_bytes(ustore_vector_scalar_t scalar_type) noexcept {
     switch (scalar_type) {
     case ustore_vector_scalar_f32_k: return sizeof(real_t);
     case ustore_vector_scalar_f64_k: return sizeof(double);
-    case ustore_vector_scalar_f16_k: return sizeof(std::int16_t);
+    case ustore_vector_scalar_f16_k: return sizeof(f16_t);
+    case ustore_vector_scalar_bf16_k: return sizeof(std::uint16_t);
     case ustore_vector_scalar_i8_k: return sizeof(quant_t);
     default: return 0;
     }
@@ -153,11 +208,1123 @@ struct vectors_arg_t {
     }
 };
 
+/*********************************************************/
+/*****************	 Proximity Graph	  ****************/
+/*********************************************************/
+
+static constexpr ustore_length_t connectivity_default_k = 16;
+static constexpr ustore_length_t expansion_add_default_k = 128;
+static constexpr ustore_length_t expansion_search_default_k = 64;
+static constexpr std::size_t levels_max_k = 16;
+/// Searches drop the cached nodes between queries, once there are more of them
+static constexpr std::size_t cached_nodes_max_k = 1ul << 16;
+/// Entries fetched at once, when the whole collection has to be scanned
+static constexpr ustore_length_t scan_read_ahead_k = 1024;
+/// Scanned vectors are compared to all the queries in tiles of this many, that stay in cache
+static constexpr std::size_t scan_tile_k = 64;
+
+static constexpr ustore_key_t graph_header_key_k = std::numeric_limits<ustore_key_t>::min();
+
+/**
+ * @brief Maps non-negative keys of vectors to negative keys of graph nodes and back.
+ */
+inline ustore_key_t node_key(ustore_key_t key) noexcept {
+    return -1 - key;
+}
+
+/**
+ * @brief Unlike the `metric`, the lower the distance - the closer the vectors are.
+ */
+template <typename first_at, typename second_at>
+real_t distance(first_at a, second_at b, std::size_t dims, ustore_vector_metric_t kind) noexcept {
+    real_t result = metric(a, b, dims, kind);
+    if (std::isnan(result))
+        return std::numeric_limits<real_t>::max();
+    return kind == ustore_vector_metric_l2_k ? result : -result;
+}
+
+real_t metric_from_distance(real_t distance, ustore_vector_metric_t kind) noexcept {
+    return kind == ustore_vector_metric_l2_k ? distance : -distance;
+}
+
+struct graph_header_t {
+    std::uint32_t dimensions;
+    /// Zero in collections, indexed with inverted lists instead of the graph
+    std::uint32_t connectivity;
+    std::uint16_t metric;
+    std::uint16_t scalar_type;
+    std::int32_t top_level;
+    ustore_key_t entry;
+};
+
+struct link_t {
+    ustore_key_t key;
+    real_t distance;
+};
+
+struct candidate_t {
+    real_t distance;
+    ustore_key_t key;
+
+    bool operator<(candidate_t const& other) const noexcept { return distance < other.distance; }
+    bool operator>(candidate_t const& other) const noexcept { return distance > other.distance; }
+};
+
+/**
+ * @brief Node of the graph, that has an empty `vector`, if it's missing.
+ */
+struct graph_node_t {
+    std::vector<quant_t> vector;
+    real_t scale = 0;
+    std::vector<std::vector<link_t>> levels;
+    bool dirty = false;
+
+    quantized_t quantized() const noexcept { return {vector.data(), scale}; }
+};
+
+/**
+ * @brief Node records contain the quantized vector and its scale, the number of levels in one byte,
+ * and for every level - the 16-bit number of neighbors, followed by their keys and distances.
+ */
+std::vector<byte_t> serialize(graph_node_t const& node) noexcept(false) {
+    std::size_t size = node.vector.size() + sizeof(real_t) + sizeof(std::uint8_t);
+    for (auto const& links : node.levels)
+        size += sizeof(std::uint16_t) + links.size() * (sizeof(ustore_key_t) + sizeof(real_t));
+
+    std::vector<byte_t> bytes(size);
+    byte_t* output = bytes.data();
+    auto append = [&](void const* source, std::size_t length) noexcept {
+        std::memcpy(output, source, length);
+        output += length;
+    };
+    append(node.vector.data(), node.vector.size());
+    append(&node.scale, sizeof(node.scale));
+    std::uint8_t levels_count = static_cast<std::uint8_t>(node.levels.size());
+    append(&levels_count, sizeof(levels_count));
+    for (auto const& links : node.levels) {
+        std::uint16_t links_count = static_cast<std::uint16_t>(links.size());
+        append(&links_count, sizeof(links_count));
+        for (link_t link : links)
+            append(&link.key, sizeof(link.key)), append(&link.distance, sizeof(link.distance));
+    }
+    return bytes;
+}
+
+bool deserialize(value_view_t bytes, std::size_t dims, graph_node_t& node) noexcept(false) {
+    byte_t const* input = bytes.begin();
+    auto extract = [&](void* target, std::size_t length) noexcept {
+        if (static_cast<std::size_t>(bytes.end() - input) < length)
+            return false;
+        std::memcpy(target, input, length);
+        input += length;
+        return true;
+    };
+    node.vector.resize(dims);
+    std::uint8_t levels_count = 0;
+    if (!extract(node.vector.data(), dims) || !extract(&node.scale, sizeof(node.scale)))
+        return false;
+    if (!extract(&levels_count, sizeof(levels_count)) || !levels_count)
+        return false;
+    node.levels.resize(levels_count);
+    for (auto& links : node.levels) {
+        std::uint16_t links_count = 0;
+        if (!extract(&links_count, sizeof(links_count)))
+            return false;
+        links.resize(links_count);
+        for (link_t& link : links)
+            if (!extract(&link.key, sizeof(link.key)) || !extract(&link.distance, sizeof(link.distance)))
+                return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the entries of a single @p collection in one batch, passing every one of them to the @p callback.
+ * Fetched values are only valid until the next read into the same @p arena.
+ */
+template <typename callback_at>
+void read_entries(ustore_database_t db,
+                  ustore_transaction_t transaction,
+                  ustore_options_t options,
+                  ustore_error_t* error,
+                  ustore_collection_t collection,
+                  ustore_arena_t* arena,
+                  ustore_key_t const* keys,
+                  std::size_t count,
+                  callback_at&& callback) noexcept(false) {
+    ustore_length_t* offsets = nullptr;
+    ustore_length_t* lengths = nullptr;
+    ustore_byte_t* values = nullptr;
+    ustore_read_t read {};
+    read.db = db;
+    read.error = error;
+    read.transaction = transaction;
+    read.arena = arena;
+    read.options = options;
+    read.tasks_count = count;
+    read.collections = &collection;
+    read.collections_stride = 0;
+    read.keys = keys;
+    read.keys_stride = sizeof(ustore_key_t);
+    read.offsets = &offsets;
+    read.lengths = &lengths;
+    read.values = &values;
+    ustore_read(&read);
+    if (*error)
+        return;
+    for (std::size_t i = 0; i != count; ++i)
+        callback(i, lengths[i] != ustore_length_missing_k, value_view_t {values + offsets[i], lengths[i]});
+}
+
+/**
+ * @brief Hierarchical Navigable Small World graph of a single collection.
+ * Caches all the nodes, it has visited, until destroyed.
+ * https://arxiv.org/abs/1603.09320
+ */
+class graph_t {
+    ustore_database_t db_;
+    ustore_transaction_t transaction_;
+    ustore_options_t options_;
+    ustore_error_t* error_;
+    ustore_collection_t collection_;
+    /// Nodes are copied out of the fetched entries, so reads reuse a separate arena
+    ustore_arena_t arena_ = nullptr;
+    std::unordered_map<ustore_key_t, graph_node_t> nodes_;
+    std::vector<ustore_key_t> missing_keys_;
+
+    template <typename callback_at>
+    void read(ustore_key_t const* keys, std::size_t count, callback_at&& callback) noexcept(false) {
+        read_entries(db_, transaction_, options_, error_, collection_, &arena_, keys, count, callback);
+    }
+
+    real_t distance(quantized_t a, quantized_t b) const noexcept {
+        return ::distance(a, b, header.dimensions, static_cast<ustore_vector_metric_t>(header.metric));
+    }
+
+    std::size_t capacity(std::size_t level) const noexcept {
+        return level ? header.connectivity : header.connectivity * 2u;
+    }
+
+    /**
+     * @brief Draws the top level of a node from a geometric distribution, seeded
+     * by its key, so that rewriting a vector never moves it between levels.
+     */
+    std::size_t random_level(ustore_key_t key) const noexcept {
+        std::uint64_t hash = static_cast<std::uint64_t>(key) + 0x9E3779B97F4A7C15ull;
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+        hash ^= hash >> 31;
+        double uniform = (static_cast<double>(hash >> 11) + 1.0) / static_cast<double>(1ull << 53);
+        double level = -std::log(uniform) / std::log(static_cast<double>(header.connectivity));
+        return std::min<std::size_t>(static_cast<std::size_t>(level), levels_max_k - 1);
+    }
+
+    /**
+     * @brief Makes sure, that the nodes of all the @p keys are cached, reading the missing ones in one batch.
+     */
+    void fetch(ustore_key_t const* keys, std::size_t count) noexcept(false) {
+        missing_keys_.clear();
+        for (std::size_t i = 0; i != count; ++i)
+            if (!nodes_.count(keys[i]))
+                missing_keys_.push_back(node_key(keys[i]));
+        if (missing_keys_.empty())
+            return;
+
+        std::sort(missing_keys_.begin(), missing_keys_.end());
+        missing_keys_.erase(std::unique(missing_keys_.begin(), missing_keys_.end()), missing_keys_.end());
+        read(missing_keys_.data(), missing_keys_.size(), [&](std::size_t i, bool present, value_view_t bytes) {
+            graph_node_t& node = nodes_[node_key(missing_keys_[i])];
+            if (!present || !deserialize(bytes, header.dimensions, node))
+                node = {};
+        });
+    }
+
+    graph_node_t& node(ustore_key_t key) noexcept(false) {
+        fetch(&key, 1);
+        return nodes_[key];
+    }
+
+    std::vector<candidate_t> entry_candidates(quantized_t query) noexcept(false) {
+        std::vector<candidate_t> candidates;
+        graph_node_t const& entry = node(header.entry);
+        if (!entry.vector.empty())
+            candidates.push_back({distance(query, entry.quantized()), header.entry});
+        return candidates;
+    }
+
+    /**
+     * @brief Best-first search on a single @p level, starting from the @p entries.
+     * @return Up to @p expansion closest nodes, sorted by distance.
+     */
+    std::vector<candidate_t> search_level(quantized_t query,
+                                          std::vector<candidate_t> const& entries,
+                                          std::size_t expansion,
+                                          std::size_t level) noexcept(false) {
+
+        std::unordered_set<ustore_key_t> visited;
+        visited.reserve(expansion * capacity(level));
+        std::priority_queue<candidate_t, std::vector<candidate_t>, std::greater<candidate_t>> candidates;
+        std::priority_queue<candidate_t> closest;
+        for (candidate_t entry : entries) {
+            visited.insert(entry.key);
+            candidates.push(entry);
+            closest.push(entry);
+        }
+        while (closest.size() > expansion)
+            closest.pop();
+
+        std::vector<ustore_key_t> neighbors;
+        while (!candidates.empty() && !*error_) {
+            candidate_t candidate = candidates.top();
+            if (closest.size() >= expansion && candidate.distance > closest.top().distance)
+                break;
+            candidates.pop();
+
+            graph_node_t const& candidate_node = nodes_[candidate.key];
+            if (level >= candidate_node.levels.size())
+                continue;
+            neighbors.clear();
+            for (link_t link : candidate_node.levels[level])
+                if (visited.insert(link.key).second)
+                    neighbors.push_back(link.key);
+
+            fetch(neighbors.data(), neighbors.size());
+            for (ustore_key_t neighbor_key : neighbors) {
+                graph_node_t const& neighbor = nodes_[neighbor_key];
+                if (neighbor.vector.empty())
+                    continue;
+                candidate_t neighbor_candidate {distance(query, neighbor.quantized()), neighbor_key};
+                if (closest.size() < expansion || neighbor_candidate.distance < closest.top().distance) {
+                    candidates.push(neighbor_candidate);
+                    closest.push(neighbor_candidate);
+                    if (closest.size() > expansion)
+                        closest.pop();
+                }
+            }
+        }
+
+        std::vector<candidate_t> sorted(closest.size());
+        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it, closest.pop())
+            *it = closest.top();
+        return sorted;
+    }
+
+    /**
+     * @brief Picks diverse neighbors with the heuristic from the paper: a candidate is skipped,
+     * if it's closer to one of the already selected neighbors, than to the new node.
+     * Skipped candidates fill the slots, that remain empty.
+     */
+    std::vector<link_t> select_neighbors(std::vector<candidate_t> const& candidates,
+                                         ustore_key_t key,
+                                         std::size_t count) noexcept(false) {
+        std::vector<link_t> selected, skipped;
+        for (candidate_t candidate : candidates) {
+            if (selected.size() == count)
+                break;
+            if (candidate.key == key)
+                continue;
+            quantized_t vector = nodes_[candidate.key].quantized();
+            bool diverse = std::all_of(selected.begin(), selected.end(), [&](link_t link) {
+                return distance(vector, nodes_[link.key].quantized()) >= candidate.distance;
+            });
+            (diverse ? selected : skipped).push_back({candidate.key, candidate.distance});
+        }
+        for (std::size_t i = 0; i != skipped.size() && selected.size() < count; ++i)
+            selected.push_back(skipped[i]);
+        return selected;
+    }
+
+    /**
+     * @brief Adds a reverse @p link to the @p target, evicting its farthest neighbor, if it has too many.
+     * Stored distances spare reading the vectors of all the other neighbors.
+     */
+    void connect(ustore_key_t target, link_t link, std::size_t level) noexcept(false) {
+        graph_node_t& node = nodes_[target];
+        if (node.vector.empty() || level >= node.levels.size())
+            return;
+
+        auto& links = node.levels[level];
+        auto it = std::find_if(links.begin(), links.end(), [&](link_t existing) { return existing.key == link.key; });
+        if (it != links.end())
+            it->distance = link.distance;
+        else
+            links.push_back(link);
+        if (links.size() > capacity(level)) {
+            auto closer = [](link_t a, link_t b) noexcept { return a.distance < b.distance; };
+            std::sort(links.begin(), links.end(), closer);
+            links.resize(capacity(level));
+        }
+        node.dirty = true;
+    }
+
+  public:
+    graph_header_t header {0, 0, 0, 0, -1, 0};
+    bool header_exists = false;
+    bool header_dirty = false;
+
+    graph_t(ustore_database_t db,
+            ustore_transaction_t transaction,
+            ustore_options_t options,
+            ustore_error_t* error,
+            ustore_collection_t collection) noexcept(false)
+        : db_(db), transaction_(transaction), options_(options), error_(error), collection_(collection) {
+        read(&graph_header_key_k, 1, [&](std::size_t, bool present, value_view_t bytes) {
+            header_exists = present && bytes.size() == sizeof(graph_header_t);
+            if (header_exists)
+                std::memcpy(&header, bytes.begin(), sizeof(graph_header_t));
+        });
+    }
+
+    graph_t(graph_t const&) = delete;
+    graph_t& operator=(graph_t const&) = delete;
+    ~graph_t() noexcept { ustore_arena_free(arena_); }
+
+    ustore_collection_t collection() const noexcept { return collection_; }
+    bool is_inverted() const noexcept { return header_exists && !header.connectivity; }
+    std::size_t cached_nodes() const noexcept { return nodes_.size(); }
+    void clear_cache() noexcept { nodes_.clear(); }
+
+    /**
+     * @brief Descends from the entry point through the upper levels with a single candidate,
+     * and finds up to @p expansion closest nodes on the base level.
+     */
+    std::vector<candidate_t> search(quantized_t query, std::size_t expansion) noexcept(false) {
+        if (header.top_level < 0)
+            return {};
+        std::vector<candidate_t> closest = entry_candidates(query);
+        for (std::size_t level = header.top_level; level != 0 && !closest.empty(); --level)
+            closest = search_level(query, closest, 1, level);
+        if (closest.empty())
+            return closest;
+        return search_level(query, closest, expansion, 0);
+    }
+
+    /**
+     * @brief Links a new node, or relinks an existing one, if the vector was overwritten.
+     * Other nodes, linking to an overwritten one, keep their links.
+     */
+    void insert(ustore_key_t key, quantized_t vector, std::size_t expansion) noexcept(false) {
+        graph_node_t& inserted = node(key);
+        bool const exists = !inserted.vector.empty();
+        std::size_t const level = exists ? inserted.levels.size() - 1 : random_level(key);
+        std::vector<std::vector<link_t>> levels(level + 1);
+
+        if (header.top_level >= 0) {
+            std::size_t const top_level = static_cast<std::size_t>(header.top_level);
+            std::vector<candidate_t> closest = entry_candidates(vector);
+            for (std::size_t current = top_level; current > level && !closest.empty(); --current)
+                closest = search_level(vector, closest, 1, current);
+            for (std::size_t current = std::min(level, top_level) + 1; current-- != 0 && !closest.empty();) {
+                closest = search_level(vector, closest, expansion, current);
+                levels[current] = select_neighbors(closest, key, capacity(current));
+            }
+        }
+        if (*error_)
+            return;
+
+        inserted.vector.assign(vector.scalars, vector.scalars + header.dimensions);
+        inserted.scale = vector.scale;
+        inserted.levels = std::move(levels);
+        inserted.dirty = true;
+        for (std::size_t current = 0; current != inserted.levels.size(); ++current)
+            for (link_t link : inserted.levels[current])
+                connect(link.key, {key, link.distance}, current);
+
+        if (header.top_level < static_cast<std::int32_t>(level)) {
+            header.top_level = static_cast<std::int32_t>(level);
+            header.entry = key;
+            header_dirty = true;
+        }
+    }
+
+    /**
+     * @brief Serializes the modified nodes and the header, appending them to the @p entries of a write.
+     * The @p buffers own the serialized bytes and must outlive the write.
+     */
+    void export_changes(std::vector<entry_t>& entries, std::deque<std::vector<byte_t>>& buffers) noexcept(false) {
+        for (auto const& [key, node] : nodes_) {
+            if (!node.dirty)
+                continue;
+            auto const& bytes = buffers.emplace_back(serialize(node));
+            entries.push_back({{collection_, node_key(key)}, {bytes.data(), bytes.size()}});
+        }
+        if (header_dirty) {
+            auto& bytes = buffers.emplace_back(sizeof(graph_header_t));
+            std::memcpy(bytes.data(), &header, sizeof(graph_header_t));
+            entries.push_back({{collection_, graph_header_key_k}, {bytes.data(), bytes.size()}});
+        }
+    }
+};
+
+/**
+ * @brief Finds the index of the @p collection among the already loaded ones, or loads it,
+ * passing the remaining @p args to its constructor.
+ */
+template <typename index_at, typename... args_at>
+index_at& find_index(std::vector<std::unique_ptr<index_at>>& indexes,
+                     ustore_database_t db,
+                     ustore_transaction_t transaction,
+                     ustore_options_t options,
+                     ustore_error_t* error,
+                     ustore_collection_t collection,
+                     args_at&&... args) noexcept(false) {
+    for (auto& index : indexes)
+        if (index->collection() == collection)
+            return *index;
+    auto& loaded = indexes.emplace_back();
+    loaded = std::make_unique<index_at>(db, transaction, options, error, collection, std::forward<args_at>(args)...);
+    return *loaded;
+}
+
+/**
+ * @brief Compares every vector in a tile of scanned originals to every query in a row-major matrix.
+ * Iterating over queries in the outer loop reuses the tile from L1, while it is compared to all of them.
+ */
+template <typename scalar_at, typename callback_at>
+void score_tile(scalar_at const* const* vectors,
+                ustore_key_t const* keys,
+                std::size_t tile_size,
+                real_t const* queries,
+                std::size_t queries_count,
+                std::size_t dims,
+                ustore_vector_metric_t kind,
+                callback_at&& callback) noexcept(false) {
+    for (std::size_t query_idx = 0; query_idx != queries_count; ++query_idx) {
+        real_t const* query = queries + query_idx * dims;
+        for (std::size_t i = 0; i != tile_size; ++i)
+            callback(query_idx, candidate_t {distance(vectors[i], query, dims, kind), keys[i]});
+    }
+}
+
+/**
+ * @brief Compares a batch of queries to every original vector in the @p collection,
+ * for metrics, that don't match the one of the graph. The collection is scanned once
+ * for the whole batch, and every fetched block is scored against all the queries.
+ * Unlike graph traversals, skips quantization, so f32 and f16 originals go straight
+ * into the kernels, while other scalar types are upcasted once per scanned vector.
+ *
+ * @param queries Row-major matrix of @p queries_count upcasted queries.
+ * @param limits Maximum number of matches for every query.
+ * @return Up to `limits[i]` closest vectors for every query, sorted by distance.
+ */
+std::vector<std::vector<candidate_t>> search_exhaustively(ustore_database_t db,
+                                                          ustore_transaction_t transaction,
+                                                          ustore_collection_t collection,
+                                                          ustore_options_t options,
+                                                          real_t const* queries,
+                                                          std::size_t const* limits,
+                                                          std::size_t queries_count,
+                                                          std::size_t dims,
+                                                          ustore_vector_scalar_t scalar_type,
+                                                          ustore_vector_metric_t kind,
+                                                          linked_memory_lock_t& arena,
+                                                          ustore_error_t* error) noexcept(false) {
+
+    std::vector<std::priority_queue<candidate_t>> closest(queries_count);
+    auto consider = [&](std::size_t query_idx, candidate_t candidate) {
+        auto& heap = closest[query_idx];
+        std::size_t limit = limits[query_idx];
+        if (heap.size() < limit || (limit && candidate.distance < heap.top().distance)) {
+            heap.push(candidate);
+            if (heap.size() > limit)
+                heap.pop();
+        }
+    };
+
+    // Originals are only valid within a fetched batch, so tiles never cross its boundaries
+    std::vector<ustore_key_t> tile_keys(scan_tile_k);
+    std::vector<byte_t const*> tile_vectors(scan_tile_k);
+    std::vector<real_t> upcasted(scan_tile_k * dims);
+    bool is_native = scalar_type == ustore_vector_scalar_f32_k || scalar_type == ustore_vector_scalar_f16_k;
+    auto callback = [&](ustore_key_t const* keys, joined_blobs_iterator_t originals, std::size_t count) {
+        for (std::size_t tile_begin = 0; tile_begin < count; tile_begin += scan_tile_k) {
+            std::size_t tile_end = std::min(count, tile_begin + scan_tile_k);
+            std::size_t tile_size = 0;
+            for (std::size_t i = tile_begin; i != tile_end; ++i, ++originals) {
+                value_view_t original = *originals;
+                if (original.size() != dims * size_bytes(scalar_type))
+                    continue;
+
+                tile_keys[tile_size] = keys[i];
+                if (is_native)
+                    tile_vectors[tile_size] = original.data();
+                else {
+                    real_t* target = upcasted.data() + tile_size * dims;
+                    upcast(original.begin(), scalar_type, dims, target);
+                    tile_vectors[tile_size] = reinterpret_cast<byte_t const*>(target);
+                }
+                ++tile_size;
+            }
+
+            if (scalar_type == ustore_vector_scalar_f16_k)
+                score_tile(reinterpret_cast<f16_t const* const*>(tile_vectors.data()),
+                           tile_keys.data(),
+                           tile_size,
+                           queries,
+                           queries_count,
+                           dims,
+                           kind,
+                           consider);
+            else
+                score_tile(reinterpret_cast<real_t const* const*>(tile_vectors.data()),
+                           tile_keys.data(),
+                           tile_size,
+                           queries,
+                           queries_count,
+                           dims,
+                           kind,
+                           consider);
+        }
+        return true;
+    };
+    ustore_key_t first_vector_key = 0;
+    full_scan_collection_batches(db,
+                                 transaction,
+                                 collection,
+                                 options,
+                                 first_vector_key,
+                                 scan_read_ahead_k,
+                                 arena,
+                                 error,
+                                 callback);
+
+    std::vector<std::vector<candidate_t>> sorted(queries_count);
+    for (std::size_t query_idx = 0; query_idx != queries_count; ++query_idx) {
+        auto& heap = closest[query_idx];
+        sorted[query_idx].resize(heap.size());
+        for (auto it = sorted[query_idx].rbegin(); it != sorted[query_idx].rend(); ++it, heap.pop())
+            *it = heap.top();
+    }
+    return sorted;
+}
+
+/*********************************************************/
+/*****************	 Inverted Lists	  ****************/
+/*********************************************************/
+
+static constexpr ustore_length_t lists_default_k = 1024;
+static constexpr ustore_length_t lists_max_k = 1u << 15;
+static constexpr ustore_length_t probes_default_k = 16;
+/// Every subspace of a vector is encoded with a single byte
+static constexpr std::size_t codewords_max_k = 256;
+/// Training is postponed, until every centroid can get this many vectors
+static constexpr std::size_t training_per_list_k = 39;
+/// Vectors of the collection, sampled to train the centroids and the codebooks
+static constexpr std::size_t training_max_k = 1ul << 15;
+static constexpr std::size_t kmeans_iterations_k = 10;
+
+static constexpr ustore_key_t codebook_key_k = graph_header_key_k + 1;
+
+/// Codes are keyed by their list in the upper bits, and by the vector key in the lower ones
+static constexpr std::size_t code_key_bits_k = 47;
+static constexpr ustore_key_t code_key_max_k = (ustore_key_t(1) << code_key_bits_k) - 1;
+static constexpr std::size_t no_list_k = std::numeric_limits<std::size_t>::max();
+
+/**
+ * @brief Maps the code of a vector in an inverted list to a negative key, that is free in
+ * collections without a graph. Codes of the same list occupy a contiguous range of keys.
+ */
+inline ustore_key_t code_key(std::size_t list, ustore_key_t key) noexcept {
+    return -1 - ((static_cast<ustore_key_t>(list) << code_key_bits_k) | key);
+}
+
+inline ustore_key_t code_key_to_vector_key(ustore_key_t key) noexcept {
+    return (-1 - key) & code_key_max_k;
+}
+
+inline std::size_t training_size(std::size_t lists) noexcept {
+    return std::max(lists * training_per_list_k, codewords_max_k);
+}
+
+/**
+ * @brief Configuration of the index, followed by the trained centroids and codebooks.
+ * Until the collection has enough vectors, the codebooks are empty and the `pending` originals
+ * are counted. Afterwards, it keeps the size of the collection at the moment of training.
+ */
+struct codebook_header_t {
+    std::uint32_t dimensions;
+    std::uint32_t lists;
+    std::uint32_t subspaces;
+    std::uint32_t codewords;
+    std::uint64_t pending;
+};
+
+std::size_t closest_centroid(real_t const* point,
+                             real_t const* centroids,
+                             std::size_t count,
+                             std::size_t dims) noexcept {
+    std::size_t closest = 0;
+    real_t closest_distance = std::numeric_limits<real_t>::max();
+    for (std::size_t i = 0; i != count; ++i) {
+        real_t distance = simd_kernels().l2sq_f32(point, centroids + i * dims, dims);
+        if (distance < closest_distance)
+            closest = i, closest_distance = distance;
+    }
+    return closest;
+}
+
+/**
+ * @brief Lloyd's k-means over a row-major matrix of @p count points, seeded with evenly spaced points.
+ * Clusters, that lose all of their points, keep their previous centroids.
+ */
+void kmeans(real_t const* points, std::size_t count, std::size_t dims, std::size_t clusters, real_t* centroids) {
+    for (std::size_t cluster = 0; cluster != clusters; ++cluster)
+        std::memcpy(centroids + cluster * dims, points + cluster * count / clusters * dims, dims * sizeof(real_t));
+
+    std::vector<real_t> sums(clusters * dims);
+    std::vector<std::size_t> sizes(clusters);
+    for (std::size_t iteration = 0; iteration != kmeans_iterations_k; ++iteration) {
+        std::fill(sums.begin(), sums.end(), real_t(0));
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (std::size_t i = 0; i != count; ++i) {
+            real_t const* point = points + i * dims;
+            std::size_t cluster = closest_centroid(point, centroids, clusters, dims);
+            real_t* sum = sums.data() + cluster * dims;
+            for (std::size_t j = 0; j != dims; ++j)
+                sum[j] += point[j];
+            ++sizes[cluster];
+        }
+        for (std::size_t cluster = 0; cluster != clusters; ++cluster)
+            if (sizes[cluster])
+                for (std::size_t j = 0; j != dims; ++j)
+                    centroids[cluster * dims + j] = sums[cluster * dims + j] / sizes[cluster];
+    }
+}
+
+/**
+ * @brief Inverted File index with Product Quantization of a single collection.
+ * Every vector is assigned to the list of its closest coarse centroid, and the residual
+ * between them is split into subspaces, each replaced with the index of its closest codeword.
+ * Centroids and codebooks are trained once and kept in memory, while the lists are read on demand.
+ * https://doi.org/10.1109/TPAMI.2010.57
+ *
+ * Every code is a separate entry, keyed by its list and its vector, so writes only touch
+ * the codes of the written vectors, and probing a list is a scan over a range of keys.
+ * Cosine similarity is searched as the inner product of normalized vectors.
+ */
+class ivfpq_t {
+    ustore_database_t db_;
+    ustore_transaction_t transaction_;
+    ustore_options_t options_;
+    ustore_error_t* error_;
+    ustore_collection_t collection_;
+    graph_header_t collection_header_;
+    /// Codes are consumed within the fetched batches, so reads reuse a separate arena
+    ustore_arena_t arena_ = nullptr;
+
+    std::vector<real_t> centroids_;
+    std::vector<real_t> codebooks_;
+    bool header_dirty_ = false;
+
+    std::vector<ustore_key_t> added_keys_;
+    std::vector<real_t> added_vectors_;
+
+    std::size_t dims() const noexcept { return header.dimensions; }
+    std::size_t subspace_dims() const noexcept { return header.dimensions / header.subspaces; }
+    real_t const* centroid(std::size_t list) const noexcept { return centroids_.data() + list * dims(); }
+    real_t const* codeword(std::size_t subspace, std::size_t code) const noexcept {
+        return codebooks_.data() + (subspace * header.codewords + code) * subspace_dims();
+    }
+
+    ustore_vector_metric_t metric() const noexcept {
+        return static_cast<ustore_vector_metric_t>(collection_header_.metric);
+    }
+    ustore_vector_scalar_t scalar_type() const noexcept {
+        return static_cast<ustore_vector_scalar_t>(collection_header_.scalar_type);
+    }
+
+    void normalize(real_t* vector) const noexcept {
+        if (metric() != ustore_vector_metric_cos_k)
+            return;
+        real_t norm = std::sqrt(simd_kernels().dot_f32(vector, vector, dims()));
+        if (norm != 0)
+            for (std::size_t i = 0; i != dims(); ++i)
+                vector[i] /= norm;
+    }
+
+    void encode(real_t const* vector, std::size_t list, std::uint8_t* code) const noexcept(false) {
+        std::vector<real_t> residual(dims());
+        for (std::size_t i = 0; i != dims(); ++i)
+            residual[i] = vector[i] - centroid(list)[i];
+        for (std::size_t subspace = 0; subspace != header.subspaces; ++subspace)
+            code[subspace] = static_cast<std::uint8_t>(closest_centroid(residual.data() + subspace * subspace_dims(),
+                                                                  codeword(subspace, 0),
+                                                                  header.codewords,
+                                                                  subspace_dims()));
+    }
+
+    /**
+     * @brief Appends the normalized originals of the whole collection to @p keys and @p vectors,
+     * except for the ones, that are overwritten by the current batch, passed in sorted @p skipped.
+     */
+    void read_originals(std::vector<ustore_key_t> const& skipped,
+                        std::vector<ustore_key_t>& keys,
+                        std::vector<real_t>& vectors) noexcept(false) {
+        auto callback = [&](ustore_key_t const* scanned, joined_blobs_iterator_t originals, std::size_t count) {
+            for (std::size_t i = 0; i != count; ++i, ++originals) {
+                value_view_t bytes = *originals;
+                if (bytes.size() != dims() * size_bytes(scalar_type()) ||
+                    std::binary_search(skipped.begin(), skipped.end(), scanned[i]))
+                    continue;
+                keys.push_back(scanned[i]);
+                vectors.resize(vectors.size() + dims());
+                upcast(bytes.begin(), scalar_type(), dims(), &vectors[vectors.size() - dims()]);
+                normalize(&vectors[vectors.size() - dims()]);
+            }
+            return true;
+        };
+        linked_memory_lock_t arena = linked_memory(&arena_, options_, error_);
+        ustore_key_t first_vector_key = 0;
+        full_scan_collection_batches(db_,
+                                     transaction_,
+                                     collection_,
+                                     options_,
+                                     first_vector_key,
+                                     scan_read_ahead_k,
+                                     arena,
+                                     error_,
+                                     callback);
+    }
+
+    /**
+     * @brief Trains the coarse centroids on a sample of @p count vectors, and the codebooks
+     * of every subspace on the residuals of that sample.
+     */
+    void train(real_t const* vectors, std::size_t count) noexcept(false) {
+        std::size_t const sampled = std::min(count, training_max_k);
+        std::vector<real_t> sample(sampled * dims());
+        for (std::size_t i = 0; i != sampled; ++i)
+            std::memcpy(&sample[i * dims()], vectors + i * count / sampled * dims(), dims() * sizeof(real_t));
+
+        header.codewords = static_cast<std::uint32_t>(codewords_max_k);
+        centroids_.resize(header.lists * dims());
+        codebooks_.resize(header.codewords * dims());
+        kmeans(sample.data(), sampled, dims(), header.lists, centroids_.data());
+
+        for (std::size_t i = 0; i != sampled; ++i) {
+            real_t* point = &sample[i * dims()];
+            real_t const* closest = centroid(closest_centroid(point, centroids_.data(), header.lists, dims()));
+            for (std::size_t j = 0; j != dims(); ++j)
+                point[j] -= closest[j];
+        }
+        std::vector<real_t> slices(sampled * subspace_dims());
+        for (std::size_t subspace = 0; subspace != header.subspaces; ++subspace) {
+            for (std::size_t i = 0; i != sampled; ++i)
+                std::memcpy(&slices[i * subspace_dims()],
+                            &sample[i * dims() + subspace * subspace_dims()],
+                            subspace_dims() * sizeof(real_t));
+            real_t* codebook = codebooks_.data() + subspace * header.codewords * subspace_dims();
+            kmeans(slices.data(), sampled, subspace_dims(), header.codewords, codebook);
+        }
+        header_dirty_ = true;
+    }
+
+    void export_header(std::vector<entry_t>& entries, std::deque<std::vector<byte_t>>& buffers) const {
+        if (!header_dirty_)
+            return;
+        std::size_t floats_size = (centroids_.size() + codebooks_.size()) * sizeof(real_t);
+        auto& bytes = buffers.emplace_back(sizeof(codebook_header_t) + floats_size);
+        std::memcpy(bytes.data(), &header, sizeof(codebook_header_t));
+        if (!trained()) {
+            entries.push_back({{collection_, codebook_key_k}, {bytes.data(), bytes.size()}});
+            return;
+        }
+        byte_t* floats = bytes.data() + sizeof(codebook_header_t);
+        std::memcpy(floats, centroids_.data(), centroids_.size() * sizeof(real_t));
+        byte_t* codebooks = floats + centroids_.size() * sizeof(real_t);
+        std::memcpy(codebooks, codebooks_.data(), codebooks_.size() * sizeof(real_t));
+        entries.push_back({{collection_, codebook_key_k}, {bytes.data(), bytes.size()}});
+    }
+
+  public:
+    codebook_header_t header {0, 0, 0, 0, 0};
+    bool header_exists = false;
+
+    ivfpq_t(ustore_database_t db,
+            ustore_transaction_t transaction,
+            ustore_options_t options,
+            ustore_error_t* error,
+            ustore_collection_t collection,
+            graph_header_t const& collection_header) noexcept(false)
+        : db_(db), transaction_(transaction), options_(options), error_(error), collection_(collection),
+          collection_header_(collection_header) {
+        header.dimensions = collection_header.dimensions;
+        auto callback = [&](std::size_t, bool present, value_view_t bytes) {
+            if (!present || bytes.size() < sizeof(codebook_header_t))
+                return;
+            codebook_header_t stored;
+            std::memcpy(&stored, bytes.begin(), sizeof(codebook_header_t));
+            std::size_t centroids = stored.codewords ? std::size_t(stored.lists) * stored.dimensions : 0;
+            std::size_t codewords = std::size_t(stored.codewords) * stored.dimensions;
+            if (stored.dimensions != header.dimensions ||
+                bytes.size() != sizeof(codebook_header_t) + (centroids + codewords) * sizeof(real_t))
+                return;
+            header = stored;
+            header_exists = true;
+            if (!stored.codewords)
+                return;
+            centroids_.resize(centroids);
+            codebooks_.resize(codewords);
+            real_t const* floats = reinterpret_cast<real_t const*>(bytes.begin() + sizeof(codebook_header_t));
+            std::memcpy(centroids_.data(), floats, centroids * sizeof(real_t));
+            std::memcpy(codebooks_.data(), floats + centroids, codewords * sizeof(real_t));
+        };
+        read_entries(db_, transaction_, options_, error_, collection_, &arena_, &codebook_key_k, 1, callback);
+    }
+
+    ivfpq_t(ivfpq_t const&) = delete;
+    ivfpq_t& operator=(ivfpq_t const&) = delete;
+    ~ivfpq_t() noexcept { ustore_arena_free(arena_); }
+
+    ustore_collection_t collection() const noexcept { return collection_; }
+    bool trained() const noexcept { return header.codewords != 0; }
+
+    /**
+     * @brief Postpones the vector until the export, as the batch may have to train the codebooks.
+     */
+    void add(ustore_key_t key, real_t const* vector) noexcept(false) {
+        added_keys_.push_back(key);
+        added_vectors_.insert(added_vectors_.end(), vector, vector + dims());
+        normalize(&added_vectors_[added_vectors_.size() - dims()]);
+    }
+
+    /**
+     * @brief Scans the @p probes inverted lists with the closest centroids, comparing the @p query
+     * to the codes with distance tables, that are computed once per list. Must be trained.
+     * @return Up to @p limit closest vectors, sorted by distance.
+     */
+    std::vector<candidate_t> search(real_t const* query, std::size_t probes, std::size_t limit) noexcept(false) {
+        if (!trained() || !limit)
+            return {};
+        std::vector<real_t> normalized(query, query + dims());
+        normalize(normalized.data());
+        query = normalized.data();
+
+        // Candidates for probing are identified by the indexes of their lists
+        std::vector<candidate_t> lists(header.lists);
+        for (std::size_t list = 0; list != header.lists; ++list)
+            lists[list] = {distance(centroid(list), query, dims(), metric()), static_cast<ustore_key_t>(list)};
+        probes = std::min<std::size_t>(std::max<std::size_t>(probes, 1), header.lists);
+        std::partial_sort(lists.begin(), lists.begin() + probes, lists.end());
+
+        // Inner products of the residuals don't depend on the list, unlike their Euclidean distances
+        bool const is_l2 = metric() == ustore_vector_metric_l2_k;
+        std::vector<real_t> residual(dims());
+        std::vector<real_t> table(header.subspaces * header.codewords);
+        auto fill_table = [&](real_t const* target) {
+            for (std::size_t subspace = 0; subspace != header.subspaces; ++subspace)
+                for (std::size_t code = 0; code != header.codewords; ++code)
+                    table[subspace * header.codewords + code] =
+                        is_l2 ? simd_kernels().l2sq_f32(target + subspace * subspace_dims(),
+                                                        codeword(subspace, code),
+                                                        subspace_dims())
+                              : simd_kernels().dot_f32(target + subspace * subspace_dims(),
+                                                       codeword(subspace, code),
+                                                       subspace_dims());
+        };
+        if (!is_l2)
+            fill_table(query);
+
+        // Lists hold `pending / lists` codes on average since training, so scans don't fetch far beyond them
+        auto read_ahead = static_cast<ustore_length_t>(
+            std::clamp<std::size_t>(header.pending * 2 / header.lists, 64, scan_read_ahead_k));
+        std::priority_queue<candidate_t> closest;
+        linked_memory_lock_t arena = linked_memory(&arena_, options_, error_);
+        for (std::size_t probe = 0; probe != probes && !*error_; ++probe) {
+            std::size_t const list = static_cast<std::size_t>(lists[probe].key);
+            real_t const* list_centroid = centroid(list);
+            real_t base = 0;
+            if (is_l2) {
+                for (std::size_t j = 0; j != dims(); ++j)
+                    residual[j] = query[j] - list_centroid[j];
+                fill_table(residual.data());
+            }
+            else
+                base = simd_kernels().dot_f32(query, list_centroid, dims());
+
+            ustore_key_t const last_key = code_key(list, 0);
+            auto callback = [&](ustore_key_t const* keys, joined_blobs_iterator_t codes, std::size_t count) {
+                for (std::size_t i = 0; i != count; ++i, ++codes) {
+                    if (keys[i] > last_key)
+                        return false;
+                    value_view_t code_bytes = *codes;
+                    if (code_bytes.size() != header.subspaces)
+                        continue;
+                    auto code = reinterpret_cast<std::uint8_t const*>(code_bytes.begin());
+                    real_t sum = 0;
+                    for (std::size_t subspace = 0; subspace != header.subspaces; ++subspace)
+                        sum += table[subspace * header.codewords + code[subspace]];
+
+                    candidate_t candidate {is_l2 ? std::sqrt(std::max(sum, real_t(0))) : -(base + sum),
+                                           code_key_to_vector_key(keys[i])};
+                    if (closest.size() < limit || candidate.distance < closest.top().distance) {
+                        closest.push(candidate);
+                        if (closest.size() > limit)
+                            closest.pop();
+                    }
+                }
+                return true;
+            };
+            full_scan_collection_batches(db_,
+                                         transaction_,
+                                         collection_,
+                                         options_,
+                                         code_key(list, code_key_max_k),
+                                         read_ahead,
+                                         arena,
+                                         error_,
+                                         callback);
+        }
+
+        std::vector<candidate_t> sorted(closest.size());
+        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it, closest.pop())
+            *it = closest.top();
+        return sorted;
+    }
+
+    /**
+     * @brief Encodes the added vectors, appending their codes and the codebooks to the @p entries
+     * of a write. The @p buffers own the serialized bytes.
+     *
+     * Until the collection has `training_size()` vectors, only counts them. The batch, that reaches
+     * that size, trains the codebooks on the whole collection and encodes all of its vectors.
+     * Later batches only replace the codes of their own vectors, deleting the old ones,
+     * if the vectors have moved to other lists.
+     */
+    void export_changes(std::vector<entry_t>& entries,
+                        std::deque<std::vector<byte_t>>& buffers,
+                        std::size_t lists,
+                        std::size_t subspaces) noexcept(false) {
+        if (added_keys_.empty())
+            return;
+        if (!header_exists) {
+            header.lists = static_cast<std::uint32_t>(lists);
+            header.subspaces = static_cast<std::uint32_t>(subspaces);
+            header_exists = header_dirty_ = true;
+        }
+
+        // The last write of every key wins
+        std::unordered_map<ustore_key_t, std::size_t> latest;
+        for (std::size_t i = 0; i != added_keys_.size(); ++i)
+            latest[added_keys_[i]] = i;
+        std::vector<ustore_key_t> keys;
+        keys.reserve(latest.size());
+        for (auto const& [key, idx] : latest)
+            keys.push_back(key);
+        std::sort(keys.begin(), keys.end());
+        std::vector<real_t> vectors(keys.size() * dims());
+        for (std::size_t i = 0; i != keys.size(); ++i)
+            std::memcpy(&vectors[i * dims()], &added_vectors_[latest[keys[i]] * dims()], dims() * sizeof(real_t));
+
+        // Centroids never move after training, so the old lists of overwritten vectors follow from their originals
+        bool const had_codes = trained();
+        std::vector<std::size_t> old_lists(keys.size(), no_list_k);
+        std::size_t new_count = 0;
+        std::vector<real_t> original(dims());
+        auto find_old_list = [&](std::size_t i, bool present, value_view_t bytes) {
+            if (!present || bytes.size() != dims() * size_bytes(scalar_type())) {
+                new_count += !present;
+                return;
+            }
+            if (!had_codes)
+                return;
+            upcast(bytes.begin(), scalar_type(), dims(), original.data());
+            normalize(original.data());
+            old_lists[i] = closest_centroid(original.data(), centroids_.data(), header.lists, dims());
+        };
+        read_entries(db_,
+                     transaction_,
+                     options_,
+                     error_,
+                     collection_,
+                     &arena_,
+                     keys.data(),
+                     keys.size(),
+                     find_old_list);
+        if (*error_)
+            return;
+
+        // Smaller samples would leave some of the centroids and codewords without vectors
+        if (!had_codes) {
+            header.pending += new_count;
+            header_dirty_ = true;
+            if (header.pending >= training_size(header.lists)) {
+                std::vector<ustore_key_t> other_keys;
+                std::vector<real_t> other_vectors;
+                read_originals(keys, other_keys, other_vectors);
+                if (*error_)
+                    return;
+                keys.insert(keys.end(), other_keys.begin(), other_keys.end());
+                vectors.insert(vectors.end(), other_vectors.begin(), other_vectors.end());
+                old_lists.resize(keys.size(), no_list_k);
+
+                // Originals, removed without the index, aren't counted anymore
+                header.pending = keys.size();
+                if (keys.size() >= training_size(header.lists))
+                    train(vectors.data(), keys.size());
+            }
+            if (!trained()) {
+                export_header(entries, buffers);
+                return;
+            }
+        }
+
+        auto& codes = buffers.emplace_back(keys.size() * header.subspaces);
+        for (std::size_t i = 0; i != keys.size(); ++i) {
+            real_t const* vector = &vectors[i * dims()];
+            std::size_t list = closest_centroid(vector, centroids_.data(), header.lists, dims());
+            byte_t* code = codes.data() + i * header.subspaces;
+            encode(vector, list, reinterpret_cast<std::uint8_t*>(code));
+            if (old_lists[i] != no_list_k && old_lists[i] != list)
+                entries.push_back({{collection_, code_key(old_lists[i], keys[i])}, value_view_t {}});
+            entries.push_back({{collection_, code_key(list, keys[i])}, {code, std::size_t(header.subspaces)}});
+        }
+        export_header(entries, buffers);
+    }
+};
+
+/*********************************************************/
+/*****************	 Primary Functions	  ****************/
+/*********************************************************/
+
+/**
+ * @brief Number of attempts to index a batch in an internal transaction,
+ * before reporting a conflict with concurrent writers of the same collections.
+ */
+static constexpr std::size_t write_attempts_k = 16;
+/// Every next attempt waits longer, to let the conflicting writers finish
+static constexpr std::size_t write_backoff_us_k = 50;
+
+/**
+ * @brief Index writes into the same collection are serialized with these mutexes,
+ * when the engine doesn't support transactions.
+ */
+static constexpr std::size_t write_stripes_k = 64;
+static std::mutex write_stripes[write_stripes_k];
+
+inline std::size_t write_stripe(ustore_database_t db, ustore_collection_t collection) noexcept {
+    std::uint64_t hash = reinterpret_cast<std::uintptr_t>(db) ^ (collection * 0x9E3779B97F4A7C15ull);
+    return static_cast<std::size_t>((hash * 0xC2B2AE3D27D4EB4Full) >> 32) % write_stripes_k;
+}
+
+/**
+ * @brief Transactions, that failed to lock or to validate their entries,
+ * are reported with this message by the engines, that lock them.
+ */
+inline bool is_conflict(ustore_error_t error) noexcept {
+    return error && std::strstr(error, "Transaction Conflict");
+}
+
 void ustore_vectors_write(ustore_vectors_write_t* c_ptr) {
 
     ustore_vectors_write_t& c = *c_ptr;
     linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
     return_if_error_m(c.error);
+    if (!c.tasks_count)
+        return;
+    return_error_if_m(c.dimensions, c.error, args_wrong_k, "Zero-dimensional vectors!");
+    return_error_if_m(c.vectors_starts, c.error, args_wrong_k, "No vectors were provided!");
+    return_error_if_m(size_bytes(c.scalar_type), c.error, args_wrong_k, "Unsupported scalar type!");
 
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
@@ -167,111 +1334,173 @@ void ustore_vectors_write(ustore_vectors_write_t* c_ptr) {
     strided_iterator_gt<ustore_length_t const> offs {c.offsets, c.offsets_stride};
     vectors_arg_t vectors_args {starts, offs, c.vectors_stride, c.scalar_type, c.dimensions, c.tasks_count};
 
-    // For each input key we must get its
-    auto quantized_entries = arena.alloc<entry_t>(c.tasks_count * 2u, c.error);
-    return_if_error_m(c.error);
-
-    auto quantized_vectors = arena.alloc<quant_t>(c.tasks_count * c.dimensions, c.error);
-    return_if_error_m(c.error);
-
-    // Add the original entries
     for (std::size_t task_idx = 0; task_idx != c.tasks_count; ++task_idx) {
-        entry_t& entry = quantized_entries[task_idx];
-        entry.collection_key.collection = places_args[task_idx].collection;
-        entry.collection_key.key = places_args[task_idx].key;
-        entry.value = vectors_args[task_idx];
+        ustore_key_t key = places_args[task_idx].key;
+        return_error_if_m(key >= 0 && key != ustore_key_unknown_k, c.error, args_wrong_k, "Invalid vector key!");
     }
 
-    // Add the mirror tasks for quantized copies
-    for (std::size_t task_idx = 0; task_idx != c.tasks_count; ++task_idx) {
-        auto original_begin = vectors_args[task_idx].begin();
-        auto quantized_begin = quantized_vectors.begin() + task_idx * c.dimensions;
-        entry_t& entry = quantized_entries[c.tasks_count + task_idx];
-        entry.collection_key.collection = places_args[task_idx].collection;
-        entry.collection_key.key = -places_args[task_idx].key;
-        entry.value = value_view_t {(ustore_bytes_cptr_t)quantized_begin, c.dimensions};
-        quantize(original_begin, c.scalar_type, c.dimensions, quantized_begin);
-    }
-
-#if 0 // Future Complex Index Logic
-
-    // Search greedily for closest entries to the provided vectors.
-    ustore_length_t starting_samples_limit = 128;
-    std::size_t max_search_rounds = 10;
-    std::size_t max_neighbors = 4;
-
-    // First, we need to random sample some starting points.
-    ustore_length_t* starting_samples_offsets = NULL;
-    ustore_length_t* starting_samples_counts = NULL;
-    ustore_key_t* starting_samples_keys = NULL;
-    ustore_sample_t sample {};
-    sample.db = c.db;
-    sample.error = c.error;
-    sample.transaction = c.transaction;
-    sample.arena = c.arena;
-    sample.options = c.options;
-    sample.collections = &first.collection_key.collection;
-    sample.collections_stride = sizeof(entry_t);
-    sample.count_limits = &starting_samples_limit;
-    sample.count_limits_stride = 0;
-    sample.offsets = &starting_samples_offsets;
-    sample.counts = &starting_samples_counts;
-    sample.keys = &starting_samples_keys;
-    ustore_sample(&sample);
-    return_if_error_m(c.error);
+    auto expansion = c.expansion_add ? c.expansion_add : expansion_add_default_k;
+    auto connectivity = std::max<ustore_length_t>(c.connectivity ? c.connectivity : connectivity_default_k, 2);
+    auto lists = c.lists ? c.lists : lists_default_k;
+    return_error_if_m(c.index != ustore_vector_index_ivfpq_k || lists <= lists_max_k,
+                      c.error,
+                      args_wrong_k,
+                      "Too many inverted lists!");
+    auto subspaces = c.subspaces;
+    for (ustore_length_t subspace_dims : {8u, 4u, 2u, 1u})
+        if (!subspaces && c.dimensions % subspace_dims == 0)
+            subspaces = c.dimensions / subspace_dims;
+    return_error_if_m(c.dimensions % subspaces == 0,
+                      c.error,
+                      args_wrong_k,
+                      "Dimensions must be divisible by the number of subspaces!");
 
-    // Allocate two priority queues per request.
-    // One will be used for top candidates, the other one for top results.
-    std::size_t bytes_per_queue = pq_t::implicit_memory_usage(max_neighbors);
-    std::size_t bytes_for_queues = c.tasks_count * 2ul * bytes_per_queue;
-    auto buffer_for_queues = arena.alloc<byte_t>(bytes_for_queues, c.error);
-    for (std::size_t task_idx = 0; task_idx != c.tasks_count; ++task_idx) {
-        implicit_init(buffer_for_queues + bytes_per_queue * (task_idx * 2ul), max_neighbors);
-        implicit_init(buffer_for_queues + bytes_per_queue * (task_idx * 2ul + 1ul), max_neighbors);
-    }
-
-    // First organize connections between the vectors in
-    // the current batch mapping into the same space.
-    // ! This is a quadratic complexity step.
-    for (std::size_t a_idx = 0; a_idx != c.tasks_count; ++a_idx) {
-        auto a_place = places_args[a_idx];
-        auto a_quants = quantized_vectors.begin() + a_idx * c.dimensions;
-        for (std::size_t b_idx = 0; b_idx != c.tasks_count; ++b_idx) {
-            auto b_place = places_args[b_idx];
-            auto b_quants = quantized_vectors.begin() + b_idx * c.dimensions;
-            if (a_place.collection != b_place.collection)
-                continue;
+    // Loads the indexes of the touched collections, updates them in memory and submits
+    // the changed entries together with the original vectors in a single batch
+    auto index_and_write = [&](ustore_transaction_t transaction,
+                               ustore_options_t read_options,
+                               ustore_options_t write_options) {
+        std::vector<std::unique_ptr<graph_t>> graphs;
+        std::vector<std::unique_ptr<ivfpq_t>> inverted;
+        std::vector<entry_t> entries;
+        std::deque<std::vector<byte_t>> buffers;
+        std::vector<real_t> float_vector(c.dimensions);
+        std::vector<quant_t> quantized_vector(c.dimensions);
+        entries.reserve(c.tasks_count);
+
+        for (std::size_t task_idx = 0; task_idx != c.tasks_count; ++task_idx) {
+            place_t place = places_args[task_idx];
+            graph_t& graph = find_index(graphs, c.db, transaction, read_options, c.error, place.collection);
+            return_if_error_m(c.error);
+
+            if (!graph.header_exists) {
+                graph.header.dimensions = c.dimensions;
+                graph.header.connectivity = c.index == ustore_vector_index_ivfpq_k ? 0 : connectivity;
+                graph.header.metric = static_cast<std::uint16_t>(c.metric);
+                graph.header.scalar_type = static_cast<std::uint16_t>(c.scalar_type);
+                graph.header_exists = graph.header_dirty = true;
+            }
+            return_error_if_m(graph.header.dimensions == c.dimensions,
+                              c.error,
+                              args_wrong_k,
+                              "Dimensions differ from the ones in the collection!");
+            return_error_if_m(graph.header.scalar_type == c.scalar_type,
+                              c.error,
+                              args_wrong_k,
+                              "Scalar type differs from the one in the collection!");
 
-            match_t match;
-            match.key = key;
-            match.metric = metric(a_quants, b_quants, c.dimensions, c.metric);
-            pq.push(match);
+            value_view_t original = vectors_args[task_idx];
+            upcast(original.begin(), c.scalar_type, c.dimensions, float_vector.data());
+            if (graph.is_inverted()) {
+                return_error_if_m(place.key <= code_key_max_k,
+                                  c.error,
+                                  args_wrong_k,
+                                  "Keys of IVF-PQ collections must fit into 47 bits!");
+                auto& index =
+                    find_index(inverted, c.db, transaction, read_options, c.error, place.collection, graph.header);
+                return_if_error_m(c.error);
+                index.add(place.key, float_vector.data());
+            }
+            else {
+                real_t scale = quantize(float_vector.data(), c.dimensions, quantized_vector.data());
+                graph.insert(place.key, quantized_t {quantized_vector.data(), scale}, expansion);
+                return_if_error_m(c.error);
+            }
+            entries.push_back({{place.collection, place.key}, original});
         }
+
+        // Codes are exported once per batch, reading the originals before they are overwritten
+        for (auto& index : inverted) {
+            index->export_changes(entries, buffers, lists, subspaces);
+            return_if_error_m(c.error);
+        }
+        for (auto& graph : graphs)
+            graph->export_changes(entries, buffers);
+
+        // Submit both original vectors and modified graph nodes
+        entry_t& first = entries[0];
+        ustore_write_t write {};
+        write.db = c.db;
+        write.error = c.error;
+        write.transaction = transaction;
+        write.arena = c.arena;
+        write.options = write_options;
+        write.tasks_count = entries.size();
+        write.collections = &first.collection_key.collection;
+        write.collections_stride = sizeof(entry_t);
+        write.keys = &first.collection_key.key;
+        write.keys_stride = sizeof(entry_t);
+        write.lengths = first.value.member_length();
+        write.lengths_stride = sizeof(entry_t);
+        write.values = first.value.member_ptr();
+        write.values_stride = sizeof(entry_t);
+        ustore_write(&write);
+    };
+
+    // The caller's transaction watches the graph header, the neighbors of new nodes
+    // and the inverted lists, so concurrent index changes fail its commit
+    if (c.transaction) {
+        auto read_options = ustore_options_t(c.options & ustore_option_transaction_dont_watch_k);
+        safe_section("Indexing vectors", c.error, [&] { index_and_write(c.transaction, read_options, c.options); });
+        return;
     }
 
-    // Greedily search for multiple rounds.
-
-    // Introduce bidirectional links.
-#endif
-
-    // Submit both original and quantized entries
-    entry_t& first = quantized_entries[0];
-    ustore_write_t write {};
-    write.db = c.db;
-    write.error = c.error;
-    write.transaction = c.transaction;
-    write.arena = c.arena;
-    write.options = c.options;
-    write.tasks_count = c.tasks_count * 2u;
-    write.collections = &first.collection_key.collection;
-    write.collections_stride = sizeof(entry_t);
-    write.keys = &first.collection_key.key;
-    write.keys_stride = sizeof(entry_t);
-    write.lengths = first.value.member_length();
-    write.lengths_stride = sizeof(entry_t);
-    write.values = first.value.member_ptr();
-    write.values_stride = sizeof(entry_t);
-    ustore_write(&write);
+    // Without transactions, concurrent writers of the same collection take turns
+    if (!ustore_supports_transactions_k) {
+        std::vector<std::size_t> stripes(c.tasks_count);
+        for (std::size_t task_idx = 0; task_idx != c.tasks_count; ++task_idx)
+            stripes[task_idx] = write_stripe(c.db, places_args[task_idx].collection);
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+        for (std::size_t stripe : stripes)
+            write_stripes[stripe].lock();
+        safe_section("Indexing vectors", c.error, [&] {
+            index_and_write(nullptr, ustore_options_default_k, c.options);
+        });
+        for (std::size_t stripe : stripes)
+            write_stripes[stripe].unlock();
+        return;
+    }
+
+    // Otherwise, the read-modify-write of the index is isolated in an internal transaction,
+    // retried from scratch, if a concurrent writer has changed the same entries
+    ustore_transaction_t transaction = nullptr;
+    auto write_options = ustore_options_t(c.options & ustore_option_dont_discard_memory_k);
+    auto commit_options = ustore_options_t(c.options & ustore_option_write_flush_k);
+    for (std::size_t attempt = 0; attempt != write_attempts_k; ++attempt) {
+        if (attempt) {
+            ustore_error_free(*c.error);
+            *c.error = nullptr;
+            std::this_thread::sleep_for(std::chrono::microseconds(attempt * write_backoff_us_k));
+        }
+
+        ustore_transaction_init_t txn_init {};
+        txn_init.db = c.db;
+        txn_init.error = c.error;
+        txn_init.transaction = &transaction;
+        ustore_transaction_init(&txn_init);
+        if (*c.error)
+            break;
+
+        safe_section("Indexing vectors", c.error, [&] {
+            index_and_write(transaction, ustore_options_default_k, write_options);
+        });
+        if (*c.error) {
+            if (is_conflict(*c.error))
+                continue;
+            break;
+        }
+
+        ustore_transaction_commit_t txn_commit {};
+        txn_commit.db = c.db;
+        txn_commit.error = c.error;
+        txn_commit.transaction = transaction;
+        txn_commit.options = commit_options;
+        ustore_transaction_commit(&txn_commit);
+        if (!*c.error)
+            break;
+    }
+    ustore_transaction_free(transaction);
 }
 
 void ustore_vectors_read(ustore_vectors_read_t* c_ptr) {
@@ -313,6 +1542,8 @@ void ustore_vectors_search(ustore_vectors_search_t* c_ptr) {
     ustore_vectors_search_t const& c = *c_ptr;
     linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
     return_if_error_m(c.error);
+    return_error_if_m(c.dimensions, c.error, args_wrong_k, "Zero-dimensional vectors!");
+    return_error_if_m(size_bytes(c.scalar_type), c.error, args_wrong_k, "Unsupported scalar type!");
 
     strided_iterator_gt<ustore_bytes_cptr_t const> starts {c.queries_starts, c.queries_starts_stride};
     strided_iterator_gt<ustore_length_t const> offs {c.queries_offsets, c.queries_offsets_stride};
@@ -322,9 +1553,7 @@ void ustore_vectors_search(ustore_vectors_search_t* c_ptr) {
     strided_range_gt<ustore_length_t const> count_limits {{c.match_counts_limits, c.match_counts_limits_stride},
                                                        c.tasks_count};
 
-    auto count_limits_max = ustore_length_t {0};
-    auto count_limits_sum = transform_reduce_n(count_limits.begin(), c.tasks_count, 0ul, [&](ustore_length_t l) {
-        count_limits_max = std::max(count_limits_max, l);
+    auto count_limits_sum = transform_reduce_n(count_limits.begin(), c.tasks_count, 0ul, [](ustore_length_t l) {
         return l;
     });
 
@@ -337,45 +1566,120 @@ void ustore_vectors_search(ustore_vectors_search_t* c_ptr) {
     auto found_metrics = arena.alloc_or_dummy(count_limits_sum, c.error, c.match_metrics);
     return_if_error_m(c.error);
 
-    auto temp_matches = arena.alloc<match_t>(count_limits_max, c.error);
-    return_if_error_m(c.error);
     auto quant_query = arena.alloc<quant_t>(c.dimensions, c.error);
     return_if_error_m(c.error);
+    auto float_queries = arena.alloc<real_t>(c.tasks_count * c.dimensions, c.error);
+    return_if_error_m(c.error);
 
-    ustore_length_t total_exported_matches = 0;
-    for (std::size_t i = 0; i != c.tasks_count && !*c.error; ++i) {
-        auto col = collections ? collections[i] : ustore_collection_main_k;
-        auto query = queries_args[i];
-        auto limit = count_limits[i];
-        quantize(query.begin(), c.scalar_type, c.dimensions, quant_query.begin());
+    auto read_options = ustore_options_t(c.options & ustore_option_transaction_dont_watch_k);
+    auto expansion = c.expansion_search ? c.expansion_search : expansion_search_default_k;
+    auto probes = c.probes ? c.probes : probes_default_k;
+    auto collection_of = [&](std::size_t i) {
+        return collections ? collections[i] : ustore_collection_main_k;
+    };
 
-        pq_t pq {temp_matches.begin(), temp_matches.begin() + limit};
+    safe_section("Searching vectors", c.error, [&] {
+        std::vector<std::unique_ptr<graph_t>> graphs;
+        std::vector<std::unique_ptr<ivfpq_t>> inverted;
+        std::vector<std::vector<candidate_t>> closest(c.tasks_count);
+        std::vector<std::size_t> exhaustive_tasks;
 
-        auto callback = [&](ustore_key_t key, value_view_t vector) noexcept {
-            if (key >= 0)
-                return false;
-            match_t match;
-            match.key = key;
-            match.metric = metric(quant_query.begin(), (quant_t const*)vector.data(), c.dimensions, c.metric);
-            if (match.metric < c.metric_threshold)
-                return true;
+        for (std::size_t i = 0; i != c.tasks_count; ++i) {
+            auto col = collection_of(i);
+            auto query = queries_args[i];
+            real_t* float_query = float_queries.begin() + i * c.dimensions;
+            upcast(query.begin(), c.scalar_type, c.dimensions, float_query);
 
-            pq.push(match);
-            return true;
-        };
+            graph_t& graph = find_index(graphs, c.db, c.transaction, read_options, c.error, col);
+            return_if_error_m(c.error);
+            return_error_if_m(!graph.header_exists || graph.header.dimensions == c.dimensions,
+                              c.error,
+                              args_wrong_k,
+                              "Dimensions differ from the ones in the collection!");
 
-        auto min_key = std::numeric_limits<ustore_key_t>::min();
-        full_scan_collection(c.db, c.transaction, col, c.options, min_key, limit, arena, c.error, callback);
-        auto count = pq.size();
+            // The index only helps, if it was constructed with the same metric,
+            // otherwise the queries are postponed to share the scans of their collections
+            auto breadth = std::max<std::size_t>(expansion, count_limits[i]);
+            if (graph.is_inverted() && graph.header.metric == c.metric) {
+                auto& index = find_index(inverted, c.db, c.transaction, read_options, c.error, col, graph.header);
+                return_if_error_m(c.error);
+                if (!index.trained()) {
+                    exhaustive_tasks.push_back(i);
+                    continue;
+                }
+                closest[i] = index.search(float_query, probes, breadth);
+                return_if_error_m(c.error);
+            }
+            else if (graph.header_exists && graph.header.metric == c.metric) {
+                if (graph.cached_nodes() > cached_nodes_max_k)
+                    graph.clear_cache();
+                real_t scale = quantize(float_query, c.dimensions, quant_query.begin());
+                closest[i] = graph.search({quant_query.begin(), scale}, breadth);
+                return_if_error_m(c.error);
+            }
+            // Collections without a header were written before the index existed,
+            // so their originals are assumed to have the scalar type of the queries
+            else
+                exhaustive_tasks.push_back(i);
+        }
 
-        found_counts[i] = count;
-        found_offsets[i] = total_exported_matches;
+        // Scan every collection once for all the postponed queries targeting it
+        std::stable_sort(exhaustive_tasks.begin(), exhaustive_tasks.end(), [&](std::size_t a, std::size_t b) {
+            return collection_of(a) < collection_of(b);
+        });
+        std::vector<real_t> group_queries;
+        std::vector<std::size_t> group_limits;
+        for (auto group_begin = exhaustive_tasks.begin(); group_begin != exhaustive_tasks.end();) {
+            auto col = collection_of(*group_begin);
+            auto group_end = std::find_if(group_begin, exhaustive_tasks.end(), [&](std::size_t i) {
+                return collection_of(i) != col;
+            });
 
-        for (std::size_t j = 0; j != count; ++j)
-            found_keys[total_exported_matches + j] = std::abs(temp_matches[j].key), //
-                found_metrics[total_exported_matches + j] = temp_matches[j].metric;
+            group_queries.clear();
+            group_limits.clear();
+            for (auto it = group_begin; it != group_end; ++it) {
+                real_t const* float_query = float_queries.begin() + *it * c.dimensions;
+                group_queries.insert(group_queries.end(), float_query, float_query + c.dimensions);
+                group_limits.push_back(count_limits[*it]);
+            }
 
-        total_exported_matches += count;
-        pq.clear();
-    }
-}
\ No newline at end of file
+            graph_t& graph = find_index(graphs, c.db, c.transaction, read_options, c.error, col);
+            auto scalar_type = graph.header_exists ? static_cast<ustore_vector_scalar_t>(graph.header.scalar_type)
+                                                   : c.scalar_type;
+            auto group_closest = search_exhaustively(c.db,
+                                                     c.transaction,
+                                                     col,
+                                                     c.options,
+                                                     group_queries.data(),
+                                                     group_limits.data(),
+                                                     group_limits.size(),
+                                                     c.dimensions,
+                                                     scalar_type,
+                                                     c.metric,
+                                                     arena,
+                                                     c.error);
+            return_if_error_m(c.error);
+            for (auto it = group_begin; it != group_end; ++it)
+                closest[*it] = std::move(group_closest[it - group_begin]);
+            group_begin = group_end;
+        }
+
+        ustore_length_t total_exported_matches = 0;
+        for (std::size_t i = 0; i != c.tasks_count; ++i) {
+            auto limit = count_limits[i];
+            ustore_length_t count = 0;
+            for (std::size_t j = 0; j != closest[i].size() && count != limit; ++j) {
+                auto metric = metric_from_distance(closest[i][j].distance, c.metric);
+                if (metric < c.metric_threshold)
+                    continue;
+                found_keys[total_exported_matches + count] = closest[i][j].key;
+                found_metrics[total_exported_matches + count] = metric;
+                ++count;
+            }
+
+            found_counts[i] = count;
+            found_offsets[i] = total_exported_matches;
+            total_exported_matches += count;
+        }
+    });
+}
@@ -601,11 +601,12 @@ void fields_parser( //
 
 void upsert_docs(ustore_docs_import_t& c, docs_t& docs, ustore_size_t task_count) {
 
+    // Imports load large batches at once, bypassing the memtables where possible
     ustore_docs_write_t docs_write {
         .db = c.db,
         .error = c.error,
         .arena = c.arena,
-        .options = ustore_option_dont_discard_memory_k,
+        .options = ustore_options_t(ustore_option_dont_discard_memory_k | ustore_option_write_bulk_k),
         .tasks_count = task_count,
         .type = ustore_doc_field_json_k,
         .modification = ustore_doc_modify_upsert_k,
@@ -0,0 +1,30 @@
+/**
+ * @file rocksdb_migrate.cpp
+ * @author Ashot Vardanian
+ *
+ * @brief Command-line entry point of the migration from @see "rocksdb_migrate.hpp".
+ *
+ * Usage: ustore_rocksdb_migrate <source_directory> <target_directory>
+ * Once finished, the target directory can replace the source one.
+ */
+#include <cstdio> // `std::fprintf`
+
+#include "rocksdb_migrate.hpp"
+
+using namespace unum::ustore;
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "Usage: %s <source_directory> <target_directory>\n", argv[0]);
+        return 1;
+    }
+
+    auto report = [](std::string const& name, std::size_t migrated) {
+        std::printf("Migrated %zu entries of collection: %s\n", migrated, name.c_str());
+    };
+    rocksdb::Status status = migrate_rocksdb(argv[1], argv[2], report);
+    if (status.ok())
+        return 0;
+    std::fprintf(stderr, "%s\n", status.ToString().c_str());
+    return 1;
+}
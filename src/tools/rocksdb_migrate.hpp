@@ -0,0 +1,157 @@
+/**
+ * @file rocksdb_migrate.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Rewrites a RocksDB-backed UStore, created with the native-endian "i64" comparator,
+ * into a new directory, where keys are big-endian and ordered by the default bytewise comparator.
+ * Every collection (Column Family) is copied with its name and all of its values.
+ * The source is opened read-only, and the target must not contain a DB yet.
+ */
+#pragma once
+#include <memory>     // `std::unique_ptr`
+#include <string>     // `std::string`
+#include <vector>     // `std::vector`
+#include <filesystem> // `std::filesystem::exists`
+
+#include <rocksdb/db.h>
+
+#include "ustore/db.h"
+#include "../helpers/key_encoding.hpp" // `ordered_key_encoding_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief The comparator of older databases, needed to open them.
+ */
+struct legacy_key_comparator_t final : public rocksdb::Comparator {
+    inline int Compare(rocksdb::Slice const& a, rocksdb::Slice const& b) const override {
+        auto ai = native_key_encoding_t::decode(a.data());
+        auto bi = native_key_encoding_t::decode(b.data());
+        if (ai == bi)
+            return 0;
+        return ai < bi ? -1 : 1;
+    }
+    const char* Name() const override { return "i64"; }
+    void FindShortestSeparator(std::string*, rocksdb::Slice const&) const override {}
+    void FindShortSuccessor(std::string*) const override {}
+    bool CanKeysWithDifferentByteContentsBeEqual() const override { return false; }
+};
+
+inline rocksdb::Comparator const* legacy_key_comparator() noexcept {
+    static legacy_key_comparator_t comparator;
+    return &comparator;
+}
+
+/// Entries are committed in batches of this many bytes
+static constexpr std::size_t migration_batch_bytes_k = 64ul * 1024ul * 1024ul;
+
+/**
+ * @brief Copies every collection of the legacy DB at @p source_path into a new DB at @p target_path.
+ * @param on_collection Called with the name of every copied collection and the number of its entries.
+ * @return The first failure, prefixed with the step, that failed.
+ */
+template <typename on_collection_at>
+rocksdb::Status migrate_rocksdb(std::string const& source_path,
+                                std::string const& target_path,
+                                on_collection_at&& on_collection) noexcept(false) {
+    namespace stdfs = std::filesystem;
+    if (stdfs::exists(stdfs::path(target_path) / "CURRENT"))
+        return rocksdb::Status::InvalidArgument("Target directory already contains a DB", target_path);
+    auto failed = [](char const* what, rocksdb::Status const& status) {
+        return rocksdb::Status::Aborted(what, status.ToString());
+    };
+
+    // Open the source with the legacy comparator in every Column Family
+    rocksdb::Options source_options;
+    source_options.comparator = legacy_key_comparator();
+    std::vector<std::string> names;
+    rocksdb::Status status = rocksdb::DB::ListColumnFamilies(source_options, source_path, &names);
+    if (!status.ok())
+        return failed("Listing collections", status);
+
+    std::vector<rocksdb::ColumnFamilyDescriptor> source_descriptors;
+    for (auto const& name : names) {
+        rocksdb::ColumnFamilyOptions cf_options;
+        cf_options.comparator = legacy_key_comparator();
+        source_descriptors.push_back({name, cf_options});
+    }
+    rocksdb::DB* source_ptr = nullptr;
+    std::vector<rocksdb::ColumnFamilyHandle*> source_columns;
+    status = rocksdb::DB::OpenForReadOnly( //
+        source_options,
+        source_path,
+        source_descriptors,
+        &source_columns,
+        &source_ptr);
+    if (!status.ok())
+        return failed("Opening the source DB", status);
+    std::unique_ptr<rocksdb::DB> source {source_ptr};
+
+    // The target gets the same Column Families with the default bytewise comparator
+    rocksdb::Options target_options;
+    target_options.create_if_missing = true;
+    target_options.create_missing_column_families = true;
+    target_options.compression = rocksdb::kNoCompression;
+    std::vector<rocksdb::ColumnFamilyDescriptor> target_descriptors;
+    for (auto const& name : names) {
+        rocksdb::ColumnFamilyOptions cf_options;
+        cf_options.compression = rocksdb::kNoCompression;
+        target_descriptors.push_back({name, cf_options});
+    }
+    rocksdb::DB* target_ptr = nullptr;
+    std::vector<rocksdb::ColumnFamilyHandle*> target_columns;
+    status = rocksdb::DB::Open(target_options, target_path, target_descriptors, &target_columns, &target_ptr);
+    if (!status.ok()) {
+        for (auto column : source_columns)
+            source->DestroyColumnFamilyHandle(column);
+        return failed("Creating the target DB", status);
+    }
+    std::unique_ptr<rocksdb::DB> target {target_ptr};
+
+    // The copy is synced with a flush, once it is complete
+    rocksdb::WriteOptions write_options;
+    write_options.disableWAL = true;
+    rocksdb::ReadOptions read_options;
+    read_options.fill_cache = false;
+    read_options.total_order_seek = true;
+
+    for (std::size_t i = 0; i != names.size() && status.ok(); ++i) {
+        std::size_t migrated = 0;
+        rocksdb::WriteBatch batch;
+        std::unique_ptr<rocksdb::Iterator> it {source->NewIterator(read_options, source_columns[i])};
+        for (it->SeekToFirst(); it->Valid() && status.ok(); it->Next()) {
+            rocksdb::Slice key = it->key();
+            if (key.size() != sizeof(ustore_key_t)) {
+                status = rocksdb::Status::Corruption("Unexpected key length in collection", names[i]);
+                break;
+            }
+            encoded_key_gt<ordered_key_encoding_t> key_bytes {native_key_encoding_t::decode(key.data())};
+            status = batch.Put(target_columns[i], {key_bytes.bytes, sizeof(key_bytes.bytes)}, it->value());
+            if (!status.ok())
+                status = failed("Staging an entry", status);
+            ++migrated;
+            if (status.ok() && batch.GetDataSize() >= migration_batch_bytes_k) {
+                status = target->Write(write_options, &batch);
+                if (!status.ok())
+                    status = failed("Writing a batch", status);
+                batch.Clear();
+            }
+        }
+        if (status.ok() && !(status = it->status()).ok())
+            status = failed("Iterating the source DB", status);
+        if (status.ok() && !(status = target->Write(write_options, &batch)).ok())
+            status = failed("Writing a batch", status);
+        if (status.ok() && !(status = target->Flush(rocksdb::FlushOptions(), target_columns[i])).ok())
+            status = failed("Flushing the target DB", status);
+        if (status.ok())
+            on_collection(names[i], migrated);
+    }
+
+    for (auto column : target_columns)
+        target->DestroyColumnFamilyHandle(column);
+    for (auto column : source_columns)
+        source->DestroyColumnFamilyHandle(column);
+    return status;
+}
+
+} // namespace unum::ustore
@@ -12,7 +12,9 @@
 #include <fstream>
 #include <iostream>
 #include <unistd.h>
+#include <sys/wait.h>
 #include <thread>
+#include <random>
 #include <mutex>
 #include <shared_mutex>
 
@@ -24,6 +26,11 @@
 
 #include <ustore/arrow.h>
 #include "ustore/ustore.hpp"
+#include "slab_allocator.hpp" // `slab_allocator_t`
+#include "simd.hpp"           // `simd_kernels_t`
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+#include "rocksdb_migrate.hpp" // `migrate_rocksdb`
+#endif
 
 using namespace unum::ustore;
 using namespace unum;
@@ -404,6 +411,164 @@ TEST(db, persistency) {
     }
 }
 
+/**
+ * Populates the main collection with flushed writes and terminates
+ * the process without closing the DBMS. Writes must survive the restart.
+ */
+TEST(db, persistency_without_closing) {
+
+    if (!path())
+        return;
+
+    clear_environment();
+    triplet_t triplet;
+    pid_t child_id = fork();
+    if (child_id == 0) {
+        database_t db;
+        if (!db.open(config().c_str()))
+            _exit(1);
+        blobs_collection_t main_collection = db.main();
+        auto main_collection_ref = main_collection[triplet.keys];
+        bool assigned = main_collection_ref.assign(triplet.contents(), true);
+        _exit(assigned ? 0 : 1);
+    }
+
+    int child_status = 0;
+    EXPECT_EQ(waitpid(child_id, &child_status, 0), child_id);
+    EXPECT_TRUE(WIFEXITED(child_status));
+    EXPECT_EQ(WEXITSTATUS(child_status), 0);
+
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t main_collection = db.main();
+    auto main_collection_ref = main_collection[triplet.keys];
+    check_equalities(main_collection_ref, triplet);
+    EXPECT_EQ(main_collection.keys().size(), 3ul);
+}
+
+/**
+ * Flushed writes from many threads, sharing the syncs of the log,
+ * followed by a process termination. Every acknowledged write must survive.
+ */
+TEST(db, persistency_of_concurrent_flushes) {
+
+    if (!path())
+        return;
+
+    clear_environment();
+    constexpr std::size_t threads_count = 8;
+    constexpr std::size_t writes_per_thread = 256;
+    pid_t child_id = fork();
+    if (child_id == 0) {
+        database_t db;
+        if (!db.open(config().c_str()))
+            _exit(1);
+        blobs_collection_t collection = db.main();
+        std::atomic<bool> failed = false;
+        std::vector<std::thread> threads;
+        for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+            threads.emplace_back([&, thread_idx] {
+                arena_t arena(db);
+                for (std::size_t write_idx = 0; write_idx != writes_per_thread; ++write_idx) {
+                    ustore_key_t key = static_cast<ustore_key_t>(thread_idx * writes_per_thread + write_idx);
+                    value_view_t value {reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key)};
+                    if (!collection[key].on(arena).assign(value, true))
+                        failed = true;
+                }
+            });
+        for (auto& thread : threads)
+            thread.join();
+        _exit(failed ? 1 : 0);
+    }
+
+    int child_status = 0;
+    EXPECT_EQ(waitpid(child_id, &child_status, 0), child_id);
+    EXPECT_TRUE(WIFEXITED(child_status));
+    EXPECT_EQ(WEXITSTATUS(child_status), 0);
+
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+    EXPECT_EQ(collection.keys().size(), threads_count * writes_per_thread);
+    for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(threads_count * writes_per_thread); ++key) {
+        auto value = collection[key].value();
+        EXPECT_TRUE(value);
+        EXPECT_EQ(*value, value_view_t(reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key)));
+    }
+}
+
+/**
+ * Saves a collection, large enough to be split into several Parquet files,
+ * named "<name>.parquet" and "<name>.parquet.<part>", and loads it back.
+ */
+TEST(db, persistency_of_parts) {
+
+#if defined(USTORE_ENGINE_IS_UCSET)
+    if (!path())
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    // Every part holds roughly a million entries
+    constexpr std::size_t keys_size = 2'500'000;
+    constexpr std::size_t batch_size = 64 * 1024;
+    std::vector<ustore_key_t> keys(keys_size);
+    std::vector<ustore_length_t> offsets(keys_size);
+    std::iota(keys.begin(), keys.end(), 0);
+    for (std::size_t key_idx = 0; key_idx != keys_size; ++key_idx)
+        offsets[key_idx] = static_cast<ustore_length_t>(key_idx * sizeof(ustore_key_t));
+    ustore_length_t const length = sizeof(ustore_key_t);
+    auto values = reinterpret_cast<ustore_bytes_cptr_t>(keys.data());
+    {
+        blobs_collection_t collection = *db.create("parts");
+        arena_t arena(db);
+        status_t status;
+        for (std::size_t first = 0; first < keys_size; first += batch_size) {
+            ustore_write_t write {};
+            write.db = db;
+            write.arena = arena.member_ptr();
+            write.error = status.member_ptr();
+            write.tasks_count = std::min(batch_size, keys_size - first);
+            write.collections = collection.member_ptr();
+            write.keys = keys.data() + first;
+            write.keys_stride = sizeof(ustore_key_t);
+            write.offsets = offsets.data() + first;
+            write.offsets_stride = sizeof(ustore_length_t);
+            write.lengths = &length;
+            write.values = &values;
+            ustore_write(&write);
+            EXPECT_TRUE(status);
+        }
+    }
+    db.close();
+
+    namespace stdfs = std::filesystem;
+    EXPECT_TRUE(stdfs::exists(stdfs::path(path()) / "parts.parquet"));
+    EXPECT_TRUE(stdfs::exists(stdfs::path(path()) / "parts.parquet.1"));
+    EXPECT_TRUE(stdfs::exists(stdfs::path(path()) / "parts.parquet.2"));
+
+    EXPECT_TRUE(db.open(config().c_str()));
+    EXPECT_TRUE(*db.contains("parts"));
+    blobs_collection_t collection = *db["parts"];
+    EXPECT_EQ(collection.keys().size(), keys_size);
+
+    keys_stream_t stream(db, collection, batch_size);
+    EXPECT_TRUE(stream.seek_to_first());
+    ustore_key_t expected_key = 0;
+    for (; !stream.is_end(); ++stream, ++expected_key)
+        EXPECT_EQ(stream.key(), expected_key);
+    EXPECT_EQ(expected_key, static_cast<ustore_key_t>(keys_size));
+
+    for (ustore_key_t key : {ustore_key_t(0), ustore_key_t(keys_size / 2), ustore_key_t(keys_size - 1)}) {
+        auto value = collection[key].value();
+        EXPECT_TRUE(value);
+        EXPECT_EQ(*value, value_view_t(reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key)));
+    }
+#endif
+}
+
 /**
  * Creates news collections under unique names.
  * Tests collection lookup by name, dropping/clearing existing collections.
@@ -591,6 +756,168 @@ TEST(db, scan) {
     EXPECT_EQ(key, keys_size);
 }
 
+/**
+ * Scans keys together with their values, pulled from the same iterator positions.
+ */
+TEST(db, scan_with_values) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    constexpr std::size_t keys_size = 1000;
+    for (ustore_key_t key = 0; key != keys_size; ++key)
+        EXPECT_TRUE(collection[key].assign(std::to_string(key).c_str()));
+    pairs_stream_t stream(db, collection, 256);
+
+    EXPECT_TRUE(stream.seek_to_first());
+    ustore_key_t key = 0;
+    while (!stream.is_end()) {
+        EXPECT_EQ(stream.key(), key);
+        EXPECT_EQ(stream.value(), value_view_t(std::to_string(key).c_str()));
+        ++stream;
+        ++key;
+    }
+    EXPECT_EQ(key, keys_size);
+}
+
+/**
+ * Large shuffled import with the bulk option, where some keys are later
+ * overwritten or removed within the same batch, and the last entry must win.
+ */
+TEST(db, bulk_write) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    constexpr std::size_t keys_size = 4096;
+    std::vector<ustore_key_t> keys(keys_size);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+    std::vector<std::string> strings(keys_size);
+    for (ustore_key_t key = 0; key != keys_size; ++key)
+        strings[key] = std::to_string(key);
+    std::string const updated = "updated";
+
+    std::vector<ustore_bytes_cptr_t> values;
+    std::vector<ustore_length_t> lengths;
+    for (ustore_key_t key : keys) {
+        values.push_back(reinterpret_cast<ustore_bytes_cptr_t>(strings[key].data()));
+        lengths.push_back(static_cast<ustore_length_t>(strings[key].size()));
+    }
+    for (ustore_key_t key = 0; key < static_cast<ustore_key_t>(keys_size); key += 3) {
+        keys.push_back(key);
+        values.push_back(key % 2 ? nullptr : reinterpret_cast<ustore_bytes_cptr_t>(updated.data()));
+        lengths.push_back(key % 2 ? 0 : static_cast<ustore_length_t>(updated.size()));
+    }
+
+    status_t status;
+    arena_t arena(db);
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.options = ustore_option_write_bulk_k;
+    write.tasks_count = keys.size();
+    write.keys = keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.lengths = lengths.data();
+    write.lengths_stride = sizeof(ustore_length_t);
+    write.values = values.data();
+    write.values_stride = sizeof(ustore_bytes_cptr_t);
+    ustore_write(&write);
+    EXPECT_TRUE(status);
+
+    auto check_values = [&](blobs_collection_t& collection) {
+        for (ustore_key_t key = 0; key != keys_size; ++key) {
+            auto value = collection[key].value();
+            EXPECT_TRUE(value);
+            if (key % 3)
+                EXPECT_EQ(*value, value_view_t(strings[key].c_str()));
+            else if (key % 2)
+                EXPECT_FALSE(*value);
+            else
+                EXPECT_EQ(*value, value_view_t(updated.c_str()));
+        }
+    };
+    check_values(collection);
+
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    // Ingested files are moved out of the staging directory, and the leftovers
+    // of interrupted imports are removed on the next opening
+    if (!path())
+        return;
+    namespace stdfs = std::filesystem;
+    auto staging = stdfs::path(path()) / "bulk";
+    EXPECT_TRUE(stdfs::is_empty(staging));
+    std::ofstream(staging / "0_0_0.sst") << "interrupted";
+    db.close();
+    EXPECT_TRUE(db.open(config().c_str()));
+    EXPECT_TRUE(stdfs::is_empty(staging));
+
+    // Imports after reopening never collide with the names of earlier ones
+    blobs_collection_t reopened = db.main();
+    write.db = db;
+    ustore_write(&write);
+    EXPECT_TRUE(status);
+    check_values(reopened);
+    EXPECT_TRUE(stdfs::is_empty(staging));
+#endif
+}
+
+/**
+ * Flushed writes from many threads, completed with callbacks.
+ * Every callback must be invoked exactly once, before the last write returns.
+ */
+TEST(db, flushed_write_callbacks) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    constexpr std::size_t threads_count = 8;
+    constexpr std::size_t writes_per_thread = 64;
+    std::atomic<std::size_t> completed = 0;
+    auto callback = [](ustore_callback_payload_t payload) {
+        ++*reinterpret_cast<std::atomic<std::size_t>*>(payload);
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<status_t> statuses(threads_count * writes_per_thread);
+    for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            arena_t arena(db);
+            for (std::size_t write_idx = 0; write_idx != writes_per_thread; ++write_idx) {
+                ustore_key_t key = static_cast<ustore_key_t>(thread_idx * writes_per_thread + write_idx);
+                auto value = reinterpret_cast<ustore_bytes_cptr_t>(&key);
+                ustore_length_t length = sizeof(key);
+                ustore_write_t write {};
+                write.db = db;
+                write.error = statuses[key].member_ptr();
+                write.arena = arena.member_ptr();
+                write.options = ustore_option_write_flush_k;
+                write.tasks_count = 1;
+                write.keys = &key;
+                write.lengths = &length;
+                write.values = &value;
+                write.callback = callback;
+                write.callback_payload = &completed;
+                ustore_write(&write);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(completed.load(), statuses.size());
+    for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(statuses.size()); ++key) {
+        EXPECT_TRUE(statuses[key]);
+        auto value = collection[key].value();
+        EXPECT_TRUE(value);
+        EXPECT_EQ(*value, value_view_t(reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key)));
+    }
+}
+
 /**
  * Ordered batched scan over the main collection.
  */
@@ -629,133 +956,736 @@ TEST(db, batch_scan) {
 }
 
 /**
- * Checks the "Read Commited" consistency guarantees of transactions.
- * Readers can't see the contents of pending (not committed) transactions.
- * https://jepsen.io/consistency/models/read-committed
+ * Bulk scans may change how the engine reads the data, but not what it exports.
+ * Every key of an ordinary scan must be present, and nothing that was never written.
  */
-TEST(db, transaction_read_commited) {
-    if (!ustore_supports_transactions_k)
-        return;
-
+TEST(db, batch_scan_bulk) {
     clear_environment();
     database_t db;
     EXPECT_TRUE(db.open(config().c_str()));
-    EXPECT_TRUE(db.transact());
-    transaction_t txn = *db.transact();
-
-    triplet_t triplet;
-
-    auto txn_ref = txn[triplet.keys];
-    round_trip(txn_ref, triplet);
-
     blobs_collection_t collection = db.main();
-    auto collection_ref = collection[triplet.keys];
 
-    // Check for missing values before commit
-    check_length(collection_ref, ustore_length_missing_k);
-    EXPECT_TRUE(txn.commit());
-    EXPECT_TRUE(txn.reset());
+    constexpr ustore_key_t keys_count = 10000;
+    std::vector<ustore_key_t> keys(keys_count);
+    std::iota(keys.begin(), keys.end(), 0);
+    EXPECT_TRUE(collection[keys].assign(value_view_t("value")));
+    std::vector<ustore_key_t> removed;
+    for (ustore_key_t key = 0; key < keys_count; key += 3)
+        removed.push_back(key);
+    EXPECT_TRUE(collection[removed].erase());
+
+    auto scan_keys = [&](ustore_options_t options) {
+        arena_t arena(db);
+        status_t status;
+        std::array<ustore_key_t, 2> start_keys {keys_count / 2, 0};
+        std::array<ustore_length_t, 2> limits {keys_count, 1000};
+        ustore_length_t* found_offsets = nullptr;
+        ustore_length_t* found_counts = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_scan_t scan {};
+        scan.db = db;
+        scan.error = status.member_ptr();
+        scan.arena = arena.member_ptr();
+        scan.options = options;
+        scan.tasks_count = start_keys.size();
+        scan.start_keys = start_keys.data();
+        scan.start_keys_stride = sizeof(ustore_key_t);
+        scan.count_limits = limits.data();
+        scan.count_limits_stride = sizeof(ustore_length_t);
+        scan.offsets = &found_offsets;
+        scan.counts = &found_counts;
+        scan.keys = &found_keys;
+        ustore_scan(&scan);
+        EXPECT_TRUE(status);
+        std::vector<ustore_key_t> exported;
+        for (std::size_t task_idx = 0; status && task_idx != start_keys.size(); ++task_idx)
+            exported.insert(exported.end(),
+                            found_keys + found_offsets[task_idx],
+                            found_keys + found_offsets[task_idx] + found_counts[task_idx]);
+        std::sort(exported.begin(), exported.end());
+        return exported;
+    };
 
-    // Validate that values match after commit
-    check_equalities(collection_ref, triplet);
+    std::vector<ustore_key_t> ordered = scan_keys(ustore_options_default_k);
+    std::vector<ustore_key_t> bulk = scan_keys(ustore_option_scan_bulk_k);
+    std::size_t expected_count = 1000;
+    for (ustore_key_t key = keys_count / 2; key != keys_count; ++key)
+        expected_count += key % 3 != 0;
+    EXPECT_EQ(ordered.size(), expected_count);
+    EXPECT_TRUE(std::includes(bulk.begin(), bulk.end(), ordered.begin(), ordered.end()));
+    for (ustore_key_t key : bulk)
+        EXPECT_TRUE(key >= 0 && key < keys_count);
 }
 
 /**
- * Checks the "Snapshot Isolation" consistency guarantees of transactions.
- * If needed, readers can initiate snapshot-backed transactions.
- * All the reads, directed to that snapshot will not see newer operations,
- * affecting the HEAD state. From a consistency standpoint, it is a downgrade
- * from "Strictly Serializable" ACID transactions, but it is extremely useful
- * for numerous Business Intelligence applications.
- * https://jepsen.io/consistency/models/snapshot-isolation
+ * Scans, that cross many internal runs of a few thousand entries, must continue
+ * exactly where the previous run stopped, whatever the batch size, and stop at the
+ * end of the collection, even if the next collection follows right after it.
  */
-TEST(db, transaction_snapshot_isolation) {
-    if (!ustore_supports_snapshots_k)
-        return;
-
+TEST(db, scan_across_runs) {
     clear_environment();
     database_t db;
     EXPECT_TRUE(db.open(config().c_str()));
 
-    triplet_t triplet;
-    triplet_t triplet_same_v;
-    triplet_same_v.vals = {'D', 'D', 'D'};
-
-    blobs_collection_t collection = db.main();
-    auto collection_ref = collection[triplet.keys];
-
-    check_length(collection_ref, ustore_length_missing_k);
-    round_trip(collection_ref, triplet);
-
-    auto snap = *db.snapshot();
-    auto snap_ref = snap[triplet.keys];
-    round_trip(snap_ref, triplet);
-    round_trip(collection_ref, triplet_same_v);
-
-    // Validate that values match
-    auto maybe_retrieved = snap_ref.value();
-    auto const& retrieved = *maybe_retrieved;
-    auto it = retrieved.begin();
-    auto cont = triplet_same_v.contents_full();
-    for (std::size_t i = 0; i != cont.size(); ++i, ++it) {
-        auto expected_len = cont[i].size();
-        auto expected_begin = cont[i].begin();
+    // Sparse keys, with the gaps straddling the run boundaries
+    constexpr std::size_t keys_count = 3 * 4096 + 17;
+    std::vector<ustore_key_t> keys(keys_count);
+    for (std::size_t key_idx = 0; key_idx != keys_count; ++key_idx)
+        keys[key_idx] = static_cast<ustore_key_t>(key_idx * 3) - 4096;
 
-        value_view_t retrieved_view = *it;
-        value_view_t expected_view(expected_begin, expected_begin + expected_len);
-        EXPECT_EQ(retrieved_view.size(), expected_view.size());
-        EXPECT_NE(retrieved_view, expected_view);
+    std::vector<blobs_collection_t> collections;
+    collections.push_back(db.main());
+    if (ustore_supports_named_collections_k) {
+        collections.push_back(*db.create("before"));
+        collections.push_back(*db.create("scanned"));
+        collections.push_back(*db.create("after"));
+    }
+    for (auto& collection : collections)
+        EXPECT_TRUE(collection[keys].assign(value_view_t("value")));
+    blobs_collection_t& scanned = collections[collections.size() > 1 ? 2 : 0];
+
+    for (std::size_t read_ahead : {1ul, 4095ul, 4096ul, 4097ul, keys_count, 2 * keys_count}) {
+        keys_stream_t stream(db, scanned, read_ahead);
+        EXPECT_TRUE(stream.seek_to_first());
+        std::size_t key_idx = 0;
+        for (; !stream.is_end() && key_idx != keys_count; ++stream, ++key_idx)
+            EXPECT_EQ(stream.key(), keys[key_idx]);
+        EXPECT_EQ(key_idx, keys_count);
+        EXPECT_TRUE(stream.is_end());
     }
 
-    snap = *db.snapshot();
-    auto ref = snap[triplet_same_v.keys];
-    round_trip(ref, triplet_same_v);
+    // Starting in the middle of a run and between the keys
+    for (std::size_t first_idx : {1ul, 4095ul, 4096ul, 4097ul, keys_count - 1}) {
+        keys_stream_t stream(db, scanned, 4096);
+        EXPECT_TRUE(stream.seek(keys[first_idx] - 1));
+        std::size_t key_idx = first_idx;
+        for (; !stream.is_end() && key_idx != keys_count; ++stream, ++key_idx)
+            EXPECT_EQ(stream.key(), keys[key_idx]);
+        EXPECT_EQ(key_idx, keys_count);
+        EXPECT_TRUE(stream.is_end());
+    }
 
-    EXPECT_TRUE(db.clear());
+    // Removing every other key leaves the runs half-full
+    std::vector<ustore_key_t> removed;
+    for (std::size_t key_idx = 0; key_idx < keys_count; key_idx += 2)
+        removed.push_back(keys[key_idx]);
+    EXPECT_TRUE(scanned[removed].erase());
+    keys_stream_t stream(db, scanned, 4096);
+    EXPECT_TRUE(stream.seek_to_first());
+    std::size_t key_idx = 1;
+    for (; !stream.is_end() && key_idx < keys_count; ++stream, key_idx += 2)
+        EXPECT_EQ(stream.key(), keys[key_idx]);
+    EXPECT_GE(key_idx, keys_count);
+    EXPECT_TRUE(stream.is_end());
 }
-TEST(db, snapshots_list) {
-    if (!ustore_supports_snapshots_k)
+
+/**
+ * Batches of reads and scans, large enough to be split between threads,
+ * must produce the same outputs, as serial ones, including missing keys,
+ * empty values, empty scans and scans running into the end of the collection.
+ */
+TEST(db, parallel_batches) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    if (!path())
         return;
 
     clear_environment();
+    auto parallel_config = fmt::format( //
+        R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{"threads": 4, "parallel_batch_size": 64}}}}}})",
+        path());
     database_t db;
-    EXPECT_TRUE(db.open(config().c_str()));
-
-    auto snap_1 = *db.snapshot();
-    auto snapshots = snap_1.snapshots();
-    auto snaps = *snapshots;
-
-    EXPECT_EQ(snaps.size(), 1u);
-
-    auto snap_2 = *db.snapshot();
-    snapshots = snap_2.snapshots();
-    snaps = *snapshots;
-    EXPECT_EQ(snaps.size(), 2u);
-
-    auto snap_3 = *db.snapshot();
-    snapshots = snap_3.snapshots();
-    snaps = *snapshots;
-
-    EXPECT_EQ(snaps.size(), 3u);
+    EXPECT_TRUE(db.open(parallel_config.c_str()));
+    blobs_collection_t collection = db.main();
 
-    snap_1 = *db.snapshot();
-    snapshots = snap_1.snapshots();
-    snaps = *snapshots;
-    EXPECT_EQ(snaps.size(), 3u);
+    constexpr ustore_key_t keys_count = 20000;
+    auto make_value = [](ustore_key_t key) {
+        std::string value;
+        for (ustore_key_t repeat = 0; repeat != key % 5; ++repeat)
+            value += std::to_string(key);
+        return value;
+    };
+    for (ustore_key_t key = 0; key != keys_count; ++key) {
+        std::string value = make_value(key);
+        EXPECT_TRUE(collection[key].assign(value_view_t(value.data(), value.size())));
+    }
 
-    EXPECT_TRUE(db.clear());
+    // Reads, including the keys outside of the collection
+    std::vector<ustore_key_t> read_keys;
+    for (ustore_key_t key = -500; key != keys_count + 500; ++key)
+        read_keys.push_back(key);
 
-    snapshots = snap_1.snapshots();
-    snaps = *snapshots;
-    EXPECT_EQ(snaps.size(), 0u);
+    arena_t arena(db);
+    status_t status;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_length_t* found_lengths = nullptr;
+    ustore_byte_t* found_values = nullptr;
+    ustore_read_t read {};
+    read.db = db;
+    read.error = status.member_ptr();
+    read.arena = arena.member_ptr();
+    read.tasks_count = read_keys.size();
+    read.keys = read_keys.data();
+    read.keys_stride = sizeof(ustore_key_t);
+    read.offsets = &found_offsets;
+    read.lengths = &found_lengths;
+    read.values = &found_values;
+    ustore_read(&read);
+    EXPECT_TRUE(status);
+    for (std::size_t task_idx = 0; task_idx != read_keys.size(); ++task_idx) {
+        ustore_key_t key = read_keys[task_idx];
+        if (key < 0 || key >= keys_count) {
+            EXPECT_EQ(found_lengths[task_idx], ustore_length_missing_k);
+            continue;
+        }
+        std::string expected = make_value(key);
+        EXPECT_EQ(found_lengths[task_idx], expected.size());
+        EXPECT_EQ(value_view_t(found_values + found_offsets[task_idx], found_lengths[task_idx]),
+                  value_view_t(expected.data(), expected.size()));
+    }
 
-    EXPECT_TRUE(db.clear());
+    // Scans of different lengths, some of which start before the first key or reach the last one
+    constexpr std::size_t scans_count = 1000;
+    std::vector<ustore_key_t> start_keys(scans_count);
+    std::vector<ustore_length_t> limits(scans_count);
+    for (std::size_t scan_idx = 0; scan_idx != scans_count; ++scan_idx) {
+        start_keys[scan_idx] = static_cast<ustore_key_t>(scan_idx * 20) - 10;
+        limits[scan_idx] = static_cast<ustore_length_t>(scan_idx % 50 ? scan_idx % 50 : 500);
+    }
+    ustore_length_t* found_scan_offsets = nullptr;
+    ustore_length_t* found_counts = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_scan_t scan {};
+    scan.db = db;
+    scan.error = status.member_ptr();
+    scan.arena = arena.member_ptr();
+    scan.tasks_count = scans_count;
+    scan.start_keys = start_keys.data();
+    scan.start_keys_stride = sizeof(ustore_key_t);
+    scan.count_limits = limits.data();
+    scan.count_limits_stride = sizeof(ustore_length_t);
+    scan.offsets = &found_scan_offsets;
+    scan.counts = &found_counts;
+    scan.keys = &found_keys;
+    ustore_scan(&scan);
+    EXPECT_TRUE(status);
+    for (std::size_t scan_idx = 0; scan_idx != scans_count; ++scan_idx) {
+        ustore_key_t first = std::max<ustore_key_t>(start_keys[scan_idx], 0);
+        ustore_length_t expected_count =
+            static_cast<ustore_length_t>(std::min<ustore_key_t>(limits[scan_idx], keys_count - first));
+        EXPECT_EQ(found_counts[scan_idx], expected_count);
+        for (ustore_length_t match_idx = 0; match_idx != found_counts[scan_idx]; ++match_idx)
+            EXPECT_EQ(found_keys[found_scan_offsets[scan_idx] + match_idx], first + match_idx);
+    }
+#endif
 }
 
-TEST(db, transaction_with_snapshot) {
-    if (!ustore_supports_snapshots_k)
-        return;
-
+/**
+ * Measurements of whole collections come from running totals, that must stay exact
+ * after overwrites with shorter and longer values, removals, batches repeating the
+ * same key, clearing the values and dropping the collection.
+ */
+TEST(db, measure_after_overwrites) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t main = db.main();
+    blobs_collection_t collection = *db.create("measured");
+
+    auto expect_measure = [](blobs_collection_t& collection, std::size_t cardinality, std::size_t bytes) {
+        auto estimates = collection.members().size_estimates();
+        EXPECT_TRUE(estimates);
+        EXPECT_EQ(estimates->cardinality.min, cardinality);
+        EXPECT_EQ(estimates->cardinality.max, cardinality);
+        EXPECT_EQ(estimates->bytes_in_values.min, bytes);
+        EXPECT_EQ(estimates->bytes_in_values.max, bytes);
+
+        // Partial ranges are walked, but must agree with the totals
+        auto walked = collection.members(std::numeric_limits<ustore_key_t>::min(), 1000000).size_estimates();
+        EXPECT_EQ(walked->cardinality.min, cardinality);
+        EXPECT_EQ(walked->bytes_in_values.min, bytes);
+    };
+
+    expect_measure(collection, 0, 0);
+    for (ustore_key_t key = 0; key != 100; ++key)
+        EXPECT_TRUE(collection[key].assign("1234567890"));
+    EXPECT_TRUE(main[0].assign("other collection"));
+    expect_measure(collection, 100, 1000);
+
+    // Overwrites with longer and shorter values
+    for (ustore_key_t key = 0; key != 10; ++key)
+        EXPECT_TRUE(collection[key].assign("12345678901234567890"));
+    for (ustore_key_t key = 10; key != 20; ++key)
+        EXPECT_TRUE(collection[key].assign("12345"));
+    expect_measure(collection, 100, 1000 + 100 - 50);
+
+    // Removals of present and missing keys
+    for (ustore_key_t key = 90; key != 110; ++key)
+        EXPECT_TRUE(collection[key].erase());
+    expect_measure(collection, 90, 1050 - 100);
+
+    // The last write of the same key in a batch wins
+    std::array<ustore_key_t, 3> repeated {50, 50, 50};
+    std::array<ustore_length_t, 3> lengths {1, 2, 3};
+    std::array<ustore_bytes_cptr_t, 3> values {
+        reinterpret_cast<ustore_bytes_cptr_t>("a"),
+        reinterpret_cast<ustore_bytes_cptr_t>("ab"),
+        reinterpret_cast<ustore_bytes_cptr_t>("abc"),
+    };
+    status_t status;
+    arena_t arena(db);
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.tasks_count = 3;
+    write.collections = collection.member_ptr();
+    write.keys = repeated.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.lengths = lengths.data();
+    write.lengths_stride = sizeof(ustore_length_t);
+    write.values = values.data();
+    write.values_stride = sizeof(ustore_bytes_cptr_t);
+    ustore_write(&write);
+    EXPECT_TRUE(status);
+    EXPECT_EQ(*collection[50].value(), value_view_t("abc"));
+    expect_measure(collection, 90, 950 - 10 + 3);
+
+    // Empty values are still present
+    EXPECT_TRUE(collection.clear_values());
+    expect_measure(collection, 90, 0);
+    EXPECT_EQ(collection.keys().size(), 90ul);
+
+    EXPECT_TRUE(collection.clear());
+    expect_measure(collection, 0, 0);
+    EXPECT_TRUE(main[0].value());
+    expect_measure(main, 1, 16);
+#endif
+}
+
+/**
+ * Dropped collections are erased in the background, while a new collection
+ * under the same name is created and filled right away. The new one must start
+ * empty and must not lose any entries to the erasure of the old one.
+ */
+TEST(db, drop_and_recreate) {
+    if (!ustore_supports_named_collections_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t old_keys_count = 64 * 1024;
+    constexpr std::size_t new_keys_count = 1000;
+    std::vector<ustore_key_t> old_keys(old_keys_count);
+    std::iota(old_keys.begin(), old_keys.end(), 0);
+    std::vector<ustore_key_t> new_keys(new_keys_count);
+    std::iota(new_keys.begin(), new_keys.end(), static_cast<ustore_key_t>(old_keys_count / 2));
+
+    for (std::size_t round = 0; round != 4; ++round) {
+        {
+            blobs_collection_t collection = *db.create("recreated");
+            EXPECT_TRUE(collection[old_keys].assign(value_view_t("old")));
+            EXPECT_EQ(collection.keys().size(), old_keys_count);
+        }
+        EXPECT_TRUE(db.drop("recreated"));
+        EXPECT_FALSE(*db.contains("recreated"));
+
+        blobs_collection_t collection = *db.create("recreated");
+        EXPECT_EQ(collection.keys().size(), 0ul);
+        EXPECT_TRUE(collection[new_keys].assign(value_view_t("new")));
+        EXPECT_EQ(collection.keys().size(), new_keys_count);
+
+        // Give the background erasure a chance to finish, and recheck
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(collection.keys().size(), new_keys_count);
+        auto values = collection[new_keys].value();
+        EXPECT_TRUE(values);
+        for (value_view_t value : *values)
+            EXPECT_EQ(value, value_view_t("new"));
+        EXPECT_EQ(db.main().keys().size(), 0ul);
+        EXPECT_TRUE(db.drop("recreated"));
+    }
+
+    // Dropping right before closing must not resurrect the entries
+    {
+        blobs_collection_t collection = *db.create("recreated");
+        EXPECT_TRUE(collection[old_keys].assign(value_view_t("old")));
+    }
+    EXPECT_TRUE(db.drop("recreated"));
+    if (!path())
+        return;
+    db.close();
+    EXPECT_TRUE(db.open(config().c_str()));
+    EXPECT_FALSE(*db.contains("recreated"));
+    EXPECT_EQ(db.main().keys().size(), 0ul);
+}
+
+/**
+ * Batched reads must return the values in the order of the requests, whether the
+ * keys come sorted, reversed, shuffled across collections, repeated or missing,
+ * including the negative keys, which sort before the positive ones.
+ * Inside of transactions both watched and unwatched reads are checked.
+ */
+TEST(db, read_sorted_and_unsorted) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    std::vector<ustore_collection_t> collections {db.main()};
+    if (ustore_supports_named_collections_k) {
+        collections.push_back(*db.create("first"));
+        collections.push_back(*db.create("second"));
+    }
+
+    // Present keys are even, odd ones are missing
+    auto make_value = [](std::size_t collection_idx, ustore_key_t key) {
+        return fmt::format("{}:{}", collection_idx, key);
+    };
+    constexpr ustore_key_t max_key = 256;
+    for (std::size_t collection_idx = 0; collection_idx != collections.size(); ++collection_idx) {
+        blobs_collection_t collection {db, collections[collection_idx]};
+        for (ustore_key_t key = -max_key; key <= max_key; key += 2) {
+            std::string value = make_value(collection_idx, key);
+            EXPECT_TRUE(collection[key].assign(value.c_str()));
+        }
+    }
+
+    struct request_t {
+        std::size_t collection_idx;
+        ustore_key_t key;
+    };
+    std::vector<request_t> sorted;
+    for (std::size_t collection_idx = 0; collection_idx != collections.size(); ++collection_idx)
+        for (ustore_key_t key = -max_key; key <= max_key; ++key)
+            sorted.push_back({collection_idx, key});
+    std::vector<request_t> reversed(sorted.rbegin(), sorted.rend());
+    std::vector<request_t> shuffled = sorted;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+    std::vector<request_t> repeated;
+    for (request_t const& request : shuffled)
+        repeated.insert(repeated.end(), {request, request, sorted.front()});
+
+    auto check = [&](std::vector<request_t> const& requests, ustore_transaction_t txn, ustore_options_t options) {
+        std::vector<ustore_collection_t> requested_collections;
+        std::vector<ustore_key_t> requested_keys;
+        for (request_t const& request : requests) {
+            requested_collections.push_back(collections[request.collection_idx]);
+            requested_keys.push_back(request.key);
+        }
+
+        arena_t arena(db);
+        status_t status;
+        ustore_length_t* found_offsets = nullptr;
+        ustore_length_t* found_lengths = nullptr;
+        ustore_byte_t* found_values = nullptr;
+        ustore_read_t read {};
+        read.db = db;
+        read.error = status.member_ptr();
+        read.transaction = txn;
+        read.arena = arena.member_ptr();
+        read.options = options;
+        read.tasks_count = requests.size();
+        read.collections = requested_collections.data();
+        read.collections_stride = sizeof(ustore_collection_t);
+        read.keys = requested_keys.data();
+        read.keys_stride = sizeof(ustore_key_t);
+        read.offsets = &found_offsets;
+        read.lengths = &found_lengths;
+        read.values = &found_values;
+        ustore_read(&read);
+        EXPECT_TRUE(status);
+
+        std::size_t mismatches = 0;
+        for (std::size_t task_idx = 0; task_idx != requests.size(); ++task_idx) {
+            request_t const& request = requests[task_idx];
+            if (request.key % 2) {
+                mismatches += found_lengths[task_idx] != ustore_length_missing_k;
+                continue;
+            }
+            std::string expected = make_value(request.collection_idx, request.key);
+            value_view_t found {found_values + found_offsets[task_idx], found_lengths[task_idx]};
+            mismatches += found != value_view_t(expected.c_str());
+        }
+        EXPECT_EQ(mismatches, 0ul);
+    };
+
+    for (auto const* requests : {&sorted, &reversed, &shuffled, &repeated})
+        check(*requests, nullptr, ustore_options_default_k);
+
+    if (!ustore_supports_transactions_k)
+        return;
+    for (auto const* requests : {&sorted, &reversed, &shuffled, &repeated})
+        for (ustore_options_t options : {ustore_options_default_k, ustore_option_transaction_dont_watch_k}) {
+            transaction_t txn = *db.transact();
+            check(*requests, txn, options);
+        }
+
+    // Unwatched batches within a single collection take a separate path in some engines
+    std::vector<request_t> single_collection;
+    for (request_t const& request : shuffled)
+        if (request.collection_idx == collections.size() - 1)
+            single_collection.push_back(request);
+    transaction_t txn = *db.transact();
+    check(single_collection, txn, ustore_option_transaction_dont_watch_k);
+    check(single_collection, txn, ustore_options_default_k);
+}
+
+/**
+ * Samples must consist of distinct keys of the requested collection only, even when
+ * the neighbouring collections interleave with it. Collections shorter than a few
+ * multiples of the limit are sampled exactly, and long ones are sampled from the
+ * whole span of their keys, including both ends.
+ */
+TEST(db, sample) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    if (!ustore_supports_named_collections_k)
+        return;
+
+    constexpr std::size_t limit = 32;
+    constexpr std::size_t samples_count = 100;
+    arena_t arena(db);
+    auto sample = [&](blobs_collection_t& collection, std::size_t count) {
+        auto maybe_keys = collection.keys().sample(count, arena.member_ptr());
+        EXPECT_TRUE(maybe_keys);
+        std::vector<ustore_key_t> keys(maybe_keys->begin(), maybe_keys->end());
+        std::sort(keys.begin(), keys.end());
+        EXPECT_EQ(std::unique(keys.begin(), keys.end()), keys.end());
+        return keys;
+    };
+    auto fill = [](blobs_collection_t& collection, std::vector<ustore_key_t> const& keys) {
+        EXPECT_TRUE(collection[keys].assign(value_view_t("value")));
+    };
+
+    // The sampled keys are multiples of 7, while the neighbours surround and interleave them
+    constexpr ustore_key_t sampled_count = 20000;
+    std::vector<ustore_key_t> sampled_keys, neighbour_keys, main_keys;
+    for (ustore_key_t idx = 0; idx != sampled_count; ++idx)
+        sampled_keys.push_back(idx * 7);
+    for (ustore_key_t idx = -1000; idx != sampled_count + 1000; ++idx)
+        neighbour_keys.push_back(idx * 7 + 1), main_keys.push_back(idx * 7 + 2);
+    blobs_collection_t main = db.main();
+    blobs_collection_t before = *db.create("before");
+    blobs_collection_t sampled = *db.create("sampled");
+    blobs_collection_t after = *db.create("after");
+    blobs_collection_t empty = *db.create("empty");
+    fill(main, main_keys);
+    fill(before, neighbour_keys);
+    fill(sampled, sampled_keys);
+    fill(after, neighbour_keys);
+
+    ustore_key_t min_sampled = std::numeric_limits<ustore_key_t>::max();
+    ustore_key_t max_sampled = std::numeric_limits<ustore_key_t>::min();
+    for (std::size_t sample_idx = 0; sample_idx != samples_count; ++sample_idx) {
+        auto keys = sample(sampled, limit);
+        EXPECT_EQ(keys.size(), limit);
+        for (ustore_key_t key : keys)
+            EXPECT_TRUE(key % 7 == 0 && key >= 0 && key < sampled_count * 7);
+        if (keys.empty())
+            continue;
+        min_sampled = std::min(min_sampled, keys.front());
+        max_sampled = std::max(max_sampled, keys.back());
+    }
+    // Out of thousands of draws, some must land in the first and the last percent of the keys
+    EXPECT_LT(min_sampled, sampled_count * 7 / 100);
+    EXPECT_GT(max_sampled, sampled_count * 7 * 99 / 100);
+
+    // Collections with fewer keys, than requested, are exported whole
+    EXPECT_TRUE(sample(empty, limit).empty());
+    std::vector<ustore_key_t> tiny_keys(sampled_keys.begin(), sampled_keys.begin() + limit / 2);
+    blobs_collection_t tiny = *db.create("tiny");
+    fill(tiny, tiny_keys);
+    EXPECT_EQ(sample(tiny, limit), tiny_keys);
+    EXPECT_EQ(sample(tiny, tiny_keys.size()), tiny_keys);
+
+    // Collections with fewer than four times the limit are sampled exactly,
+    // so every key shows up in some of the samples
+    std::vector<ustore_key_t> small_keys(sampled_keys.begin(), sampled_keys.begin() + limit * 3);
+    blobs_collection_t small = *db.create("small");
+    fill(small, small_keys);
+    std::set<ustore_key_t> small_sampled;
+    for (std::size_t sample_idx = 0; sample_idx != samples_count; ++sample_idx) {
+        auto keys = sample(small, limit);
+        EXPECT_EQ(keys.size(), limit);
+        EXPECT_TRUE(std::includes(small_keys.begin(), small_keys.end(), keys.begin(), keys.end()));
+        small_sampled.insert(keys.begin(), keys.end());
+    }
+    EXPECT_EQ(small_sampled.size(), small_keys.size());
+}
+
+/**
+ * Batches of samples from a collection, shorter than some of the limits, must report
+ * only the existing keys for those tasks, and exactly the limit for the others.
+ */
+TEST(db, sample_beyond_collection_size) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t main = db.main();
+    std::vector<ustore_key_t> keys {3, 5, 8, 13, 21};
+    EXPECT_TRUE(main[keys].assign(value_view_t("value")));
+
+    arena_t arena(db);
+    status_t status;
+    std::array<ustore_length_t, 3> limits {32, 3, 5};
+    ustore_length_t* found_offsets = nullptr;
+    ustore_length_t* found_counts = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_sample_t sample {};
+    sample.db = db;
+    sample.error = status.member_ptr();
+    sample.arena = arena.member_ptr();
+    sample.tasks_count = limits.size();
+    sample.count_limits = limits.data();
+    sample.count_limits_stride = sizeof(ustore_length_t);
+    sample.offsets = &found_offsets;
+    sample.counts = &found_counts;
+    sample.keys = &found_keys;
+    ustore_sample(&sample);
+    EXPECT_TRUE(status);
+
+    for (std::size_t task_idx = 0; task_idx != limits.size(); ++task_idx) {
+        EXPECT_EQ(found_counts[task_idx], std::min<ustore_length_t>(limits[task_idx], keys.size()));
+        std::vector<ustore_key_t> sampled(found_keys + found_offsets[task_idx],
+                                          found_keys + found_offsets[task_idx] + found_counts[task_idx]);
+        std::sort(sampled.begin(), sampled.end());
+        EXPECT_EQ(std::unique(sampled.begin(), sampled.end()), sampled.end());
+        EXPECT_TRUE(std::includes(keys.begin(), keys.end(), sampled.begin(), sampled.end()));
+    }
+    EXPECT_EQ(found_counts[0], keys.size());
+}
+
+/**
+ * Checks the "Read Commited" consistency guarantees of transactions.
+ * Readers can't see the contents of pending (not committed) transactions.
+ * https://jepsen.io/consistency/models/read-committed
+ */
+TEST(db, transaction_read_commited) {
+    if (!ustore_supports_transactions_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    EXPECT_TRUE(db.transact());
+    transaction_t txn = *db.transact();
+
+    triplet_t triplet;
+
+    auto txn_ref = txn[triplet.keys];
+    round_trip(txn_ref, triplet);
+
+    blobs_collection_t collection = db.main();
+    auto collection_ref = collection[triplet.keys];
+
+    // Check for missing values before commit
+    check_length(collection_ref, ustore_length_missing_k);
+    EXPECT_TRUE(txn.commit());
+    EXPECT_TRUE(txn.reset());
+
+    // Validate that values match after commit
+    check_equalities(collection_ref, triplet);
+}
+
+/**
+ * Checks the "Snapshot Isolation" consistency guarantees of transactions.
+ * If needed, readers can initiate snapshot-backed transactions.
+ * All the reads, directed to that snapshot will not see newer operations,
+ * affecting the HEAD state. From a consistency standpoint, it is a downgrade
+ * from "Strictly Serializable" ACID transactions, but it is extremely useful
+ * for numerous Business Intelligence applications.
+ * https://jepsen.io/consistency/models/snapshot-isolation
+ */
+TEST(db, transaction_snapshot_isolation) {
+    if (!ustore_supports_snapshots_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    triplet_t triplet;
+    triplet_t triplet_same_v;
+    triplet_same_v.vals = {'D', 'D', 'D'};
+
+    blobs_collection_t collection = db.main();
+    auto collection_ref = collection[triplet.keys];
+
+    check_length(collection_ref, ustore_length_missing_k);
+    round_trip(collection_ref, triplet);
+
+    auto snap = *db.snapshot();
+    auto snap_ref = snap[triplet.keys];
+    round_trip(snap_ref, triplet);
+    round_trip(collection_ref, triplet_same_v);
+
+    // Validate that values match
+    auto maybe_retrieved = snap_ref.value();
+    auto const& retrieved = *maybe_retrieved;
+    auto it = retrieved.begin();
+    auto cont = triplet_same_v.contents_full();
+    for (std::size_t i = 0; i != cont.size(); ++i, ++it) {
+        auto expected_len = cont[i].size();
+        auto expected_begin = cont[i].begin();
+
+        value_view_t retrieved_view = *it;
+        value_view_t expected_view(expected_begin, expected_begin + expected_len);
+        EXPECT_EQ(retrieved_view.size(), expected_view.size());
+        EXPECT_NE(retrieved_view, expected_view);
+    }
+
+    snap = *db.snapshot();
+    auto ref = snap[triplet_same_v.keys];
+    round_trip(ref, triplet_same_v);
+
+    EXPECT_TRUE(db.clear());
+}
+TEST(db, snapshots_list) {
+    if (!ustore_supports_snapshots_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    auto snap_1 = *db.snapshot();
+    auto snapshots = snap_1.snapshots();
+    auto snaps = *snapshots;
+
+    EXPECT_EQ(snaps.size(), 1u);
+
+    auto snap_2 = *db.snapshot();
+    snapshots = snap_2.snapshots();
+    snaps = *snapshots;
+    EXPECT_EQ(snaps.size(), 2u);
+
+    auto snap_3 = *db.snapshot();
+    snapshots = snap_3.snapshots();
+    snaps = *snapshots;
+
+    EXPECT_EQ(snaps.size(), 3u);
+
+    snap_1 = *db.snapshot();
+    snapshots = snap_1.snapshots();
+    snaps = *snapshots;
+    EXPECT_EQ(snaps.size(), 3u);
+
+    EXPECT_TRUE(db.clear());
+
+    snapshots = snap_1.snapshots();
+    snaps = *snapshots;
+    EXPECT_EQ(snaps.size(), 0u);
+
+    EXPECT_TRUE(db.clear());
+}
+
+TEST(db, transaction_with_snapshot) {
+    if (!ustore_supports_snapshots_k)
+        return;
+
     clear_environment();
     database_t db;
     EXPECT_TRUE(db.open(config().c_str()));
@@ -885,6 +1815,93 @@ TEST(db, snapshot_with_threads) {
     EXPECT_TRUE(db.clear());
 }
 
+/**
+ * Full scans of a snapshot, while a writer keeps overwriting, removing and adding keys.
+ * Every scan must return the contents as of the time the snapshot was taken,
+ * and the writer must not wait for a scan to finish.
+ */
+TEST(db, snapshot_scan_with_writers) {
+    if (!ustore_supports_snapshots_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    // Only even keys exist in the snapshot, spanning many runs of a scan
+    constexpr std::size_t keys_count = 32 * 1024;
+    constexpr std::size_t scans_count = 16;
+    std::vector<ustore_key_t> keys(keys_count);
+    for (std::size_t key_idx = 0; key_idx != keys_count; ++key_idx)
+        keys[key_idx] = static_cast<ustore_key_t>(key_idx * 2);
+    EXPECT_TRUE(collection[keys].assign(value_view_t("snapshot")));
+    context_t snap = *db.snapshot();
+
+    std::atomic<bool> scanning = true;
+    std::atomic<std::size_t> writes = 0;
+    std::thread writer([&] {
+        arena_t arena(db);
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<std::size_t> distribution(0, keys_count - 1);
+        while (scanning) {
+            ustore_key_t key = keys[distribution(generator)];
+            switch (writes % 3) {
+            case 0: EXPECT_TRUE(collection[key].on(arena).assign("head")); break;
+            case 1: EXPECT_TRUE(collection[key].on(arena).erase()); break;
+            case 2: EXPECT_TRUE(collection[key + 1].on(arena).assign("head")); break;
+            }
+            ++writes;
+        }
+    });
+
+    std::size_t scans_with_progress = 0;
+    arena_t arena(db);
+    for (std::size_t scan_idx = 0; scan_idx != scans_count; ++scan_idx) {
+        status_t status;
+        ustore_collection_t scanned_collection = collection;
+        ustore_key_t start_key = std::numeric_limits<ustore_key_t>::min();
+        ustore_length_t limit = static_cast<ustore_length_t>(keys_count * 2);
+        ustore_length_t* found_counts = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_length_t* found_offsets = nullptr;
+        ustore_length_t* found_lengths = nullptr;
+        ustore_byte_t* found_values = nullptr;
+
+        ustore_scan_t scan {};
+        scan.db = db;
+        scan.error = status.member_ptr();
+        scan.snapshot = snap.snap();
+        scan.arena = arena.member_ptr();
+        scan.tasks_count = 1;
+        scan.collections = &scanned_collection;
+        scan.start_keys = &start_key;
+        scan.count_limits = &limit;
+        scan.counts = &found_counts;
+        scan.keys = &found_keys;
+        scan.values_offsets = &found_offsets;
+        scan.values_lengths = &found_lengths;
+        scan.values = &found_values;
+
+        std::size_t writes_before = writes;
+        ustore_scan(&scan);
+        scans_with_progress += writes != writes_before;
+        EXPECT_TRUE(status);
+        EXPECT_EQ(found_counts[0], keys_count);
+        bool matches = found_counts[0] == keys_count;
+        for (std::size_t key_idx = 0; matches && key_idx != keys_count; ++key_idx) {
+            value_view_t value {found_values + found_offsets[key_idx], found_lengths[key_idx]};
+            matches = found_keys[key_idx] == keys[key_idx] && value == value_view_t("snapshot");
+        }
+        EXPECT_TRUE(matches);
+    }
+    scanning = false;
+    writer.join();
+
+    EXPECT_GT(writes.load(), 0ul);
+    EXPECT_GT(scans_with_progress, 0ul);
+}
+
 TEST(db, transaction_erase_missing) {
     if (!ustore_supports_transactions_k)
         return;
@@ -930,37 +1947,1071 @@ TEST(db, transaction_sequenced_commit) {
     if (!ustore_supports_transactions_k)
         return;
 
-    clear_environment();
-    database_t db;
-    EXPECT_TRUE(db.open(config().c_str()));
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    EXPECT_TRUE(db.transact());
+    transaction_t txn = *db.transact();
+
+    triplet_t triplet;
+    auto txn_ref = txn[triplet.keys];
+
+    EXPECT_TRUE(txn_ref.assign(triplet.contents()));
+    auto maybe_sequence_number = txn.sequenced_commit();
+    EXPECT_TRUE(maybe_sequence_number);
+    auto current_sequence_number = *maybe_sequence_number;
+    EXPECT_GT(current_sequence_number, 0);
+    EXPECT_TRUE(txn.reset());
+#if 0
+    auto previous_sequence_number = current_sequence_number;
+    EXPECT_TRUE(txn_ref.value());
+    maybe_sequence_number = txn.sequenced_commit();
+    EXPECT_TRUE(maybe_sequence_number);
+    current_sequence_number = *maybe_sequence_number;
+    EXPECT_EQ(current_sequence_number, previous_sequence_number);
+    EXPECT_TRUE(txn.reset());
+
+    previous_sequence_number = current_sequence_number;
+    EXPECT_TRUE(txn_ref.assign(triplet.contents()));
+    maybe_sequence_number = txn.sequenced_commit();
+    EXPECT_TRUE(maybe_sequence_number);
+    current_sequence_number = *maybe_sequence_number;
+    EXPECT_GT(current_sequence_number, previous_sequence_number);
+#endif
+}
+
+/**
+ * Scans within a transaction must see its own pending changes,
+ * merged with the committed entries, while other readers must not.
+ */
+TEST(db, transaction_scan) {
+    if (!ustore_supports_transactions_k || !ustore_supports_named_collections_k)
+        return;
+#if defined(USTORE_ENGINE_IS_UCSET) || defined(USTORE_FLIGHT_CLIENT)
+    // Scans in UCSet transactions only see the committed entries
+    return;
+#endif
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = *db.create("col");
+    for (ustore_key_t key = 0; key != 10; ++key)
+        EXPECT_TRUE(collection[key].assign("committed"));
+
+    transaction_t txn = *db.transact();
+    blobs_collection_t txn_collection = *txn["col"];
+    EXPECT_TRUE(txn_collection[3].erase());
+    EXPECT_TRUE(txn_collection[5].assign("pending"));
+    EXPECT_TRUE(txn_collection[15].assign("pending"));
+
+    pairs_stream_t stream(db, txn_collection, 4, txn);
+    EXPECT_TRUE(stream.seek_to_first());
+    std::vector<ustore_key_t> keys;
+    while (!stream.is_end()) {
+        keys.push_back(stream.key());
+        bool pending = stream.key() == 5 || stream.key() == 15;
+        EXPECT_EQ(stream.value(), value_view_t(pending ? "pending" : "committed"));
+        ++stream;
+    }
+    EXPECT_EQ(keys, (std::vector<ustore_key_t> {0, 1, 2, 4, 5, 6, 7, 8, 9, 15}));
+    EXPECT_EQ(collection.keys().size(), 10ul);
+    EXPECT_EQ(db.main().keys().size(), 0ul);
+
+    EXPECT_TRUE(txn.commit());
+    EXPECT_EQ(collection.keys().size(), 10ul);
+    EXPECT_EQ(collection[3].value()->size(), 0ul);
+    EXPECT_EQ(*collection[15].value(), value_view_t("pending"));
+}
+
+/**
+ * LevelDB transactions watch every key, exported by their scans, unless asked not to.
+ * Changes of those keys fail the commit, while the keys past the end of the scan
+ * and the new keys, inserted between the scanned ones, are not validated.
+ */
+TEST(db, transaction_scan_watch) {
+#if defined(USTORE_ENGINE_IS_LEVELDB)
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+    for (ustore_key_t key = 0; key != 20; key += 2)
+        EXPECT_TRUE(collection[key].assign("committed"));
+
+    // Scans the first 5 keys: 0, 2, 4, 6, 8
+    auto scan_and_commit = [&](ustore_options_t options, auto&& change_outside) {
+        transaction_t txn = *db.transact();
+        arena_t arena(db);
+        status_t status;
+        ustore_key_t start_key = 0;
+        ustore_length_t limit = 5;
+        ustore_length_t* found_counts = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_scan_t scan {};
+        scan.db = db;
+        scan.error = status.member_ptr();
+        scan.transaction = txn;
+        scan.arena = arena.member_ptr();
+        scan.options = options;
+        scan.tasks_count = 1;
+        scan.start_keys = &start_key;
+        scan.count_limits = &limit;
+        scan.counts = &found_counts;
+        scan.keys = &found_keys;
+        ustore_scan(&scan);
+        EXPECT_TRUE(status);
+        EXPECT_EQ(found_counts[0], limit);
+        EXPECT_EQ(found_keys[limit - 1], 8);
+
+        change_outside();
+        EXPECT_TRUE(txn.main()[1000].assign("pending"));
+        return txn.commit();
+    };
+
+    EXPECT_FALSE(scan_and_commit(ustore_options_default_k, [&] { EXPECT_TRUE(collection[4].assign("changed")); }));
+    EXPECT_FALSE(scan_and_commit(ustore_options_default_k, [&] { EXPECT_TRUE(collection[8].erase()); }));
+    EXPECT_TRUE(collection[8].assign("committed"));
+    EXPECT_TRUE(scan_and_commit(ustore_option_transaction_dont_watch_k,
+                                [&] { EXPECT_TRUE(collection[4].assign("changed")); }));
+
+    // Past the end of the scan and in the gaps between the scanned keys
+    EXPECT_TRUE(scan_and_commit(ustore_options_default_k, [&] { EXPECT_TRUE(collection[12].assign("changed")); }));
+    EXPECT_TRUE(scan_and_commit(ustore_options_default_k, [&] { EXPECT_TRUE(collection[3].assign("inserted")); }));
+#endif
+}
+
+/**
+ * Transfers between accounts, spread over different partitions of the DB,
+ * from concurrent transactions. Readers, that sum all the balances inside
+ * of a transaction and manage to commit it, must never see a partial transfer.
+ */
+TEST(db, transaction_atomic_transfers) {
+    if (!ustore_supports_transactions_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t accounts_count = 64;
+    constexpr std::int64_t initial_balance = 1000;
+    constexpr std::size_t writers_count = 4;
+    constexpr std::size_t readers_count = 2;
+    constexpr std::size_t transfers_per_writer = 256;
+
+    std::vector<ustore_key_t> accounts(accounts_count);
+    std::iota(accounts.begin(), accounts.end(), 0);
+    auto to_value = [](std::int64_t const& balance) {
+        return value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(&balance), sizeof(balance)};
+    };
+    auto from_value = [](value_view_t value) {
+        std::int64_t balance = 0;
+        std::memcpy(&balance, value.begin(), sizeof(balance));
+        return balance;
+    };
+    {
+        blobs_collection_t collection = db.main();
+        for (ustore_key_t account : accounts)
+            EXPECT_TRUE(collection[account].assign(to_value(initial_balance)));
+    }
+
+    std::atomic<std::size_t> writers_done = 0;
+    std::atomic<std::size_t> consistent_reads = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t writer_idx = 0; writer_idx != writers_count; ++writer_idx)
+        threads.emplace_back([&, writer_idx] {
+            std::mt19937 generator(static_cast<std::uint32_t>(writer_idx));
+            std::uniform_int_distribution<std::size_t> distribution(0, accounts_count - 1);
+            for (std::size_t transfer_idx = 0; transfer_idx != transfers_per_writer;) {
+                ustore_key_t from = accounts[distribution(generator)];
+                ustore_key_t to = accounts[distribution(generator)];
+                if (from == to)
+                    continue;
+
+                transaction_t txn = *db.transact();
+                blobs_collection_t collection = txn.main();
+                // Views into the arena are only valid until the next request
+                auto maybe_balance = collection[from].value();
+                if (!maybe_balance)
+                    continue;
+                std::int64_t const from_balance = from_value(*maybe_balance);
+                maybe_balance = collection[to].value();
+                if (!maybe_balance)
+                    continue;
+                std::int64_t const to_balance = from_value(*maybe_balance);
+                std::int64_t const amount = 1 + static_cast<std::int64_t>(transfer_idx % 10);
+                EXPECT_TRUE(collection[from].assign(to_value(from_balance - amount)));
+                EXPECT_TRUE(collection[to].assign(to_value(to_balance + amount)));
+                transfer_idx += static_cast<bool>(txn.commit());
+            }
+            ++writers_done;
+        });
+
+    for (std::size_t reader_idx = 0; reader_idx != readers_count; ++reader_idx)
+        threads.emplace_back([&] {
+            while (writers_done != writers_count) {
+                transaction_t txn = *db.transact();
+                blobs_collection_t collection = txn.main();
+                auto balances = collection[accounts].value();
+                if (!balances)
+                    continue;
+                std::int64_t total = 0;
+                for (value_view_t balance : *balances)
+                    total += from_value(balance);
+                if (!txn.commit())
+                    continue;
+                EXPECT_EQ(total, initial_balance * static_cast<std::int64_t>(accounts_count));
+                ++consistent_reads;
+            }
+        });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    std::int64_t total = 0;
+    auto balances = db.main()[accounts].value();
+    EXPECT_TRUE(balances);
+    for (value_view_t balance : *balances)
+        total += from_value(balance);
+    EXPECT_EQ(total, initial_balance * static_cast<std::int64_t>(accounts_count));
+    EXPECT_GT(consistent_reads.load(), 0ul);
+}
+
+/**
+ * If validation of a single watched entry fails on commit, the changes
+ * in all the other partitions, touched by the transaction, are rolled back,
+ * including the per-collection statistics.
+ */
+TEST(db, transaction_conflict_rolls_back_all_parts) {
+    if (!ustore_supports_transactions_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    constexpr std::size_t keys_count = 64;
+    for (ustore_key_t key = 0; key != keys_count; ++key)
+        EXPECT_TRUE(collection[key].assign("old"));
+
+    transaction_t txn = *db.transact();
+    blobs_collection_t txn_collection = txn.main();
+    EXPECT_TRUE(txn_collection[0].value());
+    for (ustore_key_t key = 0; key != keys_count; ++key)
+        EXPECT_TRUE(txn_collection[key].assign("new value"));
+    EXPECT_TRUE(txn_collection[keys_count].assign("new value"));
+
+    EXPECT_TRUE(collection[0].assign("outside"));
+    EXPECT_FALSE(txn.commit());
+
+    EXPECT_EQ(*collection[0].value(), value_view_t("outside"));
+    for (ustore_key_t key = 1; key != keys_count; ++key)
+        EXPECT_EQ(*collection[key].value(), value_view_t("old"));
+    EXPECT_FALSE(*collection[keys_count].present());
+    EXPECT_EQ(collection.keys().size(), keys_count);
+
+#if defined(USTORE_ENGINE_IS_UCSET)
+    auto estimates = *collection.members().size_estimates();
+    EXPECT_EQ(estimates.cardinality.min, keys_count);
+    EXPECT_EQ(estimates.bytes_in_values.min, (keys_count - 1) * 3 + 7);
+#endif
+
+    // Retrying on the fresh state succeeds
+    EXPECT_TRUE(txn.reset());
+    EXPECT_TRUE(txn_collection[0].value());
+    for (ustore_key_t key = 0; key != keys_count; ++key)
+        EXPECT_TRUE(txn_collection[key].assign("new value"));
+    EXPECT_TRUE(txn.commit());
+    for (ustore_key_t key = 0; key != keys_count; ++key)
+        EXPECT_EQ(*collection[key].value(), value_view_t("new value"));
+}
+
+/**
+ * Statistics of collections, used by `ustore_measure`, are updated on commit
+ * from the staged versions of the changed entries, so the transaction must still
+ * find its own changes after staging. Covers overwrites of different lengths,
+ * repeated writes of the same key, removals of present and missing keys.
+ */
+TEST(db, transaction_measure_after_commit) {
+    if (!ustore_supports_transactions_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    std::string const initial(10, 'i');
+    std::string const longer(20, 'l');
+    std::string const longest(30, 'x');
+    std::string const shorter(5, 's');
+    for (ustore_key_t key = 0; key != 100; ++key)
+        EXPECT_TRUE(collection[key].assign(initial.c_str()));
+
+    transaction_t txn = *db.transact();
+    blobs_collection_t txn_collection = txn.main();
+    for (ustore_key_t key = 0; key != 50; ++key)
+        EXPECT_TRUE(txn_collection[key].assign(longer.c_str()));
+    EXPECT_TRUE(txn_collection[0].assign(longest.c_str()));
+    for (ustore_key_t key = 50; key != 75; ++key)
+        EXPECT_TRUE(txn_collection[key].erase());
+    EXPECT_TRUE(txn_collection[1000].erase());
+    for (ustore_key_t key = 100; key != 110; ++key)
+        EXPECT_TRUE(txn_collection[key].assign(shorter.c_str()));
+
+#if defined(USTORE_ENGINE_IS_UCSET)
+    auto estimates = *collection.members().size_estimates();
+    EXPECT_EQ(estimates.cardinality.min, 100ul);
+    EXPECT_EQ(estimates.bytes_in_values.min, 1000ul);
+#endif
+
+    EXPECT_TRUE(txn.commit());
+    EXPECT_EQ(collection.keys().size(), 85ul);
+    EXPECT_EQ(*collection[0].value(), value_view_t(longest.c_str()));
+
+#if defined(USTORE_ENGINE_IS_UCSET)
+    estimates = *collection.members().size_estimates();
+    EXPECT_EQ(estimates.cardinality.min, 85ul);
+    EXPECT_EQ(estimates.cardinality.max, 85ul);
+    EXPECT_EQ(estimates.bytes_in_values.min, 30ul + 49 * 20 + 25 * 10 + 10 * 5);
+    EXPECT_EQ(estimates.bytes_in_values.max, 30ul + 49 * 20 + 25 * 10 + 10 * 5);
+#endif
+}
+
+/**
+ * Pessimistic RocksDB transactions lock the keys on first access, instead of
+ * validating them on commit. Waiting for a lock held by another transaction,
+ * inside or outside of a transaction, must time out with a conflict, and no
+ * read-modify-write can be lost under contention.
+ */
+TEST(db, transaction_pessimistic) {
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    if (!path())
+        return;
+
+    clear_environment();
+    auto pessimistic_config = fmt::format( //
+        R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{"TransactionDBOptions": {{)"
+        R"("concurrency_control": "pessimistic", "transaction_lock_timeout": 50, "default_lock_timeout": 50}}}}}}}})",
+        path());
+    database_t db;
+    EXPECT_TRUE(db.open(pessimistic_config.c_str()));
+    blobs_collection_t collection = db.main();
+    EXPECT_TRUE(collection[1].assign("initial"));
+
+    auto expect_conflict = [](status_t status) {
+        EXPECT_FALSE(status);
+        EXPECT_STREQ(status.message(), "Failure: Transaction Conflict");
+    };
+
+    // Reading for update locks the key for everyone else
+    transaction_t txn1 = *db.transact();
+    transaction_t txn2 = *db.transact();
+    EXPECT_EQ(*txn1.main()[1].value(), value_view_t("initial"));
+    expect_conflict(txn2.main()[1].assign("second"));
+    expect_conflict(txn2.main()[1].value().release_status());
+    expect_conflict(collection[1].assign("outside"));
+
+    // Keys, that aren't locked, are still writable
+    EXPECT_TRUE(txn2.main()[2].assign("second"));
+    EXPECT_TRUE(collection[3].assign("outside"));
+
+    // The lock is released on commit, keeping the change of its owner
+    EXPECT_TRUE(txn1.main()[1].assign("first"));
+    EXPECT_TRUE(txn1.commit());
+    EXPECT_EQ(*collection[1].value(), value_view_t("first"));
+    EXPECT_TRUE(txn2.main()[1].assign("second"));
+    EXPECT_TRUE(txn2.commit());
+    EXPECT_EQ(*collection[1].value(), value_view_t("second"));
+    EXPECT_EQ(*collection[2].value(), value_view_t("second"));
+
+    // Concurrent increments of the same counter, retried on conflicts
+    constexpr std::size_t threads_count = 4;
+    constexpr std::size_t increments_per_thread = 100;
+    constexpr ustore_key_t counter_key = 42;
+    auto to_value = [](std::int64_t const& counter) {
+        return value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(&counter), sizeof(counter)};
+    };
+    std::int64_t const initial_counter = 0;
+    EXPECT_TRUE(collection[counter_key].assign(to_value(initial_counter)));
+
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+        threads.emplace_back([&] {
+            for (std::size_t increment_idx = 0; increment_idx != increments_per_thread;) {
+                transaction_t txn = *db.transact();
+                blobs_collection_t txn_collection = txn.main();
+                auto maybe_counter = txn_collection[counter_key].value();
+                if (!maybe_counter)
+                    continue;
+                std::int64_t counter = 0;
+                std::memcpy(&counter, maybe_counter->begin(), sizeof(counter));
+                ++counter;
+                if (!txn_collection[counter_key].assign(to_value(counter)))
+                    continue;
+                increment_idx += static_cast<bool>(txn.commit());
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    std::int64_t counter = 0;
+    auto maybe_counter = collection[counter_key].value();
+    EXPECT_TRUE(maybe_counter);
+    std::memcpy(&counter, maybe_counter->begin(), sizeof(counter));
+    EXPECT_EQ(counter, static_cast<std::int64_t>(threads_count * increments_per_thread));
+#endif
+}
+
+/**
+ * Values of every length, crossing the inline capacity of UCSet entries,
+ * the bounds of the slab size-classes and the threshold of large blobs.
+ * Overwrites shrink and grow the values, moving them between the tiers.
+ */
+TEST(db, value_lengths_round_trip) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t collection = db.main();
+
+    std::vector<std::size_t> lengths {0, 1, 12, 13, 15, 16, 17, 24, 25, 2047, 2048, 2049, 4096, 100000};
+    auto make_value = [](std::size_t length, char seed) {
+        std::string value(length, '\0');
+        for (std::size_t i = 0; i != length; ++i)
+            value[i] = static_cast<char>(seed + i % 61);
+        return value;
+    };
+
+    for (std::size_t pass = 0; pass != 3; ++pass) {
+        std::vector<std::string> values(lengths.size());
+        for (std::size_t key = 0; key != lengths.size(); ++key) {
+            // Every pass rotates the lengths, so that every key changes its tier
+            std::size_t length = lengths[(key + pass * 5) % lengths.size()];
+            values[key] = make_value(length, static_cast<char>('a' + pass));
+            EXPECT_TRUE(collection[key].assign(value_view_t(values[key].data(), values[key].size())));
+        }
+        for (std::size_t key = 0; key != lengths.size(); ++key) {
+            auto value = collection[key].value();
+            EXPECT_TRUE(value);
+            EXPECT_EQ(*value, value_view_t(values[key].data(), values[key].size()));
+            EXPECT_EQ(*collection[key].length(), values[key].size());
+        }
+    }
+}
+
+/**
+ * Slots of the allocator must be distinct and keep their contents, for lengths
+ * at the bounds of every size-class, including the first large blob.
+ */
+TEST(db, slab_allocator_size_classes) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    slab_allocator_t allocator;
+    std::vector<std::size_t> lengths {1, 16, 17, 24, 25, 32, 33, 1536, 1537, 2048, 2049};
+    constexpr std::size_t copies_k = 100;
+
+    struct allocation_t {
+        byte_t* begin;
+        std::size_t length;
+        bool spilled;
+    };
+    std::vector<allocation_t> allocations;
+    for (std::size_t copy = 0; copy != copies_k; ++copy)
+        for (std::size_t length : lengths) {
+            allocation_t allocation {nullptr, length, false};
+            allocation.begin = allocator.allocate(length, allocation.spilled);
+            EXPECT_NE(allocation.begin, nullptr);
+            EXPECT_FALSE(allocation.spilled);
+            std::memset(allocation.begin, static_cast<int>(allocations.size() % 251), length);
+            allocations.push_back(allocation);
+        }
+
+    // Overlapping slots would have overwritten each other's patterns
+    for (std::size_t i = 0; i != allocations.size(); ++i) {
+        auto pattern = static_cast<std::uint8_t>(i % 251);
+        auto begin = reinterpret_cast<std::uint8_t const*>(allocations[i].begin);
+        EXPECT_TRUE(std::all_of(begin, begin + allocations[i].length, [=](std::uint8_t v) { return v == pattern; }));
+    }
+
+    // Every small class takes whole slabs, while large blobs are counted exactly
+    std::size_t large_bytes = copies_k * (2049 + 48);
+    EXPECT_EQ((allocator.resident_bytes() - large_bytes) % slab_allocator_t::slab_size_k, 0ul);
+    for (allocation_t const& allocation : allocations)
+        slab_allocator_t::deallocate(allocation.begin, allocation.length, allocation.spilled);
+    EXPECT_EQ(allocator.resident_bytes() % slab_allocator_t::slab_size_k, 0ul);
+#endif
+}
+
+/**
+ * Released slots are reused by the next allocations from the same size-class,
+ * including the shorter lengths, rounded up to the same slot size.
+ */
+TEST(db, slab_allocator_reuse) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    slab_allocator_t allocator;
+    bool spilled = false;
+
+    byte_t* first = allocator.allocate(24, spilled);
+    byte_t* second = allocator.allocate(24, spilled);
+    EXPECT_NE(first, second);
+    std::size_t resident_bytes = allocator.resident_bytes();
+
+    slab_allocator_t::deallocate(first, 24, spilled);
+    EXPECT_EQ(allocator.allocate(24, spilled), first);
+    slab_allocator_t::deallocate(second, 24, spilled);
+    EXPECT_EQ(allocator.allocate(17, spilled), second);
+    EXPECT_EQ(allocator.resident_bytes(), resident_bytes);
+
+    // Neighboring classes don't share slots
+    slab_allocator_t::deallocate(first, 24, spilled);
+    EXPECT_NE(allocator.allocate(16, spilled), first);
+    EXPECT_NE(allocator.allocate(25, spilled), first);
+    EXPECT_EQ(allocator.allocate(24, spilled), first);
+#endif
+}
+
+/**
+ * Concurrent threads allocate from different shards, and slots released
+ * by other threads return to the shard, that allocated them.
+ */
+TEST(db, slab_allocator_shards) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    slab_allocator_t allocator;
+    constexpr std::size_t threads_count = slab_allocator_t::shards_count_k;
+    constexpr std::size_t length = 64;
+
+    std::vector<byte_t*> slots(threads_count);
+    std::vector<byte_t*> reused_slots(threads_count);
+    std::atomic<std::size_t> allocated = 0;
+    std::atomic<bool> released = false;
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            bool spilled = false;
+            slots[thread_idx] = allocator.allocate(length, spilled);
+            ++allocated;
+            while (!released)
+                std::this_thread::yield();
+            reused_slots[thread_idx] = allocator.allocate(length, spilled);
+        });
+
+    while (allocated != threads_count)
+        std::this_thread::yield();
+
+    // Every fresh thread takes the next shard, so each of them needs its own slab
+    EXPECT_EQ(allocator.resident_bytes(), threads_count * slab_allocator_t::slab_size_k);
+    for (byte_t* slot : slots)
+        slab_allocator_t::deallocate(slot, length, false);
+    released = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(reused_slots, slots);
+    EXPECT_EQ(allocator.resident_bytes(), threads_count * slab_allocator_t::slab_size_k);
+#endif
+}
+
+/**
+ * Slabs and large blobs, that don't fit into the memory limit, are spilled
+ * into an unlinked file inside of the given directory and read back intact.
+ */
+TEST(db, slab_allocator_overflow) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    namespace stdfs = std::filesystem;
+    auto directory = stdfs::temp_directory_path() / "ustore_slab_allocator_overflow";
+    stdfs::remove_all(directory);
+    stdfs::create_directories(directory);
+    {
+        slab_allocator_t allocator;
+        EXPECT_TRUE(allocator.limit_memory(slab_allocator_t::slab_size_k, directory.native()));
+
+        // The unlinked file leaves no traces in the directory or next to it
+        EXPECT_TRUE(stdfs::is_empty(directory));
+
+        struct allocation_t {
+            byte_t* begin;
+            std::size_t length;
+            bool spilled;
+        };
+        std::vector<allocation_t> allocations;
+        std::size_t spilled_count = 0;
+        for (std::size_t i = 0; i != 4096; ++i) {
+            allocation_t allocation {nullptr, i % 2 ? 100ul : 5000ul, false};
+            allocation.begin = allocator.allocate(allocation.length, allocation.spilled);
+            EXPECT_NE(allocation.begin, nullptr);
+            std::memset(allocation.begin, static_cast<int>(i % 251), allocation.length);
+            spilled_count += allocation.spilled;
+            allocations.push_back(allocation);
+        }
+        EXPECT_GT(spilled_count, allocations.size() / 2);
+        EXPECT_GT(allocator.spilled_bytes(), 0ul);
+        EXPECT_LE(allocator.resident_bytes(), 2 * slab_allocator_t::slab_size_k);
+
+        for (std::size_t i = 0; i != allocations.size(); ++i) {
+            auto pattern = static_cast<std::uint8_t>(i % 251);
+            auto begin = reinterpret_cast<std::uint8_t const*>(allocations[i].begin);
+            EXPECT_TRUE(std::all_of(begin, begin + allocations[i].length, [=](std::uint8_t v) { return v == pattern; }));
+            slab_allocator_t::deallocate(allocations[i].begin, allocations[i].length, allocations[i].spilled);
+        }
+    }
+    stdfs::remove_all(directory);
+#endif
+}
+
+/**
+ * Every kernel of every instruction set, supported by the current CPU, must match
+ * the serial reference, across the lengths of all the tails, the bounds of integer
+ * blocks and the extreme values, where the products of -128 can't fit into 16 bits.
+ */
+TEST(db, simd_kernels) {
+    std::vector<std::size_t> lengths;
+    for (std::size_t length = 1; length <= 70; ++length)
+        lengths.push_back(length);
+    lengths.insert(lengths.end(), {16383, 16384, 16385});
+    std::size_t const max_length = lengths.back();
+
+    enum class fill_t { random_k, min_k, extremes_k };
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> i8_distribution(-128, 127);
+    std::uniform_real_distribution<float> f32_distribution(-2.f, 2.f);
+    std::uniform_int_distribution<int> f16_exponent_distribution(10, 20);
+    std::uniform_int_distribution<int> f16_mantissa_distribution(0, 0x3FF);
+    std::vector<std::int8_t> a_i8(max_length), b_i8(max_length);
+    std::vector<float> a_f32(max_length), b_f32(max_length);
+    std::vector<f16_t> a_f16(max_length);
+
+    auto fill = [&](fill_t kind) {
+        for (std::size_t i = 0; i != max_length; ++i) {
+            bool negative = i % 3 != 1;
+            switch (kind) {
+            case fill_t::random_k:
+                a_i8[i] = static_cast<std::int8_t>(i8_distribution(generator));
+                b_i8[i] = static_cast<std::int8_t>(i8_distribution(generator));
+                a_f32[i] = f32_distribution(generator), b_f32[i] = f32_distribution(generator);
+                a_f16[i] = static_cast<f16_t>((generator() & 0x8000u) | (f16_exponent_distribution(generator) << 10) |
+                                              f16_mantissa_distribution(generator));
+                break;
+            case fill_t::min_k:
+                a_i8[i] = b_i8[i] = -128;
+                a_f32[i] = b_f32[i] = -65504.f;
+                a_f16[i] = 0xFBFF; // -65504, the lowest finite half
+                break;
+            case fill_t::extremes_k:
+                a_i8[i] = negative ? -128 : 127, b_i8[i] = i % 2 ? -128 : 127;
+                a_f32[i] = negative ? -65504.f : 65504.f, b_f32[i] = i % 2 ? -1e-3f : 65504.f;
+                a_f16[i] = negative ? 0xFBFF : 0x7BFF;
+                break;
+            }
+        }
+    };
+
+    // Floating-point sums are reassociated by the vectorized kernels
+    auto expect_near = [](float expected, float actual, double magnitude) {
+        EXPECT_NEAR(expected, actual, 1e-3 * magnitude + 1e-6);
+    };
+    auto check_floats = [&](auto const* a, simd_kernels_t const& kernels, auto dot, auto cos, auto l2sq) {
+        for (std::size_t length : lengths) {
+            double ab = 0, aa = 0, bb = 0, diff = 0;
+            for (std::size_t i = 0; i != length; ++i) {
+                double ai = to_f32(a[i]), bi = b_f32[i];
+                ab += std::abs(ai * bi), aa += ai * ai, bb += bi * bi;
+                diff += (std::abs(ai) + std::abs(bi)) * (std::abs(ai) + std::abs(bi));
+            }
+            expect_near(dot_serial(a, b_f32.data(), length), (kernels.*dot)(a, b_f32.data(), length), ab);
+            products_f32_t expected = cos_serial(a, b_f32.data(), length);
+            products_f32_t actual = (kernels.*cos)(a, b_f32.data(), length);
+            expect_near(expected.ab, actual.ab, ab);
+            expect_near(expected.aa, actual.aa, aa);
+            expect_near(expected.bb, actual.bb, bb);
+            expect_near(l2sq_serial(a, b_f32.data(), length), (kernels.*l2sq)(a, b_f32.data(), length), diff);
+        }
+    };
+
+    for (simd_isa_t isa : {simd_isa_t::serial_k, simd_isa_t::avx2_k, simd_isa_t::avx512_k, simd_isa_t::neon_k}) {
+        if (!simd_isa_supported(isa))
+            continue;
+        SCOPED_TRACE(static_cast<int>(isa));
+        simd_kernels_t kernels = simd_kernels_for(isa);
+        for (fill_t kind : {fill_t::random_k, fill_t::min_k, fill_t::extremes_k}) {
+            SCOPED_TRACE(static_cast<int>(kind));
+            fill(kind);
+
+            // Integer kernels are exact, but can only take one block at a time
+            for (std::size_t length : lengths) {
+                std::int64_t dot = 0;
+                products_i8_t cos;
+                for (std::size_t i = 0; i < length; i += simd_kernels_t::i8_block_k) {
+                    std::size_t block = std::min(length - i, simd_kernels_t::i8_block_k);
+                    dot += kernels.dot_i8(a_i8.data() + i, b_i8.data() + i, block);
+                    products_i8_t block_cos = kernels.cos_i8(a_i8.data() + i, b_i8.data() + i, block);
+                    cos.ab += block_cos.ab, cos.aa += block_cos.aa, cos.bb += block_cos.bb;
+                }
+                products_i8_t expected = cos_i8_serial(a_i8.data(), b_i8.data(), length);
+                EXPECT_EQ(dot, dot_i8_serial(a_i8.data(), b_i8.data(), length));
+                EXPECT_EQ(cos.ab, expected.ab);
+                EXPECT_EQ(cos.aa, expected.aa);
+                EXPECT_EQ(cos.bb, expected.bb);
+            }
+
+            check_floats(a_f32.data(),
+                         kernels,
+                         &simd_kernels_t::dot_f32,
+                         &simd_kernels_t::cos_f32,
+                         &simd_kernels_t::l2sq_f32);
+            check_floats(a_f16.data(),
+                         kernels,
+                         &simd_kernels_t::dot_f16,
+                         &simd_kernels_t::cos_f16,
+                         &simd_kernels_t::l2sq_f16);
+        }
+    }
+
+    // The public wrappers split the inputs into blocks on their own
+    fill(fill_t::min_k);
+    EXPECT_EQ(dot_i8(a_i8.data(), b_i8.data(), max_length), dot_i8_serial(a_i8.data(), b_i8.data(), max_length));
+    EXPECT_EQ(cos_i8(a_i8.data(), b_i8.data(), max_length).aa, 128 * 128 * static_cast<std::int64_t>(max_length));
+}
+
+/**
+ * Once the RAM usage approaches the memory limit, the slabs, that weren't used since
+ * the previous sweep of the clock, are selected first. After their values are moved
+ * into the overflow file, the emptied slabs are returned to the system.
+ */
+TEST(db, slab_allocator_eviction) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    namespace stdfs = std::filesystem;
+    auto directory = stdfs::temp_directory_path() / "ustore_slab_allocator_eviction";
+    stdfs::remove_all(directory);
+    stdfs::create_directories(directory);
+    {
+        slab_allocator_t allocator;
+        EXPECT_TRUE(allocator.limit_memory(64 * slab_allocator_t::slab_size_k, directory.native()));
+
+        struct allocation_t {
+            byte_t* begin;
+            std::size_t length;
+            bool spilled;
+        };
+        auto allocate_many = [&](std::size_t count, std::size_t length, std::size_t& bytes) {
+            std::vector<allocation_t> allocations;
+            std::size_t resident = allocator.resident_bytes();
+            for (std::size_t i = 0; i != count; ++i) {
+                allocation_t allocation {nullptr, length, false};
+                allocation.begin = allocator.allocate(length, allocation.spilled);
+                EXPECT_NE(allocation.begin, nullptr);
+                EXPECT_FALSE(allocation.spilled);
+                std::memset(allocation.begin, static_cast<int>(i % 251), length);
+                allocations.push_back(allocation);
+            }
+            bytes = allocator.resident_bytes() - resident;
+            return allocations;
+        };
+        auto count_selected = [](std::vector<allocation_t> const& allocations) {
+            return std::count_if(allocations.begin(), allocations.end(), [](allocation_t const& allocation) {
+                return slab_allocator_t::is_selected(allocation.begin, allocation.length);
+            });
+        };
+        auto is_intact = [](std::vector<allocation_t> const& allocations) {
+            for (std::size_t i = 0; i != allocations.size(); ++i) {
+                auto pattern = static_cast<std::uint8_t>(i % 251);
+                auto begin = reinterpret_cast<std::uint8_t const*>(allocations[i].begin);
+                if (!std::all_of(begin, begin + allocations[i].length, [=](std::uint8_t v) { return v == pattern; }))
+                    return false;
+            }
+            return true;
+        };
+
+        // Smaller values belong to size classes, visited by the clock earlier
+        std::size_t older_bytes = 0, newer_bytes = 0, newest_bytes = 0;
+        auto older = allocate_many(2000, 100, older_bytes);
+        auto newer = allocate_many(1000, 200, newer_bytes);
+        EXPECT_EQ(older_bytes, 4 * slab_allocator_t::slab_size_k);
+        EXPECT_EQ(allocator.excess_resident_bytes(), 0ul);
+
+        // The first turn of the clock clears the bits, the second one selects the slabs
+        EXPECT_EQ(allocator.select_cold(older_bytes), older_bytes);
+        EXPECT_EQ(count_selected(older), static_cast<std::ptrdiff_t>(older.size()));
+        EXPECT_EQ(count_selected(newer), 0);
+
+        // Move the selected values out, like the UCSet engine does
+        std::size_t resident = allocator.resident_bytes();
+        for (allocation_t& allocation : older) {
+            byte_t* begin = allocator.allocate_spilled(allocation.length);
+            EXPECT_NE(begin, nullptr);
+            std::memcpy(begin, allocation.begin, allocation.length);
+            slab_allocator_t::deallocate(allocation.begin, allocation.length, allocation.spilled);
+            allocation = {begin, allocation.length, true};
+        }
+        allocator.release_selected();
+        EXPECT_EQ(allocator.resident_bytes(), resident - older_bytes);
+        EXPECT_GE(allocator.spilled_bytes(), older_bytes);
+        EXPECT_TRUE(is_intact(older));
+        EXPECT_TRUE(is_intact(newer));
+
+        // Values, that weren't used since the previous sweep, go before the new ones
+        auto newest = allocate_many(2000, 100, newest_bytes);
+        EXPECT_EQ(allocator.select_cold(newer_bytes), newer_bytes);
+        EXPECT_EQ(count_selected(newer), static_cast<std::ptrdiff_t>(newer.size()));
+        EXPECT_EQ(count_selected(newest), 0);
+
+        // Selected slabs are released, even if their values are just freed
+        resident = allocator.resident_bytes();
+        for (auto const* allocations : {&older, &newer, &newest})
+            for (allocation_t const& allocation : *allocations)
+                slab_allocator_t::deallocate(allocation.begin, allocation.length, allocation.spilled);
+        allocator.release_selected();
+        EXPECT_EQ(allocator.resident_bytes(), resident - newer_bytes);
+    }
+    stdfs::remove_all(directory);
+#endif
+}
+
+/**
+ * Fills a DB far beyond its memory limit, spilling the values
+ * into the overflow file, and reads them back, before and after a restart.
+ * Meanwhile, the cold values are evicted in the background.
+ */
+TEST(db, memory_limit_overflow) {
+#if defined(USTORE_ENGINE_IS_UCSET)
+    if (!path())
+        return;
+
+    clear_environment();
+    auto limited_config = fmt::format( //
+        R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{"memory_limit": "1MB"}}}}}})",
+        path());
+    database_t db;
+    EXPECT_TRUE(db.open(limited_config.c_str()));
+
+    constexpr std::size_t keys_size = 4096;
+    auto make_value = [](ustore_key_t key) {
+        return std::string(key % 2 ? 100 : 5000, static_cast<char>('a' + key % 26));
+    };
+    {
+        blobs_collection_t collection = db.main();
+        for (ustore_key_t key = 0; key != keys_size; ++key)
+            EXPECT_TRUE(collection[key].assign(make_value(key).c_str()));
+    }
+    auto check_values = [&] {
+        blobs_collection_t collection = db.main();
+        EXPECT_EQ(collection.keys().size(), keys_size);
+        for (ustore_key_t key = 0; key != keys_size; ++key) {
+            auto value = collection[key].value();
+            EXPECT_TRUE(value);
+            EXPECT_EQ(*value, value_view_t(make_value(key).c_str()));
+        }
+    };
+    check_values();
+
+    // Before-images of a snapshot are evicted along with the values in HEAD
+    {
+        auto snap = *db.snapshot();
+        blobs_collection_t collection = db.main();
+        blobs_collection_t frozen = snap.main();
+        for (ustore_key_t key = 0; key != keys_size; ++key)
+            EXPECT_TRUE(collection[key].assign(make_value(key + 1).c_str()));
+        for (ustore_key_t key = 0; key != keys_size; ++key) {
+            auto value = collection[key].value();
+            auto frozen_value = frozen[key].value();
+            EXPECT_TRUE(value && frozen_value);
+            EXPECT_EQ(*value, value_view_t(make_value(key + 1).c_str()));
+            EXPECT_EQ(*frozen_value, value_view_t(make_value(key).c_str()));
+        }
+        for (ustore_key_t key = 0; key != keys_size; ++key)
+            EXPECT_TRUE(collection[key].assign(make_value(key).c_str()));
+    }
+    check_values();
+
+    // The overflow file is created and unlinked inside of the DB directory
+    namespace stdfs = std::filesystem;
+    auto directory = stdfs::path(path());
+    for (auto const& entry : stdfs::directory_iterator(directory.parent_path()))
+        EXPECT_EQ(entry.path().filename().native().find(".overflow."), std::string::npos);
+
+    db.close();
+    EXPECT_TRUE(db.open(limited_config.c_str()));
+    check_values();
+#endif
+}
+
+/**
+ * RocksDB block caches, filters and index types are configured for the whole DB,
+ * and can be overridden per named collection. Profiles must reach the collections
+ * created later and the ones restored from disk, while malformed ones are rejected.
+ */
+TEST(db, rocksdb_table_profiles) {
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    if (!path())
+        return;
+
+    clear_environment();
+    auto make_config = [](char const* table, char const* collections) {
+        return fmt::format( //
+            R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{)"
+            R"("BlockBasedTableOptions": {{{}}}, "Collections": {{{}}}}}}}}})",
+            path(),
+            table,
+            collections);
+    };
+    auto profiled_config = make_config( //
+        R"("block_cache": "LRUCache", "block_cache_size": "16MB", "bloom_bits_per_key": 10,)"
+        R"("partition_filters": true, "cache_index_and_filter_blocks": true)",
+        R"("hot": {"CFOptions": {"memtable_whole_key_filtering": true},)"
+        R"(         "BlockBasedTableOptions": {"block_size": 4096, "data_block_hash_index": true}},)"
+        R"("cold": {"CFOptions": {"optimize_filters_for_hits": true},)"
+        R"(          "BlockBasedTableOptions": {"block_cache": "HyperClockCache", "block_cache_size": "4MB",)"
+        R"(                                     "index_type": "kBinarySearchWithFirstKey"}})");
+
+    constexpr ustore_key_t keys_count = 1000;
+    auto fill = [](blobs_collection_t& collection) {
+        for (ustore_key_t key = 0; key != keys_count; ++key)
+            EXPECT_TRUE(collection[key].assign(value_view_t(reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key))));
+    };
+    auto check = [](blobs_collection_t& collection) {
+        for (ustore_key_t key = 0; key != keys_count; ++key) {
+            auto value = collection[key].value();
+            EXPECT_TRUE(value);
+            EXPECT_EQ(*value, value_view_t(reinterpret_cast<ustore_bytes_cptr_t>(&key), sizeof(key)));
+        }
+        EXPECT_FALSE(*collection[keys_count].present());
+    };
+
+    // Collections with and without profiles, created after opening
+    {
+        database_t db;
+        EXPECT_TRUE(db.open(profiled_config.c_str()));
+        for (char const* name : {"hot", "cold", "plain"}) {
+            blobs_collection_t collection = *db.create(name);
+            fill(collection);
+            check(collection);
+        }
+        db.close();
+    }
+
+    // The same collections restored from disk, with every profile applied again
+    {
+        database_t db;
+        EXPECT_TRUE(db.open(profiled_config.c_str()));
+        for (char const* name : {"hot", "cold", "plain"}) {
+            EXPECT_TRUE(*db.contains(name));
+            blobs_collection_t collection = *db.find(name);
+            check(collection);
+        }
+        db.close();
+    }
+
+    // Malformed DB-wide options fail the opening
+    for (char const* table : {R"("block_cache": "FIFOCache", "block_cache_size": "1MB")",
+                              R"("block_cache_size": "a lot")",
+                              R"("index_type": "kUnknownSearch")"}) {
+        database_t db;
+        EXPECT_FALSE(db.open(make_config(table, "").c_str()));
+    }
+
+    // Malformed profiles fail the collections, that they describe
+    {
+        database_t db;
+        EXPECT_TRUE(db.open(make_config( //
+                                "",
+                                R"("broken": {"BlockBasedTableOptions": {"index_type": "kUnknownSearch"}})")
+                                .c_str()));
+        EXPECT_FALSE(db.create("broken"));
+        blobs_collection_t collection = *db.create("healthy");
+        fill(collection);
+        check(collection);
+    }
+#endif
+}
+
+/**
+ * Databases with the legacy native-endian "i64" comparator must be refused with a hint
+ * to migrate them, and the migrated copy must keep every collection, value and the
+ * signed order of keys, that differs from the order of their little-endian bytes.
+ */
+TEST(db, rocksdb_migrate_legacy_keys) {
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    if (!path())
+        return;
+
+    namespace stdfs = std::filesystem;
+    auto legacy_directory = stdfs::temp_directory_path() / "ustore_rocksdb_legacy";
+    stdfs::remove_all(legacy_directory);
+    std::vector<ustore_key_t> keys {256, -1, 1ll << 40, 0, -(1ll << 40), 1, -256, 255};
+    auto value_of = [](ustore_key_t key, char const* collection) {
+        return fmt::format("{}:{}", collection, key);
+    };
+
+    // Write the old layout directly, as older versions did
+    {
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        options.create_missing_column_families = true;
+        options.comparator = legacy_key_comparator();
+        rocksdb::ColumnFamilyOptions cf_options;
+        cf_options.comparator = legacy_key_comparator();
+        std::vector<rocksdb::ColumnFamilyDescriptor> descriptors {
+            {rocksdb::kDefaultColumnFamilyName, cf_options},
+            {"named", cf_options},
+        };
+        rocksdb::DB* legacy_ptr = nullptr;
+        std::vector<rocksdb::ColumnFamilyHandle*> columns;
+        EXPECT_TRUE(rocksdb::DB::Open(options, legacy_directory.native(), descriptors, &columns, &legacy_ptr).ok());
+        std::unique_ptr<rocksdb::DB> legacy {legacy_ptr};
+        for (ustore_key_t key : keys) {
+            encoded_key_gt<native_key_encoding_t> key_bytes {key};
+            rocksdb::Slice key_slice {key_bytes.bytes, sizeof(key_bytes.bytes)};
+            EXPECT_TRUE(legacy->Put(rocksdb::WriteOptions(), columns[0], key_slice, value_of(key, "main")).ok());
+            EXPECT_TRUE(legacy->Put(rocksdb::WriteOptions(), columns[1], key_slice, value_of(key, "named")).ok());
+        }
+        for (auto column : columns)
+            legacy->DestroyColumnFamilyHandle(column);
+    }
 
-    EXPECT_TRUE(db.transact());
-    transaction_t txn = *db.transact();
+    {
+        auto legacy_config = fmt::format(R"({{"version": "1.0", "directory": "{}"}})", legacy_directory.native());
+        database_t db;
+        status_t status = db.open(legacy_config.c_str());
+        EXPECT_FALSE(status);
+        EXPECT_NE(std::string(status.message() ? status.message() : "").find("ustore_rocksdb_migrate"),
+                  std::string::npos);
+    }
 
-    triplet_t triplet;
-    auto txn_ref = txn[triplet.keys];
+    clear_environment();
+    std::vector<std::string> migrated_names;
+    auto report = [&](std::string const& name, std::size_t migrated) {
+        migrated_names.push_back(name);
+        EXPECT_EQ(migrated, keys.size());
+    };
+    rocksdb::Status migration = migrate_rocksdb(legacy_directory.native(), path(), report);
+    EXPECT_TRUE(migration.ok()) << migration.ToString();
+    EXPECT_EQ(migrated_names.size(), 2ul);
 
-    EXPECT_TRUE(txn_ref.assign(triplet.contents()));
-    auto maybe_sequence_number = txn.sequenced_commit();
-    EXPECT_TRUE(maybe_sequence_number);
-    auto current_sequence_number = *maybe_sequence_number;
-    EXPECT_GT(current_sequence_number, 0);
-    EXPECT_TRUE(txn.reset());
-#if 0
-    auto previous_sequence_number = current_sequence_number;
-    EXPECT_TRUE(txn_ref.value());
-    maybe_sequence_number = txn.sequenced_commit();
-    EXPECT_TRUE(maybe_sequence_number);
-    current_sequence_number = *maybe_sequence_number;
-    EXPECT_EQ(current_sequence_number, previous_sequence_number);
-    EXPECT_TRUE(txn.reset());
+    // Running again over the migrated copy is refused
+    EXPECT_FALSE(migrate_rocksdb(legacy_directory.native(), path(), report).ok());
 
-    previous_sequence_number = current_sequence_number;
-    EXPECT_TRUE(txn_ref.assign(triplet.contents()));
-    maybe_sequence_number = txn.sequenced_commit();
-    EXPECT_TRUE(maybe_sequence_number);
-    current_sequence_number = *maybe_sequence_number;
-    EXPECT_GT(current_sequence_number, previous_sequence_number);
+    std::vector<ustore_key_t> sorted_keys(keys);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t main = db.main();
+    blobs_collection_t named = *db["named"];
+    for (auto [collection, name] : {std::make_pair(&main, "main"), std::make_pair(&named, "named")}) {
+        keys_stream_t stream(db, *collection, 3);
+        EXPECT_TRUE(stream.seek_to_first());
+        std::vector<ustore_key_t> scanned;
+        for (; !stream.is_end(); ++stream)
+            scanned.push_back(stream.key());
+        EXPECT_EQ(scanned, sorted_keys);
+
+        for (ustore_key_t key : keys) {
+            auto value = (*collection)[key].value();
+            EXPECT_TRUE(value);
+            std::string expected = value_of(key, name);
+            EXPECT_EQ(*value, value_view_t(expected.data(), expected.size()));
+        }
+    }
+    stdfs::remove_all(legacy_directory);
 #endif
 }
 
@@ -2234,6 +4285,656 @@ TEST(db, vectors) {
     EXPECT_EQ(found_keys[1], ustore_key_t('b'));
 }
 
+/**
+ * Vectors, added in batches, must be linked into a graph, that finds most of the
+ * exact nearest neighbors, and a search by another metric must fall back to an exact full scan.
+ */
+TEST(db, vectors_graph_recall) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t dims_k = 24;
+    constexpr std::size_t count_k = 2048;
+    constexpr std::size_t batch_k = 256;
+    constexpr ustore_length_t neighbors_k = 10;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    std::vector<float> vectors(count_k * dims_k);
+    for (float& scalar : vectors)
+        scalar = distribution(generator);
+    std::vector<ustore_key_t> keys(count_k);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    arena_t arena(db);
+    status_t status;
+    for (std::size_t batch_begin = 0; batch_begin != count_k; batch_begin += batch_k) {
+        float* vector_first_begin = &vectors[batch_begin * dims_k];
+        ustore_vectors_write_t write {};
+        write.db = db;
+        write.arena = arena.member_ptr();
+        write.error = status.member_ptr();
+        write.dimensions = dims_k;
+        write.keys = &keys[batch_begin];
+        write.keys_stride = sizeof(ustore_key_t);
+        write.vectors_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+        write.vectors_stride = sizeof(float) * dims_k;
+        write.tasks_count = batch_k;
+        write.metric = ustore_vector_metric_cos_k;
+        write.connectivity = 8;
+        ustore_vectors_write(&write);
+        EXPECT_TRUE(status);
+    }
+
+    auto cos = [&](float const* a, float const* b) {
+        float ab = 0, aa = 0, bb = 0;
+        for (std::size_t i = 0; i != dims_k; ++i)
+            ab += a[i] * b[i], aa += a[i] * a[i], bb += b[i] * b[i];
+        return ab / std::sqrt(aa * bb);
+    };
+
+    constexpr std::size_t queries_k = 32;
+    std::vector<ustore_length_t> limits(queries_k, neighbors_k);
+    float* query_first_begin = &vectors[0];
+    ustore_length_t* found_counts = nullptr;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_float_t* found_metrics = nullptr;
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.arena = arena.member_ptr();
+    search.error = status.member_ptr();
+    search.dimensions = dims_k;
+    search.tasks_count = queries_k;
+    search.match_counts_limits = limits.data();
+    search.match_counts_limits_stride = sizeof(ustore_length_t);
+    search.queries_starts = (ustore_bytes_cptr_t*)&query_first_begin;
+    search.queries_stride = sizeof(float) * dims_k;
+    search.match_counts = &found_counts;
+    search.match_offsets = &found_offsets;
+    search.match_keys = &found_keys;
+    search.match_metrics = &found_metrics;
+    search.metric = ustore_vector_metric_cos_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+
+    std::size_t recalled = 0;
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        float const* query = &vectors[query_idx * dims_k];
+        std::vector<ustore_key_t> exact(keys);
+        std::partial_sort(exact.begin(), exact.begin() + neighbors_k, exact.end(), [&](ustore_key_t a, ustore_key_t b) {
+            return cos(query, &vectors[a * dims_k]) > cos(query, &vectors[b * dims_k]);
+        });
+        EXPECT_EQ(found_counts[query_idx], neighbors_k);
+        EXPECT_EQ(found_keys[found_offsets[query_idx]], static_cast<ustore_key_t>(query_idx));
+        ustore_key_t const* found = found_keys + found_offsets[query_idx];
+        for (std::size_t i = 0; i != found_counts[query_idx]; ++i)
+            recalled += std::count(exact.begin(), exact.begin() + neighbors_k, found[i]);
+    }
+    EXPECT_GE(recalled, queries_k * neighbors_k * 9 / 10);
+
+    search.metric = ustore_vector_metric_l2_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        EXPECT_EQ(found_keys[found_offsets[query_idx]], static_cast<ustore_key_t>(query_idx));
+        EXPECT_EQ(found_metrics[found_offsets[query_idx]], 0.f);
+    }
+
+    // Full scans compare the originals, so the metrics must be exact
+    search.metric = ustore_vector_metric_dot_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        float const* query = &vectors[query_idx * dims_k];
+        for (std::size_t i = 0; i != found_counts[query_idx]; ++i) {
+            float const* match = &vectors[found_keys[found_offsets[query_idx] + i] * dims_k];
+            float dot = std::inner_product(query, query + dims_k, match, 0.f);
+            EXPECT_NEAR(found_metrics[found_offsets[query_idx] + i], dot, 1e-4);
+        }
+    }
+}
+
+/**
+ * Small batches of vectors, written into the same collection from many threads without
+ * a transaction, must not lose each other's links or overwrite the entry point of the graph,
+ * so every vector stays reachable and is found by a search for itself.
+ */
+TEST(db, vectors_concurrent_writes) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t dims_k = 24;
+    constexpr std::size_t threads_k = 4;
+    constexpr std::size_t count_k = 1024;
+    constexpr std::size_t batch_k = 8;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    std::vector<float> vectors(count_k * dims_k);
+    for (float& scalar : vectors)
+        scalar = distribution(generator);
+    std::vector<ustore_key_t> keys(count_k);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    // Every thread writes an interleaved share of the batches
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_k; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            arena_t arena(db);
+            for (std::size_t batch_begin = thread_idx * batch_k; batch_begin < count_k;
+                 batch_begin += threads_k * batch_k) {
+                status_t status;
+                float* vector_first_begin = &vectors[batch_begin * dims_k];
+                ustore_vectors_write_t write {};
+                write.db = db;
+                write.arena = arena.member_ptr();
+                write.error = status.member_ptr();
+                write.dimensions = dims_k;
+                write.keys = &keys[batch_begin];
+                write.keys_stride = sizeof(ustore_key_t);
+                write.vectors_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+                write.vectors_stride = sizeof(float) * dims_k;
+                write.tasks_count = batch_k;
+                write.metric = ustore_vector_metric_cos_k;
+                write.connectivity = 8;
+                ustore_vectors_write(&write);
+                EXPECT_TRUE(status);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    arena_t arena(db);
+    status_t status;
+    std::vector<ustore_length_t> limits(count_k, 1);
+    float* query_first_begin = &vectors[0];
+    ustore_length_t* found_counts = nullptr;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_float_t* found_metrics = nullptr;
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.arena = arena.member_ptr();
+    search.error = status.member_ptr();
+    search.dimensions = dims_k;
+    search.tasks_count = count_k;
+    search.match_counts_limits = limits.data();
+    search.match_counts_limits_stride = sizeof(ustore_length_t);
+    search.queries_starts = (ustore_bytes_cptr_t*)&query_first_begin;
+    search.queries_stride = sizeof(float) * dims_k;
+    search.match_counts = &found_counts;
+    search.match_offsets = &found_offsets;
+    search.match_keys = &found_keys;
+    search.match_metrics = &found_metrics;
+    search.metric = ustore_vector_metric_cos_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+
+    std::size_t found_themselves = 0;
+    for (std::size_t query_idx = 0; status && query_idx != count_k; ++query_idx)
+        found_themselves += found_counts[query_idx] &&
+                            found_keys[found_offsets[query_idx]] == static_cast<ustore_key_t>(query_idx);
+    EXPECT_GE(found_themselves, count_k * 99 / 100);
+}
+
+/**
+ * Queries of a batch, that can't use the graph, share the scans of their collections.
+ * Their results must not depend on the neighbors in the batch, whatever their collections and limits.
+ */
+TEST(db, vectors_batched_scans) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    // Enough `i8` vectors to span several fetched blocks and partial tiles
+    constexpr std::size_t dims_k = 16;
+    constexpr std::size_t count_k = 1500;
+    constexpr std::size_t queries_k = 24;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(-127, 127);
+    std::vector<std::int8_t> vectors(count_k * dims_k);
+    for (std::int8_t& scalar : vectors)
+        scalar = static_cast<std::int8_t>(distribution(generator));
+    std::vector<ustore_key_t> keys(count_k);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    std::vector<ustore_collection_t> collections {db.main()};
+    if (ustore_supports_named_collections_k)
+        collections.push_back(*db.create("vectors"));
+
+    arena_t arena(db);
+    status_t status;
+    std::int8_t* vector_first_begin = vectors.data();
+    for (ustore_collection_t collection : collections) {
+        ustore_vectors_write_t write {};
+        write.db = db;
+        write.arena = arena.member_ptr();
+        write.error = status.member_ptr();
+        write.dimensions = dims_k;
+        write.scalar_type = ustore_vector_scalar_i8_k;
+        write.collections = &collection;
+        write.keys = keys.data();
+        write.keys_stride = sizeof(ustore_key_t);
+        write.vectors_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+        write.vectors_stride = dims_k;
+        write.tasks_count = count_k;
+        write.metric = ustore_vector_metric_cos_k;
+        ustore_vectors_write(&write);
+        EXPECT_TRUE(status);
+    }
+
+    // Interleave the collections and vary the limits, including empty ones
+    std::vector<ustore_collection_t> queries_collections(queries_k);
+    std::vector<ustore_length_t> limits(queries_k);
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        queries_collections[query_idx] = collections[query_idx % collections.size()];
+        limits[query_idx] = static_cast<ustore_length_t>(query_idx % 7);
+    }
+
+    ustore_length_t* found_counts = nullptr;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_float_t* found_metrics = nullptr;
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.error = status.member_ptr();
+    search.dimensions = dims_k;
+    search.scalar_type = ustore_vector_scalar_i8_k;
+    search.metric = ustore_vector_metric_l2_k;
+    search.metric_threshold = std::numeric_limits<ustore_float_t>::lowest();
+    search.match_counts = &found_counts;
+    search.match_offsets = &found_offsets;
+    search.match_keys = &found_keys;
+    search.match_metrics = &found_metrics;
+
+    arena_t batch_arena(db);
+    search.arena = batch_arena.member_ptr();
+    search.tasks_count = queries_k;
+    search.collections = queries_collections.data();
+    search.collections_stride = sizeof(ustore_collection_t);
+    search.match_counts_limits = limits.data();
+    search.match_counts_limits_stride = sizeof(ustore_length_t);
+    search.queries_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+    search.queries_stride = dims_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+
+    // Outputs of the batch stay in its arena, while single queries overwrite the pointers
+    ustore_length_t const* batch_counts = found_counts;
+    ustore_length_t const* batch_offsets = found_offsets;
+    ustore_key_t const* batch_keys_all = found_keys;
+    ustore_float_t const* batch_metrics_all = found_metrics;
+    search.arena = arena.member_ptr();
+    search.tasks_count = 1;
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        ustore_length_t const batch_count = batch_counts[query_idx];
+        ustore_key_t const* batch_keys = batch_keys_all + batch_offsets[query_idx];
+        ustore_float_t const* batch_metrics = batch_metrics_all + batch_offsets[query_idx];
+        EXPECT_EQ(batch_count, limits[query_idx]);
+        if (batch_count)
+            EXPECT_EQ(batch_keys[0], static_cast<ustore_key_t>(query_idx));
+
+        std::int8_t* query_begin = &vectors[query_idx * dims_k];
+        search.collections = &queries_collections[query_idx];
+        search.match_counts_limits = &limits[query_idx];
+        search.queries_starts = (ustore_bytes_cptr_t*)&query_begin;
+        ustore_vectors_search(&search);
+        EXPECT_TRUE(status);
+        EXPECT_EQ(found_counts[0], batch_count);
+        for (std::size_t i = 0; i != std::min(found_counts[0], batch_count); ++i) {
+            EXPECT_EQ(found_keys[i], batch_keys[i]);
+            EXPECT_EQ(found_metrics[i], batch_metrics[i]);
+        }
+    }
+}
+
+/**
+ * Half-precision vectors with components far outside of [-1, 1] must be decoded
+ * and quantized without saturation, keeping the neighbors and the metrics accurate.
+ */
+TEST(db, vectors_half_precision) {
+    constexpr std::size_t dims_k = 32;
+    constexpr std::size_t count_k = 256;
+    constexpr std::size_t queries_k = 16;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(-255, 255);
+    // Quarters below 64 are exactly representable in both `f16` and `bf16`
+    std::vector<float> vectors(count_k * dims_k);
+    for (float& scalar : vectors)
+        scalar = distribution(generator) / 4.f;
+    std::vector<ustore_key_t> keys(count_k);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    auto to_f16 = [](float scalar) -> std::uint16_t {
+        std::uint32_t bits;
+        std::memcpy(&bits, &scalar, sizeof(bits));
+        if (scalar == 0)
+            return 0;
+        return ((bits >> 16) & 0x8000u) | ((((bits >> 23) & 0xFFu) - 112u) << 10) | ((bits >> 13) & 0x3FFu);
+    };
+    auto to_bf16 = [](float scalar) -> std::uint16_t {
+        std::uint32_t bits;
+        std::memcpy(&bits, &scalar, sizeof(bits));
+        return bits >> 16;
+    };
+
+    for (ustore_vector_scalar_t scalar_type : {ustore_vector_scalar_f16_k, ustore_vector_scalar_bf16_k}) {
+        clear_environment();
+        database_t db;
+        EXPECT_TRUE(db.open(config().c_str()));
+
+        std::vector<std::uint16_t> halves(vectors.size());
+        std::transform(vectors.begin(), vectors.end(), halves.begin(), [&](float scalar) {
+            return scalar_type == ustore_vector_scalar_f16_k ? to_f16(scalar) : to_bf16(scalar);
+        });
+
+        arena_t arena(db);
+        status_t status;
+        std::uint16_t* vector_first_begin = halves.data();
+        ustore_vectors_write_t write {};
+        write.db = db;
+        write.arena = arena.member_ptr();
+        write.error = status.member_ptr();
+        write.dimensions = dims_k;
+        write.scalar_type = scalar_type;
+        write.keys = keys.data();
+        write.keys_stride = sizeof(ustore_key_t);
+        write.vectors_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+        write.vectors_stride = sizeof(std::uint16_t) * dims_k;
+        write.tasks_count = count_k;
+        write.metric = ustore_vector_metric_cos_k;
+        ustore_vectors_write(&write);
+        EXPECT_TRUE(status);
+
+        ustore_length_t limit = 2;
+        ustore_length_t* found_counts = nullptr;
+        ustore_length_t* found_offsets = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_float_t* found_metrics = nullptr;
+        ustore_vectors_search_t search {};
+        search.db = db;
+        search.arena = arena.member_ptr();
+        search.error = status.member_ptr();
+        search.dimensions = dims_k;
+        search.scalar_type = scalar_type;
+        search.tasks_count = queries_k;
+        search.match_counts_limits = &limit;
+        search.queries_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+        search.queries_stride = sizeof(std::uint16_t) * dims_k;
+        search.match_counts = &found_counts;
+        search.match_offsets = &found_offsets;
+        search.match_keys = &found_keys;
+        search.match_metrics = &found_metrics;
+
+        auto exact = [](ustore_vector_metric_t metric, float const* a, float const* b) {
+            float ab = 0, aa = 0, bb = 0, l2 = 0;
+            for (std::size_t i = 0; i != dims_k; ++i)
+                ab += a[i] * b[i], aa += a[i] * a[i], bb += b[i] * b[i], l2 += (a[i] - b[i]) * (a[i] - b[i]);
+            return metric == ustore_vector_metric_cos_k ? ab / std::sqrt(aa * bb)
+                   : metric == ustore_vector_metric_dot_k ? ab
+                                                          : std::sqrt(l2);
+        };
+
+        // The graph compares quantized copies, while full scans compare the originals
+        for (auto metric : {ustore_vector_metric_cos_k, ustore_vector_metric_dot_k, ustore_vector_metric_l2_k}) {
+            search.metric = metric;
+            ustore_vectors_search(&search);
+            EXPECT_TRUE(status);
+            for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+                ustore_length_t offset = found_offsets[query_idx];
+                EXPECT_EQ(found_counts[query_idx], limit);
+                if (metric != ustore_vector_metric_dot_k)
+                    EXPECT_EQ(found_keys[offset], static_cast<ustore_key_t>(query_idx));
+                for (std::size_t i = 0; i != found_counts[query_idx]; ++i) {
+                    float const* match = &vectors[found_keys[offset + i] * dims_k];
+                    float expected = exact(metric, &vectors[query_idx * dims_k], match);
+                    float tolerance = metric == ustore_vector_metric_cos_k ? 1e-2f : 1e-4f * std::max(1.f, expected);
+                    EXPECT_NEAR(found_metrics[offset + i], expected, tolerance);
+                }
+            }
+        }
+
+        // Vectors of another scalar type can't be mixed into the same collection
+        write.scalar_type = ustore_vector_scalar_f32_k;
+        write.vectors_stride = sizeof(float) * dims_k;
+        write.tasks_count = 1;
+        ustore_vectors_write(&write);
+        EXPECT_FALSE(status);
+        status = status_t {};
+    }
+}
+
+/**
+ * Collections of vectors, written as plain blobs by older versions, have no index,
+ * but must still be searchable with full scans over the originals.
+ */
+TEST(db, vectors_without_index) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    blobs_collection_t main = db.main();
+
+    constexpr std::size_t dims_k = 3;
+    float vectors[3][dims_k] = {
+        {0.3, 0.1, 0.2},
+        {0.35, 0.1, 0.2},
+        {-0.1, 0.2, 0.5},
+    };
+    for (ustore_key_t key = 0; key != 3; ++key)
+        EXPECT_TRUE(main[key].assign(value_view_t((byte_t const*)vectors[key], sizeof(vectors[key]))));
+
+    arena_t arena(db);
+    status_t status;
+    float* query_first_begin = &vectors[2][0];
+    ustore_length_t max_results = 2;
+    ustore_length_t* found_results = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_float_t* found_distances = nullptr;
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.arena = arena.member_ptr();
+    search.error = status.member_ptr();
+    search.dimensions = dims_k;
+    search.tasks_count = 1;
+    search.match_counts_limits = &max_results;
+    search.queries_starts = (ustore_bytes_cptr_t*)&query_first_begin;
+    search.queries_stride = sizeof(float) * dims_k;
+    search.match_counts = &found_results;
+    search.match_keys = &found_keys;
+    search.match_metrics = &found_distances;
+    search.metric = ustore_vector_metric_l2_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+
+    EXPECT_EQ(found_results[0], max_results);
+    EXPECT_EQ(found_keys[0], 2);
+    EXPECT_NEAR(found_distances[0], 0, 1e-6);
+    EXPECT_EQ(found_keys[1], 0);
+}
+
+/**
+ * Vectors in IVF-PQ collections must be found by comparing the query to their codes in the
+ * closest inverted lists, and overwritten vectors must move between lists without duplicates.
+ * Until the collection is large enough to train the codebooks, searches compare the originals.
+ */
+TEST(db, vectors_ivfpq) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t dims_k = 24;
+    constexpr std::size_t count_k = 2048;
+    constexpr std::size_t batch_k = 512;
+    constexpr ustore_length_t lists_k = 16;
+    constexpr ustore_length_t neighbors_k = 10;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    std::vector<float> vectors(count_k * dims_k);
+    for (float& scalar : vectors)
+        scalar = distribution(generator);
+    std::vector<ustore_key_t> keys(count_k);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    // The second batch reaches 39 vectors per list and trains the codebooks for all of them
+    arena_t arena(db);
+    status_t status;
+    float* vector_first_begin = nullptr;
+    ustore_vectors_write_t write {};
+    write.db = db;
+    write.arena = arena.member_ptr();
+    write.error = status.member_ptr();
+    write.dimensions = dims_k;
+    write.keys_stride = sizeof(ustore_key_t);
+    write.vectors_starts = (ustore_bytes_cptr_t*)&vector_first_begin;
+    write.vectors_stride = sizeof(float) * dims_k;
+    write.metric = ustore_vector_metric_l2_k;
+    write.index = ustore_vector_index_ivfpq_k;
+    write.lists = lists_k;
+    write.subspaces = dims_k;
+
+    // Degenerate indexes are rejected
+    ustore_key_t wide_key = ustore_key_t(1) << 47;
+    vector_first_begin = &vectors[0];
+    write.keys = &wide_key;
+    write.tasks_count = 1;
+    ustore_vectors_write(&write);
+    EXPECT_FALSE(status);
+    status.release_error();
+    write.keys = &keys[0];
+    write.lists = 1u << 16;
+    ustore_vectors_write(&write);
+    EXPECT_FALSE(status);
+    status.release_error();
+    write.lists = lists_k;
+
+    auto l2 = [&](float const* a, float const* b) {
+        float sum = 0;
+        for (std::size_t i = 0; i != dims_k; ++i)
+            sum += (a[i] - b[i]) * (a[i] - b[i]);
+        return std::sqrt(sum);
+    };
+
+    constexpr std::size_t queries_k = 32;
+    std::vector<ustore_length_t> limits(queries_k, neighbors_k);
+    float* query_first_begin = &vectors[0];
+    ustore_length_t* found_counts = nullptr;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_float_t* found_metrics = nullptr;
+    ustore_vectors_search_t search {};
+    search.db = db;
+    search.arena = arena.member_ptr();
+    search.error = status.member_ptr();
+    search.dimensions = dims_k;
+    search.tasks_count = queries_k;
+    search.match_counts_limits = limits.data();
+    search.match_counts_limits_stride = sizeof(ustore_length_t);
+    search.queries_starts = (ustore_bytes_cptr_t*)&query_first_begin;
+    search.queries_stride = sizeof(float) * dims_k;
+    search.match_counts = &found_counts;
+    search.match_offsets = &found_offsets;
+    search.match_keys = &found_keys;
+    search.match_metrics = &found_metrics;
+    search.metric = ustore_vector_metric_l2_k;
+
+    for (std::size_t batch_begin = 0; batch_begin != count_k; batch_begin += batch_k) {
+        vector_first_begin = &vectors[batch_begin * dims_k];
+        write.keys = &keys[batch_begin];
+        write.tasks_count = batch_k;
+        ustore_vectors_write(&write);
+        EXPECT_TRUE(status);
+        if (batch_begin)
+            continue;
+
+        // Untrained collections are searched exactly, even with a single probe
+        search.probes = 1;
+        ustore_vectors_search(&search);
+        EXPECT_TRUE(status);
+        for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+            float const* query = &vectors[query_idx * dims_k];
+            EXPECT_EQ(found_counts[query_idx], neighbors_k);
+            EXPECT_EQ(found_keys[found_offsets[query_idx]], static_cast<ustore_key_t>(query_idx));
+            for (std::size_t i = 0; i != found_counts[query_idx]; ++i) {
+                float const* match = &vectors[found_keys[found_offsets[query_idx] + i] * dims_k];
+                EXPECT_NEAR(found_metrics[found_offsets[query_idx] + i], l2(query, match), 1e-4);
+            }
+        }
+    }
+
+    auto count_recalled = [&] {
+        std::size_t recalled = 0;
+        for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+            float const* query = &vectors[query_idx * dims_k];
+            std::vector<ustore_key_t> exact(keys);
+            auto closer = [&](ustore_key_t a, ustore_key_t b) {
+                return l2(query, &vectors[a * dims_k]) < l2(query, &vectors[b * dims_k]);
+            };
+            std::partial_sort(exact.begin(), exact.begin() + neighbors_k, exact.end(), closer);
+            ustore_key_t const* found = found_keys + found_offsets[query_idx];
+            for (std::size_t i = 0; i != found_counts[query_idx]; ++i)
+                recalled += std::count(exact.begin(), exact.begin() + neighbors_k, found[i]);
+        }
+        return recalled;
+    };
+
+    // Probing every list only loses the precision of the codes
+    search.probes = lists_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    std::size_t recalled_exhaustively = count_recalled();
+    EXPECT_GE(recalled_exhaustively, queries_k * neighbors_k * 9 / 10);
+    for (std::size_t query_idx = 0; query_idx != queries_k; ++query_idx) {
+        float const* query = &vectors[query_idx * dims_k];
+        EXPECT_EQ(found_counts[query_idx], neighbors_k);
+        EXPECT_EQ(found_keys[found_offsets[query_idx]], static_cast<ustore_key_t>(query_idx));
+        for (std::size_t i = 0; i != found_counts[query_idx]; ++i) {
+            float const* match = &vectors[found_keys[found_offsets[query_idx] + i] * dims_k];
+            EXPECT_NEAR(found_metrics[found_offsets[query_idx] + i], l2(query, match), 0.2);
+        }
+    }
+
+    search.probes = 1;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    EXPECT_LT(count_recalled(), recalled_exhaustively);
+
+    // Overwrite the first vector with a copy of the second one
+    vector_first_begin = &vectors[dims_k];
+    write.keys = &keys[0];
+    write.tasks_count = 1;
+    ustore_vectors_write(&write);
+    EXPECT_TRUE(status);
+
+    ustore_length_t pair_limit = 2;
+    query_first_begin = &vectors[dims_k];
+    search.tasks_count = 1;
+    search.probes = lists_k;
+    search.match_counts_limits = &pair_limit;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    EXPECT_EQ(found_counts[0], pair_limit);
+    EXPECT_EQ(std::min(found_keys[0], found_keys[1]), 0);
+    EXPECT_EQ(std::max(found_keys[0], found_keys[1]), 1);
+    EXPECT_EQ(found_metrics[0], found_metrics[1]);
+
+    query_first_begin = &vectors[0];
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    EXPECT_NE(found_keys[0], 0);
+    EXPECT_NE(found_keys[1], 0);
+
+    // Other metrics fall back to full scans over the originals
+    search.metric = ustore_vector_metric_dot_k;
+    ustore_vectors_search(&search);
+    EXPECT_TRUE(status);
+    for (std::size_t i = 0; i != found_counts[0]; ++i) {
+        ustore_key_t key = found_keys[i] ? found_keys[i] : 1;
+        float const* match = &vectors[key * dims_k];
+        EXPECT_NEAR(found_metrics[i], std::inner_product(match, match + dims_k, &vectors[0], 0.f), 1e-4);
+    }
+}
+
 int main(int argc, char** argv) {
 
 #if defined(USTORE_FLIGHT_CLIENT)